@@ -78,6 +78,9 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	// Sharing the cores between the parallel loops, OpenBLAS and OpenCV (-threads, -blas_threads, -cv_threads, -nested_parallel)
+	LandmarkDetector::ThreadingPolicy::Apply(LandmarkDetector::ThreadingPolicy(arguments));
+
 	// Prepare for image reading
 	Utilities::ImageCapture image_reader;
 
@@ -155,6 +158,9 @@ int main(int argc, char **argv)
 		// Making sure the image is in uchar grayscale (some face detectors use RGB, landmark detector uses grayscale)
 		cv::Mat_<uchar> grayscale_image = image_reader.GetGrayFrame();
 
+		// Shared by the detection of all of the faces in the image
+		LandmarkDetector::FrameContext frame(rgb_image, grayscale_image);
+
 		// Detect faces in an image
 		std::vector<cv::Rect_<float> > face_detections;
 
@@ -176,7 +182,7 @@ int main(int argc, char **argv)
 			else
 			{
 				std::vector<float> confidences;
-				LandmarkDetector::DetectFacesMTCNN(face_detections, rgb_image, face_detector_mtcnn, confidences);
+				LandmarkDetector::DetectFacesMTCNN(face_detections, frame, face_detector_mtcnn, confidences);
 			}
 		}
 
@@ -187,7 +193,7 @@ int main(int argc, char **argv)
 		{
 
 			// if there are multiple detections go through them
-			bool success = LandmarkDetector::DetectLandmarksInImage(rgb_image, face_detections[face], face_model, det_parameters, grayscale_image);
+			bool success = LandmarkDetector::DetectLandmarksInImage(frame, face_detections[face], face_model, det_parameters);
 
 			// Estimate head pose and eye gaze				
 			cv::Vec6d pose_estimate = LandmarkDetector::GetPose(face_model, image_reader.fx, image_reader.fy, image_reader.cx, image_reader.cy);
@@ -210,7 +216,7 @@ int main(int argc, char **argv)
 			// Perform AU detection and HOG feature extraction, as this can be expensive only compute it if needed by output or visualization
 			if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs() || visualizer.vis_align || visualizer.vis_hog)
 			{
-				face_analyser.PredictStaticAUsAndComputeFeatures(rgb_image, face_model.detected_landmarks);
+				face_analyser.PredictStaticAUsAndComputeFeatures(frame, face_model.detected_landmarks);
 				face_analyser.GetLatestAlignedFace(sim_warped_img);
 				face_analyser.GetLatestHOG(hog_descriptor, num_hog_rows, num_hog_cols);
 			}
@@ -84,8 +84,14 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	// Sharing the cores between the parallel loops, OpenBLAS and OpenCV (-threads, -blas_threads, -cv_threads, -nested_parallel)
+	LandmarkDetector::ThreadingPolicy::Apply(LandmarkDetector::ThreadingPolicy(arguments));
+
 	LandmarkDetector::FaceModelParameters det_parameters(arguments);
 
+	// Optionally adapting the tracking quality to keep every frame within a deadline (-deadline <ms>)
+	LandmarkDetector::QualityController quality_controller(arguments);
+
 	// The modules that are being used for tracking
 	LandmarkDetector::CLNF face_model(det_parameters.model_location);
 	if (!face_model.loaded_successfully)
@@ -126,11 +132,15 @@ int main(int argc, char **argv)
 		while (!rgb_image.empty()) // this is not a for loop as we might also be reading from a webcam
 		{
 
+			quality_controller.BeginFrame(det_parameters);
+
 			// Reading the images
 			cv::Mat_<uchar> grayscale_image = sequence_reader.GetGrayFrame();
+			LandmarkDetector::FrameContext frame(rgb_image, grayscale_image);
 
 			// The actual facial landmark detection / tracking
-			bool detection_success = LandmarkDetector::DetectLandmarksInVideo(rgb_image, face_model, det_parameters, grayscale_image);
+			bool detection_success = LandmarkDetector::DetectLandmarksInVideo(frame, face_model, det_parameters);
+			quality_controller.StageDone("landmarks");
 
 			// Gaze tracking, absolute gaze direction
 			cv::Point3f gazeDirection0(0, 0, -1);
@@ -145,6 +155,15 @@ int main(int argc, char **argv)
 
 			// Work out the pose of the head from the tracked model
 			cv::Vec6d pose_estimate = LandmarkDetector::GetPose(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
+			quality_controller.StageDone("gaze and pose");
+
+			// Report when the quality changes to meet the deadline
+			LandmarkDetector::QualityController::QualityLevel quality_level = quality_controller.GetQualityLevel();
+			quality_controller.EndFrame();
+			if (quality_controller.GetQualityLevel() != quality_level)
+			{
+				INFO_STREAM("Quality changed to " << quality_controller.GetQualityDescription() << " (latency " << quality_controller.GetLatencyPercentile() << "ms)");
+			}
 
 			// Keeping track of FPS
 			fps_tracker.AddFrame();
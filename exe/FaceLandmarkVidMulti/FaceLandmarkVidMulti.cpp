@@ -144,6 +144,9 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	// Sharing the cores between the parallel loops, OpenBLAS and OpenCV (-threads, -blas_threads, -cv_threads, -nested_parallel)
+	LandmarkDetector::ThreadingPolicy::Apply(LandmarkDetector::ThreadingPolicy(arguments));
+
 	LandmarkDetector::FaceModelParameters det_params(arguments);
 	// This is so that the model would not try re-initialising itself
 	det_params.reinit_video_every = -1;
@@ -159,27 +162,34 @@ int main(int argc, char **argv)
 
 	int num_faces_max = 4;
 
-	LandmarkDetector::CLNF face_model(det_parameters[0].model_location);
+	// The model description is loaded once and shared by all of the face trackers
+	std::shared_ptr<LandmarkDetector::CLNFModel> landmark_model = std::make_shared<LandmarkDetector::CLNFModel>(det_parameters[0].model_location);
 
-	if (!face_model.loaded_successfully)
+	if (!landmark_model->loaded_successfully)
 	{
 		std::cout << "ERROR: Could not load the landmark detector" << std::endl;
 		return 1;
 	}
 
+	// The KDE responses of the mean shift are prepared before the trackers start sharing the model
+	landmark_model->PrecomputeKDE(det_parameters[0]);
+
 	// Loading the face detectors
-	face_model.face_detector_HAAR.load(det_parameters[0].haar_face_detector_location);
-	face_model.haar_face_detector_location = det_parameters[0].haar_face_detector_location;
-	face_model.face_detector_MTCNN.Read(det_parameters[0].mtcnn_face_detector_location);
-	face_model.mtcnn_face_detector_location = det_parameters[0].mtcnn_face_detector_location;
+	landmark_model->face_detector_HAAR.load(det_parameters[0].haar_face_detector_location);
+	landmark_model->haar_face_detector_location = det_parameters[0].haar_face_detector_location;
+	landmark_model->face_detector_MTCNN.Read(det_parameters[0].mtcnn_face_detector_location);
+	landmark_model->mtcnn_face_detector_location = det_parameters[0].mtcnn_face_detector_location;
 
 	// If can't find MTCNN face detector, default to HOG one
-	if (det_parameters[0].curr_face_detector == LandmarkDetector::FaceModelParameters::MTCNN_DETECTOR && face_model.face_detector_MTCNN.empty())
+	if (det_parameters[0].curr_face_detector == LandmarkDetector::FaceModelParameters::MTCNN_DETECTOR && landmark_model->face_detector_MTCNN.empty())
 	{
 		std::cout << "INFO: defaulting to HOG-SVM face detector" << std::endl;
 		det_parameters[0].curr_face_detector = LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR;
 	}
 
+	// The trackers only hold the tracking state, so creating them does not copy the model
+	LandmarkDetector::CLNF face_model(landmark_model);
+
 	face_models.reserve(num_faces_max);
 
 	face_models.push_back(face_model);
@@ -187,7 +197,7 @@ int main(int argc, char **argv)
 
 	for (int i = 1; i < num_faces_max; ++i)
 	{
-		face_models.push_back(face_model);
+		face_models.push_back(LandmarkDetector::CLNF(landmark_model));
 		active_models.push_back(false);
 		det_parameters.push_back(det_params);
 	}
@@ -232,6 +242,15 @@ int main(int argc, char **argv)
 
 		int frame_count = 0;
 
+		// The last known and predicted locations of the recently lost faces, and the number of detections since the whole frame was last scanned
+		std::vector<std::vector<cv::Rect_<float> > > lost_faces;
+		int detections_since_full_scan = 0;
+
+		// The face detection runs on a background thread (its detections used async_detection_delay frames later, straight away if 0),
+		// with the faces that were tracked at the time it was started
+		LandmarkDetector::FaceDetectorAsync face_detector_async;
+		std::vector<cv::Rect_<float> > faces_at_detection;
+
 		Utilities::RecorderOpenFaceParameters recording_params(arguments, true, sequence_reader.IsWebcam(),
 			sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, sequence_reader.fps);
 
@@ -239,6 +258,8 @@ int main(int argc, char **argv)
 		{
 			recording_params.setOutputGaze(false);
 		}
+		// In keyframe tracking flag the frames whose landmarks were propagated
+		recording_params.setOutputPropagated(det_parameters[0].keyframe_interval > 1);
 
 		Utilities::RecorderOpenFace open_face_rec(sequence_reader.name, recording_params, arguments);
 
@@ -263,6 +284,9 @@ int main(int argc, char **argv)
 			// Reading the images
 			cv::Mat_<uchar> grayscale_image = sequence_reader.GetGrayFrame();
 
+			// Shared by all of the trackers and the face analysis of this frame
+			LandmarkDetector::FrameContext frame(rgb_image, grayscale_image);
+
 			std::vector<cv::Rect_<float> > face_detections;
 
 			bool all_models_active = true;
@@ -274,24 +298,90 @@ int main(int argc, char **argv)
 				}
 			}
 
-			// Get the detections (every 8th frame and when there are free models available for tracking)
-			if (frame_count % 8 == 0 && !all_models_active)
+			face_detector_async.NextFrame();
+
+			// Start the detection (every 8th frame and when there are free models available for tracking)
+			if (frame_count % 8 == 0 && !all_models_active && !face_detector_async.Pending())
 			{
-				if (det_parameters[0].curr_face_detector == LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR)
+				// Recently lost faces are first looked for around where they were last seen, at a similar size, the whole frame is only scanned
+				// every few detections (to pick up new faces) or if none of them are found
+				bool roi_search = det_parameters[0].redetection_roi_scale > 0 && !lost_faces.empty()
+					&& (det_parameters[0].redetection_full_scan_every <= 0 || detections_since_full_scan + 1 < det_parameters[0].redetection_full_scan_every);
+
+				float min_width = -1;
+				float max_width = -1;
+				cv::Rect_<float> roi(0.0, 0.0, 1.0, 1.0);
+				if (roi_search)
+				{
+					std::vector<cv::Rect_<float> > expected_boxes;
+					for (size_t lost = 0; lost < lost_faces.size(); ++lost)
+					{
+						expected_boxes.insert(expected_boxes.end(), lost_faces[lost].begin(), lost_faces[lost].end());
+
+						float face_width = lost_faces[lost][0].width;
+						min_width = lost == 0 ? 0.5f * face_width : std::min(min_width, 0.5f * face_width);
+						max_width = lost == 0 ? 2.0f * face_width : std::max(max_width, 2.0f * face_width);
+					}
+					roi = LandmarkDetector::FaceSearchROI(expected_boxes, det_parameters[0].redetection_roi_scale, grayscale_image.size());
+				}
+
+				faces_at_detection.clear();
+				for (size_t model = 0; model < face_models.size(); ++model)
 				{
-					std::vector<float> confidences;
-					LandmarkDetector::DetectFacesHOG(face_detections, grayscale_image, face_models[0].face_detector_HOG, confidences);
+					if (active_models[model])
+					{
+						faces_at_detection.push_back(face_models[model].GetBoundingBox());
+					}
 				}
-				else if (det_parameters[0].curr_face_detector == LandmarkDetector::FaceModelParameters::HAAR_DETECTOR)
+
+				face_detector_async.Start(rgb_image, landmark_model, det_parameters[0], cv::Point(-1, -1), min_width, max_width, roi);
+			}
+
+			// Get the detections once they are due and finished (waiting for them only when detecting synchronously)
+			LandmarkDetector::FaceDetectorAsync::Result detection;
+			if (face_detector_async.Pending() && face_detector_async.FramesPending() >= det_parameters[0].async_detection_delay
+				&& face_detector_async.Collect(detection, det_parameters[0].async_detection_delay == 0))
+			{
+				face_detections = detection.regions;
+
+				if (detection.full_frame)
 				{
-					LandmarkDetector::DetectFaces(face_detections, grayscale_image, face_models[0].face_detector_HAAR);
+					detections_since_full_scan = 0;
+					lost_faces.clear();
 				}
 				else
 				{
-					std::vector<float> confidences;
-					LandmarkDetector::DetectFacesMTCNN(face_detections, rgb_image, face_models[0].face_detector_MTCNN, confidences);
+					detections_since_full_scan++;
+
+					// The lost faces that were found are no longer looked for
+					for (int lost = lost_faces.size() - 1; lost >= 0; --lost)
+					{
+						cv::Rect_<float> lost_roi = LandmarkDetector::FaceSearchROI(lost_faces[lost], det_parameters[0].redetection_roi_scale, grayscale_image.size());
+						for (size_t detection_ind = 0; detection_ind < face_detections.size(); ++detection_ind)
+						{
+							cv::Point2f centre((face_detections[detection_ind].x + face_detections[detection_ind].width / 2) / grayscale_image.cols,
+								(face_detections[detection_ind].y + face_detections[detection_ind].height / 2) / grayscale_image.rows);
+							if (lost_roi.contains(centre))
+							{
+								lost_faces.erase(lost_faces.begin() + lost);
+								break;
+							}
+						}
+					}
 				}
 
+				// The faces tracked when the detection was started are not new either (the trackers have moved on since)
+				for (int detection_ind = face_detections.size() - 1; detection_ind >= 0; --detection_ind)
+				{
+					for (size_t face = 0; face < faces_at_detection.size(); ++face)
+					{
+						if (IOU(faces_at_detection[face], face_detections[detection_ind]) > 0.5)
+						{
+							face_detections.erase(face_detections.begin() + detection_ind);
+							break;
+						}
+					}
+				}
 			}
 
 			// Keep only non overlapping detections (so as not to start tracking where the face is already tracked)
@@ -304,9 +394,17 @@ int main(int argc, char **argv)
 
 				bool detection_success = false;
 
-				// If the current model has failed more than 4 times in a row, remove it
+				// If the current model has failed more than 4 times in a row, remove it (remembering where it was lost)
 				if (face_models[model].failures_in_a_row > 4)
 				{
+					if (active_models[model] && face_models[model].last_face_box.width > 0)
+					{
+						std::vector<cv::Rect_<float> > lost_face;
+						lost_face.push_back(face_models[model].last_face_box);
+						lost_face.push_back(face_models[model].predicted_face_box);
+						lost_faces.push_back(lost_face);
+					}
+
 					active_models[model] = false;
 					face_models[model].Reset();
 				}
@@ -327,7 +425,7 @@ int main(int argc, char **argv)
 
 							// This ensures that a wider window is used for the initial landmark localisation
 							face_models[model].detection_success = false;
-							detection_success = LandmarkDetector::DetectLandmarksInVideo(rgb_image, face_detections[detection_ind], face_models[model], det_parameters[model], grayscale_image);
+							detection_success = LandmarkDetector::DetectLandmarksInVideo(frame, face_detections[detection_ind], face_models[model], det_parameters[model]);
 
 							// This activates the model
 							active_models[model] = true;
@@ -341,7 +439,7 @@ int main(int argc, char **argv)
 				else
 				{
 					// The actual facial landmark detection / tracking
-					detection_success = LandmarkDetector::DetectLandmarksInVideo(rgb_image, face_models[model], det_parameters[model], grayscale_image);
+					detection_success = LandmarkDetector::DetectLandmarksInVideo(frame, face_models[model], det_parameters[model]);
 				}
 			}
 
@@ -354,6 +452,30 @@ int main(int argc, char **argv)
 
 			visualizer.SetImage(rgb_image, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
 
+			// Perform AU detection and HOG feature extraction for all of the tracked faces at once (the AUs of all of them are a single matrix product),
+			// as this can be expensive only compute it if needed by output or visualization
+			std::vector<FaceAnalysis::FaceAnalyser::StaticFaceAnalysis> face_analyses(face_models.size());
+			if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs() || visualizer.vis_align || visualizer.vis_hog)
+			{
+				std::vector<cv::Mat_<float> > active_landmarks;
+				std::vector<size_t> active_ids;
+				for (size_t model = 0; model < face_models.size(); ++model)
+				{
+					if (active_models[model])
+					{
+						active_landmarks.push_back(face_models[model].detected_landmarks);
+						active_ids.push_back(model);
+					}
+				}
+
+				std::vector<FaceAnalysis::FaceAnalyser::StaticFaceAnalysis> active_analyses;
+				face_analyser.PredictStaticAUsAndComputeFeatures(frame, active_landmarks, active_analyses);
+				for (size_t i = 0; i < active_ids.size(); ++i)
+				{
+					face_analyses[active_ids[i]] = active_analyses[i];
+				}
+			}
+
 			// Go through every model and detect eye gaze, record results and visualise the results
 			for (size_t model = 0; model < face_models.size(); ++model)
 			{
@@ -375,16 +497,10 @@ int main(int argc, char **argv)
 					}
 
 					// Face analysis step
-					cv::Mat sim_warped_img;
-					cv::Mat_<double> hog_descriptor; int num_hog_rows = 0, num_hog_cols = 0;
-
-					// Perform AU detection and HOG feature extraction, as this can be expensive only compute it if needed by output or visualization
-					if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs() || visualizer.vis_align || visualizer.vis_hog)
-					{
-						face_analyser.PredictStaticAUsAndComputeFeatures(rgb_image, face_models[model].detected_landmarks);
-						face_analyser.GetLatestAlignedFace(sim_warped_img);
-						face_analyser.GetLatestHOG(hog_descriptor, num_hog_rows, num_hog_cols);
-					}
+					const FaceAnalysis::FaceAnalyser::StaticFaceAnalysis& face_analysis = face_analyses[model];
+					const cv::Mat& sim_warped_img = face_analysis.aligned_face;
+					const cv::Mat_<double>& hog_descriptor = face_analysis.hog_descriptor;
+					int num_hog_rows = face_analysis.num_hog_rows, num_hog_cols = face_analysis.num_hog_cols;
 
 					// Visualize the features
 					visualizer.SetObservationFaceAlign(sim_warped_img);
@@ -392,13 +508,13 @@ int main(int argc, char **argv)
 					visualizer.SetObservationLandmarks(face_models[model].detected_landmarks, face_models[model].detection_certainty);
 					visualizer.SetObservationPose(LandmarkDetector::GetPose(face_models[model], sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy), face_models[model].detection_certainty);
 					visualizer.SetObservationGaze(gaze_direction0, gaze_direction1, LandmarkDetector::CalculateAllEyeLandmarks(face_models[model]), LandmarkDetector::Calculate3DEyeLandmarks(face_models[model], sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy), face_models[model].detection_certainty);
-					visualizer.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
+					visualizer.SetObservationActionUnits(face_analysis.AUs_reg, face_analysis.AUs_class);
 
 					// Output features
 					open_face_rec.SetObservationHOG(face_models[model].detection_success, hog_descriptor, num_hog_rows, num_hog_cols, 31); // The number of channels in HOG is fixed at the moment, as using FHOG
-					open_face_rec.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
+					open_face_rec.SetObservationActionUnits(face_analysis.AUs_reg, face_analysis.AUs_class);
 					open_face_rec.SetObservationLandmarks(face_models[model].detected_landmarks, face_models[model].GetShape(sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy),
-						face_models[model].params_global, face_models[model].params_local, face_models[model].detection_certainty, face_models[model].detection_success);
+						face_models[model].params_global, face_models[model].params_local, face_models[model].detection_certainty, face_models[model].detection_success, face_models[model].landmarks_propagated);
 					open_face_rec.SetObservationPose(pose_estimate);
 					open_face_rec.SetObservationGaze(gaze_direction0, gaze_direction1, gaze_angle, LandmarkDetector::CalculateAllEyeLandmarks(face_models[model]), LandmarkDetector::Calculate3DEyeLandmarks(face_models[model], sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy));
 					open_face_rec.SetObservationFaceAlign(sim_warped_img);
@@ -427,6 +543,8 @@ int main(int argc, char **argv)
 					face_models[i].Reset();
 					active_models[i] = false;
 				}
+				lost_faces.clear();
+				face_detector_async.Cancel();
 			}
 			// quit the application
 			else if (character_press == 'q')
@@ -94,9 +94,15 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	// Sharing the cores between the parallel loops, OpenBLAS and OpenCV (-threads, -blas_threads, -cv_threads, -nested_parallel)
+	LandmarkDetector::ThreadingPolicy::Apply(LandmarkDetector::ThreadingPolicy(arguments));
+
 	// Load the modules that are being used for tracking and face analysis
 	// Load face landmark detector
 	LandmarkDetector::FaceModelParameters det_parameters(arguments);
+
+	// Optionally adapting the tracking quality to keep every frame within a deadline (-deadline <ms>), useful for live streams
+	LandmarkDetector::QualityController quality_controller(arguments);
 	// Always track gaze in feature extraction
 	LandmarkDetector::CLNF face_model(det_parameters.model_location);
 
@@ -153,6 +159,9 @@ int main(int argc, char **argv)
 		{
 			recording_params.setOutputGaze(false);
 		}
+		// In keyframe tracking flag the frames whose landmarks were propagated
+		recording_params.setOutputPropagated(det_parameters.keyframe_interval > 1);
+		recording_params.setOutputQualityLevel(quality_controller.Enabled());
 		Utilities::RecorderOpenFace open_face_rec(sequence_reader.name, recording_params, arguments);
 
 		if (recording_params.outputGaze() && !face_model.eye_model)
@@ -166,12 +175,18 @@ int main(int argc, char **argv)
 		INFO_STREAM("Starting tracking");
 		while (!captured_image.empty())
 		{
+			quality_controller.BeginFrame(det_parameters);
+			int quality_level = quality_controller.GetQualityLevel();
+
 			// Converting to grayscale
 			cv::Mat_<uchar> grayscale_image = sequence_reader.GetGrayFrame();
 
+			// The versions of the frame needed by the landmark detector and the face analyser are computed once
+			LandmarkDetector::FrameContext frame(captured_image, grayscale_image);
 
 			// The actual facial landmark detection / tracking
-			bool detection_success = LandmarkDetector::DetectLandmarksInVideo(captured_image, face_model, det_parameters, grayscale_image);
+			bool detection_success = LandmarkDetector::DetectLandmarksInVideo(frame, face_model, det_parameters);
+			quality_controller.StageDone("landmarks");
 			
 			// Gaze tracking, absolute gaze direction
 			cv::Point3f gazeDirection0(0, 0, 0); cv::Point3f gazeDirection1(0, 0, 0); cv::Vec2d gazeAngle(0, 0);
@@ -182,6 +197,7 @@ int main(int argc, char **argv)
 				GazeAnalysis::EstimateGaze(face_model, gazeDirection1, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy, false);
 				gazeAngle = GazeAnalysis::GetGazeAngle(gazeDirection0, gazeDirection1);
 			}
+			quality_controller.StageDone("gaze");
 			
 			// Do face alignment
 			cv::Mat sim_warped_img;
@@ -190,14 +206,22 @@ int main(int argc, char **argv)
 			// Perform AU detection and HOG feature extraction, as this can be expensive only compute it if needed by output or visualization
 			if (recording_params.outputAlignedFaces() || recording_params.outputHOG() || recording_params.outputAUs() || visualizer.vis_align || visualizer.vis_hog || visualizer.vis_aus)
 			{
-				face_analyser.AddNextFrame(captured_image, face_model.detected_landmarks, face_model.detection_success, sequence_reader.time_stamp, sequence_reader.IsWebcam());
+				face_analyser.AddNextFrame(frame, face_model.detected_landmarks, face_model.detection_success, sequence_reader.time_stamp, sequence_reader.IsWebcam());
 				face_analyser.GetLatestAlignedFace(sim_warped_img);
 				face_analyser.GetLatestHOG(hog_descriptor, num_hog_rows, num_hog_cols);
 			}
+			quality_controller.StageDone("face analysis");
 			
 			// Work out the pose of the head from the tracked model
 			cv::Vec6d pose_estimate = LandmarkDetector::GetPose(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy);
 
+			// Report when the quality changes to meet the deadline
+			quality_controller.EndFrame();
+			if (quality_controller.GetQualityLevel() != quality_level)
+			{
+				INFO_STREAM("Quality changed to " << quality_controller.GetQualityDescription() << " (latency " << quality_controller.GetLatencyPercentile() << "ms)");
+			}
+
 			// Keeping track of FPS
 			fps_tracker.AddFrame();
 
@@ -225,8 +249,9 @@ int main(int argc, char **argv)
 			open_face_rec.SetObservationVisualization(visualizer.GetVisImage());
 			open_face_rec.SetObservationActionUnits(face_analyser.GetCurrentAUsReg(), face_analyser.GetCurrentAUsClass());
 			open_face_rec.SetObservationLandmarks(face_model.detected_landmarks, face_model.GetShape(sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy),
-				face_model.params_global, face_model.params_local, face_model.detection_certainty, detection_success);
+				face_model.params_global, face_model.params_local, face_model.detection_certainty, detection_success, face_model.landmarks_propagated);
 			open_face_rec.SetObservationPose(pose_estimate);
+			open_face_rec.SetObservationQualityLevel(quality_level);
 			open_face_rec.SetObservationGaze(gazeDirection0, gazeDirection1, gazeAngle, LandmarkDetector::CalculateAllEyeLandmarks(face_model), LandmarkDetector::Calculate3DEyeLandmarks(face_model, sequence_reader.fx, sequence_reader.fy, sequence_reader.cx, sequence_reader.cy));
 			open_face_rec.SetObservationTimestamp(sequence_reader.time_stamp);
 			open_face_rec.SetObservationFaceID(0);
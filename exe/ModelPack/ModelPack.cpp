@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+// ModelPack.cpp : Converts the text landmark detection and AU models to a single binary model bundle for fast loading.
+
+#include "LandmarkCoreIncludes.h"
+#include "ModelBundle.h"
+
+#include <FaceAnalyser.h>
+
+#ifndef CONFIG_DIR
+#define CONFIG_DIR "~"
+#endif
+
+std::vector<std::string> get_arguments(int argc, char **argv)
+{
+
+	std::vector<std::string> arguments;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		arguments.push_back(std::string(argv[i]));
+	}
+	return arguments;
+}
+
+int main(int argc, char **argv)
+{
+
+	//Convert arguments to more convenient vector form
+	std::vector<std::string> arguments = get_arguments(argc, argv);
+
+	// no arguments: output usage
+	if (arguments.size() == 1)
+	{
+		std::cout << "Usage: ModelPack -of <output bundle> [-mloc <landmark model>] [-auloc <AU model>] [-au_static] [-noau] [-quantise]" << std::endl;
+		std::cout << "The resulting bundle can be used in place of both the landmark model (-mloc) and the AU model (-auloc)" << std::endl;
+		std::cout << "-quantise stores the CEN patch experts with INT8 weights (about 4x smaller, at a small cost in accuracy, but not faster)" << std::endl;
+		return 0;
+	}
+
+	std::string output_location;
+	bool pack_au = true;
+	bool quantise = false;
+
+	for (size_t i = 1; i < arguments.size(); ++i)
+	{
+		if (arguments[i].compare("-of") == 0 && i + 1 < arguments.size())
+		{
+			output_location = arguments[i + 1];
+			i++;
+		}
+		else if (arguments[i].compare("-noau") == 0)
+		{
+			pack_au = false;
+		}
+		else if (arguments[i].compare("-quantise") == 0)
+		{
+			quantise = true;
+		}
+	}
+
+	if (output_location.empty())
+	{
+		std::cout << "ERROR: No output location specified, use -of" << std::endl;
+		return 1;
+	}
+
+	LandmarkDetector::FaceModelParameters det_parameters(arguments);
+
+	if (LandmarkDetector::ModelBundle::IsBundle(det_parameters.model_location))
+	{
+		std::cout << "ERROR: The landmark model is already a model bundle" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Loading the landmark detection model" << std::endl;
+	LandmarkDetector::CLNFModel landmark_model(det_parameters.model_location);
+
+	if (!landmark_model.loaded_successfully)
+	{
+		std::cout << "ERROR: Could not load the landmark detector" << std::endl;
+		return 1;
+	}
+
+	if (quantise)
+	{
+		std::cout << "Quantising the CEN patch experts" << std::endl;
+		landmark_model.QuantisePatchExperts();
+	}
+
+	LandmarkDetector::ModelBundleWriter bundle;
+	landmark_model.Write(bundle, "clnf/");
+
+	if (pack_au)
+	{
+		std::cout << "Loading the AU model" << std::endl;
+		FaceAnalysis::FaceAnalyserParameters face_analysis_params(arguments);
+		FaceAnalysis::FaceAnalyser face_analyser(face_analysis_params);
+
+		face_analyser.Write(bundle, "au/");
+	}
+
+	std::cout << "Writing " << bundle.Size() << " entries to: " << output_location << std::endl;
+	if (!bundle.Write(output_location))
+	{
+		std::cout << "ERROR: Could not write the model bundle" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Done" << std::endl;
+	return 0;
+}
@@ -98,11 +98,11 @@ namespace GazeAnalyser_Interop {
 			int part_right = -1;
 			for (size_t i = 0; i < clnf->getCLNF()->hierarchical_models.size(); ++i)
 			{
-				if (clnf->getCLNF()->hierarchical_model_names[i].compare("left_eye_28") == 0)
+				if (clnf->getCLNF()->model->hierarchical_model_names[i].compare("left_eye_28") == 0)
 				{
 					part_left = i;
 				}
-				if (clnf->getCLNF()->hierarchical_model_names[i].compare("right_eye_28") == 0)
+				if (clnf->getCLNF()->model->hierarchical_model_names[i].compare("right_eye_28") == 0)
 				{
 					part_right = i;
 				}
@@ -416,12 +416,12 @@ namespace CppInterop {
 
 			int GetNumPoints()
 			{
-				return clnf->pdm.NumberOfPoints();
+				return clnf->model->pdm.NumberOfPoints();
 			}
 
 			int GetNumModes()
 			{
-				return clnf->pdm.NumberOfModes();
+				return clnf->model->pdm.NumberOfModes();
 			}
 
 			// Getting the non-rigid shape parameters describing the facial expression
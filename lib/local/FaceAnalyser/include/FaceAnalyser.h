@@ -49,6 +49,7 @@
 #include "SVM_static_lin.h"
 #include "SVM_dynamic_lin.h"
 #include "PDM.h"
+#include "FrameContext.h"
 #include "FaceAnalyserParameters.h"
 
 namespace FaceAnalysis
@@ -61,11 +62,27 @@ public:
 
 	enum RegressorType{ SVR_appearance_static_linear = 0, SVR_appearance_dynamic_linear = 1, SVR_dynamic_geom_linear = 2, SVR_combined_linear = 3, SVM_linear_stat = 4, SVM_linear_dyn = 5, SVR_linear_static_seg = 6, SVR_linear_dynamic_seg =7};
 
+	// The outcome of the static analysis of one of several faces analysed together
+	struct StaticFaceAnalysis
+	{
+		cv::Mat aligned_face;
+		cv::Mat_<double> hog_descriptor;
+		int num_hog_rows = 0;
+		int num_hog_cols = 0;
+
+		// AU intensity and presence
+		std::vector<std::pair<std::string, double>> AUs_reg;
+		std::vector<std::pair<std::string, double>> AUs_class;
+	};
+
 	// Constructor for FaceAnalyser using the parameters structure
 	FaceAnalyser(const FaceAnalysis::FaceAnalyserParameters& face_analyser_params);
 
 	void AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& detected_landmarks, bool success, double timestamp_seconds, bool online = false);
 
+	// The same on the frame context used for landmark detection (the face is aligned from the frame as provided)
+	void AddNextFrame(LandmarkDetector::FrameContext& frame, const cv::Mat_<float>& detected_landmarks, bool success, double timestamp_seconds, bool online = false);
+
 	double GetCurrentTimeSeconds();
 	
 	// Grab the current predictions about AUs from the face analyser
@@ -75,6 +92,12 @@ public:
 
 	// A standalone call for predicting AUs and computing face texture features from a static image
 	void PredictStaticAUsAndComputeFeatures(const cv::Mat& frame, const cv::Mat_<float>& detected_landmarks);
+	void PredictStaticAUsAndComputeFeatures(LandmarkDetector::FrameContext& frame, const cv::Mat_<float>& detected_landmarks);
+
+	// The same for several faces of an image at once, the AUs of all of the faces are predicted with a single matrix multiplication
+	// (the latest features and AUs are the ones of the last face afterwards)
+	void PredictStaticAUsAndComputeFeatures(const cv::Mat& frame, const std::vector<cv::Mat_<float> >& detected_landmarks, std::vector<StaticFaceAnalysis>& o_analyses);
+	void PredictStaticAUsAndComputeFeatures(LandmarkDetector::FrameContext& frame, const std::vector<cv::Mat_<float> >& detected_landmarks, std::vector<StaticFaceAnalysis>& o_analyses);
 
 	void Reset();
 
@@ -104,6 +127,15 @@ public:
 	// Helper function for post-processing AU output files
 	void PostprocessOutputFile(std::string output_file);
 
+	// Writing the AU models to a model bundle (for faster loading)
+	void Write(LandmarkDetector::ModelBundleWriter& bundle, const std::string& prefix) const;
+
+	// The AU intensities and presences of the currently stored descriptors (before any correction or clipping), from the stacked float model
+	void PredictCurrentAUs(std::vector<std::pair<std::string, double>>& o_AUs_reg, std::vector<std::pair<std::string, double>>& o_AUs_class);
+
+	// The same from the double precision regressors and classifiers applied one by one, the reference the stacked model is tested against
+	void PredictCurrentAUsReference(std::vector<std::pair<std::string, double>>& o_AUs_reg, std::vector<std::pair<std::string, double>>& o_AUs_class);
+
 private:
 
 	// Point distribution model coddesponding to the current Face Analyser
@@ -170,15 +202,28 @@ private:
 	// Using the bounding box of previous analysed frame to determine if a reset is needed
 	cv::Rect_<double> face_bounding_box;
 	
-	// The AU predictions internally
-	std::vector<std::pair<std::string, double>> PredictCurrentAUs(int view);
-	std::vector<std::pair<std::string, double>> PredictCurrentAUsClass(int view);
+	// Aligning the face and computing its HOG and geometry descriptors for static AU prediction
+	void ComputeStaticFeatures(const cv::Mat& frame, const cv::Mat_<float>& detected_landmarks);
+
+	// Stacking all of the AU regressors and classifiers into one linear model (done after reading them)
+	void StackAUModels();
+
+	// Copying the currently stored descriptors into a row of the stacked model input, false if they do not match the model
+	bool FillAUInput(cv::Mat_<float>& o_input_row) const;
+
+	// Applying the stacked model to a number of inputs (one per row), the dynamic models are normalised by the current running median
+	void PredictAUOutputs(cv::Mat_<float>& o_outputs, const cv::Mat_<float>& inputs);
+
+	// Splitting a row of the stacked model outputs into the named AU intensities and presences
+	void SplitAUOutputs(const cv::Mat_<float>& outputs_row, std::vector<std::pair<std::string, double>>& o_AUs_reg, std::vector<std::pair<std::string, double>>& o_AUs_class) const;
 
 	// special step for online (rather than offline AU prediction)
 	std::vector<std::pair<std::string, double>> CorrectOnlineAUs(std::vector<std::pair<std::string, double>> predictions_orig, int view, bool dyn_shift = false, bool dyn_scale = false, bool update_track = true, bool clip_values = false);
 
 	void Read(std::string model_loc);
 
+	void Read(const LandmarkDetector::ModelBundle& bundle, const std::string& prefix);
+
 	void ReadAU(std::string au_location);
 
 	void ReadRegressor(std::string fname, const std::vector<std::string>& au_names);
@@ -197,6 +242,26 @@ private:
 	SVM_static_lin AU_SVM_static_appearance_lin;
 	SVM_dynamic_lin AU_SVM_dynamic_appearance_lin;
 
+	// All of the above stacked into one float linear model (with the means folded into the biases), so that the AUs of a face are a single matrix-vector product
+	// The outputs are the static ones followed by the dynamic ones (from au_dynamic_start on), the input is the HOG descriptor followed by the geometry one
+	cv::Mat_<float> au_weights;
+	cv::Mat_<float> au_biases;
+	int au_dynamic_start;
+
+	// The biases of the dynamic outputs include the projection of the running median, recomputed when the median changes (empty when out of date)
+	cv::Mat_<float> au_biases_median;
+
+	// Which outputs are intensities and which are presences (with the values of positive and negative classifications)
+	std::vector<int> au_reg_outputs;
+	std::vector<std::string> au_reg_names;
+	std::vector<int> au_class_outputs;
+	std::vector<std::string> au_class_names;
+	std::vector<double> au_pos_classes;
+	std::vector<double> au_neg_classes;
+
+	// The principal components of the PDM, in double to compute the geometry descriptor
+	cv::Mat_<double> princ_comp_d;
+
 	// The AUs predicted by the model are not always 0 calibrated to a person. That is they don't always predict 0 for a neutral expression
 	// Keeping track of the predictions we can correct for this, by assuming that at least "ratio" of frames are neutral and subtract that value of prediction, only perform the correction after min_frames
 	void UpdatePredictionTrack(cv::Mat_<int>& prediction_corr_histogram, int& prediction_correction_count, 
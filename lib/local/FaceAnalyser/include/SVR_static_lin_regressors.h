@@ -44,6 +44,8 @@
 
 #include <opencv2/core/core.hpp>
 
+#include "ModelBundle.h"
+
 namespace FaceAnalysis
 {
 
@@ -61,6 +63,13 @@ public:
 	// Reading in the model (or adding to it)
 	void Read(std::ifstream& stream, const std::vector<std::string>& au_names);
 
+	// Reading from and writing to a model bundle (stores the already combined regressors)
+	void Read(const LandmarkDetector::ModelBundle& bundle, const std::string& prefix);
+	void Write(LandmarkDetector::ModelBundleWriter& bundle, const std::string& prefix) const;
+
+	// The model as a linear function of the descriptor, with the means folded into the biases (for stacking all of the AU models into one)
+	void GetLinearModel(cv::Mat_<double>& o_weights, cv::Mat_<double>& o_biases) const;
+
 	std::vector<std::string> GetAUNames() const
 	{
 		return AU_names;
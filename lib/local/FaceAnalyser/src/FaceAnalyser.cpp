@@ -44,6 +44,10 @@ using namespace FaceAnalysis;
 FaceAnalyser::FaceAnalyser(const FaceAnalysis::FaceAnalyserParameters& face_analyser_params)
 {
 	this->Read(face_analyser_params.getModelLoc());
+
+	// Stacking the AU models into one, and keeping the PDM in the precision of the geometry descriptor
+	StackAUModels();
+	pdm.princ_comp.convertTo(princ_comp_d, CV_64F);
 		
 	align_mask = face_analyser_params.getAlignMask();
 	align_scale_out = face_analyser_params.getSimScaleOut();
@@ -231,7 +235,88 @@ int GetViewId(const std::vector<cv::Vec3d> orientations_all, const cv::Vec3d& or
 	
 }
 
+void FaceAnalyser::PredictStaticAUsAndComputeFeatures(LandmarkDetector::FrameContext& frame, const cv::Mat_<float>& detected_landmarks)
+{
+	PredictStaticAUsAndComputeFeatures(frame.Image(), detected_landmarks);
+}
+
 void FaceAnalyser::PredictStaticAUsAndComputeFeatures(const cv::Mat& frame, const cv::Mat_<float>& detected_landmarks)
+{
+	ComputeStaticFeatures(frame, detected_landmarks);
+
+	// Perform AU prediction
+	std::vector<std::pair<std::string, double>> AU_predictions_intensity;
+	std::vector<std::pair<std::string, double>> AU_predictions_occurence;
+	PredictCurrentAUs(AU_predictions_intensity, AU_predictions_occurence);
+
+	// Make sure intensity is within range (0-5)
+	for (size_t au = 0; au < AU_predictions_intensity.size(); ++au)
+	{
+		if (AU_predictions_intensity[au].second < 0)
+			AU_predictions_intensity[au].second = 0;
+
+		if (AU_predictions_intensity[au].second > 5)
+			AU_predictions_intensity[au].second = 5;
+	}
+	
+	AU_predictions_reg = AU_predictions_intensity;
+	AU_predictions_class = AU_predictions_occurence;
+
+}
+
+void FaceAnalyser::PredictStaticAUsAndComputeFeatures(LandmarkDetector::FrameContext& frame, const std::vector<cv::Mat_<float> >& detected_landmarks, std::vector<StaticFaceAnalysis>& o_analyses)
+{
+	PredictStaticAUsAndComputeFeatures(frame.Image(), detected_landmarks, o_analyses);
+}
+
+void FaceAnalyser::PredictStaticAUsAndComputeFeatures(const cv::Mat& frame, const std::vector<cv::Mat_<float> >& detected_landmarks, std::vector<StaticFaceAnalysis>& o_analyses)
+{
+	o_analyses.resize(detected_landmarks.size());
+
+	// The features of every face first, collecting the inputs of the AU models
+	cv::Mat_<float> inputs((int)detected_landmarks.size(), au_weights.rows, 0.0f);
+	std::vector<bool> valid_inputs(detected_landmarks.size());
+
+	for (size_t face = 0; face < detected_landmarks.size(); ++face)
+	{
+		ComputeStaticFeatures(frame, detected_landmarks[face]);
+
+		GetLatestAlignedFace(o_analyses[face].aligned_face);
+		GetLatestHOG(o_analyses[face].hog_descriptor, o_analyses[face].num_hog_rows, o_analyses[face].num_hog_cols);
+
+		cv::Mat_<float> input_row = inputs.row((int)face);
+		valid_inputs[face] = FillAUInput(input_row);
+	}
+
+	// And the AUs of all of them at once
+	cv::Mat_<float> outputs;
+	PredictAUOutputs(outputs, inputs);
+
+	for (size_t face = 0; face < detected_landmarks.size(); ++face)
+	{
+		o_analyses[face].AUs_reg.clear();
+		o_analyses[face].AUs_class.clear();
+
+		if (valid_inputs[face] && !outputs.empty())
+		{
+			SplitAUOutputs(outputs.row((int)face), o_analyses[face].AUs_reg, o_analyses[face].AUs_class);
+		}
+
+		// Make sure intensity is within range (0-5)
+		for (size_t au = 0; au < o_analyses[face].AUs_reg.size(); ++au)
+		{
+			o_analyses[face].AUs_reg[au].second = std::min(std::max(o_analyses[face].AUs_reg[au].second, 0.0), 5.0);
+		}
+	}
+
+	if (!o_analyses.empty())
+	{
+		AU_predictions_reg = o_analyses.back().AUs_reg;
+		AU_predictions_class = o_analyses.back().AUs_class;
+	}
+}
+
+void FaceAnalyser::ComputeStaticFeatures(const cv::Mat& frame, const cv::Mat_<float>& detected_landmarks)
 {
 	
 	// Extract shape parameters from the detected landmarks
@@ -266,43 +351,20 @@ void FaceAnalyser::PredictStaticAUsAndComputeFeatures(const cv::Mat& frame, cons
 	// Store the descriptor
 	hog_desc_frame = hog_descriptor;
 
-	cv::Vec3d curr_orient(params_global[1], params_global[2], params_global[3]);
-	int orientation_to_use = GetViewId(this->head_orientations, curr_orient);
-	
 	// Geom descriptor and its median, TODO these should be floats?
 	params_local = params_local.t();
 	params_local.convertTo(geom_descriptor_frame, CV_64F);
 	
-	cv::Mat_<double> princ_comp_d;
-	pdm.princ_comp.convertTo(princ_comp_d, CV_64F);
-
 	// Stack with the actual feature point locations (without mean)
 	cv::Mat_<double> locs = princ_comp_d * geom_descriptor_frame.t();
 
 	cv::hconcat(locs.t(), geom_descriptor_frame.clone(), geom_descriptor_frame);
-	
-	// First convert the face image to double representation as a row vector, TODO rem
-	//cv::Mat_<uchar> aligned_face_cols(1, aligned_face_for_au.cols * aligned_face_for_au.rows * aligned_face_for_au.channels(), aligned_face_for_au.data, 1);
-	//cv::Mat_<double> aligned_face_cols_double;
-	//aligned_face_cols.convertTo(aligned_face_cols_double, CV_64F);
-	
-	// Perform AU prediction	
-	auto AU_predictions_intensity = PredictCurrentAUs(orientation_to_use);
-	auto AU_predictions_occurence = PredictCurrentAUsClass(orientation_to_use);
 
-	// Make sure intensity is within range (0-5)
-	for (size_t au = 0; au < AU_predictions_intensity.size(); ++au)
-	{
-		if (AU_predictions_intensity[au].second < 0)
-			AU_predictions_intensity[au].second = 0;
-
-		if (AU_predictions_intensity[au].second > 5)
-			AU_predictions_intensity[au].second = 5;
-	}
-	
-	AU_predictions_reg = AU_predictions_intensity;
-	AU_predictions_class = AU_predictions_occurence;
+}
 
+void FaceAnalyser::AddNextFrame(LandmarkDetector::FrameContext& frame, const cv::Mat_<float>& detected_landmarks, bool success, double timestamp_seconds, bool online)
+{
+	AddNextFrame(frame.Image(), detected_landmarks, success, timestamp_seconds, online);
 }
 
 void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& detected_landmarks, bool success, double timestamp_seconds, bool online)
@@ -415,9 +477,6 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& det
 	}
 
 	// Stack with the actual feature point locations (without mean)
-	// TODO rem double
-	cv::Mat_<double> princ_comp_d;
-	pdm.princ_comp.convertTo(princ_comp_d, CV_64F);
 	cv::Mat_<double> locs = princ_comp_d * geom_descriptor_frame.t();
 	
 	cv::hconcat(locs.t(), geom_descriptor_frame.clone(), geom_descriptor_frame);
@@ -426,10 +485,13 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& det
 	if(frames_tracking % 2 == 1)
 	{
 		UpdateRunningMedian(this->geom_desc_hist, this->geom_hist_sum, this->geom_descriptor_median, geom_descriptor_frame, update_median, this->num_bins_geom, this->min_val_geom, this->max_val_geom);
+
+		// The dynamic AU models have to be renormalised
+		au_biases_median.release();
 	}
 	
 	// Perform AU prediction	
-	AU_predictions_reg = PredictCurrentAUs(orientation_to_use);
+	PredictCurrentAUs(AU_predictions_reg, AU_predictions_class);
 
 	// Add the reg predictions to the historic data
 	for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
@@ -450,8 +512,6 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const cv::Mat_<float>& det
 		}
 	}
 	
-	AU_predictions_class = PredictCurrentAUsClass(orientation_to_use);
-
 	for (size_t au = 0; au < AU_predictions_class.size(); ++au)
 	{
 
@@ -519,7 +579,9 @@ void FaceAnalyser::PostprocessPredictions()
 				this->geom_descriptor_frame = geom_descriptor_frames_init[success_ind];
 
 				// Perform AU prediction	
-				auto AU_predictions_reg = PredictCurrentAUs(views[success_ind]);								
+				std::vector<std::pair<std::string, double>> AU_predictions_reg;
+				std::vector<std::pair<std::string, double>> AU_predictions_class;
+				PredictCurrentAUs(AU_predictions_reg, AU_predictions_class);
 
 				// Modify the predictions to the historic data
 				for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
@@ -529,8 +591,6 @@ void FaceAnalyser::PostprocessPredictions()
 
 				}
 
-				auto AU_predictions_class = PredictCurrentAUsClass(views[success_ind]);
-
 				for (size_t au = 0; au < AU_predictions_class.size(); ++au)
 				{
 					// Find the appropriate AU (if not found add it)		
@@ -736,6 +796,7 @@ void FaceAnalyser::Reset()
 	}
 
 	this->geom_descriptor_median.setTo(cv::Scalar(0));
+	au_biases_median.release();
 	this->geom_desc_hist = cv::Mat_<int>(geom_desc_hist.rows, geom_desc_hist.cols, (int)0);
 	geom_hist_sum = 0;
 
@@ -859,37 +920,223 @@ void FaceAnalyser::ExtractMedian(cv::Mat_<int>& histogram, int hist_count, cv::M
 		}
 	}
 }
-// Apply the current predictors to the currently stored descriptors
-std::vector<std::pair<std::string, double>> FaceAnalyser::PredictCurrentAUs(int view)
+// Apply the current predictors to the currently stored descriptors, both the intensities and the presences come from a single product with the stacked models
+void FaceAnalyser::PredictCurrentAUs(std::vector<std::pair<std::string, double>>& o_AUs_reg, std::vector<std::pair<std::string, double>>& o_AUs_class)
 {
+	o_AUs_reg.clear();
+	o_AUs_class.clear();
+
+	if(!hog_desc_frame.empty())
+	{
+		cv::Mat_<float> input(1, au_weights.rows, 0.0f);
+		if (!FillAUInput(input))
+		{
+			return;
+		}
+
+		cv::Mat_<float> outputs;
+		PredictAUOutputs(outputs, input);
 
-	std::vector<std::pair<std::string, double>> predictions;
+		if (!outputs.empty())
+		{
+			SplitAUOutputs(outputs, o_AUs_reg, o_AUs_class);
+		}
+	}
+}
+
+// Apply the original double precision models to the currently stored descriptors one by one (the static ones first, the dynamic ones normalised by the running median)
+void FaceAnalyser::PredictCurrentAUsReference(std::vector<std::pair<std::string, double>>& o_AUs_reg, std::vector<std::pair<std::string, double>>& o_AUs_class)
+{
+	o_AUs_reg.clear();
+	o_AUs_class.clear();
 
 	if(!hog_desc_frame.empty())
 	{
-		std::vector<std::string> svr_lin_stat_aus;
-		std::vector<double> svr_lin_stat_preds;
+		std::vector<std::string> names;
+		std::vector<double> preds;
+
+		AU_SVR_static_appearance_lin_regressors.Predict(preds, names, hog_desc_frame, geom_descriptor_frame);
+		AU_SVR_dynamic_appearance_lin_regressors.Predict(preds, names, hog_desc_frame, geom_descriptor_frame, hog_desc_median, geom_descriptor_median);
+		std::vector<std::string> reg_names = AU_SVR_static_appearance_lin_regressors.GetAUNames();
+		std::vector<std::string> reg_dyn_names = AU_SVR_dynamic_appearance_lin_regressors.GetAUNames();
+		reg_names.insert(reg_names.end(), reg_dyn_names.begin(), reg_dyn_names.end());
+
+		for(size_t i = 0; i < preds.size() && i < reg_names.size(); ++i)
+		{
+			o_AUs_reg.push_back(std::pair<std::string, double>(reg_names[i], preds[i]));
+		}
+
+		preds.clear();
+		AU_SVM_static_appearance_lin.Predict(preds, names, hog_desc_frame, geom_descriptor_frame);
+		AU_SVM_dynamic_appearance_lin.Predict(preds, names, hog_desc_frame, geom_descriptor_frame, hog_desc_median, geom_descriptor_median);
+		std::vector<std::string> class_names = AU_SVM_static_appearance_lin.GetAUNames();
+		std::vector<std::string> class_dyn_names = AU_SVM_dynamic_appearance_lin.GetAUNames();
+		class_names.insert(class_names.end(), class_dyn_names.begin(), class_dyn_names.end());
+
+		for(size_t i = 0; i < preds.size() && i < class_names.size(); ++i)
+		{
+			o_AUs_class.push_back(std::pair<std::string, double>(class_names[i], preds[i]));
+		}
+	}
+}
+
+void FaceAnalyser::StackAUModels()
+{
+	// In the order of the outputs, the static models first
+	std::vector<cv::Mat_<double> > weights(4);
+	std::vector<cv::Mat_<double> > biases(4);
+	AU_SVR_static_appearance_lin_regressors.GetLinearModel(weights[0], biases[0]);
+	AU_SVM_static_appearance_lin.GetLinearModel(weights[1], biases[1]);
+	AU_SVR_dynamic_appearance_lin_regressors.GetLinearModel(weights[2], biases[2]);
+	AU_SVM_dynamic_appearance_lin.GetLinearModel(weights[3], biases[3]);
+
+	std::vector<std::vector<std::string> > names(4);
+	names[0] = AU_SVR_static_appearance_lin_regressors.GetAUNames();
+	names[1] = AU_SVM_static_appearance_lin.GetAUNames();
+	names[2] = AU_SVR_dynamic_appearance_lin_regressors.GetAUNames();
+	names[3] = AU_SVM_dynamic_appearance_lin.GetAUNames();
+
+	std::vector<std::vector<double> > pos_classes(4);
+	std::vector<std::vector<double> > neg_classes(4);
+	pos_classes[1] = AU_SVM_static_appearance_lin.GetPosClasses();
+	neg_classes[1] = AU_SVM_static_appearance_lin.GetNegClasses();
+	pos_classes[3] = AU_SVM_dynamic_appearance_lin.GetPosClasses();
+	neg_classes[3] = AU_SVM_dynamic_appearance_lin.GetNegClasses();
+
+	// The models only using the HOG descriptor have zero weights for the geometry one
+	int num_inputs = 0;
+	int num_outputs = 0;
+	for (size_t i = 0; i < weights.size(); ++i)
+	{
+		num_inputs = std::max(num_inputs, weights[i].rows);
+		num_outputs += weights[i].cols;
+	}
 
-		AU_SVR_static_appearance_lin_regressors.Predict(svr_lin_stat_preds, svr_lin_stat_aus, hog_desc_frame, geom_descriptor_frame);
+	au_weights = cv::Mat_<float>(num_inputs, num_outputs, 0.0f);
+	au_biases = cv::Mat_<float>(1, num_outputs, 0.0f);
+	au_biases_median.release();
 
-		for(size_t i = 0; i < svr_lin_stat_preds.size(); ++i)
+	au_reg_outputs.clear();
+	au_reg_names.clear();
+	au_class_outputs.clear();
+	au_class_names.clear();
+	au_pos_classes.clear();
+	au_neg_classes.clear();
+
+	int output = 0;
+	for (size_t i = 0; i < weights.size(); ++i)
+	{
+		if (i == 2)
 		{
-			predictions.push_back(std::pair<std::string, double>(svr_lin_stat_aus[i], svr_lin_stat_preds[i]));
+			au_dynamic_start = output;
 		}
 
-		std::vector<std::string> svr_lin_dyn_aus;
-		std::vector<double> svr_lin_dyn_preds;
+		if (weights[i].empty())
+		{
+			continue;
+		}
 
-		AU_SVR_dynamic_appearance_lin_regressors.Predict(svr_lin_dyn_preds, svr_lin_dyn_aus, hog_desc_frame, geom_descriptor_frame,  this->hog_desc_median, this->geom_descriptor_median);
+		cv::Mat_<float> weights_block = au_weights(cv::Rect(output, 0, weights[i].cols, weights[i].rows));
+		weights[i].convertTo(weights_block, CV_32F);
+		cv::Mat_<float> biases_block = au_biases(cv::Rect(output, 0, biases[i].cols, 1));
+		biases[i].convertTo(biases_block, CV_32F);
 
-		for(size_t i = 0; i < svr_lin_dyn_preds.size(); ++i)
+		// The SVR models are the intensities and the SVM ones the presences
+		for (int k = 0; k < weights[i].cols; ++k)
 		{
-			predictions.push_back(std::pair<std::string, double>(svr_lin_dyn_aus[i], svr_lin_dyn_preds[i]));
+			if (i % 2 == 0)
+			{
+				au_reg_outputs.push_back(output + k);
+				au_reg_names.push_back(names[i][k]);
+			}
+			else
+			{
+				au_class_outputs.push_back(output + k);
+				au_class_names.push_back(names[i][k]);
+				au_pos_classes.push_back(pos_classes[i][k]);
+				au_neg_classes.push_back(neg_classes[i][k]);
+			}
 		}
+		output += weights[i].cols;
+	}
+}
 
+bool FaceAnalyser::FillAUInput(cv::Mat_<float>& o_input_row) const
+{
+	int num_hog = hog_desc_frame.cols;
+	int num_geom = au_weights.rows - num_hog;
+
+	if (num_geom != 0 && num_geom != geom_descriptor_frame.cols)
+	{
+		return false;
 	}
 
-	return predictions;
+	cv::Mat_<float> hog_part = o_input_row.colRange(0, num_hog);
+	hog_desc_frame.convertTo(hog_part, CV_32F);
+
+	if (num_geom > 0)
+	{
+		cv::Mat_<float> geom_part = o_input_row.colRange(num_hog, au_weights.rows);
+		geom_descriptor_frame.convertTo(geom_part, CV_32F);
+	}
+	return true;
+}
+
+void FaceAnalyser::PredictAUOutputs(cv::Mat_<float>& o_outputs, const cv::Mat_<float>& inputs)
+{
+	if (au_weights.empty() || inputs.rows == 0)
+	{
+		o_outputs = cv::Mat_<float>();
+		return;
+	}
+
+	// The dynamic models subtract the running median from their input, which only changes the biases: (x - m) * W + b = x * W + (b - m * W)
+	if (au_biases_median.empty())
+	{
+		au_biases_median = au_biases.clone();
+
+		int num_hog = hog_desc_median.cols;
+		if (num_hog > 0 && au_dynamic_start < au_weights.cols && num_hog <= au_weights.rows)
+		{
+			cv::Mat_<float> median(1, au_weights.rows, 0.0f);
+			cv::Mat_<float> hog_part = median.colRange(0, num_hog);
+			hog_desc_median.convertTo(hog_part, CV_32F);
+
+			if (geom_descriptor_median.cols == au_weights.rows - num_hog)
+			{
+				cv::Mat_<float> geom_part = median.colRange(num_hog, au_weights.rows);
+				geom_descriptor_median.convertTo(geom_part, CV_32F);
+			}
+
+			cv::Mat_<float> median_projection = median * au_weights.colRange(au_dynamic_start, au_weights.cols);
+			cv::Mat_<float> dynamic_biases = au_biases_median.colRange(au_dynamic_start, au_weights.cols);
+			cv::subtract(dynamic_biases, median_projection, dynamic_biases);
+		}
+	}
+
+	// A single matrix-vector product per face (or a matrix product for several faces)
+	if (inputs.rows == 1)
+	{
+		cv::gemm(inputs, au_weights, 1.0, au_biases_median, 1.0, o_outputs);
+	}
+	else
+	{
+		cv::gemm(inputs, au_weights, 1.0, cv::repeat(au_biases_median, inputs.rows, 1), 1.0, o_outputs);
+	}
+}
+
+void FaceAnalyser::SplitAUOutputs(const cv::Mat_<float>& outputs_row, std::vector<std::pair<std::string, double>>& o_AUs_reg, std::vector<std::pair<std::string, double>>& o_AUs_class) const
+{
+	for (size_t i = 0; i < au_reg_outputs.size(); ++i)
+	{
+		o_AUs_reg.push_back(std::pair<std::string, double>(au_reg_names[i], outputs_row(au_reg_outputs[i])));
+	}
+
+	for (size_t i = 0; i < au_class_outputs.size(); ++i)
+	{
+		double presence = outputs_row(au_class_outputs[i]) > 0 ? au_pos_classes[i] : au_neg_classes[i];
+		o_AUs_class.push_back(std::pair<std::string, double>(au_class_names[i], presence));
+	}
 }
 
 std::vector<std::pair<std::string, double>> FaceAnalyser::CorrectOnlineAUs(std::vector<std::pair<std::string, double>> predictions_orig, 
@@ -955,39 +1202,6 @@ std::vector<std::pair<std::string, double>> FaceAnalyser::CorrectOnlineAUs(std::
 	return predictions;
 }
 
-// Apply the current predictors to the currently stored descriptors (classification)
-std::vector<std::pair<std::string, double>> FaceAnalyser::PredictCurrentAUsClass(int view)
-{
-
-	std::vector<std::pair<std::string, double>> predictions;
-
-	if(!hog_desc_frame.empty())
-	{
-		std::vector<std::string> svm_lin_stat_aus;
-		std::vector<double> svm_lin_stat_preds;
-		
-		AU_SVM_static_appearance_lin.Predict(svm_lin_stat_preds, svm_lin_stat_aus, hog_desc_frame, geom_descriptor_frame);
-
-		for(size_t i = 0; i < svm_lin_stat_aus.size(); ++i)
-		{
-			predictions.push_back(std::pair<std::string, double>(svm_lin_stat_aus[i], svm_lin_stat_preds[i]));
-		}
-
-		std::vector<std::string> svm_lin_dyn_aus;
-		std::vector<double> svm_lin_dyn_preds;
-
-		AU_SVM_dynamic_appearance_lin.Predict(svm_lin_dyn_preds, svm_lin_dyn_aus, hog_desc_frame, geom_descriptor_frame, this->hog_desc_median, this->geom_descriptor_median);
-
-		for(size_t i = 0; i < svm_lin_dyn_aus.size(); ++i)
-		{
-			predictions.push_back(std::pair<std::string, double>(svm_lin_dyn_aus[i], svm_lin_dyn_preds[i]));
-		}
-		
-	}
-
-	return predictions;
-}
-
 std::vector<std::pair<std::string, double>> FaceAnalyser::GetCurrentAUsClass() const
 {
 	return AU_predictions_class;
@@ -1009,6 +1223,17 @@ void FaceAnalyser::Read(std::string model_loc)
 
 	std::cout << "Reading the AU analysis module from: " << model_loc << std::endl;
 
+	// Model bundles contain all of the AU modules in one memory mapped file
+	if (LandmarkDetector::ModelBundle::IsBundle(model_loc))
+	{
+		std::shared_ptr<const LandmarkDetector::ModelBundle> bundle = LandmarkDetector::ModelBundle::Open(model_loc);
+		if (bundle)
+		{
+			Read(*bundle, "au/");
+		}
+		return;
+	}
+
 	std::ifstream locations(model_loc.c_str(), std::ios_base::in);
 	if (!locations.is_open())
 	{
@@ -1069,6 +1294,36 @@ void FaceAnalyser::Read(std::string model_loc)
 
 }
 
+void FaceAnalyser::Read(const LandmarkDetector::ModelBundle& bundle, const std::string& prefix)
+{
+	std::cout << "Reading the AU predictors....";
+	AU_SVR_static_appearance_lin_regressors.Read(bundle, prefix + "svr_static/");
+	AU_SVR_dynamic_appearance_lin_regressors.Read(bundle, prefix + "svr_dynamic/");
+	AU_SVM_static_appearance_lin.Read(bundle, prefix + "svm_static/");
+	AU_SVM_dynamic_appearance_lin.Read(bundle, prefix + "svm_dynamic/");
+	std::cout << "... Done" << std::endl;
+
+	std::cout << "Reading the PDM....";
+	pdm = LandmarkDetector::PDM();
+	pdm.Read(bundle, prefix + "pdm/");
+	std::cout << "... Done" << std::endl;
+
+	// The triangulation used for masking out the non-face parts of aligned image
+	bundle.GetMat(prefix + "triangulation", triangulation);
+}
+
+void FaceAnalyser::Write(LandmarkDetector::ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	AU_SVR_static_appearance_lin_regressors.Write(bundle, prefix + "svr_static/");
+	AU_SVR_dynamic_appearance_lin_regressors.Write(bundle, prefix + "svr_dynamic/");
+	AU_SVM_static_appearance_lin.Write(bundle, prefix + "svm_static/");
+	AU_SVM_dynamic_appearance_lin.Write(bundle, prefix + "svm_dynamic/");
+
+	pdm.Write(bundle, prefix + "pdm/");
+
+	bundle.AddMat(prefix + "triangulation", triangulation);
+}
+
 // Split the string into tokens
 static void split(const std::string& str, std::vector<std::string>& out, char delim = ' ')
 {
@@ -68,6 +68,9 @@ FaceAnalyserParameters::FaceAnalyserParameters(std::vector<std::string> &argumen
 	bool scale_set = false;
 	bool size_set = false;
 
+	// An explicitly provided AU model (e.g. a model bundle)
+	std::string au_model_location;
+
 	for (size_t i = 1; i < arguments.size(); ++i)
 	{
 		valid[i] = true;
@@ -82,6 +85,13 @@ FaceAnalyserParameters::FaceAnalyserParameters(std::vector<std::string> &argumen
 			grayscale = true;
 			valid[i] = false;
 		}
+		else if (arguments[i].compare("-auloc") == 0)
+		{
+			au_model_location = arguments[i + 1];
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
 		else if (arguments[i].compare("-nomask") == 0)
 		{
 			sim_align_face_mask = false;
@@ -122,6 +132,11 @@ FaceAnalyserParameters::FaceAnalyserParameters(std::vector<std::string> &argumen
 		this->model_location = "AU_predictors/main_static_svms.txt";
 	}
 
+	if (!au_model_location.empty())
+	{
+		this->model_location = au_model_location;
+	}
+
 	// If we set the size but not the scale, adapt the scale to the right size
 	if (!scale_set && size_set) sim_scale_out = sim_size_out * (0.7 / 112.0);
 
@@ -98,6 +98,54 @@ void SVM_dynamic_lin::Read(std::ifstream& stream, const std::vector<std::string>
 	}
 }
 
+// Reading from a model bundle
+void SVM_dynamic_lin::Read(const LandmarkDetector::ModelBundle& bundle, const std::string& prefix)
+{
+	AU_names = bundle.GetStrings(prefix + "au_names");
+
+	if (AU_names.empty())
+	{
+		return;
+	}
+
+	bundle.GetMat(prefix + "means", means);
+	bundle.GetMat(prefix + "support_vectors", support_vectors);
+	bundle.GetMat(prefix + "biases", biases);
+	pos_classes = bundle.GetDoubles(prefix + "pos_classes");
+	neg_classes = bundle.GetDoubles(prefix + "neg_classes");
+}
+
+// Writing to a model bundle
+void SVM_dynamic_lin::Write(LandmarkDetector::ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	bundle.AddStrings(prefix + "au_names", AU_names);
+
+	if (AU_names.empty())
+	{
+		return;
+	}
+
+	bundle.AddMat(prefix + "means", means);
+	bundle.AddMat(prefix + "support_vectors", support_vectors);
+	bundle.AddMat(prefix + "biases", biases);
+	bundle.AddDoubles(prefix + "pos_classes", pos_classes);
+	bundle.AddDoubles(prefix + "neg_classes", neg_classes);
+}
+
+// The linear model with the means folded into the biases
+void SVM_dynamic_lin::GetLinearModel(cv::Mat_<double>& o_weights, cv::Mat_<double>& o_biases) const
+{
+	if (AU_names.empty())
+	{
+		o_weights = cv::Mat_<double>();
+		o_biases = cv::Mat_<double>();
+		return;
+	}
+
+	o_weights = support_vectors;
+	o_biases = biases - means * support_vectors;
+}
+
 // Prediction using the HOG descriptor
 void SVM_dynamic_lin::Predict(std::vector<double>& predictions, std::vector<std::string>& names, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params,  const cv::Mat_<double>& running_median,  const cv::Mat_<double>& running_median_geom)
 {
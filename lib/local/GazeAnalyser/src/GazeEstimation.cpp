@@ -93,11 +93,11 @@ void GazeAnalysis::EstimateGaze(const LandmarkDetector::CLNF& clnf_model, cv::Po
 	int part = -1;
 	for (size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
 	{
-		if (left_eye && clnf_model.hierarchical_model_names[i].compare("left_eye_28") == 0)
+		if (left_eye && clnf_model.model->hierarchical_model_names[i].compare("left_eye_28") == 0)
 		{
 			part = i;
 		}
-		if (!left_eye && clnf_model.hierarchical_model_names[i].compare("right_eye_28") == 0)
+		if (!left_eye && clnf_model.model->hierarchical_model_names[i].compare("right_eye_28") == 0)
 		{
 			part = i;
 		}
@@ -40,6 +40,8 @@
 #include <map>
 #include <vector>
 
+#include "ModelBundle.h"
+
 namespace LandmarkDetector
 {
 
@@ -77,6 +79,11 @@ public:
 	CCNF_neuron(const CCNF_neuron& other);
 
 	void Read(std::ifstream &stream);
+
+	// Reading from and writing to a model bundle
+	void Read(const ModelBundle& bundle, const std::string& prefix);
+	void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
+
 	// The im_dft, integral_img, and integral_img_sq are precomputed images for convolution speedups (they get set if passed in empty values)
 	void Response(const cv::Mat_<float> &im, cv::Mat_<double> &im_dft, cv::Mat &integral_img, cv::Mat &integral_img_sq, cv::Mat_<float> &resp);
 
@@ -115,6 +122,10 @@ public:
 
 	void Read(std::ifstream &stream, std::vector<int> window_sizes, std::vector<std::vector<cv::Mat_<float> > > sigma_components);
 
+	// Reading from and writing to a model bundle (the combined weight matrix is stored directly)
+	void Read(const ModelBundle& bundle, const std::string& prefix);
+	void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
+
 	// actual work (can pass in an image and a potential depth image, if the CCNF is trained with depth)
 	void Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 
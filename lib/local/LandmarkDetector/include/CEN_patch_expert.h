@@ -38,12 +38,30 @@
 
 // system includes
 #include <vector>
+#include <algorithm>
 
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+#include "ModelBundle.h"
+
 namespace LandmarkDetector
 {
+	//===========================================================================
+	/**
+	The sparse CEN responses (every second pixel) are interpolated to a full response map, every response pixel being
+	a weighted sum of at most four sparse responses. The stencil depends only on the response size so is computed once per window size
+	*/
+	struct CEN_interpolation_stencil
+	{
+		int response_height;
+		int response_width;
+
+		// For every response pixel (in row major order) the indices of the sparse responses contributing to it and their weights
+		cv::Mat_<int> indices;
+		cv::Mat_<float> weights;
+	};
+
 	//===========================================================================
 	/**
 	The classes describing the CEN patch experts
@@ -62,6 +80,13 @@ namespace LandmarkDetector
 		// Neural weights
 		std::vector<cv::Mat_<float>> weights;
 
+		// Optional quantised neural weights, INT8 with a float scale per output channel (the first layer without the constant input column)
+		// If present the float weights are not kept. This saves memory, not time: without AVX-512 VNNI the blocked INT8 GEMM is only about
+		// as fast as the OpenBLAS float one, and the last layers are slower as quantising their input costs more than the multiplication.
+		// There is no FP16 variant, as OpenBLAS has no half precision GEMM (see test/CENQuantisationTest for the accuracy)
+		std::vector<cv::Mat_<signed char>> weights_quantised;
+		std::vector<cv::Mat_<float>> weight_scales;
+
 		std::vector<int> activation_function;
 		
 		// Confidence of the current patch expert (used for NU_RLMS optimisation)
@@ -75,17 +100,48 @@ namespace LandmarkDetector
 		// Reading in the patch expert
 		void Read(std::ifstream &stream);
 
+		// Reading from and writing to a model bundle
+		void Read(const ModelBundle& bundle, const std::string& prefix);
+		void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
+
+		// Converting the weights to the quantised representation
+		void Quantise();
+		inline bool IsQuantised() const { return !weight_scales.empty(); }
+
 		// The actual response computation from intensity image
 		void Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 
-		void ResponseInternal(cv::Mat_<float>& response);
+		// Computing the response at every second pixel and interpolating the rest, for frontal faces can apply mirrored and non-mirrored experts at the same time
+		// The im2col, the layers and the activations are computed in tiles of samples, using the scratch memory provided by the caller
+		void ResponseSparse(const cv::Mat_<float> &area_of_interest_left, const cv::Mat_<float> &area_of_interest_right, cv::Mat_<float> &response_left, cv::Mat_<float> &response_right, 
+			const CEN_interpolation_stencil& stencil, cv::Mat_<float>& scratch) const;
+
+		inline size_t NumLayers() const { return activation_function.size(); }
+		inline int InputSize() const { return width_support * height_support; }
+		inline int LayerSize(size_t layer) const { return biases[layer].rows; }
+		inline int MaxLayerSize() const { int max_size = 0; for (size_t i = 0; i < biases.size(); ++i) max_size = std::max(max_size, biases[i].rows); return max_size; }
+
+	private:
+
+		// The first layer bias with the weights of the constant im2col input folded in
+		cv::Mat_<float> input_bias;
 
-		// For frontal faces can apply mirrored and non-mirrored experts at the same time
-		void ResponseSparse(const cv::Mat_<float> &area_of_interest_left, const cv::Mat_<float> &area_of_interest_right, cv::Mat_<float> &response_left, cv::Mat_<float> &response_right, cv::Mat_<float>& mapMatrix, cv::Mat_<float>& im2col_prealloc_left, cv::Mat_<float>& im2col_prealloc_right);
+		void FoldInputBias();
+
+		// Computing a single layer (with bias and activation) for samples laid out one per row
+		void ResponseLayer(size_t layer, const float* input, int num_samples, float* output) const;
+
+		void ResponseLayerQuantised(size_t layer, const float* input, int num_samples, const float* bias, float* output) const;
 
 	};
 
-	void interpolationMatrix(cv::Mat_<float>& mapMatrix, int response_height, int response_width, int input_width, int input_height);
+	void interpolationStencil(CEN_interpolation_stencil& stencil, int response_height, int response_width);
+
+	// Number of directly computed samples in a sparse response
+	inline int NumSparseSamples(const CEN_interpolation_stencil& stencil) { return (stencil.response_height * stencil.response_width - 1) / 2; }
+
+	// Interpolating the full response from the sparse one, flipping it horizontally if mirrored
+	void interpolateSparseResponse(const float* sparse_response, const CEN_interpolation_stencil& stencil, bool mirrored, cv::Mat_<float>& response);
 
 }
 #endif // CEN_PATCH_EXPERT_H
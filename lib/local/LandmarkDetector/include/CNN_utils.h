@@ -37,26 +37,126 @@
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+// System includes
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
 namespace LandmarkDetector
 {
+	//===========================================================================
+	// A contiguous NCHW float tensor (batch x channels x height x width), it does not own the data, which lives in a CNN_arena
+	class CNN_tensor
+	{
+	public:
+
+		CNN_tensor() : n(0), c(0), h(0), w(0), data(0) { ; }
+
+		CNN_tensor(int batch, int channels, int height, int width, float* tensor_data) : n(batch), c(channels), h(height), w(width), data(tensor_data) { ; }
+
+		// Shape
+		int n, c, h, w;
+
+		float* data;
+
+		// Strides of the batch and channel dimensions, rows are w elements apart
+		size_t BatchStride() const { return (size_t)c * h * w; }
+		size_t ChannelStride() const { return (size_t)h * w; }
+
+		size_t Size() const { return (size_t)n * c * h * w; }
+
+		float* Plane(int b, int ch) const { return data + b * BatchStride() + ch * ChannelStride(); }
+
+		// A matrix header on a single map of the tensor (no copy)
+		cv::Mat_<float> PlaneMat(int b, int ch) const { return cv::Mat_<float>(h, w, Plane(b, ch)); }
+	};
+
+	//===========================================================================
+	// The memory of CNN inference, the layer outputs alternate between two buffers (ping-pong), so once the arena has grown to the largest layer nothing is allocated any more
+	class CNN_arena
+	{
+	public:
+
+		CNN_arena() : current(0) { ; }
+
+		// A tensor in the buffer that does not hold the current layer input, it then becomes the current one
+		CNN_tensor Next(int n, int c, int h, int w);
+
+		// Scratch memory for the intermediate results of a layer (e.g. im2col), valid until the next call
+		float* Scratch(size_t size);
+
+	private:
+
+		std::vector<float> buffers[2];
+		std::vector<float> scratch;
+		int current;
+	};
+
+	//===========================================================================
+	// The DFTs of the convolution kernels for FFT convolution, computed once per layer and DFT size (which depends on the input size) and kept across frames
+	// The cache is shared by all the threads using a network, and is bounded in memory by evicting the least recently used sizes
+	class CNN_dft_cache
+	{
+	public:
+
+		// The DFTs of a layer, kernel -> input map
+		typedef std::vector<std::vector<cv::Mat_<float> > > KernelDfts;
+
+		CNN_dft_cache(size_t max_memory = 64 * 1024 * 1024) : bytes_used(0), max_bytes(max_memory) { ; }
+
+		// Get the DFTs of the layer kernels at a DFT size, computing and caching them if they are not present yet
+		std::shared_ptr<const KernelDfts> Get(int layer, cv::Size dft_size, const std::vector<std::vector<cv::Mat_<float> > >& kernels);
+
+		void Clear();
+
+		size_t BytesUsed();
+
+	private:
+
+		// Layer, DFT width, DFT height
+		typedef std::tuple<int, int, int> Key;
+
+		std::mutex cache_mutex;
+
+		// Most recently used first
+		std::list<Key> lru;
+		std::map<Key, std::pair<std::shared_ptr<const KernelDfts>, std::list<Key>::iterator> > entries;
+
+		size_t bytes_used;
+		size_t max_bytes;
+	};
+
 	//===========================================================================	
-	// Various CNN layers
+	// Various CNN layers, all of them work on a whole batch, the layers that produce a new tensor take it from the arena
 
-	// Parametric ReLU with leaky weights (separate ones per channel)
-	void PReLU(std::vector<cv::Mat_<float> >& input_output_maps, cv::Mat_<float> prelu_weights);
+	// Parametric ReLU with leaky weights (separate ones per channel), in place
+	void PReLU(CNN_tensor& input_output, const cv::Mat_<float>& prelu_weights);
 
-	// The fully connected layer
-	void fully_connected(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps, cv::Mat_<float> weights, cv::Mat_<float> biases);
+	// The fully connected layer, applied to every pixel if the weights match the number of channels, otherwise to every flattened image (the outputs are then 1x1 maps)
+	void fully_connected(CNN_tensor& output, const CNN_tensor& input, const cv::Mat_<float>& weights, const cv::Mat_<float>& biases, CNN_arena& arena);
 
 	// Max pooling layer with parametrized stride and kernel sizes
-	void max_pooling(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps, int stride_x, int stride_y, int kernel_size_x, int kernel_size_y);
+	void max_pooling(CNN_tensor& output, const CNN_tensor& input, int stride_x, int stride_y, int kernel_size_x, int kernel_size_y, CNN_arena& arena);
 
-	// Convolution using FFT optimization rather than matrix multiplication, TODO do these still work
-	void convolution_fft2(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps, 
+	// Convolution using FFT optimization rather than matrix multiplication, the kernel DFTs come from the cache (under the layer index)
+	void convolution_fft2(CNN_tensor& output, const CNN_tensor& input, 
 		const std::vector<std::vector<cv::Mat_<float> > >& kernels, const std::vector<float >& biases, 
-		std::vector<std::map<int, std::vector<cv::Mat_<double> > > >& precomp_dfts);
+		CNN_dft_cache& dft_cache, int layer, CNN_arena& arena);
 	
-	// Convolution using matrix multiplication and OpenBLAS optimization, can also provide a pre-allocated im2col result for faster processing
-	void convolution_direct_blas(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps, const cv::Mat_<float>& weight_matrix, int height_k, int width_k, cv::Mat_<float>& pre_alloc_im2col);
+	// Convolution using matrix multiplication and OpenBLAS optimization, a single im2col and matrix multiplication for the whole batch
+	// If PReLU weights are provided the activation is applied while the result is moved to the output maps
+	void convolution_direct_blas(CNN_tensor& output, const CNN_tensor& input, const cv::Mat_<float>& weight_matrix, int height_k, int width_k, CNN_arena& arena, const cv::Mat_<float>& prelu_weights = cv::Mat_<float>());
+
+	// Transform 3x3 kernels (kernel -> input map) for Winograd F(2x2,3x3) convolution, the 16 transformed elements are stored as 16 blocks of num_kernels x num_in_maps
+	void winograd_kernels(cv::Mat_<float>& kernels_winograd, const std::vector<std::vector<cv::Mat_<float> > >& kernels);
+
+	// Check if Winograd F(2x2,3x3) is expected to be faster than direct convolution for this input (it does fewer multiplications, but the transforms have a cost and small maps waste part of the 2x2 output tiles)
+	bool winograd_faster(const CNN_tensor& input, int num_kernels);
+
+	// Convolution with 3x3 kernels using Winograd F(2x2,3x3), 16 matrix multiplications for the whole batch, the biases and PReLU (if weights are provided) are applied in the output transform
+	void convolution_winograd(CNN_tensor& output, const CNN_tensor& input, const cv::Mat_<float>& kernels_winograd, const std::vector<float>& biases, CNN_arena& arena, const cv::Mat_<float>& prelu_weights = cv::Mat_<float>());
 }
 #endif // CNN_UTILS_H
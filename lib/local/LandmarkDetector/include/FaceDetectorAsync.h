@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef FACE_DETECTOR_ASYNC_H
+#define FACE_DETECTOR_ASYNC_H
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// System includes
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "LandmarkDetectorModel.h"
+#include "LandmarkDetectorParameters.h"
+
+namespace LandmarkDetector
+{
+	//===========================================================================
+	// Running face detection (and optionally the landmark detection that reinitialises a tracker) on a background thread,
+	// so that the tracking of the frames that follow is not stalled by it. The detection is done on a copy of a frame and
+	// its outcome collected a few frames later, there is at most one detection in progress at a time
+	//===========================================================================
+	class FaceDetectorAsync
+	{
+
+	public:
+
+		// The outcome of a detection
+		struct Result
+		{
+			// All of the faces found, and if the whole frame was searched (a restricted search falls back to the whole frame if it finds nothing)
+			std::vector<cv::Rect_<float> > regions;
+			std::vector<float> confidences;
+			bool full_frame;
+
+			// The face closest to the preference point (or the biggest one), empty if no face was found
+			cv::Rect_<float> chosen_region;
+
+			// When reinitialising a tracker, the copy of it fit to the chosen face (null if no face was found) and whether the fit was successful
+			std::shared_ptr<CLNF> tracker;
+			bool landmark_detection_success;
+		};
+
+		FaceDetectorAsync();
+
+		// Waits for a detection in progress to finish
+		~FaceDetectorAsync();
+
+		FaceDetectorAsync(const FaceDetectorAsync& other) = delete;
+		FaceDetectorAsync & operator= (const FaceDetectorAsync& other) = delete;
+
+		// Starting the detection of the faces in a copy of the frame, with the face detector chosen in the parameters, optionally restricted
+		// to a range of face widths and a region of interest (as in DetectFacesMTCNN). The face detectors of the model should not be used
+		// elsewhere until the detection is collected. Returns false if a detection is still in progress (pending, or dropped but still running)
+		bool Start(const cv::Mat& image, std::shared_ptr<CLNFModel> model, const FaceModelParameters& params, cv::Point preference = cv::Point(-1, -1),
+			float min_width = -1, float max_width = -1, cv::Rect_<float> roi = cv::Rect_<float>(0.0, 0.0, 1.0, 1.0));
+
+		// The same, also detecting the landmarks of the chosen face on a copy of the tracker (as its reinitialisation does)
+		// The copy shares the model with the tracker, so the model has to support being fit by several trackers at once
+		bool Start(const cv::Mat& image, const CLNF& clnf_model, const FaceModelParameters& params, cv::Point preference = cv::Point(-1, -1),
+			float min_width = -1, float max_width = -1, cv::Rect_<float> roi = cv::Rect_<float>(0.0, 0.0, 1.0, 1.0));
+
+		// If a detection was started and not collected yet, and how many frames have passed since it was started
+		bool Pending() const { return pending; }
+		int FramesPending() const { return frames_pending; }
+
+		// Counting the frames processed while the detection is in progress
+		void NextFrame();
+
+		// Collecting the outcome of the detection once it has finished, returns false if no detection was started or if it is still running
+		// (it is then collected on a later frame, so that the tracking is not stalled), unless waiting for it to finish
+		bool Collect(Result& o_result, bool wait = false);
+
+		// Dropping the detection in progress (without waiting for it, its outcome is ignored)
+		void Cancel();
+
+	private:
+
+		// The detection done on the background thread
+		void Detect(std::shared_ptr<CLNFModel> model, FaceModelParameters params, cv::Point preference, float min_width, float max_width, cv::Rect_<float> roi);
+
+		// Preparing for a new detection, false if the previous one is still running
+		bool Prepare(const cv::Mat& image);
+
+		std::thread detection_thread;
+		std::atomic<bool> finished;
+
+		bool pending;
+		int frames_pending;
+
+		// The copy of the frame, and the tracker to reinitialise (if any)
+		cv::Mat image;
+		std::shared_ptr<CLNF> tracker;
+
+		Result result;
+
+	};
+
+}
+#endif // FACE_DETECTOR_ASYNC_H
@@ -38,10 +38,21 @@
 #include <opencv2/core/core.hpp>
 
 // System includes
+#include <map>
 #include <vector>
 
+#include "CNN_utils.h"
+#include "FrameContext.h"
+
 namespace LandmarkDetector
 {
+	// The scratch memory of CNN inference, kept outside of the network so that a network can be used by several threads at once (one workspace per thread)
+	struct CNN_workspace
+	{
+		// The layer activations and the im2col results
+		CNN_arena arena;
+	};
+
 	class CNN
 	{
 	public:
@@ -49,23 +60,31 @@ namespace LandmarkDetector
 		//==========================================
 
 		// Default constructor
-		CNN() { ; }
+		CNN() : dft_cache(std::make_shared<CNN_dft_cache>()) { ; }
 
 		// Copy constructor
 		CNN(const CNN& other);
 
 		// Given an image apply a CNN on it, the boolean direct controls if direct convolution is used (through matrix multiplication) or an FFT optimization
-		std::vector<cv::Mat_<float> > Inference(const cv::Mat& input_img, bool direct = true, bool thread_safe = false);
+		// The network is not modified, so inference is reentrant, the scratch memory is either allocated per call or reused from a workspace
+		// Returns a map per output channel
+		std::vector<cv::Mat_<float> > Inference(const cv::Mat& input_img, bool direct = true) const;
+		std::vector<cv::Mat_<float> > Inference(const cv::Mat& input_img, CNN_workspace& workspace, bool direct = true) const;
+
+		// Apply the CNN on a batch of equally sized float images at once, every convolutional layer is a single im2col and matrix multiplication for the whole batch
+		// Returns a row of network outputs per image (the output maps of the image flattened, e.g. the fully connected outputs of RNet and ONet)
+		cv::Mat_<float> InferenceBatch(const std::vector<cv::Mat>& input_imgs, CNN_workspace& workspace) const;
 
 		// Reading in the model
 		void Read(const std::string& location);
 
-		// Clearing precomputed DFTs
-		void ClearPrecomp();
-
-		size_t NumberOfLayers() { return cnn_layer_types.size(); }
+		size_t NumberOfLayers() const { return cnn_layer_types.size(); }
 
 	private:
+
+		// Apply all of the layers to an input tensor in the workspace arena, the output tensor is in the arena as well
+		CNN_tensor Forward(const CNN_tensor& input, CNN_workspace& workspace, bool direct) const;
+
 		//==========================================
 		// Convolutional Neural Network
 
@@ -73,8 +92,8 @@ namespace LandmarkDetector
 		// Layer -> Weight matrix
 		std::vector<cv::Mat_<float> > cnn_convolutional_layers_weights;
 
-		// Keeping some pre-allocated im2col data as malloc is a significant time cost (not thread safe though)
-		std::vector<cv::Mat_<float> > conv_layer_pre_alloc_im2col;
+		// The kernels transformed for Winograd F(2x2,3x3) convolution, empty for layers without 3x3 kernels
+		std::vector<cv::Mat_<float> > cnn_convolutional_layers_winograd;
 
 		// Layer -> kernel -> input maps
 		std::vector<std::vector<std::vector<cv::Mat_<float> > > > cnn_convolutional_layers;
@@ -85,11 +104,11 @@ namespace LandmarkDetector
 		std::vector<cv::Mat_<float> >  cnn_prelu_layer_weights;
 		std::vector<std::tuple<int, int, int, int> > cnn_max_pooling_layers;
 
-		// Precomputations for faster convolution
-		std::vector<std::vector<std::map<int, std::vector<cv::Mat_<double> > > > > cnn_convolutional_layers_dft;
-
 		// CNN: 0 - convolutional, 1 - max pooling, 2 - fully connected, 3 - prelu, 4 - sigmoid
 		std::vector<int > cnn_layer_types;
+
+		// The kernel DFTs for FFT convolution, kept across frames and shared by the threads using the network
+		std::shared_ptr<CNN_dft_cache> dft_cache;
 	};
 	//===========================================================================
 	//
@@ -114,6 +133,13 @@ namespace LandmarkDetector
 		bool DetectFaces(std::vector<cv::Rect_<float> >& o_regions, const cv::Mat& input_img, 
 			std::vector<float>& o_confidences, int min_face = 60, float t1 = 0.6, float t2 = 0.7, float t3 = 0.7);
 
+		// The same on a frame context, sharing its float image and pyramid levels
+		// The search can be restricted to faces no bigger than max_face (which limits the pyramid scales) and to a region of interest (relative to the image size),
+		// only the region of interest is then scanned
+		bool DetectFaces(std::vector<cv::Rect_<float> >& o_regions, FrameContext& frame,
+			std::vector<float>& o_confidences, int min_face = 60, float t1 = 0.6, float t2 = 0.7, float t3 = 0.7,
+			int max_face = -1, cv::Rect_<float> roi = cv::Rect_<float>(0.0, 0.0, 1.0, 1.0));
+
 		// Reading in the model
 		void Read(const std::string& location);
 
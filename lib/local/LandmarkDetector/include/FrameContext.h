@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_CONTEXT_H
+#define FRAME_CONTEXT_H
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// System includes
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "LandmarkDetectorParameters.h"
+
+namespace LandmarkDetector
+{
+	//===========================================================================
+	// The versions of a frame needed by the different stages (face detection, landmark detection and validation, face analysis)
+	// created once per frame and computed on first use, so the frame is converted and resampled only once no matter how many
+	// trackers, hypotheses or part models use it. The lazy computations are thread safe
+	//===========================================================================
+	class FrameContext
+	{
+	public:
+
+		// The frame (8 bit BGR or grayscale), it is referenced and not copied so should not change while the context is in use
+		explicit FrameContext(const cv::Mat& image);
+
+		// Using an already computed grayscale version of the frame (ignored if empty)
+		FrameContext(const cv::Mat& image, const cv::Mat& grayscale_image);
+
+		// There is one context per frame
+		FrameContext(const FrameContext& other) = delete;
+		FrameContext & operator= (const FrameContext& other) = delete;
+
+		// The frame as it was provided
+		const cv::Mat& Image() const { return image; }
+
+		// The 8 bit grayscale and the float grayscale version of the frame
+		const cv::Mat_<uchar>& Grayscale();
+		const cv::Mat_<float>& GrayscaleFloat();
+
+		// The three channel float version of the frame and its resized versions (levels of the face detection image pyramid)
+		const cv::Mat& ColourFloat();
+		const cv::Mat& ColourFloatResized(const cv::Size& size);
+
+		// The faces found in the frame by a face detector, returns false if that detector has not been run on the frame
+		bool GetFaceDetections(FaceModelParameters::FaceDetector detector, std::vector<cv::Rect_<float> >& regions, std::vector<float>& confidences) const;
+		void SetFaceDetections(FaceModelParameters::FaceDetector detector, const std::vector<cv::Rect_<float> >& regions, const std::vector<float>& confidences);
+
+	private:
+
+		cv::Mat image;
+
+		cv::Mat_<uchar> grayscale;
+		cv::Mat_<float> grayscale_float;
+		cv::Mat colour_float;
+
+		// Keyed by (width, height), the map keeps the references handed out valid
+		std::map<std::pair<int, int>, cv::Mat> colour_float_resized;
+
+		// Face regions and their confidences, for every detector used on the frame
+		std::map<int, std::pair<std::vector<cv::Rect_<float> >, std::vector<float> > > face_detections;
+
+		mutable std::mutex context_mutex;
+	};
+}
+#endif // FRAME_CONTEXT_H
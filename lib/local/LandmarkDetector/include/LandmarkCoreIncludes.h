@@ -36,9 +36,14 @@
 #ifndef LANDMARK_CORE_INCLUDES_H
 #define LANDMARK_CORE_INCLUDES_H
 
+#include "FaceDetectorAsync.h"
+#include "FrameContext.h"
 #include "LandmarkDetectorModel.h"
 #include "LandmarkDetectorFunc.h"
 #include "LandmarkDetectorParameters.h"
 #include "LandmarkDetectorUtils.h"
+#include "QualityController.h"
+#include "SimdDispatch.h"
+#include "ThreadingPolicy.h"
 
 #endif // LANDMARK_CORE_INCLUDES_H
\ No newline at end of file
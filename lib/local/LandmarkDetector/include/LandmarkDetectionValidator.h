@@ -39,9 +39,12 @@
 #include <opencv2/core/core.hpp>
 
 // System includes
+#include <mutex>
 #include <vector>
 
 // Local includes
+#include "CNN_utils.h"
+#include "FrameContext.h"
 #include "PAW.h"
 
 namespace LandmarkDetector
@@ -70,7 +73,6 @@ public:
 	// view -> layer
 	std::vector<std::vector<std::vector<std::vector<cv::Mat_<float> > > > > cnn_convolutional_layers;
 	std::vector<std::vector<cv::Mat_<float> > > cnn_convolutional_layers_weights;
-	std::vector<std::vector<cv::Mat_<float> > > cnn_convolutional_layers_im2col_precomp;
 
 	std::vector< std::vector<int> > cnn_subsampling_layers;
 	std::vector< std::vector<cv::Mat_<float> > > cnn_fully_connected_layers_weights;
@@ -93,14 +95,30 @@ public:
 	// Given an image, orientation and detected landmarks output the result of the appropriate regressor
 	float Check(const cv::Vec3d& orientation, const cv::Mat_<uchar>& intensity_img, cv::Mat_<float>& detected_landmarks);
 
+	// The same on a frame context, reusing its float grayscale image
+	float Check(const cv::Vec3d& orientation, FrameContext& frame, cv::Mat_<float>& detected_landmarks);
+
 	// Reading in the model
 	void Read(std::string location);
+
+	// Reading from and writing to a model bundle
+	void Read(const ModelBundle& bundle, const std::string& prefix);
+	void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
 			
 	// Getting the closest view center based on orientation
 	int GetViewId(const cv::Vec3d& orientation) const;
 
 private:
 
+	// The warps and the CNN keep scratch memory, so checks from trackers sharing the validator are done one at a time
+	std::mutex check_mutex;
+
+	// The memory of the CNN layer activations, reused across checks
+	CNN_arena cnn_arena;
+
+	// The check on an 8 bit or float grayscale image
+	float CheckImage(const cv::Vec3d& orientation, const cv::Mat& intensity_img, cv::Mat_<float>& detected_landmarks);
+
 	// The actual regressor application on the image
 
 	// Convolutional Neural Network
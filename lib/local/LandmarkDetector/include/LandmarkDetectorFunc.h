@@ -41,6 +41,7 @@
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+#include <FrameContext.h>
 #include <LandmarkDetectorParameters.h>
 #include <LandmarkDetectorUtils.h>
 #include <LandmarkDetectorModel.h>
@@ -56,6 +57,10 @@ namespace LandmarkDetector
 	bool DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image);
 	bool DetectLandmarksInVideo(const cv::Mat &rgb_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image);
 
+	// The same on a frame context created once per frame, so that its conversions are shared with the other stages (face detection, face analysis)
+	bool DetectLandmarksInVideo(FrameContext& frame, CLNF& clnf_model, FaceModelParameters& params);
+	bool DetectLandmarksInVideo(FrameContext& frame, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params);
+
 	//================================================================================================================
 	// Landmark detection in image, need to provide an image and optionally CLNF model together with parameters (default values work well)
 	// Optionally can provide a bounding box in which detection is performed (this is useful if multiple faces are to be detected in images)
@@ -65,6 +70,10 @@ namespace LandmarkDetector
 	// Providing a bounding box
 	bool DetectLandmarksInImage(const cv::Mat &rgb_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image);
 
+	// The same on a frame context
+	bool DetectLandmarksInImage(FrameContext& frame, CLNF& clnf_model, FaceModelParameters& params);
+	bool DetectLandmarksInImage(FrameContext& frame, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params);
+
 	//================================================================
 	// Helper function for getting head pose from CLNF parameters
 
@@ -39,6 +39,13 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/objdetect.hpp>
 
+// System includes
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 // dlib dependencies for face detection
 #include <dlib/image_processing/frontal_face_detector.h>
 #include <dlib/opencv.h>
@@ -48,15 +55,21 @@
 #include "LandmarkDetectionValidator.h"
 #include "LandmarkDetectorParameters.h"
 #include "FaceDetectorMTCNN.h"
+#include "FrameContext.h"
+#include "PoseMotionModel.h"
 
 namespace LandmarkDetector
 {
 
-// A main class containing all the modules required for landmark detection
+class FaceDetectorAsync;
+
+// The description of a landmark detector, containing all the modules required for landmark detection
 // Face shape model
 // Patch experts
-// Optimization techniques
-class CLNF{
+// Hierarchical part models, landmark validator and face detectors
+// The model is not changed by tracking, so it can be shared (through std::shared_ptr) across any number of CLNF trackers
+// (trackers sharing a CEN or CCNF model can be fitted concurrently, the SVR patch experts cache their DFTs while fitting so should not be)
+class CLNFModel{
 
 public:
 
@@ -64,28 +77,18 @@ public:
 	// Member variables that contain the model description
 
 	// The linear 3D Point Distribution Model
-    PDM					pdm;
+	PDM					pdm;
 	// The set of patch experts
 	Patch_experts		patch_experts;
 
-	// The local and global parameters describing the current model instance (current landmark detections)
-
-	// Local parameters describing the non-rigid shape
-	cv::Mat_<float>    params_local;
-
-	// Global parameters describing the rigid shape [scale, euler_x, euler_y, euler_z, tx, ty]
-	cv::Vec6f           params_global;
-
 	// A collection of hierarchical CLNF models that can be used for refinement
-	std::vector<CLNF>								hierarchical_models;
+	std::vector<std::shared_ptr<CLNFModel> >		hierarchical_models;
 	std::vector<std::string>						hierarchical_model_names;
 	std::vector<std::vector<std::pair<int,int>>>	hierarchical_mapping;
 	std::vector<FaceModelParameters>				hierarchical_params;
 
 	//==================== Helpers for face detection and landmark detection validation =========================================
 
-	// TODO these should be static, and loading should be made easier
-
 	// Haar cascade classifier for face detection
 	cv::CascadeClassifier   face_detector_HAAR;
 	std::string             haar_face_detector_location;
@@ -99,6 +102,163 @@ public:
 	// Validate if the detected landmarks are correct using an SVR regressor
 	DetectionValidator	landmark_validator; 
 
+	// Indicator if eye model is there for eye detection
+	bool				eye_model;
+
+	// the triangulation per each view (for drawing purposes only)
+	std::vector<cv::Mat_<int> >	triangulations;
+
+	// See if the model was read in correctly
+	bool loaded_successfully;
+
+	// The KDE step of the mean shift is evaluated on a grid of this resolution (in response map pixels)
+	static constexpr float kde_step_size = 0.1f;
+
+	// The speedup of RLMS using precalculated KDE responses (described in Saragih 2011 RLMS paper), shared by all the trackers using the model
+	// They are computed at load time (see PrecomputeKDE) and only read afterwards, one table per response size and KDE sigma stored contiguously
+	struct KDE_table
+	{
+		int resp_size;
+		float a;
+		size_t offset;
+	};
+	std::vector<KDE_table>	kde_tables;
+	std::vector<float>		kde_responses;
+
+	// A default constructor
+	CLNFModel();
+
+	// Constructor from a model file
+	CLNFModel(std::string fname);
+
+	// Constructor from a model bundle
+	CLNFModel(const ModelBundle& bundle, const std::string& prefix);
+
+	// The model is shared and never copied
+	CLNFModel(const CLNFModel& other) = delete;
+	CLNFModel & operator= (const CLNFModel& other) = delete;
+
+	// Reading the model in (either a text model description or a model bundle)
+	void Read(std::string name);
+
+	// Reading from and writing to a model bundle (the face detectors are not part of the bundle)
+	bool Read(const ModelBundle& bundle, const std::string& prefix);
+	void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
+
+	// Quantising the CEN patch experts of the model and its parts to INT8, done before writing a bundle
+	void QuantisePatchExperts();
+
+	// Precomputing the KDE responses for every response size and KDE sigma the parameters lead to (over window_sizes_init and window_sizes_small)
+	// Replaces the previously precomputed ones, not thread safe so should be done before the model is used for tracking
+	void PrecomputeKDE(const FaceModelParameters& parameters);
+
+	// The precomputed KDE responses for a response size and a = -0.5/sigma^2, nullptr if they were not precomputed
+	const float* KDEResponses(int resp_size, float a) const;
+
+	// The landmark detector type the patch experts correspond to
+	FaceModelParameters::LandmarkDetector DetectorType() const;
+
+	// Reading in the HAAR or MTCNN face detector the first time it is needed (HOG is always there), false if it could not be read
+	// The model is shared by the trackers and the background detectors, so this is guarded by a mutex and has to come before any use of the detector
+	bool LoadFaceDetector(FaceModelParameters::FaceDetector detector, const FaceModelParameters& params);
+
+	// Evaluating the KDE of a response map on the grid, for every grid location a row of resp_size^2 values (the table has (resp_size/kde_step_size)^2 rows)
+	static void ComputeKDE(float* kde, int resp_size, float a);
+
+	// The number of values in a KDE table
+	static size_t KDESize(int resp_size);
+
+	// The KDE parameter a = -0.5/sigma^2 of the mean shift
+	static float KDEParameter(float sigma) { return (float)(-0.5 / (sigma * sigma)); }
+
+private:
+
+	// Helper reading function
+	bool Read_CLNF(std::string clnf_location);
+
+	// Fitting parameters of a part based model, also sets eye_model if it is an eye part
+	FaceModelParameters Part_parameters(const std::string& part_name, const std::string& root_loc);
+
+	// Guarding the lazy reading of the face detectors
+	std::mutex face_detector_mutex;
+
+};
+
+// Preallocated memory for the NU-RLMS optimisation of a tracker, sized once for the PDM so that the fitting iterations do no heap allocations
+struct NU_RLMS_workspace
+{
+	// The buffers that depend on the parametrisation, rigid (6 parameters) or non-rigid (6 + number of modes)
+	struct Parametrisation
+	{
+		cv::Mat_<float> J;
+		cv::Mat_<float> J_w_t;
+		cv::Mat_<float> reg_term;
+		cv::Mat_<float> hessian;
+		cv::Mat_<float> J_w_t_m;
+	};
+
+	int num_points = 0;
+	int num_modes = 0;
+
+	Parametrisation rigid;
+	Parametrisation non_rigid;
+
+	cv::Mat_<float> current_local;
+	cv::Mat_<float> current_shape;
+	cv::Mat_<float> previous_shape;
+	cv::Mat_<float> shape_3D;
+	cv::Mat_<float> weight_matrix;
+	cv::Mat_<float> dxs;
+	cv::Mat_<float> dys;
+	cv::Mat_<float> mean_shifts;
+
+	// The landmarks at the start of a fitting scale
+	cv::Mat_<float> fit_shape;
+	cv::Mat_<float> scale_start_shape;
+
+	// The patch expert response maps of every landmark, and the fitting parameters adapted to the current scale
+	std::vector<cv::Mat_<float> > patch_expert_responses;
+	FaceModelParameters scale_parameters;
+
+	// The column (first row) and row (second row) of every response map element for the mean shift, for every response size
+	std::map<int, cv::Mat_<float> > response_coordinates;
+
+	// The KDE responses that were not precomputed by the model (for fitting parameters it was not prepared for), keyed by response size and KDE parameter
+	std::map<std::pair<int, float>, std::vector<float> > kde_responses;
+
+	// The inputs of the batched mean shift: the response maps and KDE rows of the visible landmarks, their locations and mean shifts
+	std::vector<int> mean_shift_landmarks;
+	std::vector<const float*> mean_shift_responses;
+	std::vector<const float*> mean_shift_kde_rows;
+	std::vector<cv::Mat_<float> > continuous_responses;
+	cv::Mat_<float> mean_shift_locations;
+	cv::Mat_<float> mean_shift_outputs;
+
+	// Sizing the buffers for a PDM, does nothing if they already have the right size
+	void Allocate(int num_points, int num_modes);
+};
+
+// A landmark tracker, containing the state of tracking a single face (model instance and tracking history)
+// The model description itself is kept in a shared CLNFModel, so copying or creating a tracker is cheap
+class CLNF{
+
+public:
+
+	// The model being tracked (shared across the trackers)
+	std::shared_ptr<CLNFModel>	model;
+
+	// The local and global parameters describing the current model instance (current landmark detections)
+
+	// Local parameters describing the non-rigid shape
+	cv::Mat_<float>    params_local;
+
+	// Global parameters describing the rigid shape [scale, euler_x, euler_y, euler_z, tx, ty]
+	cv::Vec6f           params_global;
+
+	// The trackers of the hierarchical models that can be used for refinement (corresponding to model->hierarchical_models)
+	std::vector<CLNF>								hierarchical_models;
+	std::vector<FaceModelParameters>				hierarchical_params;
+
 	// Indicating if landmark detection succeeded (based on SVR validator)
 	bool				detection_success; 
 
@@ -111,9 +271,6 @@ public:
 	// Indicator if eye model is there for eye detection
 	bool				eye_model;
 
-	// the triangulation per each view (for drawing purposes only)
-	std::vector<cv::Mat_<int> >	triangulations;
-	
 	//===========================================================================
 	// Member variables that retain the state of the tracking (reflecting the state of the lastly tracked (detected) image
 
@@ -137,6 +294,34 @@ public:
 	// Tracking which view was used last
 	int view_used;
 
+	// The number of scales and optimisation iterations the last fitting actually used (they stop early once converged)
+	int scales_used;
+	int iterations_used;
+
+	// The search windows used by the last fitting, and the expected error of the motion prediction it started from (in pixels, -1 if there was no prediction)
+	std::vector<int> window_sizes_used;
+	float motion_uncertainty;
+
+	// The motion of the tracked face, used to predict the pose and choose the search windows in the next frame
+	PoseMotionModel motion_model;
+
+	// Keyframe tracking state: if the landmarks of the last frame were propagated with optical flow rather than fitted, the frames since the last full fit,
+	// and the optical flow pyramid of the last tracked frame
+	bool landmarks_propagated;
+	int frames_since_keyframe;
+	std::vector<cv::Mat> previous_pyramid;
+
+	// Where the face was last tracked successfully and where it was expected when tracking failed (in pixels, empty if not known),
+	// reinitialisation first looks for the face around these, and the number of such attempts since the whole frame was last scanned
+	cv::Rect_<float> last_face_box;
+	cv::Rect_<float> predicted_face_box;
+	int redetections_since_full_scan;
+
+	// The reinitialisation in progress on a background thread (when detecting asynchronously), every tracker has its own,
+	// and if a reinitialisation could not be started as a dropped one was still running (it is then started on the next frame)
+	std::shared_ptr<FaceDetectorAsync> async_detector;
+	bool async_detection_deferred;
+
 	// See if the model was read in correctly
 	bool loaded_successfully;
 
@@ -145,11 +330,14 @@ public:
 
 	// Constructor from a model file
 	CLNF(std::string fname);
+
+	// Constructor of a tracker from an already loaded model (no model data is copied)
+	CLNF(std::shared_ptr<CLNFModel> model);
 	
-	// Copy constructor (makes a deep copy of the detector)
+	// Copy constructor (makes a deep copy of the tracking state, the model is shared)
 	CLNF(const CLNF& other);
 
-	// Assignment operator for lvalues (makes a deep copy of the detector)
+	// Assignment operator for lvalues (makes a deep copy of the tracking state, the model is shared)
 	CLNF & operator= (const CLNF& other);
 
 	// Empty Destructor	as the memory of every object will be managed by the corresponding libraries (no pointers)
@@ -163,6 +351,10 @@ public:
 
 	// Does the actual work - landmark detection
 	bool DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& params);
+
+	// Landmark detection on a frame context, the float image is shared with the part models and the validator
+	// tracking indicates that the fit starts from the landmarks of the previous frame, which allows the finer scales to be skipped once converged
+	bool DetectLandmarks(FrameContext& frame, FaceModelParameters& params, bool tracking = false);
 	
 	// Gets the shape of the current detected landmarks in camera space (given camera calibration)
 	// Can only be called after a call to DetectLandmarksInVideo or DetectLandmarksInImage
@@ -180,24 +372,38 @@ public:
 	// Reset the model, choosing the face nearest (x,y) where x and y are between 0 and 1.
 	void Reset(double x, double y);
 
-	// Reading the model in
+	// Reading the model in (replaces the model used by this tracker)
 	void Read(std::string name);
+
+	// Setting a flag that abandons the fitting once raised (used when evaluating several initialisations at once), nullptr to disable
+	void SetCancellationFlag(const std::atomic<bool>* cancel_flag) { this->cancel_flag = cancel_flag; }
 	
 private:
 
-	// Helper reading function
-	bool Read_CLNF(std::string clnf_location);
+	// Scratch memory for the im2col patch expert response computation (kept per tracker so that trackers sharing a model can be fitted concurrently)
+	std::vector<std::map<int, cv::Mat_<float> > > preallocated_im2col;
+
+	// Memory for the optimisation, reused across iterations and frames
+	NU_RLMS_workspace optimisation_workspace;
 
-	// the speedup of RLMS using precalculated KDE responses (described in Saragih 2011 RLMS paper)
-	std::map<int, cv::Mat_<float> >		kde_resp_precalc;
+	// If set and raised the fitting is abandoned
+	const std::atomic<bool>* cancel_flag;
+
+	// Setting up the tracking state for the current model
+	void Init();
 
 	// The model fitting: patch response computation and optimisation steps
-    bool Fit(const cv::Mat_<float>& intensity_image, const std::vector<int>& window_sizes, const FaceModelParameters& parameters);
+    bool Fit(const cv::Mat_<float>& intensity_image, const std::vector<int>& window_sizes, const FaceModelParameters& parameters, bool tracking);
+
+	// Mean shift computation that uses precalculated kernel density estimators, done for all of the visible landmarks in one pass
+	void MeanShift_precalc_kde(cv::Mat_<float>& out_mean_shifts, const std::vector<cv::Mat_<float> >& patch_expert_responses, 
+		const cv::Mat_<float> &dxs, const cv::Mat_<float> &dys, int resp_size, float a, int scale, int view_id);
+
+	// The column and row of every element of a response map (reused from the workspace)
+	const cv::Mat_<float>& ResponseCoordinates(int resp_size);
 
-	// Mean shift computation that uses precalculated kernel density estimators (the one actually used)
-	void NonVectorisedMeanShift_precalc_kde(cv::Mat_<float>& out_mean_shifts, const std::vector<cv::Mat_<float> >& patch_expert_responses, 
-		const cv::Mat_<float> &dxs, const cv::Mat_<float> &dys, int resp_size, float a, int scale, int view_id, 
-		std::map<int, cv::Mat_<float> >& mean_shifts);
+	// The KDE responses for a response size and KDE parameter, from the model if precomputed or computed once into the workspace otherwise
+	const float* KDEResponses(int resp_size, float a);
 
 	// The actual model optimisation (update step), returns the model likelihood
     float NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const std::vector<cv::Mat_<float> >& patch_expert_responses, 
@@ -210,6 +416,10 @@ private:
 	void GetWeightMatrix(cv::Mat_<float>& WeightMatrix, int scale, int view_id, const FaceModelParameters& parameters);
 
   };
+
+  // CLNF is the per face tracker of a shared CLNFModel
+  typedef CLNF CLNFTracker;
+
   //===========================================================================
 }
 #endif // LANDMARK_DETECTOR_MODEL_H
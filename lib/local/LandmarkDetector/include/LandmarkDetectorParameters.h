@@ -46,6 +46,13 @@ struct FaceModelParameters
 
 	// A number of RLMS or NU-RLMS iterations
 	int num_optimisation_iteration;
+
+	// The optimisation at a scale stops early once the RMS movement of the landmarks (in pixels) over an iteration falls below this
+	// (0 by default, running every iteration as earlier versions did)
+	float convergence_landmark_threshold;
+
+	// When tracking, the remaining scales are skipped once a whole scale moved the landmarks less than this (RMS in pixels), 0 (the default) to always use every scale
+	float scale_convergence_threshold;
 	
 	// Should pose be limited to 180 degrees frontal
 	bool limit_pose;
@@ -64,6 +71,22 @@ struct FaceModelParameters
 	
 	// Used for the current frame
 	std::vector<int> window_sizes_current;
+
+	// When tracking, predict the pose in the next frame with a constant velocity model, and choose the search windows from how reliable that prediction has been (off by default)
+	bool use_motion_prediction;
+
+	// The expected prediction error, as a fraction of the search radius of the coarsest tracking window, above which the initialisation windows are used
+	float motion_fast_threshold;
+
+	// and below which (measured against the next finer window) the coarsest tracking scale is skipped and fewer optimisation iterations are used
+	float motion_still_threshold;
+
+	// Keyframe tracking (for when only head pose and coarse landmarks are needed): the full landmark detection is only done every keyframe_interval frames,
+	// in between the landmarks are propagated with optical flow (1 to fit every frame)
+	int keyframe_interval;
+
+	// A full fit is done instead of propagating if the median forward-backward optical flow error (in pixels) is above this
+	float keyframe_flow_threshold;
 	
 	// How big is the tracking template that helps with large motions
 	float face_template_scale;	
@@ -88,6 +111,17 @@ struct FaceModelParameters
 	// How often should face detection be used to attempt reinitialisation, every n frames (set to negative not to reinit)
 	int reinit_video_every;
 
+	// When reinitialising a lost face, the face detector first only scans the area around its last known and predicted locations, enlarged by this scale,
+	// and only for faces of a similar size (0, the default, to always scan the whole frame)
+	float redetection_roi_scale;
+
+	// The whole frame is still scanned every n reinitialisation attempts (and whenever nothing was found around the expected locations)
+	int redetection_full_scan_every;
+
+	// Reinitialisation of a lost face runs in the background while the tracking goes on, its outcome is used this many frames later
+	// (0 to detect synchronously, stalling the frame on it)
+	int async_detection_delay;
+
 	// Determining which face detector to use for (re)initialisation, HAAR is quicker but provides more false positives and is not goot for in-the-wild conditions
 	// Also HAAR detector can detect smaller faces while HOG SVM is only capable of detecting faces at least 70px across
 	// MTCNN detector is much more accurate that the other two, and is even suitable for profile faces, but it is somewhat slower
@@ -107,8 +141,15 @@ struct FaceModelParameters
 
 	FaceModelParameters(std::vector<std::string> &arguments);
 
+	// The default parameters of a landmark detector type (without looking for the model files)
+	explicit FaceModelParameters(LandmarkDetector landmark_detector);
+
+	// Adapting the regularisation, KDE sigma and weight factor of the base parameters to a scale of the patch experts (used when refine_parameters is set)
+	void AdaptToScale(const FaceModelParameters& base, const std::vector<double>& patch_scaling, int scale);
+
 	private:
 		void init();
+		void init_detector(LandmarkDetector landmark_detector);
 		void check_model_path(const std::string& root = "/");
 
 };
@@ -89,6 +89,23 @@ namespace LandmarkDetector
 	// The preference point allows for disambiguation if multiple faces are present (pick the closest one), if it is not set the biggest face is chosen
 	bool DetectSingleFaceMTCNN(cv::Rect_<float>& o_region, const cv::Mat& image, LandmarkDetector::FaceDetectorMTCNN& detector, float& confidence, const cv::Point preference = cv::Point(-1, -1));
 
+	// The same on a frame context, the detections are stored with the frame so that the detector is only run once per frame
+	// The search can be restricted to a range of face widths (which limits the pyramid scales) and to a region of interest (only that part of the frame is scanned),
+	// such restricted detections are not stored with the frame
+	bool DetectFacesMTCNN(std::vector<cv::Rect_<float> >& o_regions, FrameContext& frame, LandmarkDetector::FaceDetectorMTCNN& detector, std::vector<float>& confidences,
+		float min_width = -1, float max_width = -1, cv::Rect_<float> roi = cv::Rect_<float>(0.0, 0.0, 1.0, 1.0));
+	bool DetectSingleFaceMTCNN(cv::Rect_<float>& o_region, FrameContext& frame, LandmarkDetector::FaceDetectorMTCNN& detector, float& confidence, const cv::Point preference = cv::Point(-1, -1),
+		float min_width = -1, float max_width = -1, cv::Rect_<float> roi = cv::Rect_<float>(0.0, 0.0, 1.0, 1.0));
+
+	// Face detection with the detector of a face model chosen by the parameters, optionally restricted to a range of face widths and a region of interest (relative to the image size)
+	// The Haar cascade detector provides no confidences, so they are all 1 for it
+	bool DetectFacesInFrame(std::vector<cv::Rect_<float> >& o_regions, std::vector<float>& o_confidences, FrameContext& frame, CLNFModel& model, FaceModelParameters::FaceDetector detector,
+		float min_width = -1, float max_width = -1, cv::Rect_<float> roi = cv::Rect_<float>(0.0, 0.0, 1.0, 1.0));
+
+	// The region of interest (relative to the image size) in which to look for a face that is expected near some face boxes (e.g. its last known and predicted locations),
+	// the area around the boxes enlarged by scale, an empty region if there are no boxes
+	cv::Rect_<float> FaceSearchROI(const std::vector<cv::Rect_<float> >& face_boxes, float scale, const cv::Size& image_size);
+
 	//============================================================================
 	// Matrix reading functionality
 	//============================================================================
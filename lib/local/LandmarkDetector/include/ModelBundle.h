@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MODEL_BUNDLE_H
+#define MODEL_BUNDLE_H
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// System includes
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace LandmarkDetector
+{
+//===========================================================================
+// A versioned binary bundle of named matrices, used for fast model loading
+// The file consists of a header, the matrix data (each blob aligned to 64 bytes) and an index of the entry names
+// Entries are named hierarchically (e.g. "clnf/patch_experts/cen/0/3/17/weights_1"), so the index also describes the scales, views and landmarks
+// The bundle is memory mapped and matrices point directly to the mapped data, so multiple processes share the same physical pages
+//===========================================================================
+class ModelBundle
+{
+public:
+
+	// Current version of the bundle format
+	static const int VERSION = 1;
+
+	// Opening (memory mapping) a bundle, bundles stay mapped for the lifetime of the process as the model matrices point into them
+	// Returns an empty pointer if the bundle could not be opened
+	static std::shared_ptr<const ModelBundle> Open(const std::string& location);
+
+	// Check if the file at the location is a model bundle (as opposed to a text model description)
+	static bool IsBundle(const std::string& location);
+
+	~ModelBundle();
+
+	// The bundle can't be copied as it owns the mapping
+	ModelBundle(const ModelBundle& other) = delete;
+	ModelBundle & operator= (const ModelBundle& other) = delete;
+
+	// The location the bundle was read from
+	const std::string& Location() const { return location; }
+
+	// Check if an entry exists
+	bool Has(const std::string& name) const;
+
+	// Getting the matrix of an entry, the matrix points to the mapped data (no copy is made)
+	bool GetMat(const std::string& name, cv::Mat& output_mat) const;
+
+	// Typed version, only makes a copy if the stored type differs
+	template<typename T>
+	bool GetMat(const std::string& name, cv::Mat_<T>& output_mat) const
+	{
+		cv::Mat stored_mat;
+		bool found = GetMat(name, stored_mat);
+		output_mat = stored_mat;
+		return found;
+	}
+
+	// Helpers for scalar, vector and string entries
+	int GetInt(const std::string& name, int default_value = 0) const;
+	double GetDouble(const std::string& name, double default_value = 0.0) const;
+	std::vector<double> GetDoubles(const std::string& name) const;
+	std::string GetString(const std::string& name) const;
+	std::vector<std::string> GetStrings(const std::string& name) const;
+
+private:
+
+	ModelBundle() : data(nullptr), size(0), file_handle(nullptr), mapping_handle(nullptr) { ; }
+
+	// Location and index of the entries
+	struct Entry
+	{
+		int rows;
+		int cols;
+		int type;
+		size_t offset;
+	};
+
+	std::string location;
+	std::map<std::string, Entry> index;
+
+	// The mapped file
+	const char* data;
+	size_t size;
+
+	// Platform specific handles of the mapping
+	void* file_handle;
+	void* mapping_handle;
+
+	bool Map(const std::string& location);
+};
+
+//===========================================================================
+// Collecting named matrices and writing them out as a model bundle
+//===========================================================================
+class ModelBundleWriter
+{
+public:
+
+	// Adding an entry (the matrix is written out with its current type)
+	void AddMat(const std::string& name, const cv::Mat& mat);
+
+	// Helpers for scalar, vector and string entries
+	void AddInt(const std::string& name, int value);
+	void AddDouble(const std::string& name, double value);
+	void AddDoubles(const std::string& name, const std::vector<double>& values);
+	void AddString(const std::string& name, const std::string& value);
+	void AddStrings(const std::string& name, const std::vector<std::string>& values);
+
+	// Number of entries collected so far
+	size_t Size() const { return entries.size(); }
+
+	// Writing out the bundle
+	bool Write(const std::string& location) const;
+
+private:
+	std::vector<std::pair<std::string, cv::Mat> > entries;
+};
+
+}
+#endif // MODEL_BUNDLE_H
@@ -38,6 +38,8 @@
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+#include "ModelBundle.h"
+
 namespace LandmarkDetector
 {
   //===========================================================================
@@ -109,6 +111,10 @@ namespace LandmarkDetector
 
 		void Read(std::ifstream &s);
 
+		// Reading from and writing to a model bundle
+		void Read(const ModelBundle& bundle, const std::string& prefix);
+		void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
+
 		// The actual warping
 		void Warp(const cv::Mat& image_to_warp, cv::Mat& destination_image, const cv::Mat_<float>& landmarks_to_warp);
 
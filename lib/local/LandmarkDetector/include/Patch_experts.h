@@ -38,6 +38,9 @@
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+// System includes
+#include <map>
+#include <mutex>
 
 #include "SVR_patch_expert.h"
 #include "CCNF_patch_expert.h"
@@ -67,9 +70,6 @@ public:
 	// The collection of CEN patch experts (for intensity images), the experts are laid out scale->view->landmark
 	std::vector<std::vector<std::vector<CEN_patch_expert> > >			cen_expert_intensity;
 
-	//Useful to pre-allocate data for im2col so that it is not allocated for every iteration and every patch
-	std::vector< std::map<int, cv::Mat_<float> > > preallocated_im2col;
-
 	// The available scales for intensity patch experts
 	std::vector<double>							patch_scaling;
 
@@ -98,8 +98,10 @@ public:
 	// Additionally returns the transform from the image coordinates to the response coordinates (and vice versa).
 	// The computation also requires the current landmark locations to compute response around, the PDM corresponding to the desired model, and the parameters describing its instance
 	// Also need to provide the size of the area of interest and the desired scale of analysis
+	// The im2col scratch memory is provided by the caller (per landmark and im2col size), so that several trackers can share the patch experts
 	void Response(std::vector<cv::Mat_<float> >& patch_expert_responses, cv::Matx22f& sim_ref_to_img, cv::Matx22f& sim_img_to_ref, const cv::Mat_<float>& grayscale_image,
-							 const PDM& pdm, const cv::Vec6f& params_global, const cv::Mat_<float>& params_local, int window_size, int scale);
+							 const PDM& pdm, const cv::Vec6f& params_global, const cv::Mat_<float>& params_local, int window_size, int scale,
+							 std::vector<std::map<int, cv::Mat_<float> > >& preallocated_im2col);
 
 	// Getting the best view associated with the current orientation
 	int GetViewIdx(const cv::Vec6f& params_global, int scale) const;
@@ -110,9 +112,29 @@ public:
 	// Reading in all of the patch experts
 	bool Read(std::vector<std::string> intensity_svr_expert_locations, std::vector<std::string> intensity_ccnf_expert_locations,
 		std::vector<std::string> intensity_cen_expert_locations, std::string early_term_loc = "");
+
+	// Reading from and writing to a model bundle
+	bool Read(const ModelBundle& bundle, const std::string& prefix);
+	void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
+
+	// Converting the CEN patch experts to INT8 weights (about 4x less memory for the weights, at a small cost in accuracy and no gain in speed)
+	void Quantise_CEN();
    
 
 private:
+
+	// The CCNF Sigmas are computed on demand, this protects them when several trackers use the patch experts at once
+	std::mutex sigma_mutex;
+
+	// The CEN interpolation stencils for every response size, computed on demand and kept for the lifetime of the patch experts
+	std::map<int, CEN_interpolation_stencil> cen_interpolation_stencils;
+	std::mutex stencil_mutex;
+
+	const CEN_interpolation_stencil& Get_CEN_interpolation_stencil(int response_size);
+
+	void Extract_area_of_interest(const cv::Mat_<float>& grayscale_image, const cv::Mat_<float>& landmark_locations, int ind, float a1, float b1,
+		int area_of_interest_width, int area_of_interest_height, cv::Mat_<float>& area_of_interest) const;
+
 	bool Read_SVR_patch_experts(std::string expert_location, std::vector<cv::Vec3d>& centers, std::vector<cv::Mat_<int> >& visibility, std::vector<std::vector<Multi_SVR_patch_expert> >& patches, double& scale);
 	bool Read_CCNF_patch_experts(std::string patchesFileLocation, std::vector<cv::Vec3d>& centers, std::vector<cv::Mat_<int> >& visibility, std::vector<std::vector<CCNF_patch_expert> >& patches, double& patchScaling);
 	bool Read_CEN_patch_experts(std::string expert_location, std::vector<cv::Vec3d>& centers, std::vector<cv::Mat_<int> >& visibility, std::vector<std::vector<CEN_patch_expert> >& patches, double& scale);
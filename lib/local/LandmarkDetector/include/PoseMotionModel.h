@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef POSE_MOTION_MODEL_H
+#define POSE_MOTION_MODEL_H
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+namespace LandmarkDetector
+{
+	//===========================================================================
+	// A constant velocity model of the global parameters [scale, euler_x, euler_y, euler_z, tx, ty] of a tracked face
+	// Predicts the pose in the next frame and keeps a running estimate of how far off such predictions tend to be,
+	// which is used to choose the search windows when tracking (an alpha-beta filter, the steady state form of a Kalman filter)
+	//===========================================================================
+	class PoseMotionModel
+	{
+
+	public:
+
+		PoseMotionModel();
+
+		// Forget the motion history (when tracking is lost or reinitialised)
+		void Reset();
+
+		// Adding the global parameters fitted in the current frame
+		void Update(const cv::Vec6f& params_global);
+
+		// If enough frames have been seen to predict the motion and its uncertainty
+		bool Ready() const { return updates > 2; }
+
+		// The predicted global parameters in the next frame
+		cv::Vec6f Predict() const;
+
+		// The expected error (RMS, in image pixels) of the predicted landmark locations, for a face of a given radius in pixels
+		float PredictionUncertainty(float face_radius) const;
+
+	private:
+
+		// The current estimate of the global parameters and their velocity (per frame)
+		cv::Vec6f state;
+		cv::Vec6f velocity;
+
+		// Running mean of the squared prediction errors of every global parameter
+		cv::Vec6f error_variance;
+
+		// How many frames have been added since a reset
+		int updates;
+
+	};
+
+}
+#endif // POSE_MOTION_MODEL_H
@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef QUALITY_CONTROLLER_H
+#define QUALITY_CONTROLLER_H
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// System includes
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "LandmarkDetectorParameters.h"
+
+namespace LandmarkDetector
+{
+	//===========================================================================
+	// Keeping the per-frame latency of real-time processing within a deadline, by changing the speed/accuracy levers of the
+	// landmark detector parameters as the measured latencies require (stepping the quality down under load and back up when there is headroom)
+	// Per frame use BeginFrame before processing, StageDone after each stage (optional), and EndFrame once the frame is done
+	//===========================================================================
+	class QualityController
+	{
+
+	public:
+
+		// The quality levels, each one adds a lever to the ones of the levels above it
+		enum QualityLevel { FULL_QUALITY, FAST_FACE_DETECTOR, NO_HIERARCHICAL_REFINEMENT, FEWER_ITERATIONS, SMALLER_WINDOWS, NO_VALIDATION };
+
+		// The target latency (in ms) that the given percentile of the frames should be within, a non-positive target disables the controller
+		QualityController(double target_latency = 33, double percentile = 0.9);
+
+		// Reading the target from the arguments (-deadline <ms> and -deadline_percentile <0-1>), without a deadline the controller is disabled
+		QualityController(std::vector<std::string>& arguments);
+
+		bool Enabled() const { return target_latency > 0; }
+
+		// Setting the levers of the parameters for the coming frame and starting its timing
+		// The parameters the controller first sees are taken as the full quality ones, changes made to them elsewhere afterwards are overridden
+		void BeginFrame(FaceModelParameters& params);
+
+		// Marking the end of a processing stage of the current frame (the time since the last stage or the beginning of the frame)
+		void StageDone(const std::string& stage);
+
+		// Marking the end of the current frame, its latency is used for the quality decisions
+		void EndFrame();
+
+		// The current quality level and a description of the levers it uses
+		QualityLevel GetQualityLevel() const { return quality_level; }
+		std::string GetQualityDescription() const;
+
+		// The measured latency percentile of the recent frames (ms), and the mean latency of every stage (ms)
+		double GetLatencyPercentile() const;
+		const std::map<std::string, double>& GetStageLatencies() const { return stage_latencies; }
+
+	private:
+
+		// The deadline and the fraction of frames that should meet it
+		double target_latency;
+		double percentile;
+
+		// The latencies of the recent frames at the current quality level
+		std::deque<double> frame_latencies;
+
+		// Running mean latency of every stage
+		std::map<std::string, double> stage_latencies;
+
+		QualityLevel quality_level;
+
+		// The parameters at full quality
+		bool base_set;
+		FaceModelParameters base_params;
+
+		// The face detector last set, to notice when the detector falls back to another one (if its model can not be read)
+		FaceModelParameters::FaceDetector applied_face_detector;
+
+		// Timing of the current frame and stage
+		int64 frame_start;
+		int64 stage_start;
+
+		void Init(double target_latency, double percentile);
+
+		// Setting the levers of a quality level
+		void ApplyLevel(FaceModelParameters& params) const;
+
+	};
+
+}
+#endif // QUALITY_CONTROLLER_H
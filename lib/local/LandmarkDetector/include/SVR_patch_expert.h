@@ -42,6 +42,8 @@
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+#include "ModelBundle.h"
+
 namespace LandmarkDetector
 {
   //===========================================================================
@@ -78,6 +80,10 @@ class SVR_patch_expert{
 		// Reading in the patch expert
 		void Read(std::ifstream &stream);
 
+		// Reading from and writing to a model bundle
+		void Read(const ModelBundle& bundle, const std::string& prefix);
+		void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
+
 		// The actual response computation from intensity or depth (for CLM-Z)
 		void Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 		void ResponseDepth(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
@@ -105,6 +111,10 @@ class Multi_SVR_patch_expert{
 
 		void Read(std::ifstream &stream);
 
+		// Reading from and writing to a model bundle
+		void Read(const ModelBundle& bundle, const std::string& prefix);
+		void Write(ModelBundleWriter& bundle, const std::string& prefix) const;
+
 		// actual response computation from intensity of depth (for CLM-Z)
 		void Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
 		void ResponseDepth(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response);
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SIMD_DISPATCH_H
+#define SIMD_DISPATCH_H
+
+// System includes
+#include <cstddef>
+#include <string>
+
+namespace LandmarkDetector
+{
+	//===========================================================================
+	// Runtime dispatch of the hot loops to the widest instruction set the CPU supports
+	// The kernels are compiled for several instruction sets and the best one is picked on first use through cpuid,
+	// the OPENFACE_SIMD environment variable (scalar, sse2, avx2 or avx512) can be used to select a lower one
+	//===========================================================================
+
+	enum SimdLevel { SIMD_SCALAR = 0, SIMD_SSE2 = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3 };
+
+	struct SimdKernels
+	{
+		// Subtracting the mean from a vector and dividing it by its L2 norm (if not 0), in place
+		void(*contrast_normalize)(float* data, int length);
+
+		// max(x, 0), in place
+		void(*relu)(float* data, size_t length);
+
+		// x >= 0 ? x : x * slope, in place
+		void(*prelu)(float* data, size_t length, float slope);
+
+		// acc = max(acc, row), element-wise
+		void(*max_accumulate)(float* acc, const float* row, size_t length);
+
+		// The mean shifts of a number of landmarks in one pass, for landmark i with v = responses[i] * kde_rows[i] (of the given length)
+		// ms_x[i] = sum(v * col) / sum(v) - xs[i] and ms_y[i] = sum(v * row) / sum(v) - ys[i]
+		void(*mean_shifts)(const float* const* responses, const float* const* kde_rows, const float* cols, const float* rows, int length,
+			const float* xs, const float* ys, int count, float* ms_x, float* ms_y);
+
+		// Activations, in place. The SIMD versions evaluate exp through a polynomial (Cephes expf) with a relative error below 2e-7
+		// over the non saturated range, so the sigmoid and softmax outputs stay within 1e-6 of the scalar ones and tanh within 1e-6 absolute
+		// 1 / (1 + exp(-x))
+		void(*sigmoid)(float* data, size_t length);
+
+		// tanh(x), computed as 2 * sigmoid(2x) - 1
+		void(*tanh)(float* data, size_t length);
+
+		// exp(x - max(x)) / sum(exp(x - max(x)))
+		void(*softmax)(float* data, size_t length);
+
+		// c = a * b' of INT8 matrices with rows of the given length (num_a x num_b, row major), accumulated in 32 bit integers
+		// (exact, the products of a length below 2^17 can not overflow). Blocks of rows are multiplied together, so every row loaded is used several times
+		void(*gemm_int8)(const signed char* a, int num_a, const signed char* b, int num_b, int length, int* c);
+	};
+
+	// The kernels for the instruction set in use
+	const SimdKernels& GetSimdKernels();
+
+	// The instruction set in use and the one detected on the CPU
+	SimdLevel GetSimdLevel();
+	SimdLevel DetectSimdLevel();
+
+	const char* SimdLevelName(SimdLevel level);
+
+	// A human readable summary of the instruction set selection, for diagnostics
+	std::string SimdDiagnostics();
+
+	// The kernel tables of the separately compiled instruction sets, returning false if the instruction set was not compiled in
+	bool GetSimdKernelsSSE2(SimdKernels& kernels);
+	bool GetSimdKernelsAVX2(SimdKernels& kernels);
+	bool GetSimdKernelsAVX512(SimdKernels& kernels);
+
+}
+#endif // SIMD_DISPATCH_H
@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef THREADING_POLICY_H
+#define THREADING_POLICY_H
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// System includes
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace LandmarkDetector
+{
+	//===========================================================================
+	// How the process uses threads. The parallel loops of the landmark and face detection share one pool of worker threads,
+	// so running several trackers (or a loop inside another loop) does not multiply the threads, and the thread counts of
+	// OpenBLAS and OpenCV are set in the same place. The policy should be applied before the processing starts
+	//===========================================================================
+	struct ThreadingPolicy
+	{
+		// The number of threads working on the parallel loops, including the thread that starts a loop (0 to use all of the cores, 1 to run the loops serially)
+		int num_threads;
+
+		// The threads OpenBLAS uses inside a single matrix multiplication, 1 by default as the loops around the multiplications are already parallel
+		int blas_threads;
+
+		// The threads OpenCV uses in its own functions, e.g. resizing and warping (-1 to leave the OpenCV default, 0 or 1 to run them serially)
+		int opencv_threads;
+
+		// Should a parallel loop started from inside another one be parallel as well, its iterations then go to the same workers (no threads are added),
+		// otherwise it runs serially on the thread that started it
+		bool nested_parallelism;
+
+		ThreadingPolicy();
+
+		// Reading -threads, -blas_threads, -cv_threads and -nested_parallel from the arguments (removing them)
+		ThreadingPolicy(std::vector<std::string>& arguments);
+
+		// Making the policy the one used by the whole process: the worker pool is recreated and the OpenBLAS and OpenCV thread counts are set
+		// (loops already running finish on the old workers, which are stopped after them)
+		static void Apply(const ThreadingPolicy& policy);
+
+		// The policy in use, the default one until another is applied
+		static ThreadingPolicy Current();
+
+		// Setting the OpenBLAS thread count of the policy in use (done when reading the models, as the patch experts rely on it)
+		static void ApplyBlasThreads();
+
+		// The number of threads the loops run on, with 0 resolved to the number of cores
+		int NumThreads() const;
+	};
+
+	// Running the body over the range on the shared worker pool, the calling thread takes part and the call returns once the whole range is done
+	// The range is split into chunks that are handed out to whichever thread is free (idle workers steal them from the queues of busy ones),
+	// a thread waiting for its loop to finish helps with the other loops in the meantime
+	void ParallelFor(const cv::Range& range, const std::function<void(const cv::Range&)>& body);
+
+}
+
+// The threading policy covers the whole toolkit (landmarks, face analysis and gaze), so it is also available under the OpenFace namespace
+namespace OpenFace
+{
+	using LandmarkDetector::ThreadingPolicy;
+	using LandmarkDetector::ParallelFor;
+}
+#endif // THREADING_POLICY_H
@@ -42,6 +42,8 @@
 
 // Local includes
 #include "LandmarkDetectorUtils.h"
+#include "SimdDispatch.h"
+#include "ThreadingPolicy.h"
 
 using namespace LandmarkDetector;
 
@@ -135,6 +137,27 @@ void CCNF_neuron::Read(std::ifstream &stream)
 
 }
 
+void CCNF_neuron::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	// The scalar parameters are stored together as neuron type, norm weights, bias, alpha
+	cv::Mat_<double> params;
+	bundle.GetMat(prefix + "params", params);
+
+	neuron_type = (int)params(0);
+	norm_weights = params(1);
+	bias = params(2);
+	alpha = params(3);
+
+	bundle.GetMat(prefix + "weights", weights);
+}
+
+void CCNF_neuron::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	cv::Mat_<double> params = (cv::Mat_<double>(1, 4) << neuron_type, norm_weights, bias, alpha);
+	bundle.AddMat(prefix + "params", params);
+	bundle.AddMat(prefix + "weights", weights);
+}
+
 // Perform im2col, while at the same time doing contrast normalization and adding a bias term 
 void im2colContrastNormBias(const cv::Mat_<float>& input, const unsigned int width, const unsigned int height, cv::Mat_<float>& output)
 {
@@ -271,16 +294,13 @@ void CCNF_neuron::Response(const cv::Mat_<float> &im, cv::Mat_<double> &im_dft,
 		matchTemplate_m(I, im_dft, integral_img, integral_img_sq, weights, weights_dfts, resp, cv::TM_CCOEFF_NORMED); // the linear multiplication, efficient calc of response
 	}
 	
-	cv::MatIterator_<float> p = resp.begin();
-
-	cv::MatIterator_<float> q1 = resp.begin(); // respone for each pixel
-	cv::MatIterator_<float> q2 = resp.end();
-
 	// the logistic function (sigmoid) applied to the response
-	while(q1 != q2)
+	resp.convertTo(resp, CV_32F, norm_weights, bias);
+	for (int y = 0; y < resp.rows; ++y)
 	{
-		*p++ = (2 * alpha) * 1.0 /(1.0 + exp( -(*q1++ * norm_weights + bias )));
+		GetSimdKernels().sigmoid(resp.ptr<float>(y), resp.cols);
 	}
+	resp *= 2 * alpha;
 
 }
 
@@ -328,8 +348,8 @@ void CCNF_patch_expert::Read(std::ifstream &stream, std::vector<int> window_size
 		weight_matrix.at<float>(i, 0) = neurons[i].bias;
 	}
 
-	// In case we are using OpenBLAS, make sure it is not multi-threading as we are multi-threading outside of it
-	openblas_set_num_threads(1);
+	// In case we are using OpenBLAS, make sure it uses the threads of the threading policy (a single one by default, as we are multi-threading outside of it)
+	ThreadingPolicy::ApplyBlasThreads();
 
 	int n_sigmas = window_sizes.size();
 
@@ -352,6 +372,54 @@ void CCNF_patch_expert::Read(std::ifstream &stream, std::vector<int> window_size
 
 }
 
+void CCNF_patch_expert::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	// Stored as width, height, number of neurons
+	cv::Mat_<int> size;
+	bundle.GetMat(prefix + "size", size);
+
+	width = size(0);
+	height = size(1);
+	int num_neurons = size(2);
+
+	if (num_neurons == 0)
+	{
+		// empty patch due to landmark being invisible at that orientation
+		return;
+	}
+
+	neurons.resize(num_neurons);
+	for (int i = 0; i < num_neurons; i++)
+		neurons[i].Read(bundle, prefix + std::to_string(i) + "/");
+
+	// The combined weight matrix was precomputed when writing the bundle
+	bundle.GetMat(prefix + "weight_matrix", weight_matrix);
+
+	// In case we are using OpenBLAS, make sure it uses the threads of the threading policy (a single one by default, as we are multi-threading outside of it)
+	ThreadingPolicy::ApplyBlasThreads();
+
+	betas = bundle.GetDoubles(prefix + "betas");
+	patch_confidence = bundle.GetDouble(prefix + "patch_confidence");
+}
+
+void CCNF_patch_expert::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	cv::Mat_<int> size = (cv::Mat_<int>(1, 3) << width, height, (int)neurons.size());
+	bundle.AddMat(prefix + "size", size);
+
+	if (neurons.empty())
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < neurons.size(); i++)
+		neurons[i].Write(bundle, prefix + std::to_string(i) + "/");
+
+	bundle.AddMat(prefix + "weight_matrix", weight_matrix);
+	bundle.AddDoubles(prefix + "betas", betas);
+	bundle.AddDouble(prefix + "patch_confidence", patch_confidence);
+}
+
 //===========================================================================
 void CCNF_patch_expert::Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response)
 {
@@ -420,9 +488,10 @@ void CCNF_patch_expert::ResponseOpenBlas(const cv::Mat_<float> &area_of_interest
 	int response_height = area_of_interest.rows - height + 1;
 	int response_width = area_of_interest.cols - width + 1;
 
-	if (response.rows != response_height || response.cols != response_width)
+	// The response is written in place, so that the memory of the response map is reused across calls
+	if (response.rows != response_height || response.cols != response_width || !response.isContinuous())
 	{
-		response.create(response_height, response_width);
+		response = cv::Mat_<float>(response_height, response_width);
 	}
 
 	response.setTo(0);
@@ -433,20 +502,29 @@ void CCNF_patch_expert::ResponseOpenBlas(const cv::Mat_<float> &area_of_interest
 
 	// the placeholder for the column normalized representation of the image, don't get recalculated for every response
 	im2colContrastNormBias(area_of_interest, neurons[0].weights.cols, neurons[0].weights.rows, im2col_prealloc);
-	cv::Mat_<float> normalized_input = im2col_prealloc.t();
-
-	// the placeholder for the DFT of the image, the integral image, and squared integral image so they don't get recalculated for every response
-	cv::Mat_<double> area_of_interest_dft;
-	cv::Mat integral_image, integral_image_sq;
 
-	cv::Mat_<float> neuron_response;
+	int num_windows = im2col_prealloc.rows;
+	int num_responses = response_height * response_width;
 
+	// Scratch memory for the intermediate results, kept per thread (as several experts are computed at once) and only grown when needed
+	static thread_local std::vector<float> scratch;
+	size_t scratch_size = (size_t)im2col_prealloc.cols * num_windows + (size_t)weight_matrix.rows * num_windows + 2 * (size_t)num_responses;
+	if (scratch.size() < scratch_size)
+	{
+		scratch.resize(scratch_size);
+	}
 
-	int h = area_of_interest.rows - neurons[0].weights.rows + 1;
-	int w = area_of_interest.cols - neurons[0].weights.cols + 1;
+	float* scratch_ptr = scratch.data();
+	cv::Mat_<float> normalized_input(im2col_prealloc.cols, num_windows, scratch_ptr);
+	scratch_ptr += normalized_input.total();
+	cv::Mat_<float> neuron_resp_full(weight_matrix.rows, num_windows, scratch_ptr);
+	scratch_ptr += neuron_resp_full.total();
+	cv::Mat_<float> accumulated_response(response_height, response_width, scratch_ptr);
+	scratch_ptr += num_responses;
+	cv::Mat_<float> transposed_response(response_width, response_height, scratch_ptr);
 
+	cv::transpose(im2col_prealloc, normalized_input);
 
-	cv::Mat_<float> neuron_resp_full(weight_matrix.rows, normalized_input.cols, 0.0f);
 	// Perform matrix multiplication in OpenBLAS (fortran call)
 	float alpha1 = 1.0;
 	float beta1 = 0.0;
@@ -456,24 +534,25 @@ void CCNF_patch_expert::ResponseOpenBlas(const cv::Mat_<float> &area_of_interest
 	// Above is a faster version of this
 	//cv::Mat_<float> neuron_resp_full = this->weight_matrix * normalized_input;
 
+	accumulated_response.setTo(0);
 	for (size_t i = 0; i < neurons.size(); i++)
 	{
 		if (neurons[i].alpha > 1e-4)
 		{
-			cv::MatIterator_<float> p = response.begin();
-
-			cv::Mat_<float> rel_row = neuron_resp_full.row(i);
-			cv::MatIterator_<float> q1 = rel_row.begin(); // respone for each pixel
-			cv::MatIterator_<float> q2 = rel_row.end();
+			float* p = accumulated_response.ptr<float>();
 
 			// the logistic function (sigmoid) applied to the response
-			while (q1 != q2)
+			float* rel_row = neuron_resp_full.ptr<float>(i);
+			GetSimdKernels().sigmoid(rel_row, neuron_resp_full.cols);
+
+			const float neuron_weight = 2.0f * (float)neurons[i].alpha;
+			for (int k = 0; k < neuron_resp_full.cols; ++k)
 			{
-				*p++ += (2.0 * neurons[i].alpha) / (1.0 + exp(-*q1++));
+				*p++ += neuron_weight * rel_row[k];
 			}
 		}
 	}
-	response = response.t();
+	cv::transpose(accumulated_response, transposed_response);
 
 	int s_to_use = -1;
 
@@ -488,19 +567,15 @@ void CCNF_patch_expert::ResponseOpenBlas(const cv::Mat_<float> &area_of_interest
 		}
 	}
 
-	cv::Mat_<float> resp_vec_f = response.reshape(1, response_height * response_width);
-
-	cv::Mat_<float> out(Sigmas[s_to_use].rows, resp_vec_f.cols, 0.0f);
+	cv::Mat_<float> resp_vec_f = transposed_response.reshape(1, num_responses);
 
-	// Perform matrix multiplication in OpenBLAS (fortran call)
+	// Perform matrix multiplication in OpenBLAS (fortran call), straight into the response map
 	alpha1 = 1.0;
 	beta1 = 0.0;
-	sgemm_(N, N, &resp_vec_f.cols, &Sigmas[s_to_use].rows, &Sigmas[s_to_use].cols, &alpha1, (float*)resp_vec_f.data, &resp_vec_f.cols, (float*)Sigmas[s_to_use].data, &Sigmas[s_to_use].cols, &beta1, (float*)out.data, &resp_vec_f.cols);
+	sgemm_(N, N, &resp_vec_f.cols, &Sigmas[s_to_use].rows, &Sigmas[s_to_use].cols, &alpha1, (float*)resp_vec_f.data, &resp_vec_f.cols, (float*)Sigmas[s_to_use].data, &Sigmas[s_to_use].cols, &beta1, (float*)response.data, &resp_vec_f.cols);
 
 	// Above is a faster version of this
-	//cv::Mat out = Sigmas[s_to_use] * resp_vec_f;
-
-	response = out.reshape(1, response_height);
+	//response = (Sigmas[s_to_use] * resp_vec_f).reshape(1, response_height);
 
 	// Making sure the response does not have negative numbers
 	double min;
@@ -42,9 +42,12 @@
 
 // Local includes
 #include "LandmarkDetectorUtils.h"
+#include "SimdDispatch.h"
+#include "ThreadingPolicy.h"
 
 // For exponential
 #include <math.h> 
+#include <algorithm>
 
 using namespace LandmarkDetector;
 
@@ -52,13 +55,14 @@ using namespace LandmarkDetector;
 CEN_patch_expert::CEN_patch_expert(const CEN_patch_expert& other) : confidence(other.confidence), width_support(other.width_support), height_support(other.height_support)
 {
 
-	// Copy the layer weights in a deep way
-	for (size_t i = 0; i < other.weights.size(); ++i)
-	{
-		this->weights.push_back(other.weights[i]);
-		this->biases.push_back(other.biases[i]);
-		this->activation_function.push_back(other.activation_function[i]);
-	}
+	// Copy the layer weights (the matrix data itself is shared)
+	this->weights = other.weights;
+	this->weights_quantised = other.weights_quantised;
+	this->weight_scales = other.weight_scales;
+	this->biases = other.biases;
+	this->activation_function = other.activation_function;
+
+	this->input_bias = other.input_bias;
 
 }
 
@@ -67,7 +71,7 @@ void CEN_patch_expert::Read(std::ifstream &stream)
 {
 
 	// Setting up OpenBLAS
-	openblas_set_num_threads(1);
+	ThreadingPolicy::ApplyBlasThreads();
 	
 	// Sanity check
 	int read_type;
@@ -111,507 +115,482 @@ void CEN_patch_expert::Read(std::ifstream &stream)
 	// Read the patch confidence
 	stream.read((char*)&confidence, 8);
 
+	FoldInputBias();
+
 }
 
-// Contrast normalize the input for response map computation
-void contrastNorm(const cv::Mat_<float>& input, cv::Mat_<float>& output)
+void CEN_patch_expert::Read(const ModelBundle& bundle, const std::string& prefix)
 {
 
-	const unsigned int num_cols = input.cols;
+	// Setting up OpenBLAS
+	ThreadingPolicy::ApplyBlasThreads();
 
-	const unsigned int num_rows = input.rows;
+	// Stored as width, height, number of layers
+	cv::Mat_<int> size;
+	bundle.GetMat(prefix + "size", size);
 
-	output = input.clone();
+	width_support = size(0);
+	height_support = size(1);
+	int num_layers = size(2);
 
-	cv::MatConstIterator_<float> p = input.begin();
+	confidence = bundle.GetDouble(prefix + "confidence");
 
-	// Compute row wise
-	for (unsigned int y = 0; y < num_rows; ++y)
+	if (num_layers == 0)
 	{
-		
-		cv::Scalar mean_s = cv::mean(input(cv::Rect(1,y,num_cols-1, 1)));
-		float mean = (float)mean_s[0];
-
-		p++;
-
-		float sum_sq = 0;
-		for (unsigned int x = 1; x < num_cols; ++x)
-		{
-			float curr = *p++;
-			sum_sq += (curr - mean) * (curr - mean);
-		}
+		// empty patch due to landmark being invisible at that orientation (or visible through mirroring)
+		return;
+	}
 
-		float norm = sqrt(sum_sq);
+	cv::Mat_<int> activations;
+	bundle.GetMat(prefix + "activation_function", activations);
+	activation_function.assign(activations.begin(), activations.end());
 
-		if (norm == 0)
-			norm = 1;
+	biases.resize(num_layers);
+	for (int i = 0; i < num_layers; i++)
+	{
+		bundle.GetMat(prefix + "biases_" + std::to_string(i), biases[i]);
+	}
 
-		for (unsigned int x = 1; x < num_cols; ++x)
+	// Quantised experts store the INT8 weights with their scales and the already folded input bias
+	if (bundle.Has(prefix + "weights_q_0"))
+	{
+		weights_quantised.resize(num_layers);
+		weight_scales.resize(num_layers);
+		for (int i = 0; i < num_layers; i++)
 		{
-			output.at<float>(y, x) = (output.at<float>(y, x) - mean) / norm;
+			bundle.GetMat(prefix + "weights_q_" + std::to_string(i), weights_quantised[i]);
+			bundle.GetMat(prefix + "weight_scales_" + std::to_string(i), weight_scales[i]);
 		}
+		bundle.GetMat(prefix + "input_bias", input_bias);
+		return;
+	}
 
+	weights.resize(num_layers);
+	for (int i = 0; i < num_layers; i++)
+	{
+		bundle.GetMat(prefix + "weights_" + std::to_string(i), weights[i]);
 	}
 
+	FoldInputBias();
 }
 
-void im2colBias(const cv::Mat_<float>& input, const unsigned int width, const unsigned int height, cv::Mat_<float>& output)
+// The first column of the first layer weights is applied to the constant (bias) input of the im2col, so it can be added to the bias instead
+void CEN_patch_expert::FoldInputBias()
 {
-
-	const unsigned int m = input.rows;
-	const unsigned int n = input.cols;
-
-	// determine how many blocks there will be with a sliding window of width x height in the input
-	const unsigned int yB = m - height + 1;
-	const unsigned int xB = n - width + 1;
-
-	// Allocate the output size
-	if(output.rows != xB*yB && output.cols != width * height + 1)
-	{
-		output = cv::Mat::ones(xB*yB, width * height + 1, CV_32F);
-	}
-
-	// Iterate over the blocks
-	for (unsigned int j = 0; j< xB; j++)
+	input_bias.create(weights[0].rows, 1);
+	for (int y = 0; y < weights[0].rows; ++y)
 	{
-		for (unsigned int i = 0; i< yB; i++)
-		{
-			unsigned int rowIdx = i + j*yB;
-
-			for (unsigned int yy = 0; yy < height; ++yy)
-				for (unsigned int xx = 0; xx < width; ++xx)
-				{
-					unsigned int colIdx = xx*height + yy;
-					output.at<float>(rowIdx, colIdx + 1) = input.at<float>(i + yy, j + xx);
-				}
-		}
+		input_bias(y) = biases[0](y) + weights[0](y, 0);
 	}
 }
 
-//===========================================================================
-void CEN_patch_expert::Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response)
+// Symmetric per output channel quantisation of the weights to INT8, the float weights are released afterwards
+void CEN_patch_expert::Quantise()
 {
-
-	int response_height = area_of_interest.rows - height_support + 1;
-	int response_width = area_of_interest.cols - width_support + 1;
-	
-	cv::Mat_<float> input_col;
-	im2colBias(area_of_interest, width_support, height_support, input_col);
-
-	// Mean and standard deviation normalization
-	contrastNorm(input_col, response);
-	response = response.t();
-
-	for (size_t layer = 0; layer < activation_function.size(); ++layer)
+	if (weights.empty() || IsQuantised())
 	{
+		return;
+	}
 
-		// We are performing response = weights[layers] * response(t), but in OpenBLAS as that is significantly quicker than OpenCV		
-		cv::Mat_<float> resp = response;
-		float* m1 = (float*)resp.data;
-		cv::Mat_<float> weight = weights[layer];
-		float* m2 = (float*)weight.data;
-
-		cv::Mat_<float> resp_blas(weight.rows, resp.cols);
-		float* m3 = (float*)resp_blas.data;
-
-		// Perform matrix multiplication in OpenBLAS (fortran call)
-		float alpha1 = 1.0;
-		float beta1 = 0.0;
-		char N[2]; N[0] = 'N';
-		sgemm_(N, N, &resp.cols, &weight.rows, &weight.cols, &alpha1, m1, &resp.cols, m2, &weight.cols, &beta1, m3, &resp.cols);
+	weights_quantised.resize(weights.size());
+	weight_scales.resize(weights.size());
 
-		// The above is a faster version of this, by calling the fortran version directly
-		//cblas_sgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, resp.cols, weight.rows, weight.cols, 1, m1, resp.cols, m2, weight.cols, 0.0, m3, resp.cols);
+	for (size_t layer = 0; layer < weights.size(); ++layer)
+	{
+		// The constant input column of the first layer is already folded into its bias
+		cv::Mat_<float> weight = layer == 0 ? weights[layer].colRange(1, weights[layer].cols) : weights[layer];
 
-		// Adding the bias (bit ugly, but the fastest way to do this)
-		response = resp_blas;
+		weights_quantised[layer].create(weight.rows, weight.cols);
+		weight_scales[layer].create(weight.rows, 1);
 
-		float* data = (float*)response.data;
-		size_t height = response.rows;
-		size_t width = response.cols;
-		float* data_b = (float*)biases[layer].data;
-		for (size_t y = 0; y < height; ++y)
+		for (int y = 0; y < weight.rows; ++y)
 		{
-			float bias = data_b[y];
-			for (size_t x = 0; x < width; ++x)
+			double min_val, max_val;
+			cv::minMaxLoc(weight.row(y), &min_val, &max_val);
+			float scale = (float)std::max(std::abs(min_val), std::abs(max_val)) / 127.0f;
+
+			if (scale == 0)
 			{
-				float in = *data + bias;
-				*data++ = in;
+				scale = 1;
 			}
-		}
 
-		// Perform activation and add bias at the same time	
-		if (activation_function[layer] == 0) // Sigmoid
-		{
-
-			size_t resp_size = response.rows * response.cols;
-
-			// Iterate over the data directly
-			float* data = (float*)response.data;
-
-			for (size_t counter = 0; counter < resp_size; ++counter)
+			weight_scales[layer](y) = scale;
+			for (int x = 0; x < weight.cols; ++x)
 			{
-				float in = *data;
-				*data++ = 1.0 / (1.0 + exp(-(in)));
+				weights_quantised[layer](y, x) = cv::saturate_cast<signed char>(weight(y, x) / scale);
 			}
-
 		}
-		else if (activation_function[layer] == 2)// ReLU
-		{
-			cv::threshold(response, response, 0, 0, cv::THRESH_TOZERO);
-		}
-
 	}
 
-	response = response.t();
-	response = response.reshape(1, response_height);
-	response = response.t();
-
+	weights.clear();
 }
 
-// Perform im2col, while at the same time doing contrast normalization and adding a bias term (also skip every other region)
-void im2colBiasSparseContrastNorm(const cv::Mat_<float>& input, const unsigned int width, const unsigned int height, cv::Mat_<float>& output)
+void CEN_patch_expert::Write(ModelBundleWriter& bundle, const std::string& prefix) const
 {
-	const unsigned int m = input.rows;
-	const unsigned int n = input.cols;
+	cv::Mat_<int> size = (cv::Mat_<int>(1, 3) << width_support, height_support, (int)biases.size());
+	bundle.AddMat(prefix + "size", size);
+	bundle.AddDouble(prefix + "confidence", confidence);
 
-	// determine how many blocks there will be with a sliding window of width x height in the input
-	const unsigned int yB = m - height + 1;
-	const unsigned int xB = n - width + 1;
+	if (biases.empty())
+	{
+		return;
+	}
 
-	// As we will be skipping half of the outputs
-	const unsigned int out_size = (yB*xB - 1) / 2;
+	bundle.AddMat(prefix + "activation_function", cv::Mat_<int>(activation_function, true));
 
-	// Allocate the output size
-	if (output.rows != out_size && output.cols != width * height + 1)
+	for (size_t i = 0; i < biases.size(); i++)
 	{
-		output = cv::Mat::ones(out_size, width * height + 1, CV_32F);
+		bundle.AddMat(prefix + "biases_" + std::to_string(i), biases[i]);
+
+		if (IsQuantised())
+		{
+			bundle.AddMat(prefix + "weights_q_" + std::to_string(i), weights_quantised[i]);
+			bundle.AddMat(prefix + "weight_scales_" + std::to_string(i), weight_scales[i]);
+		}
+		else
+		{
+			bundle.AddMat(prefix + "weights_" + std::to_string(i), weights[i]);
+		}
 	}
 
-	// Iterate over the blocks, skipping every second block
-	unsigned int rowIdx = 0;
-	unsigned int skipCounter = 0;
-	for (unsigned int j = 0; j< xB; j++)
+	if (IsQuantised())
 	{
-		for (unsigned int i = 0; i< yB; i++)
-		{
-			// Skip every second row
-			skipCounter++;
-			if ((skipCounter + 1) % 2 == 0)
-			{
-				continue;
-			}
+		bundle.AddMat(prefix + "input_bias", input_bias);
+	}
+}
 
-			float* Mo = output.ptr<float>(rowIdx);
+//===========================================================================
+void CEN_patch_expert::Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response)
+{
 
-			float sum = 0;
+	int response_height = area_of_interest.rows - height_support + 1;
+	int response_width = area_of_interest.cols - width_support + 1;
+	int num_samples = response_height * response_width;
+	const int num_inputs = InputSize();
 
-			for (unsigned int yy = 0; yy < height; ++yy)
+	// The contrast normalized im2col of every position (going down the columns first), one per row
+	cv::Mat_<float> input_col(num_samples, num_inputs);
+	for (int j = 0; j < response_width; ++j)
+	{
+		for (int i = 0; i < response_height; ++i)
+		{
+			float* Mo = input_col.ptr<float>(i + j * response_height);
+			for (int yy = 0; yy < height_support; ++yy)
 			{
-				const float* Mi = input.ptr<float>(i + yy);
-				for (unsigned int xx = 0; xx < width; ++xx)
+				const float* Mi = area_of_interest.ptr<float>(i + yy);
+				for (int xx = 0; xx < width_support; ++xx)
 				{
-					int colIdx = xx*height + yy;
-					float in = Mi[j + xx];
-					sum += in;
-
-					Mo[colIdx+1] = in;
+					Mo[xx * height_support + yy] = Mi[j + xx];
 				}
 			}
+			GetSimdKernels().contrast_normalize(Mo, num_inputs);
+		}
+	}
 
-			// Working out the mean
-			float mean = sum / (float)(width * height);
-
-			float sum_sq = 0;
-			const unsigned int num_items = width*height + 1;
-			// Working out the sum squared and subtracting the mean
-			for (unsigned int x = 1; x < num_items; ++x)
-			{
-				float in = Mo[x] - mean;
-				Mo[x] = in;
-				sum_sq += in * in;
-			}
-
-			float norm = sqrt(sum_sq);
-
-			// Avoiding division by 0
-			if (norm == 0)
-			{
-				norm = 1;
-			}
-
-			// Flip multiplication to division for speed
-			norm = 1.0 / norm;
-
-			for (unsigned int x = 1; x < num_items; ++x)
-			{
-				Mo[x] *= norm;
-			}
+	cv::Mat_<float> layer_input = input_col;
+	for (size_t layer = 0; layer < NumLayers(); ++layer)
+	{
+		cv::Mat_<float> layer_output(num_samples, LayerSize(layer));
+		ResponseLayer(layer, layer_input.ptr<float>(), num_samples, layer_output.ptr<float>());
+		layer_input = layer_output;
+	}
 
-			rowIdx++;
+	response.create(response_height, response_width);
+	for (int j = 0; j < response_width; ++j)
+	{
+		for (int i = 0; i < response_height; ++i)
+		{
+			response(i, j) = layer_input(i + j * response_height, 0);
 		}
 	}
+
 }
 
-void im2colBiasSparse(const cv::Mat_<float>& input, const unsigned int width, const unsigned int height, cv::Mat_<float>& output)
-{
+// Number of samples processed together by the fused sparse response, small enough for the tile and the layer activations to stay in cache
+const int CEN_TILE_SIZE = 64;
 
+// Perform im2col of a single sample of the sparse response (every other region), while at the same time doing contrast normalization
+// The region can be read from a horizontally mirrored input, avoiding the need to flip it
+void im2colSparseContrastNorm(const cv::Mat_<float>& input, bool mirrored, const unsigned int width, const unsigned int height, int sample, float* Mo)
+{
 	const unsigned int m = input.rows;
 	const unsigned int n = input.cols;
 
 	// determine how many blocks there will be with a sliding window of width x height in the input
 	const unsigned int yB = m - height + 1;
-	const unsigned int xB = n - width + 1;
 
-	// As we will be skipping half of the outputs
-	const unsigned int out_size = (yB*xB - 1) / 2;
+	// Only every second block is computed, going down the columns first
+	const unsigned int block = 2 * sample + 1;
+	const unsigned int i = block % yB;
+	const unsigned int j = block / yB;
 
-	// Allocate the output size
-	if (output.rows != out_size && output.cols != width * height + 1)
+	for (unsigned int yy = 0; yy < height; ++yy)
 	{
-		output = cv::Mat::ones(out_size, width * height + 1, CV_32F);
-	}
-
-	// Iterate over the blocks, skipping every second block
-	unsigned int rowIdx = 0;
-	unsigned int skipCounter = 0;
-	for (unsigned int j = 0; j< xB; j++)
-	{
-		for (unsigned int i = 0; i< yB; i++)
+		const float* Mi = input.ptr<float>(i + yy);
+		for (unsigned int xx = 0; xx < width; ++xx)
 		{
-			// Skip every second row
-			skipCounter++;
-			if ((skipCounter + 1) % 2 == 0)
-			{
-				continue;
-			}
-
-			for (unsigned int yy = 0; yy < height; ++yy)
-			{
-				for (unsigned int xx = 0; xx < width; ++xx)
-				{
-					unsigned int colIdx = xx*height + yy;
-					output.at<float>(rowIdx, colIdx + 1) = input.at<float>(i + yy, j + xx);
-				}
-			}
-			rowIdx++;
+			unsigned int colIdx = xx*height + yy;
+			Mo[colIdx] = mirrored ? Mi[n - 1 - j - xx] : Mi[j + xx];
 		}
 	}
+
+	// Mean and standard deviation normalization
+	GetSimdKernels().contrast_normalize(Mo, width * height);
 }
 
-// As the sparse patch expert output with interpolation, this function creates an interpolation matrix
-void LandmarkDetector::interpolationMatrix(cv::Mat_<float>& mapMatrix, int response_height, int response_width, 
-	int input_width, int input_height)
+// As the sparse patch expert output with interpolation, this function creates an interpolation stencil
+// Every second response (going down the columns) is computed directly, the rest are averages of their computed 4-neighbours
+void LandmarkDetector::interpolationStencil(CEN_interpolation_stencil& stencil, int response_height, int response_width)
 {
-	int m = input_height;
-	int n = input_width;
-
-	// determine how many blocks there will be with a sliding window of width x height in the input
-	int yB = m - 11 + 1;
-	int xB = n - 11 + 1;
+	stencil.response_height = response_height;
+	stencil.response_width = response_width;
 
-	// As we will be skipping half of the outputs
-	int out_size = (yB*xB - 1) / 2;
-
-	mapMatrix.create(out_size, response_height * response_width);
-	mapMatrix.setTo(0.0f);
+	stencil.indices.create(response_height * response_width, 4);
+	stencil.indices.setTo(0);
+	stencil.weights.create(response_height * response_width, 4);
+	stencil.weights.setTo(0.0f);
 
 	// Find a mapping from indices in the computed sparse response and the original full response
-	cv::Mat_<int> value_id_matrix(response_width, response_height, 0);
-
-	int ind = 0;
-	for (int k = 0; k < value_id_matrix.rows * value_id_matrix.cols; ++k)
+	cv::Mat_<int> value_id_matrix(response_height, response_width, 0);
+	for (int x = 0; x < response_width; ++x)
 	{
-		if (k % 2 != 0)
+		for (int y = 0; y < response_height; ++y)
 		{
-			value_id_matrix.at<int>(k) = ind;
-			ind++;
+			int k = x * response_height + y;
+			if (k % 2 != 0)
+			{
+				value_id_matrix(y, x) = k / 2;
+			}
 		}
 	}
-	value_id_matrix = value_id_matrix.t();
 
-	int skip_counter = 0;
-	for (int x = 0; x < response_width; ++x)
+	for (int y = 0; y < response_height; ++y)
 	{
-		for (int y = 0; y < response_height; ++y)
+		for (int x = 0; x < response_width; ++x)
 		{
-			int mapping_col = x * response_height + y;
-			skip_counter++;
-			if (skip_counter % 2 == 0)
+			int pixel = y * response_width + x;
+			int* ids = stencil.indices[pixel];
+			float* weights = stencil.weights[pixel];
+
+			if ((x * response_height + y) % 2 != 0)
 			{
-				int val_id = value_id_matrix.at<int>(y, x);
-				mapMatrix.at<float>(val_id, mapping_col) = 1;
+				ids[0] = value_id_matrix(y, x);
+				weights[0] = 1;
 				continue;
 			}
 
-			float num_neigh = 0.0;
-			std::vector<int> val_ids;
+			int num_neigh = 0;
 			if (x - 1 >= 0)
 			{
-				num_neigh++;
-				val_ids.push_back(value_id_matrix.at<int>(y, x - 1));
+				ids[num_neigh++] = value_id_matrix(y, x - 1);
 			}
 			if (y - 1 >= 0)
 			{
-				num_neigh++;
-				val_ids.push_back(value_id_matrix.at<int>(y - 1, x));
+				ids[num_neigh++] = value_id_matrix(y - 1, x);
 			}
 			if (x + 1 < response_width)
 			{
-				num_neigh++;
-				val_ids.push_back(value_id_matrix.at<int>(y, x + 1));
+				ids[num_neigh++] = value_id_matrix(y, x + 1);
 			}
 			if (y + 1 < response_height)
 			{
-				num_neigh++;
-				val_ids.push_back(value_id_matrix.at<int>(y + 1, x));
+				ids[num_neigh++] = value_id_matrix(y + 1, x);
 			}
 
-			for (size_t k = 0; k < val_ids.size(); ++k)
+			for (int k = 0; k < num_neigh; ++k)
 			{
-				mapMatrix.at<float>(val_ids[k], mapping_col) = 1.0 / num_neigh;
+				weights[k] = 1.0f / num_neigh;
 			}
 		}
 	}
 }
 
-void CEN_patch_expert::ResponseInternal(cv::Mat_<float>& response)
+// The samples are laid out one per row, so every layer is computed as output = input * weights' + bias, with the bias used to initialize the output
+void CEN_patch_expert::ResponseLayer(size_t layer, const float* input, int num_samples, float* output) const
 {
-	for (size_t layer = 0; layer < activation_function.size(); ++layer)
+	// The first layer uses the bias with the weights of the constant input folded in
+	const float* bias = layer == 0 ? input_bias.ptr<float>() : biases[layer].ptr<float>();
+	int num_out = LayerSize(layer);
+
+	if (IsQuantised())
+	{
+		ResponseLayerQuantised(layer, input, num_samples, bias, output);
+	}
+	else
 	{
+		const cv::Mat_<float>& weight = weights[layer];
 
-		// We are performing response = weights[layers] * response, but in OpenBLAS as that is significantly quicker than OpenCV		
-		cv::Mat_<float> resp = response;
-		float* m1 = (float*)resp.data;
-		float* m2 = (float*)weights[layer].data;
+		// The first layer skips the weights of the constant input
+		int input_cols = layer == 0 ? weight.cols - 1 : weight.cols;
+		float* m2 = layer == 0 ? (float*)weight.ptr<float>() + 1 : (float*)weight.ptr<float>();
+		int ld_weight = weight.cols;
 
-		cv::Mat_<float> resp_blas(weights[layer].rows, resp.cols);
-		float* m3 = (float*)resp_blas.data;
+		for (int sample = 0; sample < num_samples; ++sample)
+		{
+			std::copy(bias, bias + num_out, output + sample * num_out);
+		}
 
-		// Perform matrix multiplication in OpenBLAS (fortran call)
+		// Perform matrix multiplication in OpenBLAS (fortran call), accumulating on top of the bias
 		float alpha1 = 1.0;
-		float beta1 = 0.0;
+		float beta1 = 1.0;
 		char N[2]; N[0] = 'N';
-		sgemm_(N, N, &resp.cols, &weights[layer].rows, &weights[layer].cols, &alpha1, m1, &resp.cols, m2, &weights[layer].cols, &beta1, m3, &resp.cols);
+		char T[2]; T[0] = 'T';
+		sgemm_(T, N, &num_out, &num_samples, &input_cols, &alpha1, m2, &ld_weight, (float*)input, &input_cols, &beta1, output, &num_out);
+	}
 
-		// The above is a faster version of this, by calling the fortran version directly
-		//cblas_sgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, resp.cols, weight.rows, weight.cols, 1, m1, resp.cols, m2, weight.cols, 0.0, m3, resp.cols);
+	// Perform activation while the output is still in cache
+	const int resp_size = num_samples * num_out;
+	if (activation_function[layer] == 0) // Sigmoid
+	{
+		GetSimdKernels().sigmoid(output, resp_size);
+	}
+	else if (activation_function[layer] == 2)// ReLU
+	{
+		GetSimdKernels().relu(output, resp_size);
+	}
+}
 
-		response = resp_blas;
+// The integer GEMM, every sample (row) is quantised to INT8 with its own scale, the products are accumulated in 32 bit integers
+// and rescaled by the sample and the output channel scales
+void CEN_patch_expert::ResponseLayerQuantised(size_t layer, const float* input, int num_samples, const float* bias, float* output) const
+{
+	const cv::Mat_<signed char>& weight = weights_quantised[layer];
+	const float* scales = weight_scales[layer].ptr<float>();
+	const int num_out = weight.rows;
+	const int input_cols = weight.cols;
+
+	// The quantised samples, their scales and the integer products, kept per thread as several experts are computed at once
+	// (the sparse response works in tiles, so they only grow to the size of the largest tile)
+	static thread_local std::vector<signed char> quantised_input;
+	static thread_local std::vector<float> input_scales;
+	static thread_local std::vector<int> accumulated;
+	if (quantised_input.size() < (size_t)num_samples * input_cols)
+	{
+		quantised_input.resize((size_t)num_samples * input_cols);
+	}
+	if (input_scales.size() < (size_t)num_samples)
+	{
+		input_scales.resize(num_samples);
+	}
+	if (accumulated.size() < (size_t)num_samples * num_out)
+	{
+		accumulated.resize((size_t)num_samples * num_out);
+	}
 
-		// Alternative is to multiply the responses directly using OpenCV (much slower)
-		//response = weights[layer] * response;
+	for (int sample = 0; sample < num_samples; ++sample)
+	{
+		const float* in = input + sample * input_cols;
+		signed char* q_in = quantised_input.data() + (size_t)sample * input_cols;
 
-		// Adding the bias (bit ugly, but the fastest way to do this), TODO can this bias be incorporated in the above?
-		float* data = (float*)response.data;
-		const unsigned height = response.rows;
-		const unsigned width = response.cols;
-		float* data_b = (float*)biases[layer].data;
-		for (unsigned int y = 0; y < height; ++y)
+		float max_abs = 0;
+		for (int k = 0; k < input_cols; ++k)
 		{
-			float bias = data_b[y];
-			for (unsigned int x = 0; x < width; ++x)
-			{
-				float in = *data + bias;
-				*data++ = in;
-			}
+			max_abs = std::max(max_abs, std::abs(in[k]));
 		}
+		float input_scale = max_abs == 0 ? 1.0f : max_abs / 127.0f;
+		float inv_scale = 1.0f / input_scale;
 
-		// Perform activation and add bias at the same time	
-		if (activation_function[layer] == 0) // Sigmoid
+		for (int k = 0; k < input_cols; ++k)
 		{
+			q_in[k] = (signed char)cvRound(in[k] * inv_scale);
+		}
+		input_scales[sample] = input_scale;
+	}
 
-			const unsigned int resp_size = response.rows * response.cols;
+	GetSimdKernels().gemm_int8(quantised_input.data(), num_samples, weight.ptr<signed char>(), num_out, input_cols, accumulated.data());
 
-			// Iterate over the data directly
-			float* data = (float*)response.data;
+	for (int sample = 0; sample < num_samples; ++sample)
+	{
+		const int* acc = accumulated.data() + (size_t)sample * num_out;
+		float* out = output + sample * num_out;
+		for (int o = 0; o < num_out; ++o)
+		{
+			out[o] = bias[o] + (float)acc[o] * input_scales[sample] * scales[o];
+		}
+	}
+}
 
-			for (unsigned int counter = 0; counter < resp_size; ++counter)
-			{
-				float in = *data;
-				*data++ = 1.0f / (1.0f + exp(-(in)));
-			}
+// Interpolate the full response from the sparse one (flipping it back if it was computed on a mirrored area of interest)
+void LandmarkDetector::interpolateSparseResponse(const float* sparse_response, const CEN_interpolation_stencil& stencil, bool mirrored, cv::Mat_<float>& response)
+{
+	const int height = stencil.response_height;
+	const int width = stencil.response_width;
 
-		}
-		else if (activation_function[layer] == 2)// ReLU
+	response.create(height, width);
+	for (int y = 0; y < height; ++y)
+	{
+		float* out = response.ptr<float>(y);
+		for (int x = 0; x < width; ++x)
 		{
-			cv::threshold(response, response, 0, 0, cv::THRESH_TOZERO);
+			const int* ids = stencil.indices[y * width + x];
+			const float* w = stencil.weights[y * width + x];
+			out[mirrored ? width - 1 - x : x] = w[0] * sparse_response[ids[0]] + w[1] * sparse_response[ids[1]] + w[2] * sparse_response[ids[2]] + w[3] * sparse_response[ids[3]];
 		}
-
 	}
-
 }
 
 //===========================================================================
-void CEN_patch_expert::ResponseSparse(const cv::Mat_<float> &area_of_interest_left, const cv::Mat_<float> &area_of_interest_right, cv::Mat_<float> &response_left, cv::Mat_<float> &response_right, cv::Mat_<float>& mapMatrix, cv::Mat_<float>& im2col_prealloc_left, cv::Mat_<float>& im2col_prealloc_right)
+void CEN_patch_expert::ResponseSparse(const cv::Mat_<float> &area_of_interest_left, const cv::Mat_<float> &area_of_interest_right, cv::Mat_<float> &response_left, cv::Mat_<float> &response_right, 
+	const CEN_interpolation_stencil& stencil, cv::Mat_<float>& scratch) const
 {
-	unsigned int response_height = 0;
 
 	const bool left_provided = !area_of_interest_left.empty();
 	const bool right_provided = !area_of_interest_right.empty();
 
-	if(right_provided)
-	{
-		cv::flip(area_of_interest_right, area_of_interest_right, 1);
-		response_height = area_of_interest_right.rows - height_support + 1;
-		im2colBiasSparseContrastNorm(area_of_interest_right, width_support, height_support, im2col_prealloc_right);
-	}
+	// The mirrored (right) samples follow the left ones, so both are computed together
+	const int num_sparse = NumSparseSamples(stencil);
+	const int num_left = left_provided ? num_sparse : 0;
+	const int num_samples = num_left + (right_provided ? num_sparse : 0);
 
-	// Extract im2col but in a sparse way and contrast normalize
-	if(left_provided)
-	{
-		response_height = area_of_interest_left.rows - height_support + 1;
-		im2colBiasSparseContrastNorm(area_of_interest_left, width_support, height_support, im2col_prealloc_left);
-	}
+	const int num_inputs = width_support * height_support;
+	const int max_layer_size = MaxLayerSize();
 
-	cv::Mat_<float> response;
-	if(right_provided && left_provided)
-	{
-		cv::vconcat(im2col_prealloc_left, im2col_prealloc_right, response);
-		response = response.t();
-	}
-	else if (left_provided)
-	{
-		response = im2col_prealloc_left.t();
-	}
-	else if (right_provided)
+	// Scratch memory: the im2col tile, two tiles of layer activations, and the sparse responses
+	const int scratch_size = CEN_TILE_SIZE * (num_inputs + 2 * max_layer_size) + num_samples;
+	if (scratch.total() < (size_t)scratch_size)
 	{
-		response = im2col_prealloc_right.t();
+		scratch.create(1, scratch_size);
 	}
+	float* tile = scratch.ptr<float>();
+	float* buffer_a = tile + CEN_TILE_SIZE * num_inputs;
+	float* buffer_b = buffer_a + CEN_TILE_SIZE * max_layer_size;
+	float* sparse_response = buffer_b + CEN_TILE_SIZE * max_layer_size;
 
-	ResponseInternal(response);
-	
-	if(left_provided && right_provided)
-	{
-		response_left = response(cv::Rect(0, 0, response.cols / 2, 1));
-		response_right = response(cv::Rect(response.cols / 2, 0, response.cols / 2, 1));
-	}
-	else if (left_provided)
-	{
-		response_left = response;
-	}
-	else if (right_provided)
+	for (int tile_start = 0; tile_start < num_samples; tile_start += CEN_TILE_SIZE)
 	{
-		response_right = response;
+		const int tile_samples = std::min(CEN_TILE_SIZE, num_samples - tile_start);
+
+		// Extract im2col in a sparse way and contrast normalize
+		for (int s = 0; s < tile_samples; ++s)
+		{
+			int sample = tile_start + s;
+			if (sample < num_left)
+			{
+				im2colSparseContrastNorm(area_of_interest_left, false, width_support, height_support, sample, tile + s * num_inputs);
+			}
+			else
+			{
+				im2colSparseContrastNorm(area_of_interest_right, true, width_support, height_support, sample - num_left, tile + s * num_inputs);
+			}
+		}
+
+		// Run all of the layers on the tile, the last one writing the sparse responses
+		const float* layer_input = tile;
+		for (size_t layer = 0; layer < activation_function.size(); ++layer)
+		{
+			float* layer_output = layer == activation_function.size() - 1 ? sparse_response + tile_start : (layer % 2 == 0 ? buffer_a : buffer_b);
+			ResponseLayer(layer, layer_input, tile_samples, layer_output);
+			layer_input = layer_output;
+		}
 	}
 
-	if(left_provided)
+	if (left_provided)
 	{
-		// TODO This could and should be gemm'ed
-		response_left = response_left * mapMatrix;
-		response_left = response_left.t();
-		response_left = response_left.reshape(1, response_height);
-		response_left = response_left.t();
+		interpolateSparseResponse(sparse_response, stencil, false, response_left);
 	}
 
-	if(right_provided)
+	if (right_provided)
 	{
-		// TODO This could and should be gemm'ed
-		response_right = response_right * mapMatrix;
-		response_right = response_right.t();
-		response_right = response_right.reshape(1, response_height);
-		response_right = response_right.t();
-
-		cv::flip(response_right, response_right, 1);
+		interpolateSparseResponse(sparse_response + num_left, stencil, true, response_right);
 	}
-}
\ No newline at end of file
+}
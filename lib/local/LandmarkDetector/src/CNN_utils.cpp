@@ -34,326 +34,317 @@
 #include "stdafx.h"
 
 #include "CNN_utils.h"
+#include "SimdDispatch.h"
+#include "ThreadingPolicy.h"
 
 namespace LandmarkDetector
 {
 
-	// Parametric ReLU with leaky weights (separate ones per channel)
-	void PReLU(std::vector<cv::Mat_<float> >& input_output_maps, cv::Mat_<float> prelu_weights)
+	CNN_tensor CNN_arena::Next(int n, int c, int h, int w)
 	{
+		current = 1 - current;
 
-		if (input_output_maps.size() > 1)
+		size_t size = (size_t)n * c * h * w;
+		if (buffers[current].size() < size)
 		{
-			unsigned int h = input_output_maps[0].rows;
-			unsigned int w = input_output_maps[0].cols;
-			unsigned int size_in = h * w;
-
-			for (int k = 0; k < (int) input_output_maps.size(); ++k)
-			{
-				// Apply the PReLU
-				auto iter = input_output_maps[k].begin();
-
-				float neg_mult = prelu_weights.at<float>(k);
-
-				for (unsigned int i = 0; i < size_in; ++i)
-				{
-					float in_val = *iter;
+			buffers[current].resize(size);
+		}
 
-					// The prelu step
-					*iter++ = in_val >= 0 ? in_val : in_val * neg_mult;
+		return CNN_tensor(n, c, h, w, buffers[current].data());
+	}
 
-				}
-			}
-		}
-		else
+	float* CNN_arena::Scratch(size_t size)
+	{
+		if (scratch.size() < size)
 		{
+			scratch.resize(size);
+		}
+		return scratch.data();
+	}
 
-			int w = input_output_maps[0].cols;
+	// Parametric ReLU with leaky weights (separate ones per channel)
+	void PReLU(CNN_tensor& input_output, const cv::Mat_<float>& prelu_weights)
+	{
+		const SimdKernels& kernels = GetSimdKernels();
 
-			for (int k = 0; k < prelu_weights.rows; ++k)
+		for (int b = 0; b < input_output.n; ++b)
+		{
+			for (int k = 0; k < input_output.c; ++k)
 			{
-				auto iter = input_output_maps[0].row(k).begin();
-				float neg_mult = prelu_weights.at<float>(k);
-
-				for (int i = 0; i < w; ++i)
-				{
-					float in_val = *iter;
-					// Apply the PReLU
-					*iter = in_val >= 0 ? in_val : in_val * neg_mult;					
-
-					// To deal with OpenCV 3.4s debug mode not allowing to go over iteration boundaries
-					if(i + 1 < w)
-					{
-						iter++;
-					}
-				}
+				// The maps are contiguous, so the whole map is done at once
+				kernels.prelu(input_output.Plane(b, k), input_output.ChannelStride(), prelu_weights.at<float>(k));
 			}
-
 		}
-
 	}
 
-	void fully_connected(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps, cv::Mat_<float> weights, cv::Mat_<float> biases)
+	void fully_connected(CNN_tensor& output, const CNN_tensor& input, const cv::Mat_<float>& weights, const cv::Mat_<float>& biases, CNN_arena& arena)
 	{
-		outputs.clear();
+		int num_out = weights.rows;
+		int map_size = input.h * input.w;
+
+		float alpha = 1.0f;
+		float beta = 0.0f;
 
-		if (input_maps.size() > 1)
+		// Treat the input as separate feature maps
+		if (weights.cols == input.c && map_size > 1)
 		{
-			// Concatenate all the maps
-			cv::Size orig_size = input_maps[0].size();
-			cv::Mat_<float> input_concat((int)input_maps.size(), input_maps[0].cols * input_maps[0].rows);
+			output = arena.Next(input.n, num_out, input.h, input.w);
 
-			for (int in = 0; in < (int)input_maps.size(); ++in)
+			char N[2]; N[0] = 'N';
+			int num_in = input.c;
+			for (int b = 0; b < input.n; ++b)
 			{
-				cv::Mat_<float> add = input_maps[in];
+				// Equivalent to out = weights * in, with the maps of an image as the rows of in and out
+				sgemm_(N, N, &map_size, &num_out, &num_in, &alpha, input.Plane(b, 0), &map_size, (float*)weights.data, &num_in, &beta, output.Plane(b, 0), &map_size);
 
-				// Reshape if all of the data will be flattened
-				if (input_concat.rows != weights.cols)
+				for (int k = 0; k < num_out; ++k)
 				{
-					add = add.t();
+					float* out_map = output.Plane(b, k);
+					float bias = biases.at<float>(k);
+					for (int i = 0; i < map_size; ++i)
+					{
+						out_map[i] += bias;
+					}
 				}
-
-				add = add.reshape(0, 1);
-				add.copyTo(input_concat.row(in));
 			}
+		}
+		else
+		{
+			// Flatten every image into a row, the maps are flattened column by column (as the weights were trained that way)
+			int num_in = input.c * map_size;
+			float* input_flat = arena.Scratch((size_t)input.n * num_in);
 
-			// Treat the input as separate feature maps
-			if (input_concat.rows == weights.cols)
+			for (int b = 0; b < input.n; ++b)
 			{
-				input_concat = weights * input_concat;
-				// Add biases
-				for (int k = 0; k < biases.rows; ++k)
-				{
-					input_concat.row(k) = input_concat.row(k) + biases.at<float>(k);
-				}
-
-				outputs.clear();
-				// Resize and add as output
-				for (int k = 0; k < biases.rows; ++k)
+				for (int in = 0; in < input.c; ++in)
 				{
-					cv::Mat_<float> reshaped = input_concat.row(k).clone();
-					reshaped = reshaped.reshape(1, orig_size.height);
-					outputs.push_back(reshaped);
+					const float* in_map = input.Plane(b, in);
+					float* flat = input_flat + (size_t)b * num_in + in * map_size;
+					for (int y = 0; y < input.h; ++y)
+					{
+						for (int x = 0; x < input.w; ++x)
+						{
+							flat[x * input.h + y] = in_map[y * input.w + x];
+						}
+					}
 				}
 			}
-			else
-			{
-				// Flatten the input
-				input_concat = input_concat.reshape(0, input_concat.rows * input_concat.cols);
 
-				input_concat = weights * input_concat + biases;
+			output = arena.Next(input.n, num_out, 1, 1);
 
-				outputs.clear();
-				outputs.push_back(input_concat);
-			}
+			// Equivalent to out = input_flat * weights', with a row per image
+			char N[2]; N[0] = 'N';
+			char T[2]; T[0] = 'T';
+			sgemm_(T, N, &num_out, &output.n, &num_in, &alpha, (float*)weights.data, &num_in, input_flat, &num_in, &beta, output.data, &num_out);
 
+			// Add biases
+			for (int b = 0; b < output.n; ++b)
+			{
+				float* out = output.Plane(b, 0);
+				for (int k = 0; k < num_out; ++k)
+				{
+					out[k] += biases.at<float>(k);
+				}
+			}
 		}
-		else
-		{
-			cv::Mat out = weights * input_maps[0] + biases;
-			outputs.clear();
-			outputs.push_back(out.t());
-		}
-
 	}
 
-
-	void max_pooling(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps, int stride_x, int stride_y, int kernel_size_x, int kernel_size_y)
+	void max_pooling(CNN_tensor& output, const CNN_tensor& input, int stride_x, int stride_y, int kernel_size_x, int kernel_size_y, CNN_arena& arena)
 	{
-		std::vector<cv::Mat_<float> > outputs_sub;
+		// Help with rounding up a bit, to match caffe style output
+		int out_x = (int)round((float)(input.w - kernel_size_x) / (float)stride_x) + 1;
+		int out_y = (int)round((float)(input.h - kernel_size_y) / (float)stride_y) + 1;
 
-		// Iterate over kernel height and width, based on stride
-		for (size_t in = 0; in < input_maps.size(); ++in)
-		{
-			// Help with rounding up a bit, to match caffe style output
-			int out_x = (int)round((float)(input_maps[in].cols - kernel_size_x) / (float)stride_x) + 1;
-			int out_y = (int)round((float)(input_maps[in].rows - kernel_size_y) / (float)stride_y) + 1;
+		output = arena.Next(input.n, input.c, out_y, out_x);
 
-			cv::Mat_<float> sub_out(out_y, out_x, 0.0);
-			cv::Mat_<float> in_map = input_maps[in];
+		const SimdKernels& kernels = GetSimdKernels();
 
-			for (int x = 0; x < input_maps[in].cols; x += stride_x)
-			{
-				int max_x = cv::min(input_maps[in].cols, x + kernel_size_x);
-				int x_in_out = int(x / stride_x);
+		// Every map of every image is pooled separately
+		ParallelFor(cv::Range(0, input.n * input.c), [&](const cv::Range& range) {
+
+			// The maximum over the kernel rows is computed for whole rows at a time, followed by the maximum over the kernel columns
+			std::vector<float> row_max(input.w);
 
-				if (x_in_out >= out_x)
-					continue;
+			for (int map = range.start; map < range.end; ++map)
+			{
+				const float* in_map = input.data + map * input.ChannelStride();
+				float* out_map = output.data + map * output.ChannelStride();
 
-				for (int y = 0; y < input_maps[in].rows; y += stride_y)
+				for (int y = 0; y < input.h; y += stride_y)
 				{
 					int y_in_out = int(y / stride_y);
 
 					if (y_in_out >= out_y)
 						continue;
 
-					int max_y = cv::min(input_maps[in].rows, y + kernel_size_y);
+					int max_y = cv::min(input.h, y + kernel_size_y);
 
-					float curr_max = -FLT_MAX;
+					const float* row = in_map + y * input.w;
+					std::copy(row, row + input.w, row_max.begin());
+					for (int y_in = y + 1; y_in < max_y; ++y_in)
+					{
+						kernels.max_accumulate(row_max.data(), in_map + y_in * input.w, input.w);
+					}
 
-					for (int x_in = x; x_in < max_x; ++x_in)
+					float* out_row = out_map + y_in_out * out_x;
+
+					for (int x = 0; x < input.w; x += stride_x)
 					{
-						for (int y_in = y; y_in < max_y; ++y_in)
+						int max_x = cv::min(input.w, x + kernel_size_x);
+						int x_in_out = int(x / stride_x);
+
+						if (x_in_out >= out_x)
+							continue;
+
+						float curr_max = -FLT_MAX;
+
+						for (int x_in = x; x_in < max_x; ++x_in)
 						{
-							float curr_val = in_map.at<float>(y_in, x_in);
-							if (curr_val > curr_max)
+							if (row_max[x_in] > curr_max)
 							{
-								curr_max = curr_val;
+								curr_max = row_max[x_in];
 							}
 						}
+						out_row[x_in_out] = curr_max;
 					}
-					sub_out.at<float>(y_in_out, x_in_out) = curr_max;
 				}
 			}
-
-			outputs_sub.push_back(sub_out);
-
-		}
-		outputs = outputs_sub;
-
+		});
 	}
 
-	void convolution_single_kern_fft(const std::vector<cv::Mat_<float> >& input_imgs, std::vector<cv::Mat_<double> >& img_dfts, 
-		const std::vector<cv::Mat_<float> >&  _templs, std::map<int, std::vector<cv::Mat_<double> > >& _templ_dfts, cv::Mat_<float>& result)
+	std::shared_ptr<const CNN_dft_cache::KernelDfts> CNN_dft_cache::Get(int layer, cv::Size dft_size, const std::vector<std::vector<cv::Mat_<float> > >& kernels)
 	{
-		// Assume result is defined properly
-		if (result.empty())
-		{
-			cv::Size corrSize(input_imgs[0].cols - _templs[0].cols + 1, input_imgs[0].rows - _templs[0].rows + 1);
-			result.create(corrSize);
-		}
-
-		// Our model will always be under min block size so can ignore this
-		//const double blockScale = 4.5;
-		//const int minBlockSize = 256;
-
-		int maxDepth = CV_64F;
-
-		cv::Size dftsize;
+		Key key(layer, dft_size.width, dft_size.height);
 
-		dftsize.width = cv::getOptimalDFTSize(result.cols + _templs[0].cols - 1);
-		dftsize.height = cv::getOptimalDFTSize(result.rows + _templs[0].rows - 1);
-
-		// Compute block size
-		cv::Size blocksize;
-		blocksize.width = dftsize.width - _templs[0].cols + 1;
-		blocksize.width = MIN(blocksize.width, result.cols);
-		blocksize.height = dftsize.height - _templs[0].rows + 1;
-		blocksize.height = MIN(blocksize.height, result.rows);
-
-		std::vector<cv::Mat_<double>> dftTempl;
-
-		// if this has not been precomputed, precompute it, otherwise use it
-		if (_templ_dfts.find(dftsize.width) == _templ_dfts.end())
 		{
-			dftTempl.resize(_templs.size());
-			for (size_t k = 0; k < _templs.size(); ++k)
+			std::lock_guard<std::mutex> lock(cache_mutex);
+			auto entry = entries.find(key);
+			if (entry != entries.end())
 			{
-				dftTempl[k].create(dftsize.height, dftsize.width);
-
-				cv::Mat_<float> src = _templs[k];
-
-				cv::Mat_<double> dst(dftTempl[k], cv::Rect(0, 0, dftsize.width, dftsize.height));
-
-				cv::Mat_<double> dst1(dftTempl[k], cv::Rect(0, 0, _templs[k].cols, _templs[k].rows));
-
-				if (dst1.data != src.data)
-					src.convertTo(dst1, dst1.depth());
-
-				if (dst.cols > _templs[k].cols)
-				{
-					cv::Mat_<double> part(dst, cv::Range(0, _templs[k].rows), cv::Range(_templs[k].cols, dst.cols));
-					part.setTo(0);
-				}
-
-				// Perform DFT of the template
-				dft(dst, dst, 0, _templs[k].rows);
-
+				// Move to the front of the LRU list
+				lru.splice(lru.begin(), lru, entry->second.second);
+				return entry->second.first;
 			}
-			_templ_dfts[dftsize.width] = dftTempl;
-
 		}
-		else
-		{
-			dftTempl = _templ_dfts[dftsize.width];
-		}
-
-		cv::Size bsz(std::min(blocksize.width, result.cols), std::min(blocksize.height, result.rows));
-		cv::Mat src;
-
-		cv::Mat cdst(result, cv::Rect(0, 0, bsz.width, bsz.height));
 
-		std::vector<cv::Mat_<double> > dftImgs;
-		dftImgs.resize(input_imgs.size());
-
-		if (img_dfts.empty())
+		// Compute the DFTs outside of the lock, so other threads can keep using the cache
+		std::shared_ptr<KernelDfts> dfts = std::make_shared<KernelDfts>(kernels.size());
+		size_t bytes = 0;
+		for (size_t k = 0; k < kernels.size(); ++k)
 		{
-			for (size_t k = 0; k < input_imgs.size(); ++k)
+			(*dfts)[k].resize(kernels[k].size());
+			for (size_t in = 0; in < kernels[k].size(); ++in)
 			{
-				dftImgs[k].create(dftsize);
-				dftImgs[k].setTo(0.0);
-
-				cv::Size dsz(bsz.width + _templs[k].cols - 1, bsz.height + _templs[k].rows - 1);
+				const cv::Mat_<float>& kernel = kernels[k][in];
 
-				int x2 = std::min(input_imgs[k].cols, dsz.width);
-				int y2 = std::min(input_imgs[k].rows, dsz.height);
+				// Zero pad the kernel to the DFT size
+				cv::Mat_<float> kernel_dft(dft_size.height, dft_size.width, 0.0f);
+				kernel.copyTo(kernel_dft(cv::Rect(0, 0, kernel.cols, kernel.rows)));
+				cv::dft(kernel_dft, kernel_dft, 0, kernel.rows);
 
-				cv::Mat src0(input_imgs[k], cv::Range(0, y2), cv::Range(0, x2));
-				cv::Mat dst(dftImgs[k], cv::Rect(0, 0, dsz.width, dsz.height));
-				cv::Mat dst1(dftImgs[k], cv::Rect(0, 0, x2, y2));
-
-				src = src0;
+				(*dfts)[k][in] = kernel_dft;
+				bytes += kernel_dft.total() * kernel_dft.elemSize();
+			}
+		}
 
-				if (dst1.data != src.data)
-					src.convertTo(dst1, dst1.depth());
+		std::lock_guard<std::mutex> lock(cache_mutex);
 
-				dft(dftImgs[k], dftImgs[k], 0, dsz.height);
-				img_dfts.push_back(dftImgs[k].clone());
-			}
+		// Another thread might have added the same DFTs in the meantime
+		auto entry = entries.find(key);
+		if (entry != entries.end())
+		{
+			return entry->second.first;
 		}
 
-		cv::Mat_<double> dft_img(img_dfts[0].rows, img_dfts[0].cols, 0.0);
-		for (size_t k = 0; k < input_imgs.size(); ++k)
+		lru.push_front(key);
+		entries[key] = std::make_pair(std::shared_ptr<const KernelDfts>(dfts), lru.begin());
+		bytes_used += bytes;
+
+		// Evict the least recently used sizes when over the memory cap (the entries in use stay alive until released)
+		while (bytes_used > max_bytes && lru.size() > 1)
 		{
-			cv::Mat dftTempl1(dftTempl[k], cv::Rect(0, 0, dftsize.width, dftsize.height));
-			if (k == 0)
-			{
-				cv::mulSpectrums(img_dfts[k], dftTempl1, dft_img, 0, true);
-			}
-			else
+			auto evicted = entries.find(lru.back());
+			for (const auto& kernel_dfts : *evicted->second.first)
 			{
-				cv::mulSpectrums(img_dfts[k], dftTempl1, dftImgs[k], 0, true);
-				dft_img = dft_img + dftImgs[k];
+				for (const auto& kernel_dft : kernel_dfts)
+				{
+					bytes_used -= kernel_dft.total() * kernel_dft.elemSize();
+				}
 			}
+			entries.erase(evicted);
+			lru.pop_back();
 		}
 
-		cv::dft(dft_img, dft_img, cv::DFT_INVERSE + cv::DFT_SCALE, bsz.height);
-
-		src = dft_img(cv::Rect(0, 0, bsz.width, bsz.height));
+		return dfts;
+	}
 
-		src.convertTo(cdst, CV_32F);
+	void CNN_dft_cache::Clear()
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		lru.clear();
+		entries.clear();
+		bytes_used = 0;
+	}
 
+	size_t CNN_dft_cache::BytesUsed()
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		return bytes_used;
 	}
 
-	void convolution_fft2(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps,
+	void convolution_fft2(CNN_tensor& output, const CNN_tensor& input,
 		const std::vector<std::vector<cv::Mat_<float> > >& kernels, const std::vector<float >& biases,
-		std::vector<std::map<int, std::vector<cv::Mat_<double> > > >& precomp_dfts)
+		CNN_dft_cache& dft_cache, int layer, CNN_arena& arena)
 	{
-		outputs.clear();
+		int height_k = kernels[0][0].rows;
+		int width_k = kernels[0][0].cols;
 
-		// Useful precomputed data placeholders for quick correlation (convolution)
-		std::vector<cv::Mat_<double> > input_image_dft;
+		int out_h = input.h - height_k + 1;
+		int out_w = input.w - width_k + 1;
 
-		for (size_t k = 0; k < kernels.size(); ++k)
+		output = arena.Next(input.n, (int)kernels.size(), out_h, out_w);
+
+		// Our model will always be under min block size, so the whole correlation is done as a single block
+		cv::Size dft_size(cv::getOptimalDFTSize(input.w), cv::getOptimalDFTSize(input.h));
+
+		std::shared_ptr<const CNN_dft_cache::KernelDfts> kernel_dfts = dft_cache.Get(layer, dft_size, kernels);
+
+		std::vector<cv::Mat_<float> > input_dfts(input.c);
+		cv::Mat_<float> product;
+		cv::Mat_<float> correlation;
+
+		for (int b = 0; b < input.n; ++b)
 		{
+			// The DFTs of the input maps are shared by all the kernels
+			for (int in = 0; in < input.c; ++in)
+			{
+				input_dfts[in] = cv::Mat_<float>(dft_size.height, dft_size.width, 0.0f);
+				input.PlaneMat(b, in).copyTo(input_dfts[in](cv::Rect(0, 0, input.w, input.h)));
+				cv::dft(input_dfts[in], input_dfts[in], 0, input.h);
+			}
 
-			// The convolution (with precomputation)
-			cv::Mat_<float> output;
-			convolution_single_kern_fft(input_maps, input_image_dft, kernels[k], precomp_dfts[k], output);
+			for (size_t k = 0; k < kernels.size(); ++k)
+			{
+				// Correlation with every input map is a product with the conjugate kernel spectrum, summed over the input maps
+				for (int in = 0; in < input.c; ++in)
+				{
+					if (in == 0)
+					{
+						cv::mulSpectrums(input_dfts[in], (*kernel_dfts)[k][in], correlation, 0, true);
+					}
+					else
+					{
+						cv::mulSpectrums(input_dfts[in], (*kernel_dfts)[k][in], product, 0, true);
+						correlation += product;
+					}
+				}
 
-			// Combining the maps
-			outputs.push_back(output + biases[k]);
+				cv::dft(correlation, correlation, cv::DFT_INVERSE + cv::DFT_SCALE, out_h);
 
+				// Combining the maps
+				cv::Mat_<float> out_map = output.PlaneMat(b, (int)k);
+				out_map = correlation(cv::Rect(0, 0, out_w, out_h)) + biases[k];
+			}
 		}
 	}
 
@@ -442,12 +433,12 @@ namespace LandmarkDetector
 		}
 	}
 
-	void im2col_multimap(const std::vector<cv::Mat_<float> >& inputs, const unsigned int width, const unsigned int height, 
-		cv::Mat_<float>& output)
+	// The im2col of a single image of the tensor, the kernel elements go down the columns first (matching the weight matrices), and the last column is the bias term
+	void im2col_tensor(const CNN_tensor& input, int b, const unsigned int width, const unsigned int height, float* output)
 	{
 	
-		const unsigned int m = inputs[0].rows;
-		const unsigned int n = inputs[0].cols;
+		const unsigned int m = input.h;
+		const unsigned int n = input.w;
 	
 		// determine how many blocks there will be with a sliding window of width x height in the input
 		const unsigned int yB = m - height + 1;
@@ -455,13 +446,8 @@ namespace LandmarkDetector
 	
 		int stride = height * width;
 	
-		unsigned int num_maps = (unsigned int)inputs.size();
-	
-		// Allocate the output size
-		if (output.cols != width * height * inputs.size() + 1 || (unsigned int) output.rows < xB*yB)
-		{
-			output = cv::Mat::ones(xB*yB, width * height * num_maps + 1, CV_32F);
-		}
+		unsigned int num_maps = (unsigned int)input.c;
+		unsigned int num_cols = width * height * num_maps + 1;
 	
 		// Iterate over the whole image
 		for (unsigned int i = 0; i< yB; i++)
@@ -470,9 +456,7 @@ namespace LandmarkDetector
 			for (unsigned int j = 0; j< xB; j++)
 			{
 	
-				float* Mo = output.ptr<float>(rowIdx);
-
-				// TODO, this should be rearranged and done through mem-copy
+				float* Mo = output + (size_t)rowIdx * num_cols;
 
 				// iterate over the blocks within the image
 				for (unsigned int yy = 0; yy < height; ++yy)
@@ -480,64 +464,287 @@ namespace LandmarkDetector
 					for (unsigned int in_maps = 0; in_maps < num_maps; ++in_maps)
 					{
 						// Faster iteration over the image
-						const float* Mi = inputs[in_maps].ptr<float>(i + yy);
+						const float* Mi = input.Plane(b, in_maps) + (i + yy) * n;
 	
 						for (unsigned int xx = 0; xx < width; ++xx)
 						{
 							unsigned int colIdx = xx*height + yy + in_maps * stride;
-							//output.at<float>(rowIdx, colIdx) = Mi[j + xx]; //input.at<float>(i + yy, j + xx);
 							Mo[colIdx] = Mi[j + xx];
 						}
 					}
 				}
+				Mo[num_cols - 1] = 1.0f;
 				rowIdx++;
 	
 			}
 		}
 	}
 
-	// A fast convolution implementation, can provide a pre-allocated im2col as well, if empty, it is created
-	void convolution_direct_blas(std::vector<cv::Mat_<float> >& outputs, const std::vector<cv::Mat_<float> >& input_maps, const cv::Mat_<float>& weight_matrix, int height_k, int width_k, cv::Mat_<float>& pre_alloc_im2col)
+	// A fast convolution implementation, the im2col of the whole batch is a single matrix in the arena scratch memory
+	void convolution_direct_blas(CNN_tensor& output, const CNN_tensor& input, const cv::Mat_<float>& weight_matrix, int height_k, int width_k, CNN_arena& arena, const cv::Mat_<float>& prelu_weights)
 	{
-		outputs.clear();
-	
-		int height_in = input_maps[0].rows;
-		int width_n = input_maps[0].cols;
-	
-		// determine how many blocks there will be with a sliding window of width x height in the input
-		int yB = height_in - height_k + 1;
-		int xB = width_n - width_k + 1;
+		// determine how many blocks there will be with a sliding window of width x height in every image
+		int yB = input.h - height_k + 1;
+		int xB = input.w - width_k + 1;
 		int num_rows = yB * xB;
+		int num_rows_batch = num_rows * input.n;
+		int num_cols = width_k * height_k * input.c + 1;
+		int num_kernels = weight_matrix.cols;
+
+		// The im2col of every image followed by the matrix multiplication result
+		float* im2col_batch = arena.Scratch((size_t)num_rows_batch * (num_cols + num_kernels));
+		float* out = im2col_batch + (size_t)num_rows_batch * num_cols;
+
+		// Every image fills its own block of rows of the im2col matrix
+		ParallelFor(cv::Range(0, input.n), [&](const cv::Range& range) {
+			for (int b = range.start; b < range.end; ++b)
+			{
+				im2col_tensor(input, b, width_k, height_k, im2col_batch + (size_t)b * num_rows * num_cols);
+			}
+		});
 
-		// Instead of re-allocating data use the first rows of already allocated data and re-allocate only if not enough rows are present, this is what makes this non thread safe, as same memory would be used
-		im2col_multimap(input_maps, width_k, height_k, pre_alloc_im2col);
-		
-		float* m1 = (float*)pre_alloc_im2col.data;
 		float* m2 = (float*)weight_matrix.data;
 		int m2_cols = weight_matrix.cols;
-		int m2_rows = weight_matrix.rows;
 
-		cv::Mat_<float> out(num_rows, weight_matrix.cols, 1.0);
-		float* m3 = (float*)out.data;
-		
-		//cblas_sgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, weight_t.cols, yB * xB, pre_alloc_im2col.cols, 1, m2, weight_t.cols, m1, pre_alloc_im2col.cols, 0.0, m3, weight_t.cols);
 		float alpha = 1.0f;
 		float beta = 0.0f;
 		// Call fortran directly (faster)
 		char N[2]; N[0] = 'N';
-		sgemm_(N, N, &m2_cols, &num_rows, &pre_alloc_im2col.cols, &alpha, m2, &m2_cols, m1, &pre_alloc_im2col.cols, &beta, m3, &m2_cols);
+		sgemm_(N, N, &m2_cols, &num_rows_batch, &num_cols, &alpha, m2, &m2_cols, im2col_batch, &num_cols, &beta, out, &m2_cols);
 
-		// Above is equivalent to out = pre_alloc_im2col * weight_matrix;
-		
-		out = out.t();
-
-		// Move back to vectors and reshape accordingly
-		for (int k = 0; k < out.rows; ++k)
+		// Above is equivalent to out = im2col_batch * weight_matrix, with a row per position and a column per kernel, so the block of every image is transposed into its maps
+		output = arena.Next(input.n, num_kernels, yB, xB);
+		if (prelu_weights.empty())
 		{
-			outputs.push_back(out.row(k).reshape(1, yB));
+			for (int b = 0; b < input.n; ++b)
+			{
+				cv::Mat out_image(num_rows, num_kernels, CV_32F, out + (size_t)b * num_rows * num_kernels);
+				cv::Mat out_maps(num_kernels, num_rows, CV_32F, output.Plane(b, 0));
+				cv::transpose(out_image, out_maps);
+			}
+		}
+		else
+		{
+			// Apply the PReLU while transposing, rather than as a separate pass over the output
+			const float* slopes = prelu_weights.ptr<float>();
+			ParallelFor(cv::Range(0, input.n), [&](const cv::Range& range) {
+				for (int b = range.start; b < range.end; ++b)
+				{
+					const float* out_image = out + (size_t)b * num_rows * num_kernels;
+					float* out_maps = output.Plane(b, 0);
+					for (int r = 0; r < num_rows; ++r)
+					{
+						const float* out_row = out_image + (size_t)r * num_kernels;
+						for (int k = 0; k < num_kernels; ++k)
+						{
+							float val = out_row[k];
+							out_maps[(size_t)k * num_rows + r] = val > 0 ? val : val * slopes[k];
+						}
+					}
+				}
+			});
 		}
 	
 	}
 
+	void winograd_kernels(cv::Mat_<float>& kernels_winograd, const std::vector<std::vector<cv::Mat_<float> > >& kernels)
+	{
+		int num_kernels = (int)kernels.size();
+		int num_in_maps = (int)kernels[0].size();
+
+		kernels_winograd.create(16 * num_kernels, num_in_maps);
+
+		for (int k = 0; k < num_kernels; ++k)
+		{
+			for (int in = 0; in < num_in_maps; ++in)
+			{
+				const cv::Mat_<float>& g = kernels[k][in];
+
+				// G g, with G = [1 0 0; 0.5 0.5 0.5; 0.5 -0.5 0.5; 0 0 1]
+				float tmp[4][3];
+				for (int x = 0; x < 3; ++x)
+				{
+					tmp[0][x] = g(0, x);
+					tmp[1][x] = 0.5f * (g(0, x) + g(1, x) + g(2, x));
+					tmp[2][x] = 0.5f * (g(0, x) - g(1, x) + g(2, x));
+					tmp[3][x] = g(2, x);
+				}
+
+				// (G g) G'
+				for (int y = 0; y < 4; ++y)
+				{
+					float u[4];
+					u[0] = tmp[y][0];
+					u[1] = 0.5f * (tmp[y][0] + tmp[y][1] + tmp[y][2]);
+					u[2] = 0.5f * (tmp[y][0] - tmp[y][1] + tmp[y][2]);
+					u[3] = tmp[y][2];
+
+					for (int x = 0; x < 4; ++x)
+					{
+						kernels_winograd((y * 4 + x) * num_kernels + k, in) = u[x];
+					}
+				}
+			}
+		}
+	}
+
+	bool winograd_faster(const CNN_tensor& input, int num_kernels)
+	{
+		double out_h = input.h - 2;
+		double out_w = input.w - 2;
+		double num_tiles = (double)input.n * std::ceil(out_h / 2.0) * std::ceil(out_w / 2.0);
+
+		// Multiply-adds of the direct convolution, and of Winograd including the input (32 per tile and map) and output (24 per tile and map) transforms
+		double direct_cost = (double)input.n * out_h * out_w * 9.0 * input.c * num_kernels;
+		double winograd_cost = num_tiles * (16.0 * input.c * num_kernels + 32.0 * input.c + 24.0 * num_kernels);
+
+		return winograd_cost < direct_cost;
+	}
+
+	void convolution_winograd(CNN_tensor& output, const CNN_tensor& input, const cv::Mat_<float>& kernels_winograd, const std::vector<float>& biases, CNN_arena& arena, const cv::Mat_<float>& prelu_weights)
+	{
+		int num_in_maps = input.c;
+		int num_kernels = kernels_winograd.rows / 16;
+
+		int out_h = input.h - 2;
+		int out_w = input.w - 2;
+
+		// Every tile produces 2x2 outputs, the ones at the bottom and right edges can be partial
+		int tiles_y = (out_h + 1) / 2;
+		int tiles_x = (out_w + 1) / 2;
+		int tiles_image = tiles_y * tiles_x;
+		int num_tiles = tiles_image * input.n;
+
+		// The transformed input tiles followed by their products with the transformed kernels, both as 16 blocks (one per tile element) with a column per tile
+		float* input_winograd = arena.Scratch((size_t)16 * num_tiles * (num_in_maps + num_kernels));
+		float* products = input_winograd + (size_t)16 * num_tiles * num_in_maps;
+
+		// Input transform B' d B of every 4x4 tile (overlapping by 2), with B' = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1]
+		ParallelFor(cv::Range(0, input.n * num_in_maps), [&](const cv::Range& range) {
+			for (int map = range.start; map < range.end; ++map)
+			{
+				int b = map / num_in_maps;
+				int in = map % num_in_maps;
+				const float* in_map = input.Plane(b, in);
+
+				for (int ty = 0; ty < tiles_y; ++ty)
+				{
+					for (int tx = 0; tx < tiles_x; ++tx)
+					{
+						// Load the tile, padding with zeros outside the map
+						float d[4][4];
+						for (int y = 0; y < 4; ++y)
+						{
+							int y_in = ty * 2 + y;
+							for (int x = 0; x < 4; ++x)
+							{
+								int x_in = tx * 2 + x;
+								d[y][x] = (y_in < input.h && x_in < input.w) ? in_map[y_in * input.w + x_in] : 0.0f;
+							}
+						}
+
+						float tmp[4][4];
+						for (int x = 0; x < 4; ++x)
+						{
+							tmp[0][x] = d[0][x] - d[2][x];
+							tmp[1][x] = d[1][x] + d[2][x];
+							tmp[2][x] = d[2][x] - d[1][x];
+							tmp[3][x] = d[1][x] - d[3][x];
+						}
+
+						int tile = b * tiles_image + ty * tiles_x + tx;
+						for (int y = 0; y < 4; ++y)
+						{
+							float v[4];
+							v[0] = tmp[y][0] - tmp[y][2];
+							v[1] = tmp[y][1] + tmp[y][2];
+							v[2] = tmp[y][2] - tmp[y][1];
+							v[3] = tmp[y][1] - tmp[y][3];
+
+							for (int x = 0; x < 4; ++x)
+							{
+								input_winograd[((size_t)(y * 4 + x) * num_in_maps + in) * num_tiles + tile] = v[x];
+							}
+						}
+					}
+				}
+			}
+		});
+
+		// The element-wise products summed over the input maps are a matrix multiplication per tile element, products = kernels_winograd * input_winograd
+		float alpha = 1.0f;
+		float beta = 0.0f;
+		char N[2]; N[0] = 'N';
+		for (int e = 0; e < 16; ++e)
+		{
+			float* m1 = input_winograd + (size_t)e * num_in_maps * num_tiles;
+			float* m2 = (float*)kernels_winograd.ptr<float>(e * num_kernels);
+			float* m3 = products + (size_t)e * num_kernels * num_tiles;
+			sgemm_(N, N, &num_tiles, &num_kernels, &num_in_maps, &alpha, m1, &num_tiles, m2, &num_in_maps, &beta, m3, &num_tiles);
+		}
+
+		output = arena.Next(input.n, num_kernels, out_h, out_w);
+
+		// Output transform A' m A, with A' = [1 1 1 0; 0 1 -1 -1], followed by the bias and the PReLU
+		ParallelFor(cv::Range(0, input.n * num_kernels), [&](const cv::Range& range) {
+			for (int map = range.start; map < range.end; ++map)
+			{
+				int b = map / num_kernels;
+				int k = map % num_kernels;
+				float* out_map = output.Plane(b, k);
+
+				float bias = biases[k];
+				bool prelu = !prelu_weights.empty();
+				float slope = prelu ? prelu_weights.at<float>(k) : 1.0f;
+
+				for (int ty = 0; ty < tiles_y; ++ty)
+				{
+					for (int tx = 0; tx < tiles_x; ++tx)
+					{
+						int tile = b * tiles_image + ty * tiles_x + tx;
+
+						float m[4][4];
+						for (int e = 0; e < 16; ++e)
+						{
+							m[e / 4][e % 4] = products[((size_t)e * num_kernels + k) * num_tiles + tile];
+						}
+
+						float tmp[2][4];
+						for (int x = 0; x < 4; ++x)
+						{
+							tmp[0][x] = m[0][x] + m[1][x] + m[2][x];
+							tmp[1][x] = m[1][x] - m[2][x] - m[3][x];
+						}
+
+						for (int y = 0; y < 2; ++y)
+						{
+							int y_out = ty * 2 + y;
+							if (y_out >= out_h)
+								continue;
+
+							float out[2];
+							out[0] = tmp[y][0] + tmp[y][1] + tmp[y][2] + bias;
+							out[1] = tmp[y][1] - tmp[y][2] - tmp[y][3] + bias;
+
+							for (int x = 0; x < 2; ++x)
+							{
+								int x_out = tx * 2 + x;
+								if (x_out >= out_w)
+									continue;
+
+								float val = out[x];
+								if (prelu && val < 0)
+								{
+									val *= slope;
+								}
+								out_map[y_out * out_w + x_out] = val;
+							}
+						}
+					}
+				}
+			}
+		});
+	}
+
 
 }
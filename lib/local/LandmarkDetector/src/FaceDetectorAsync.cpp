@@ -0,0 +1,190 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "FaceDetectorAsync.h"
+
+#include "LandmarkDetectorFunc.h"
+#include "LandmarkDetectorUtils.h"
+
+using namespace LandmarkDetector;
+
+FaceDetectorAsync::FaceDetectorAsync() : finished(true), pending(false), frames_pending(0)
+{
+}
+
+FaceDetectorAsync::~FaceDetectorAsync()
+{
+	if (detection_thread.joinable())
+	{
+		detection_thread.join();
+	}
+}
+
+bool FaceDetectorAsync::Prepare(const cv::Mat& image)
+{
+	if (pending || !finished)
+	{
+		return false;
+	}
+
+	// The previous detection is done (collected or dropped)
+	if (detection_thread.joinable())
+	{
+		detection_thread.join();
+	}
+
+	this->image = image.clone();
+	tracker.reset();
+	result = Result();
+
+	pending = true;
+	frames_pending = 0;
+	finished = false;
+
+	return true;
+}
+
+bool FaceDetectorAsync::Start(const cv::Mat& image, std::shared_ptr<CLNFModel> model, const FaceModelParameters& params, cv::Point preference,
+	float min_width, float max_width, cv::Rect_<float> roi)
+{
+	if (!Prepare(image))
+	{
+		return false;
+	}
+
+	detection_thread = std::thread(&FaceDetectorAsync::Detect, this, model, params, preference, min_width, max_width, roi);
+	return true;
+}
+
+bool FaceDetectorAsync::Start(const cv::Mat& image, const CLNF& clnf_model, const FaceModelParameters& params, cv::Point preference,
+	float min_width, float max_width, cv::Rect_<float> roi)
+{
+	if (!Prepare(image))
+	{
+		return false;
+	}
+
+	// The copy is made now, as the tracker carries on with the following frames
+	tracker = std::make_shared<CLNF>(clnf_model);
+
+	detection_thread = std::thread(&FaceDetectorAsync::Detect, this, clnf_model.model, params, preference, min_width, max_width, roi);
+	return true;
+}
+
+void FaceDetectorAsync::Detect(std::shared_ptr<CLNFModel> model, FaceModelParameters params, cv::Point preference, float min_width, float max_width, cv::Rect_<float> roi)
+{
+	FrameContext frame(image);
+
+	// A restricted search first, and the whole frame if nothing is found that way
+	result.full_frame = min_width == -1 && max_width == -1 && roi == cv::Rect_<float>(0.0, 0.0, 1.0, 1.0);
+	DetectFacesInFrame(result.regions, result.confidences, frame, *model, params.curr_face_detector, min_width, max_width, roi);
+
+	if (result.regions.empty() && !result.full_frame)
+	{
+		result.confidences.clear();
+		result.full_frame = true;
+		DetectFacesInFrame(result.regions, result.confidences, frame, *model, params.curr_face_detector);
+	}
+
+	// Choosing the face closest to the preference point or the biggest one
+	bool use_preferred = (preference.x != -1) && (preference.y != -1);
+	float best_so_far = 0;
+	for (size_t i = 0; i < result.regions.size(); ++i)
+	{
+		const cv::Rect_<float>& region = result.regions[i];
+		float score = region.width;
+		if (use_preferred)
+		{
+			float dx = preference.x - (region.x + region.width / 2);
+			float dy = preference.y - (region.y + region.height / 2);
+			score = -sqrt(dx * dx + dy * dy);
+		}
+
+		if (i == 0 || score > best_so_far)
+		{
+			best_so_far = score;
+			result.chosen_region = region;
+		}
+	}
+
+	// Reinitialising the tracker copy from the chosen face, with the same multi-view landmark detection as when detecting synchronously
+	result.landmark_detection_success = false;
+	if (tracker && !result.regions.empty())
+	{
+		tracker->params_local.setTo(0);
+		tracker->model->pdm.CalcParams(tracker->params_global, result.chosen_region, tracker->params_local);
+
+		params.window_sizes_current = params.window_sizes_init;
+		params.multi_view = true;
+		result.landmark_detection_success = DetectLandmarksInImage(frame, result.chosen_region, *tracker, params);
+		result.tracker = tracker;
+	}
+
+	finished = true;
+}
+
+void FaceDetectorAsync::NextFrame()
+{
+	if (pending)
+	{
+		frames_pending++;
+	}
+}
+
+bool FaceDetectorAsync::Collect(Result& o_result, bool wait)
+{
+	if (!pending || (!wait && !finished))
+	{
+		return false;
+	}
+
+	if (detection_thread.joinable())
+	{
+		detection_thread.join();
+	}
+
+	o_result = result;
+	pending = false;
+	tracker.reset();
+	image.release();
+
+	return true;
+}
+
+void FaceDetectorAsync::Cancel()
+{
+	pending = false;
+}
@@ -41,20 +41,12 @@
 #endif
 
 #include "LandmarkDetectorUtils.h"
+#include "SimdDispatch.h"
+#include "ThreadingPolicy.h"
 
 // CNN includes
 #include "CNN_utils.h"
 
-// Instead of including cblas.h (the definitions from OpenBLAS and other BLAS libraries differ, declare the required OpenBLAS functionality here)
-#ifdef __cplusplus
-extern "C" {
-	/* Assume C declarations for C++ */
-#endif  /* __cplusplus */
-
-	/*Set the number of threads on runtime.*/
-	void openblas_set_num_threads(int num_threads);
-}
-
 using namespace LandmarkDetector;
 
 // Constructor from model file location
@@ -67,7 +59,8 @@ FaceDetectorMTCNN::FaceDetectorMTCNN(const FaceDetectorMTCNN& other) : PNet(othe
 {
 }
 
-CNN::CNN(const CNN& other) : cnn_layer_types(other.cnn_layer_types), cnn_max_pooling_layers(other.cnn_max_pooling_layers), cnn_convolutional_layers_bias(other.cnn_convolutional_layers_bias), conv_layer_pre_alloc_im2col(other.conv_layer_pre_alloc_im2col)
+CNN::CNN(const CNN& other) : cnn_layer_types(other.cnn_layer_types), cnn_max_pooling_layers(other.cnn_max_pooling_layers), cnn_convolutional_layers_bias(other.cnn_convolutional_layers_bias),
+	dft_cache(std::make_shared<CNN_dft_cache>())
 {
 
 	this->cnn_convolutional_layers_weights.resize(other.cnn_convolutional_layers_weights.size());
@@ -77,6 +70,13 @@ CNN::CNN(const CNN& other) : cnn_layer_types(other.cnn_layer_types), cnn_max_poo
 		this->cnn_convolutional_layers_weights[l] = other.cnn_convolutional_layers_weights[l].clone();
 	}
 
+	this->cnn_convolutional_layers_winograd.resize(other.cnn_convolutional_layers_winograd.size());
+	for (size_t l = 0; l < other.cnn_convolutional_layers_winograd.size(); ++l)
+	{
+		// Make sure the matrix is copied.
+		this->cnn_convolutional_layers_winograd[l] = other.cnn_convolutional_layers_winograd[l].clone();
+	}
+
 	this->cnn_convolutional_layers.resize(other.cnn_convolutional_layers.size());
 	for (size_t l = 0; l < other.cnn_convolutional_layers.size(); ++l)
 	{
@@ -119,29 +119,81 @@ CNN::CNN(const CNN& other) : cnn_layer_types(other.cnn_layer_types), cnn_max_poo
 	}
 }
 
-std::vector<cv::Mat_<float>> CNN::Inference(const cv::Mat& input_img, bool direct, bool thread_safe)
+// Copy a BGR image into a map of the input tensor, flipping the BGR order to RGB
+static void CopyToInputTensor(const CNN_tensor& input, int b, const cv::Mat& input_img)
+{
+	cv::Mat img = input_img;
+	if (img.channels() == 1)
+	{
+		cv::cvtColor(input_img, img, cv::COLOR_GRAY2BGR);
+	}
+	if (img.depth() != CV_32F)
+	{
+		img.convertTo(img, CV_32F);
+	}
+
+	cv::Mat maps[3] = { input.PlaneMat(b, 0), input.PlaneMat(b, 1), input.PlaneMat(b, 2) };
+	int from_to[] = { 2, 0, 1, 1, 0, 2 };
+	cv::mixChannels(&img, 1, maps, 3, from_to, 3);
+}
+
+std::vector<cv::Mat_<float>> CNN::Inference(const cv::Mat& input_img, bool direct) const
+{
+	CNN_workspace workspace;
+	return Inference(input_img, workspace, direct);
+}
+
+std::vector<cv::Mat_<float>> CNN::Inference(const cv::Mat& input_img, CNN_workspace& workspace, bool direct) const
+{
+	CNN_tensor input = workspace.arena.Next(1, 3, input_img.rows, input_img.cols);
+	CopyToInputTensor(input, 0, input_img);
+
+	CNN_tensor output = Forward(input, workspace, direct);
+
+	// Copy the output maps out of the arena
+	std::vector<cv::Mat_<float> > outputs;
+	for (int k = 0; k < output.c; ++k)
+	{
+		outputs.push_back(output.PlaneMat(0, k).clone());
+	}
+	return outputs;
+
+}
+
+cv::Mat_<float> CNN::InferenceBatch(const std::vector<cv::Mat>& input_imgs, CNN_workspace& workspace) const
 {
-	if (input_img.channels() == 1)
+	int batch_size = (int)input_imgs.size();
+	if (batch_size == 0)
 	{
-		cv::cvtColor(input_img, input_img, cv::COLOR_GRAY2BGR);
+		return cv::Mat_<float>();
 	}
 
+	CNN_tensor input = workspace.arena.Next(batch_size, 3, input_imgs[0].rows, input_imgs[0].cols);
+
+	ParallelFor(cv::Range(0, batch_size), [&](const cv::Range& range) {
+		for (int b = range.start; b < range.end; ++b)
+		{
+			CopyToInputTensor(input, b, input_imgs[b]);
+		}
+	});
+
+	CNN_tensor output = Forward(input, workspace, true);
+
+	// A row per image
+	cv::Mat_<float> outputs_batch = cv::Mat_<float>(batch_size, (int)output.BatchStride(), output.data).clone();
+	return outputs_batch;
+}
+
+CNN_tensor CNN::Forward(const CNN_tensor& input, CNN_workspace& workspace, bool direct) const
+{
 	int cnn_layer = 0;
 	int fully_connected_layer = 0;
 	int prelu_layer = 0;
 	int max_pool_layer = 0;
 
-	// Slit a BGR image into three chnels
-	cv::Mat channels[3]; 
-	cv::split(input_img, channels);  
-
-	// Flip the BGR order to RGB
-	std::vector<cv::Mat_<float> > input_maps;
-	input_maps.push_back(channels[2]);
-	input_maps.push_back(channels[1]);
-	input_maps.push_back(channels[0]);
-
-	std::vector<cv::Mat_<float> > outputs;
+	// The activations of every layer are taken from the arena, alternating between its two buffers
+	CNN_tensor input_maps = input;
+	CNN_tensor outputs;
 
 	for (size_t layer = 0; layer < cnn_layer_types.size(); ++layer)
 	{
@@ -153,30 +205,35 @@ std::vector<cv::Mat_<float>> CNN::Inference(const cv::Mat& input_img, bool direc
 		if (layer_type == 0)		
 		{
 
-			// Either perform direct convolution through matrix multiplication or use an FFT optimized version, which one is optimal depends on the kernel and input sizes
+			// A PReLU straight after the convolution is applied as part of it
+			bool fuse_prelu = direct && layer + 1 < cnn_layer_types.size() && cnn_layer_types[layer + 1] == 3;
+			const cv::Mat_<float> prelu_weights = fuse_prelu ? cnn_prelu_layer_weights[prelu_layer] : cv::Mat_<float>();
+
+			// Either perform direct convolution through matrix multiplication (or Winograd for 3x3 kernels if the input is large enough to benefit) or use an FFT optimized version, which one is optimal depends on the kernel and input sizes
 			if (direct)
 			{
-				if(thread_safe)
+				const cv::Mat_<float>& kernels_winograd = cnn_convolutional_layers_winograd[cnn_layer];
+				if (!kernels_winograd.empty() && winograd_faster(input_maps, (int)cnn_convolutional_layers[cnn_layer].size()))
 				{
-					cv::Mat_<float> pre_alloc;
-					convolution_direct_blas(outputs, input_maps, cnn_convolutional_layers_weights[cnn_layer], cnn_convolutional_layers[cnn_layer][0][0].rows, cnn_convolutional_layers[cnn_layer][0][0].cols, pre_alloc);
+					convolution_winograd(outputs, input_maps, kernels_winograd, cnn_convolutional_layers_bias[cnn_layer], workspace.arena, prelu_weights);
 				}
 				else
 				{
-					convolution_direct_blas(outputs, input_maps, cnn_convolutional_layers_weights[cnn_layer], cnn_convolutional_layers[cnn_layer][0][0].rows, cnn_convolutional_layers[cnn_layer][0][0].cols, conv_layer_pre_alloc_im2col[cnn_layer]);
+					convolution_direct_blas(outputs, input_maps, cnn_convolutional_layers_weights[cnn_layer], cnn_convolutional_layers[cnn_layer][0][0].rows, cnn_convolutional_layers[cnn_layer][0][0].cols, workspace.arena, prelu_weights);
 				}
-	
 			}
 			else
 			{
-				convolution_fft2(outputs, input_maps, cnn_convolutional_layers[cnn_layer], cnn_convolutional_layers_bias[cnn_layer], cnn_convolutional_layers_dft[cnn_layer]);
+				convolution_fft2(outputs, input_maps, cnn_convolutional_layers[cnn_layer], cnn_convolutional_layers_bias[cnn_layer], *dft_cache, cnn_layer, workspace.arena);
 			}
-			//vector<cv::Mat_<float> > outs;
-			//convolution_fft(outs, input_maps, cnn_convolutional_layers[cnn_layer], cnn_convolutional_layers_bias[cnn_layer], cnn_convolutional_layers_dft[cnn_layer]);
-
-
 
 			cnn_layer++;
+
+			if (fuse_prelu)
+			{
+				prelu_layer++;
+				layer++;
+			}
 		}
 		if (layer_type == 1)
 		{
@@ -187,12 +244,12 @@ std::vector<cv::Mat_<float>> CNN::Inference(const cv::Mat& input_img, bool direc
 			int kernel_size_x = std::get<0>(cnn_max_pooling_layers[max_pool_layer]);
 			int kernel_size_y = std::get<1>(cnn_max_pooling_layers[max_pool_layer]);
 
-			max_pooling(outputs, input_maps, stride_x, stride_y, kernel_size_x, kernel_size_y);
+			max_pooling(outputs, input_maps, stride_x, stride_y, kernel_size_x, kernel_size_y, workspace.arena);
 			max_pool_layer++;
 		}
 		if (layer_type == 2)
 		{
-			fully_connected(outputs, input_maps, cnn_fully_connected_layers_weights[fully_connected_layer], cnn_fully_connected_layers_biases[fully_connected_layer]);
+			fully_connected(outputs, input_maps, cnn_fully_connected_layers_weights[fully_connected_layer], cnn_fully_connected_layers_biases[fully_connected_layer], workspace.arena);
 			fully_connected_layer++;
 		}
 		if (layer_type == 3) // PReLU
@@ -204,24 +261,15 @@ std::vector<cv::Mat_<float>> CNN::Inference(const cv::Mat& input_img, bool direc
 		}
 		if (layer_type == 4)
 		{
-			outputs.clear();
-			for (size_t k = 0; k < input_maps.size(); ++k)
-			{
-				// Apply the sigmoid
-				cv::exp(-input_maps[k], input_maps[k]);
-				input_maps[k] = 1.0 / (1.0 + input_maps[k]);
-
-				outputs.push_back(input_maps[k]);
-
-			}
+			// Apply the sigmoid in place
+			GetSimdKernels().sigmoid(input_maps.data, input_maps.Size());
+			outputs = input_maps;
 		}
 		// Set the outputs of this layer to inputs of the next one
 		input_maps = outputs;		
 	}
 
-	
 	return outputs;
-
 }
 
 void ReadMatBin(std::ifstream& stream, cv::Mat &output_mat)
@@ -239,21 +287,11 @@ void ReadMatBin(std::ifstream& stream, cv::Mat &output_mat)
 
 }
 
-void CNN::ClearPrecomp()
-{
-	for (size_t k1 = 0; k1 < cnn_convolutional_layers_dft.size(); ++k1)
-	{
-		for (size_t k2 = 0; k2 < cnn_convolutional_layers_dft[k1].size(); ++k2)
-		{
-			cnn_convolutional_layers_dft[k1][k2].clear();
-		}
-	}
-}
-
 void CNN::Read(const std::string& location)
 {
 
-	openblas_set_num_threads(1);
+	// The detector parallelises across pyramid scales itself, so the BLAS threads come from the threading policy (a single one by default)
+	ThreadingPolicy::ApplyBlasThreads();
 
 	std::ifstream cnn_stream(location, std::ios::in | std::ios::binary);
 	if (cnn_stream.is_open())
@@ -328,11 +366,6 @@ void CNN::Read(const std::string& location)
 
 				cnn_convolutional_layers.push_back(kernels_rearr);
 
-				// Place-holders for DFT precomputation
-				std::vector<std::map<int, std::vector<cv::Mat_<double> > > > cnn_convolutional_layers_dft_curr_layer;
-				cnn_convolutional_layers_dft_curr_layer.resize(num_kernels);
-				cnn_convolutional_layers_dft.push_back(cnn_convolutional_layers_dft_curr_layer);
-
 				// Rearrange the flattened kernels into weight matrices for direct convolution computation
 				cv::Mat_<float> weight_matrix(num_in_maps * kernels_rearr[0][0].rows * kernels_rearr[0][0].cols, num_kernels);
 				for (int k = 0; k < num_kernels; ++k)
@@ -358,7 +391,14 @@ void CNN::Read(const std::string& location)
 				weight_matrix.copyTo(W(cv::Rect(0, 0, weight_matrix.cols, weight_matrix.rows)));
 
 				cnn_convolutional_layers_weights.push_back(W.t());
-				conv_layer_pre_alloc_im2col.push_back(cv::Mat_<float>());
+
+				// The transformed kernels for Winograd convolution (only for 3x3 kernels)
+				cv::Mat_<float> kernels_winograd;
+				if (kernels_rearr[0][0].rows == 3 && kernels_rearr[0][0].cols == 3)
+				{
+					winograd_kernels(kernels_winograd, kernels_rearr);
+				}
+				cnn_convolutional_layers_winograd.push_back(kernels_winograd);
 
 			}
 			else if (layer_type == 1)
@@ -623,39 +663,109 @@ void apply_correction(std::vector<cv::Rect_<float> >& total_bboxes, const std::v
 
 }
 
+// Crop the proposals out of the image (padding with zeros outside it), resize them to the network input size and normalise them
+void extract_proposals(std::vector<cv::Mat>& o_proposal_imgs, const cv::Mat& img_float, const std::vector<cv::Rect_<float> >& proposal_boxes, int input_size)
+{
+	int height_orig = img_float.rows;
+	int width_orig = img_float.cols;
+
+	o_proposal_imgs.clear();
+	o_proposal_imgs.resize(proposal_boxes.size());
+
+	ParallelFor(cv::Range(0, (int)proposal_boxes.size()), [&](const cv::Range& range) {
+		for (int k = range.start; k < range.end; ++k)
+		{
+			float width_target = proposal_boxes[k].width + 1;
+			float height_target = proposal_boxes[k].height + 1;
+
+			// Work out the start and end indices in the original image
+			int start_x_in = cv::max((int)(proposal_boxes[k].x - 1), 0);
+			int start_y_in = cv::max((int)(proposal_boxes[k].y - 1), 0);
+			int end_x_in = cv::min((int)(proposal_boxes[k].x + width_target - 1), width_orig);
+			int end_y_in = cv::min((int)(proposal_boxes[k].y + height_target - 1), height_orig);
+
+			// Work out the start and end indices in the target image
+			int	start_x_out = cv::max((int)(-proposal_boxes[k].x + 1), 0);
+			int start_y_out = cv::max((int)(-proposal_boxes[k].y + 1), 0);
+			int end_x_out = cv::min(width_target - (proposal_boxes[k].x + proposal_boxes[k].width - width_orig), width_target);
+			int end_y_out = cv::min(height_target - (proposal_boxes[k].y + proposal_boxes[k].height - height_orig), height_target);
+
+			cv::Mat tmp(height_target, width_target, CV_32FC3, cv::Scalar(0.0f, 0.0f, 0.0f));
+
+			img_float(cv::Rect(start_x_in, start_y_in, end_x_in - start_x_in, end_y_in - start_y_in)).copyTo(
+				tmp(cv::Rect(start_x_out, start_y_out, end_x_out - start_x_out, end_y_out - start_y_out)));
+
+			cv::Mat prop_img;
+			cv::resize(tmp, prop_img, cv::Size(input_size, input_size));
+
+			o_proposal_imgs[k] = (prop_img - 127.5) * 0.0078125;
+		}
+	});
+}
 
 // The actual MTCNN face detection step
 bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, const cv::Mat& img_in, 
 	std::vector<float>& o_confidences, int min_face_size, float t1, float t2, float t3)
 {
+	FrameContext frame(img_in);
+
+	return DetectFaces(o_regions, frame, o_confidences, min_face_size, t1, t2, t3);
+}
+
+bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, FrameContext& frame,
+	std::vector<float>& o_confidences, int min_face_size, float t1, float t2, float t3, int max_face_size, cv::Rect_<float> roi)
+{
+
+	// Only scanning the region of interest, as a frame of its own, and moving the detections back to the full frame
+	if (roi != cv::Rect_<float>(0.0, 0.0, 1.0, 1.0))
+	{
+		cv::Size image_size = frame.Image().size();
+		cv::Rect roi_px((int)(roi.x * image_size.width), (int)(roi.y * image_size.height), (int)ceil(roi.width * image_size.width), (int)ceil(roi.height * image_size.height));
+		roi_px = roi_px & cv::Rect(0, 0, image_size.width, image_size.height);
 
-	int height_orig = img_in.size().height;
-	int width_orig = img_in.size().width;
+		if (roi_px.area() == 0)
+		{
+			return false;
+		}
+
+		FrameContext roi_frame(frame.Image()(roi_px));
+
+		size_t num_before = o_regions.size();
+		bool detection_success = DetectFaces(o_regions, roi_frame, o_confidences, min_face_size, t1, t2, t3, max_face_size);
+		for (size_t k = num_before; k < o_regions.size(); ++k)
+		{
+			o_regions[k].x += roi_px.x;
+			o_regions[k].y += roi_px.y;
+		}
+		return detection_success;
+	}
+
+	int height_orig = frame.Image().size().height;
+	int width_orig = frame.Image().size().width;
 
 	// Size ratio of image pyramids
 	double pyramid_factor = 0.709;
 
 	// Face support region is 12x12 px, so from that can work out the largest
 	// scale(which is 12 / min), and work down from there to smallest scale(no smaller than 12x12px)
+	// or to the one for the largest face expected
 	int min_dim = std::min(height_orig, width_orig);
+	if (max_face_size > 0)
+	{
+		min_dim = std::min(min_dim, max_face_size);
+	}
 
 	int face_support = 12;
 	int num_scales = floor(log((double)min_face_size / (double)min_dim) / log(pyramid_factor)) + 1;
 
-	cv::Mat input_img;
-
-	// Force the image to three channels
-	if (img_in.channels() == 1)
+	// The image (or the range of face sizes) is too small for any face to be found
+	if (num_scales <= 0)
 	{
-		cv::cvtColor(img_in, input_img, cv::COLOR_GRAY2RGB);
-	}
-	else
-	{
-		input_img = img_in;
+		return false;
 	}
 
-	cv::Mat img_float;
-	input_img.convertTo(img_float, CV_32FC3);
+	// The three channel float image and its pyramid levels come from the frame
+	const cv::Mat& img_float = frame.ColourFloat();
 
 	std::vector<cv::Rect_<float> > proposal_boxes_all;
 	std::vector<float> scores_all;
@@ -666,29 +776,32 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 	std::vector<std::vector<float> > scores_cross_scale(num_scales);
 	std::vector<std::vector<cv::Rect_<float> > > proposal_corrections_cross_scale(num_scales);
 
-	for (int i = 0; i < num_scales; ++i)
+	// The scales are independent, so run them in parallel, each range with its own inference scratch memory,
+	// scale 0 is the largest, so the most expensive work is scheduled first
+	ParallelFor(cv::Range(0, num_scales), [&](const cv::Range& range) {
+
+	CNN_workspace pnet_workspace;
+
+	for (int i = range.start; i < range.end; ++i)
 	{
 		double scale = ((double)face_support / (double)min_face_size)*cv::pow(pyramid_factor, i);
 
 		int h_pyr = ceil(height_orig * scale);
 		int w_pyr = ceil(width_orig * scale);
 
-		cv::Mat normalised_img;
-		cv::resize(img_float, normalised_img, cv::Size(w_pyr, h_pyr));
-		
 		// Normalize the image
-		normalised_img = (normalised_img - 127.5) * 0.0078125;
+		cv::Mat normalised_img = (frame.ColourFloatResized(cv::Size(w_pyr, h_pyr)) - 127.5) * 0.0078125;
 
 		// Actual PNet CNN step
-		std::vector<cv::Mat_<float> > pnet_out = PNet.Inference(normalised_img, true, false);
-
-		// Clear the precomputations, as the image sizes will be different
-		PNet.ClearPrecomp();
+		std::vector<cv::Mat_<float> > pnet_out = PNet.Inference(normalised_img, pnet_workspace, true);
 
 		// Extract the probabilities from PNet response
-		cv::Mat_<float> prob_heatmap;
-		cv::exp(pnet_out[0]- pnet_out[1], prob_heatmap);
-		prob_heatmap = 1.0 / (1.0 + prob_heatmap);
+		// The two class softmax, i.e. the sigmoid of the difference
+		cv::Mat_<float> prob_heatmap = pnet_out[1] - pnet_out[0];
+		for (int y = 0; y < prob_heatmap.rows; ++y)
+		{
+			GetSimdKernels().sigmoid(prob_heatmap.ptr<float>(y), prob_heatmap.cols);
+		}
 
 		// Extract the probabilities from PNet response
 		std::vector<cv::Mat_<float>> corrections_heatmap(pnet_out.begin() + 2, pnet_out.end());
@@ -703,9 +816,9 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 		scores_cross_scale[i] = scores;
 		proposal_corrections_cross_scale[i] = proposal_corrections;
 	}
-	//});
+	});
 
-	// Perform non-maximum supression on proposals accross scales and combine them
+	// Perform non-maximum supression on proposals accross scales and combine them, always in scale order so the result does not depend on the scheduling
 	for (int i = 0; i < num_scales; ++i)
 	{
 		std::vector<int> to_keep = non_maximum_supression(proposal_boxes_cross_scale[i], scores_cross_scale[i], 0.5, false);
@@ -731,42 +844,23 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 	std::vector<bool> above_thresh;
 	above_thresh.resize(proposal_boxes_all.size(), false);
 
-	for (size_t k = 0; k < proposal_boxes_all.size(); ++k) 
-	{
-		float width_target = proposal_boxes_all[k].width + 1;
-		float height_target = proposal_boxes_all[k].height + 1;
+	// Crop out all of the proposals and run RNet on them as a single batch
+	std::vector<cv::Mat> prop_imgs;
+	extract_proposals(prop_imgs, img_float, proposal_boxes_all, 24);
 
-		// Work out the start and end indices in the original image
-		int start_x_in = cv::max((int)(proposal_boxes_all[k].x - 1), 0);
-		int start_y_in = cv::max((int)(proposal_boxes_all[k].y - 1), 0);
-		int end_x_in = cv::min((int)(proposal_boxes_all[k].x + width_target - 1), width_orig);
-		int end_y_in = cv::min((int)(proposal_boxes_all[k].y + height_target - 1), height_orig);
+	CNN_workspace rnet_workspace;
+	cv::Mat_<float> rnet_out = RNet.InferenceBatch(prop_imgs, rnet_workspace);
 
-		// Work out the start and end indices in the target image
-		int	start_x_out = cv::max((int)(-proposal_boxes_all[k].x + 1), 0);
-		int start_y_out = cv::max((int)(-proposal_boxes_all[k].y + 1), 0);
-		int end_x_out = cv::min(width_target - (proposal_boxes_all[k].x + proposal_boxes_all[k].width - width_orig), width_target);
-		int end_y_out = cv::min(height_target - (proposal_boxes_all[k].y + proposal_boxes_all[k].height - height_orig), height_target);
-
-		cv::Mat tmp(height_target, width_target, CV_32FC3, cv::Scalar(0.0f,0.0f,0.0f));
-
-		img_float(cv::Rect(start_x_in, start_y_in, end_x_in - start_x_in, end_y_in - start_y_in)).copyTo(
-			tmp(cv::Rect(start_x_out, start_y_out, end_x_out - start_x_out, end_y_out - start_y_out)));
-		
-		cv::Mat prop_img;
-		cv::resize(tmp, prop_img, cv::Size(24, 24));
-			
-		prop_img = (prop_img - 127.5) * 0.0078125;
-		
-		// Perform RNet on the proposal image
-		std::vector<cv::Mat_<float> > rnet_out = RNet.Inference(prop_img, true, false);
+	for (size_t k = 0; k < proposal_boxes_all.size(); ++k)
+	{
+		const float* out = rnet_out.ptr<float>((int)k);
 
-		float prob = 1.0 / (1.0 + cv::exp(rnet_out[0].at<float>(0) - rnet_out[0].at<float>(1)));
+		float prob = 1.0 / (1.0 + cv::exp(out[0] - out[1]));
 		scores_all[k] = prob;
-		proposal_corrections_all[k].x = rnet_out[0].at<float>(2);
-		proposal_corrections_all[k].y = rnet_out[0].at<float>(3);
-		proposal_corrections_all[k].width = rnet_out[0].at<float>(4);
-		proposal_corrections_all[k].height = rnet_out[0].at<float>(5);
+		proposal_corrections_all[k].x = out[2];
+		proposal_corrections_all[k].y = out[3];
+		proposal_corrections_all[k].width = out[4];
+		proposal_corrections_all[k].height = out[5];
 		if(prob >= t2)
 		{
 			above_thresh[k] = true;
@@ -777,7 +871,6 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 		}
 
 	}
-	//});
 
 	to_keep.clear();
 	for (size_t i = 0; i < above_thresh.size(); ++i)
@@ -804,42 +897,22 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 	above_thresh.clear();
 	above_thresh.resize(proposal_boxes_all.size());
 
-	for (size_t k = 0; k < proposal_boxes_all.size(); ++k)
-	{
-		float width_target = proposal_boxes_all[k].width + 1;
-		float height_target = proposal_boxes_all[k].height + 1;
-
-		// Work out the start and end indices in the original image
-		int start_x_in = cv::max((int)(proposal_boxes_all[k].x - 1), 0);
-		int start_y_in = cv::max((int)(proposal_boxes_all[k].y - 1), 0);
-		int end_x_in = cv::min((int)(proposal_boxes_all[k].x + width_target - 1), width_orig);
-		int end_y_in = cv::min((int)(proposal_boxes_all[k].y + height_target - 1), height_orig);
-
-		// Work out the start and end indices in the target image
-		int	start_x_out = cv::max((int)(-proposal_boxes_all[k].x + 1), 0);
-		int start_y_out = cv::max((int)(-proposal_boxes_all[k].y + 1), 0);
-		int end_x_out = cv::min(width_target - (proposal_boxes_all[k].x + proposal_boxes_all[k].width - width_orig), width_target);
-		int end_y_out = cv::min(height_target - (proposal_boxes_all[k].y + proposal_boxes_all[k].height - height_orig), height_target);
-
-		cv::Mat tmp(height_target, width_target, CV_32FC3, cv::Scalar(0.0f, 0.0f, 0.0f));
-
-		img_float(cv::Rect(start_x_in, start_y_in, end_x_in - start_x_in, end_y_in - start_y_in)).copyTo(
-			tmp(cv::Rect(start_x_out, start_y_out, end_x_out - start_x_out, end_y_out - start_y_out)));
+	// Crop out all of the remaining proposals and run ONet on them as a single batch
+	extract_proposals(prop_imgs, img_float, proposal_boxes_all, 48);
 
-		cv::Mat prop_img;
-		cv::resize(tmp, prop_img, cv::Size(48, 48));
+	CNN_workspace onet_workspace;
+	cv::Mat_<float> onet_out = ONet.InferenceBatch(prop_imgs, onet_workspace);
 
-		prop_img = (prop_img - 127.5) * 0.0078125;
-
-		// Perform RNet on the proposal image
-		std::vector<cv::Mat_<float> > onet_out = ONet.Inference(prop_img, true, false);
+	for (size_t k = 0; k < proposal_boxes_all.size(); ++k)
+	{
+		const float* out = onet_out.ptr<float>((int)k);
 
-		float prob = 1.0 / (1.0 + cv::exp(onet_out[0].at<float>(0) - onet_out[0].at<float>(1)));
+		float prob = 1.0 / (1.0 + cv::exp(out[0] - out[1]));
 		scores_all[k] = prob;
-		proposal_corrections_all[k].x = onet_out[0].at<float>(2);
-		proposal_corrections_all[k].y = onet_out[0].at<float>(3);
-		proposal_corrections_all[k].width = onet_out[0].at<float>(4);
-		proposal_corrections_all[k].height = onet_out[0].at<float>(5);
+		proposal_corrections_all[k].x = out[2];
+		proposal_corrections_all[k].y = out[3];
+		proposal_corrections_all[k].width = out[4];
+		proposal_corrections_all[k].height = out[5];
 		if (prob >= t3)
 		{
 			above_thresh[k] = true;
@@ -849,7 +922,6 @@ bool FaceDetectorMTCNN::DetectFaces(std::vector<cv::Rect_<float> >& o_regions, c
 			above_thresh[k] = false;
 		}
 	}
-	//});
 
 	to_keep.clear();
 	for (size_t i = 0; i < above_thresh.size(); ++i)
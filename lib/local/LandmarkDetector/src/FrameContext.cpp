@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "FrameContext.h"
+#include "ImageManipulationHelpers.h"
+
+// OpenCV includes
+#include <opencv2/imgproc.hpp>
+
+using namespace LandmarkDetector;
+
+FrameContext::FrameContext(const cv::Mat& image) : image(image)
+{
+}
+
+FrameContext::FrameContext(const cv::Mat& image, const cv::Mat& grayscale_image) : image(image)
+{
+	if (!grayscale_image.empty())
+	{
+		grayscale = grayscale_image;
+	}
+}
+
+const cv::Mat_<uchar>& FrameContext::Grayscale()
+{
+	std::lock_guard<std::mutex> lock(context_mutex);
+	if (grayscale.empty())
+	{
+		cv::Mat grayscale_tmp;
+		Utilities::ConvertToGrayscale_8bit(image, grayscale_tmp);
+		grayscale = grayscale_tmp;
+	}
+	return grayscale;
+}
+
+const cv::Mat_<float>& FrameContext::GrayscaleFloat()
+{
+	const cv::Mat_<uchar>& grayscale_8bit = Grayscale();
+
+	std::lock_guard<std::mutex> lock(context_mutex);
+	if (grayscale_float.empty())
+	{
+		grayscale_8bit.convertTo(grayscale_float, CV_32F);
+	}
+	return grayscale_float;
+}
+
+const cv::Mat& FrameContext::ColourFloat()
+{
+	std::lock_guard<std::mutex> lock(context_mutex);
+	if (colour_float.empty())
+	{
+		// Force the image to three channels
+		if (image.channels() == 1)
+		{
+			cv::Mat colour;
+			cv::cvtColor(image, colour, cv::COLOR_GRAY2RGB);
+			colour.convertTo(colour_float, CV_32FC3);
+		}
+		else
+		{
+			image.convertTo(colour_float, CV_32FC3);
+		}
+	}
+	return colour_float;
+}
+
+const cv::Mat& FrameContext::ColourFloatResized(const cv::Size& size)
+{
+	std::pair<int, int> key(size.width, size.height);
+	{
+		std::lock_guard<std::mutex> lock(context_mutex);
+		auto level = colour_float_resized.find(key);
+		if (level != colour_float_resized.end())
+		{
+			return level->second;
+		}
+	}
+
+	// Resizing outside of the lock, so that several levels can be computed at once
+	cv::Mat resized;
+	cv::resize(ColourFloat(), resized, size);
+
+	std::lock_guard<std::mutex> lock(context_mutex);
+	return colour_float_resized.emplace(key, resized).first->second;
+}
+
+bool FrameContext::GetFaceDetections(FaceModelParameters::FaceDetector detector, std::vector<cv::Rect_<float> >& regions, std::vector<float>& confidences) const
+{
+	std::lock_guard<std::mutex> lock(context_mutex);
+	auto detections = face_detections.find(detector);
+	if (detections == face_detections.end())
+	{
+		return false;
+	}
+	regions = detections->second.first;
+	confidences = detections->second.second;
+	return true;
+}
+
+void FrameContext::SetFaceDetections(FaceModelParameters::FaceDetector detector, const std::vector<cv::Rect_<float> >& regions, const std::vector<float>& confidences)
+{
+	std::lock_guard<std::mutex> lock(context_mutex);
+	face_detections[detector] = std::make_pair(regions, confidences);
+}
@@ -52,13 +52,14 @@
 #endif
 // Local includes
 #include "LandmarkDetectorUtils.h"
+#include "SimdDispatch.h"
 #include "CNN_utils.h"
 
 using namespace LandmarkDetector;
 
 // Copy constructor
 DetectionValidator::DetectionValidator(const DetectionValidator& other) : orientations(other.orientations), paws(other.paws),
-cnn_subsampling_layers(other.cnn_subsampling_layers), cnn_layer_types(other.cnn_layer_types), cnn_convolutional_layers_im2col_precomp(other.cnn_convolutional_layers_im2col_precomp),
+cnn_subsampling_layers(other.cnn_subsampling_layers), cnn_layer_types(other.cnn_layer_types),
 cnn_convolutional_layers_weights(other.cnn_convolutional_layers_weights)
 {
 
@@ -165,7 +166,6 @@ void DetectionValidator::Read(std::string location)
 		paws.resize(n);
 
 		cnn_convolutional_layers_weights.resize(n);
-		cnn_convolutional_layers_im2col_precomp.resize(n);
 		cnn_convolutional_layers.resize(n);
 		cnn_fully_connected_layers_weights.resize(n);
 		cnn_layer_types.resize(n);
@@ -283,7 +283,6 @@ void DetectionValidator::Read(std::string location)
 						weight_matrix.copyTo(W(cv::Rect(0, 0, weight_matrix.cols, weight_matrix.rows)));
 
 						cnn_convolutional_layers_weights[i].push_back(W.t());
-						cnn_convolutional_layers_im2col_precomp[i].push_back(cv::Mat_<float>());
 					}
 					else if (layer_type == 2)
 					{
@@ -309,10 +308,161 @@ void DetectionValidator::Read(std::string location)
 	}
 }
 
+//===========================================================================
+void DetectionValidator::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	// The orientations are stored as rows (in radians)
+	cv::Mat_<double> orientations_mat;
+	if (!bundle.GetMat(prefix + "orientations", orientations_mat))
+	{
+		std::cout << "WARNING: Can't find the Face checker in the model bundle" << std::endl;
+		return;
+	}
+
+	int n = orientations_mat.rows;
+
+	orientations.resize(n);
+	paws.resize(n);
+
+	cnn_convolutional_layers_weights.resize(n);
+	cnn_convolutional_layers.resize(n);
+	cnn_fully_connected_layers_weights.resize(n);
+	cnn_layer_types.resize(n);
+	cnn_fully_connected_layers_biases.resize(n);
+
+	mean_images.resize(n);
+	standard_deviations.resize(n);
+
+	for (int i = 0; i < n; i++)
+	{
+		std::string view_prefix = prefix + std::to_string(i) + "/";
+
+		orientations[i] = cv::Vec3d(orientations_mat(i, 0), orientations_mat(i, 1), orientations_mat(i, 2));
+
+		bundle.GetMat(view_prefix + "mean_image", mean_images[i]);
+		bundle.GetMat(view_prefix + "standard_deviation", standard_deviations[i]);
+
+		cv::Mat_<int> layer_types;
+		bundle.GetMat(view_prefix + "layer_types", layer_types);
+		cnn_layer_types[i].assign(layer_types.begin(), layer_types.end());
+
+		for (size_t layer = 0; layer < cnn_layer_types[i].size(); ++layer)
+		{
+			std::string layer_prefix = view_prefix + std::to_string(layer) + "/";
+
+			// convolutional
+			if (cnn_layer_types[i][layer] == 0)
+			{
+				cv::Mat_<float> weights;
+				bundle.GetMat(layer_prefix + "weights", weights);
+				cnn_convolutional_layers_weights[i].push_back(weights);
+
+				// The kernels of each input map are stored stacked vertically
+				int num_in_maps = bundle.GetInt(layer_prefix + "num_in_maps");
+				int num_kernels = weights.cols;
+
+				std::vector<std::vector<cv::Mat_<float> > > kernels(num_in_maps);
+				for (int in = 0; in < num_in_maps; ++in)
+				{
+					cv::Mat_<float> stacked_kernels;
+					bundle.GetMat(layer_prefix + "kernels_" + std::to_string(in), stacked_kernels);
+
+					int kernel_height = stacked_kernels.rows / num_kernels;
+					for (int k = 0; k < num_kernels; ++k)
+					{
+						kernels[in].push_back(stacked_kernels.rowRange(k * kernel_height, (k + 1) * kernel_height));
+					}
+				}
+				cnn_convolutional_layers[i].push_back(kernels);
+			}
+			else if (cnn_layer_types[i][layer] == 2)
+			{
+				cv::Mat_<float> biases;
+				bundle.GetMat(layer_prefix + "biases", biases);
+				cnn_fully_connected_layers_biases[i].push_back(biases);
+
+				cv::Mat_<float> weights;
+				bundle.GetMat(layer_prefix + "weights", weights);
+				cnn_fully_connected_layers_weights[i].push_back(weights);
+			}
+		}
+
+		paws[i].Read(bundle, view_prefix + "paw/");
+	}
+}
+
+void DetectionValidator::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	if (orientations.empty())
+	{
+		return;
+	}
+
+	cv::Mat_<double> orientations_mat((int)orientations.size(), 3);
+	for (size_t i = 0; i < orientations.size(); i++)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			orientations_mat((int)i, j) = orientations[i][j];
+		}
+	}
+	bundle.AddMat(prefix + "orientations", orientations_mat);
+
+	for (size_t i = 0; i < orientations.size(); i++)
+	{
+		std::string view_prefix = prefix + std::to_string(i) + "/";
+
+		bundle.AddMat(view_prefix + "mean_image", mean_images[i]);
+		bundle.AddMat(view_prefix + "standard_deviation", standard_deviations[i]);
+		bundle.AddMat(view_prefix + "layer_types", cv::Mat_<int>(cnn_layer_types[i], true));
+
+		size_t conv_layer = 0;
+		size_t fc_layer = 0;
+		for (size_t layer = 0; layer < cnn_layer_types[i].size(); ++layer)
+		{
+			std::string layer_prefix = view_prefix + std::to_string(layer) + "/";
+
+			if (cnn_layer_types[i][layer] == 0)
+			{
+				bundle.AddMat(layer_prefix + "weights", cnn_convolutional_layers_weights[i][conv_layer]);
+
+				const std::vector<std::vector<cv::Mat_<float> > >& kernels = cnn_convolutional_layers[i][conv_layer];
+				bundle.AddInt(layer_prefix + "num_in_maps", (int)kernels.size());
+				for (size_t in = 0; in < kernels.size(); ++in)
+				{
+					cv::Mat_<float> stacked_kernels;
+					cv::vconcat(kernels[in], stacked_kernels);
+					bundle.AddMat(layer_prefix + "kernels_" + std::to_string(in), stacked_kernels);
+				}
+				conv_layer++;
+			}
+			else if (cnn_layer_types[i][layer] == 2)
+			{
+				bundle.AddMat(layer_prefix + "biases", cnn_fully_connected_layers_biases[i][fc_layer]);
+				bundle.AddMat(layer_prefix + "weights", cnn_fully_connected_layers_weights[i][fc_layer]);
+				fc_layer++;
+			}
+		}
+
+		paws[i].Write(bundle, view_prefix + "paw/");
+	}
+}
+
 //===========================================================================
 // Check if the fitting actually succeeded
 float DetectionValidator::Check(const cv::Vec3d& orientation, const cv::Mat_<uchar>& intensity_img, cv::Mat_<float>& detected_landmarks)
 {
+	return CheckImage(orientation, intensity_img, detected_landmarks);
+}
+
+float DetectionValidator::Check(const cv::Vec3d& orientation, FrameContext& frame, cv::Mat_<float>& detected_landmarks)
+{
+	return CheckImage(orientation, frame.GrayscaleFloat(), detected_landmarks);
+}
+
+float DetectionValidator::CheckImage(const cv::Vec3d& orientation, const cv::Mat& intensity_img, cv::Mat_<float>& detected_landmarks)
+{
+	std::lock_guard<std::mutex> lock(check_mutex);
 
 	int id = GetViewId(orientation);
 	
@@ -347,8 +497,16 @@ float DetectionValidator::Check(const cv::Vec3d& orientation, const cv::Mat_<uch
 		return 0.0f;
 	}
 
+	// A float image only needs its ROI to be referenced
 	cv::Mat_<float> intensity_img_float_local;
-	intensity_img(cv::Rect(min_x, min_y, max_x - min_x, max_y - min_y)).convertTo(intensity_img_float_local, CV_32F);
+	if (intensity_img.depth() == CV_32F)
+	{
+		intensity_img_float_local = intensity_img(cv::Rect(min_x, min_y, max_x - min_x, max_y - min_y));
+	}
+	else
+	{
+		intensity_img(cv::Rect(min_x, min_y, max_x - min_x, max_y - min_y)).convertTo(intensity_img_float_local, CV_32F);
+	}
 
 	// the piece-wise affine image warping
 	paws[id].Warp(intensity_img_float_local, warped, detected_landmarks_local);
@@ -398,10 +556,12 @@ double DetectionValidator::CheckCNN(const cv::Mat_<float>& warped_img, int view_
 	int cnn_layer = 0;
 	int fully_connected_layer = 0;
 
-	std::vector<cv::Mat_<float> > input_maps;
-	input_maps.push_back(img);
+	// The layer activations alternate between the two buffers of the arena
+	CNN_tensor input_maps = cnn_arena.Next(1, 1, img.rows, img.cols);
+	cv::Mat_<float> input_map = input_maps.PlaneMat(0, 0);
+	img.copyTo(input_map);
 
-	std::vector<cv::Mat_<float> > outputs;
+	CNN_tensor outputs;
 
 	for (size_t layer = 0; layer < cnn_layer_types[view_id].size(); ++layer)
 	{
@@ -412,43 +572,32 @@ double DetectionValidator::CheckCNN(const cv::Mat_<float>& warped_img, int view_
 		if (layer_type == 0)
 		{
 
-			convolution_direct_blas(outputs, input_maps, cnn_convolutional_layers_weights[view_id][cnn_layer], cnn_convolutional_layers[view_id][cnn_layer][0][0].rows, cnn_convolutional_layers[view_id][cnn_layer][0][0].cols, cnn_convolutional_layers_im2col_precomp[view_id][cnn_layer]);
+			convolution_direct_blas(outputs, input_maps, cnn_convolutional_layers_weights[view_id][cnn_layer], cnn_convolutional_layers[view_id][cnn_layer][0][0].rows, cnn_convolutional_layers[view_id][cnn_layer][0][0].cols, cnn_arena);
 
 			cnn_layer++;
 		}
 		if (layer_type == 1)
 		{
-			max_pooling(outputs, input_maps, 2, 2, 2, 2);
+			max_pooling(outputs, input_maps, 2, 2, 2, 2, cnn_arena);
 		}
 		if (layer_type == 2)
 		{
 
-			fully_connected(outputs, input_maps, cnn_fully_connected_layers_weights[view_id][fully_connected_layer].t(), cnn_fully_connected_layers_biases[view_id][fully_connected_layer]);
+			fully_connected(outputs, input_maps, cnn_fully_connected_layers_weights[view_id][fully_connected_layer].t(), cnn_fully_connected_layers_biases[view_id][fully_connected_layer], cnn_arena);
 			fully_connected_layer++;
 		}
 		if (layer_type == 3) // ReLU
 		{
-			outputs.clear();
-			for (size_t k = 0; k < input_maps.size(); ++k)
-			{
-				// Apply the ReLU
-				cv::threshold(input_maps[k], input_maps[k], 0, 0, cv::THRESH_TOZERO);
-				outputs.push_back(input_maps[k]);
-
-			}
+			// Apply the ReLU in place, over all the maps at once
+			cv::Mat_<float> all_maps(1, (int)input_maps.Size(), input_maps.data);
+			cv::threshold(all_maps, all_maps, 0, 0, cv::THRESH_TOZERO);
+			outputs = input_maps;
 		}
 		if (layer_type == 4)
 		{
-			outputs.clear();
-			for (size_t k = 0; k < input_maps.size(); ++k)
-			{
-				// Apply the sigmoid
-				cv::exp(-input_maps[k], input_maps[k]);
-				input_maps[k] = 1.0 / (1.0 + input_maps[k]);
-
-				outputs.push_back(input_maps[k]);
-
-			}
+			// Apply the sigmoid in place
+			GetSimdKernels().sigmoid(input_maps.data, input_maps.Size());
+			outputs = input_maps;
 		}
 		// Set the outputs of this layer to inputs of the next
 		input_maps = outputs;
@@ -458,11 +607,12 @@ double DetectionValidator::CheckCNN(const cv::Mat_<float>& warped_img, int view_
 	// Convert the class label to a continuous value
 	double max_val = 0;
 	cv::Point max_loc;
-	cv::minMaxLoc(outputs[0].t(), 0, &max_val, 0, &max_loc);
-	int max_idx = max_loc.y;
+	cv::Mat_<float> output(1, (int)outputs.Size(), outputs.data);
+	cv::minMaxLoc(output, 0, &max_val, 0, &max_loc);
+	int max_idx = max_loc.x;
 	double max = 1;
 	double min = -1;
-	double bins = (double)outputs[0].cols;
+	double bins = (double)output.cols;
 	// Unquantizing the softmax layer to continuous value
 	double step_size = (max - min) / bins; // This should be saved somewhere
 	double unquantized = min + step_size / 2.0 + max_idx * step_size;
@@ -35,6 +35,8 @@
 #include "stdafx.h"
 
 #include "LandmarkDetectorFunc.h"
+#include "FaceDetectorAsync.h"
+#include "ThreadingPolicy.h"
 #include "RotationHelpers.h"
 #include "ImageManipulationHelpers.h"
 
@@ -42,8 +44,12 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
 
 // System includes
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <vector>
 #include <numeric>
 
@@ -72,7 +78,7 @@ cv::Vec6f LandmarkDetector::GetPose(const CLNF& clnf_model, float fx, float fy,
 
 		// 3D points
 		cv::Mat_<float> landmarks_3D;
-		clnf_model.pdm.CalcShape3D(landmarks_3D, clnf_model.params_local);
+		clnf_model.model->pdm.CalcShape3D(landmarks_3D, clnf_model.params_local);
 		
 		landmarks_3D = landmarks_3D.reshape(1, 3).t();
 
@@ -113,7 +119,7 @@ cv::Vec6f LandmarkDetector::GetPoseWRTCamera(const CLNF& clnf_model, float fx, f
 
 		// 3D points
 		cv::Mat_<float> landmarks_3D;
-		clnf_model.pdm.CalcShape3D(landmarks_3D, clnf_model.params_local);
+		clnf_model.model->pdm.CalcShape3D(landmarks_3D, clnf_model.params_local);
 
 		landmarks_3D = landmarks_3D.reshape(1, 3).t();
 
@@ -158,7 +164,7 @@ cv::Vec6f LandmarkDetector::GetPoseWRTCamera(const CLNF& clnf_model, float fx, f
 void UpdateTemplate(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model)
 {
 	cv::Rect_<float> bounding_box;
-	clnf_model.pdm.CalcBoundingBox(bounding_box, clnf_model.params_global, clnf_model.params_local);
+	clnf_model.model->pdm.CalcBoundingBox(bounding_box, clnf_model.params_global, clnf_model.params_local);
 	
 	// Make sure the box is not out of bounds
 	cv::Rect_<int> bbox_tmp((int)bounding_box.x, (int)bounding_box.y, (int)bounding_box.width, (int)bounding_box.height);
@@ -171,7 +177,7 @@ void UpdateTemplate(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model)
 void CorrectGlobalParametersVideo(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model, const FaceModelParameters& params)
 {
 	cv::Rect_<float> init_box;
-	clnf_model.pdm.CalcBoundingBox(init_box, clnf_model.params_global, clnf_model.params_local);
+	clnf_model.model->pdm.CalcBoundingBox(init_box, clnf_model.params_global, clnf_model.params_local);
 
 	cv::Rect roi(init_box.x - init_box.width/2, init_box.y - init_box.height/2, init_box.width * 2, init_box.height * 2);
 	roi = roi & cv::Rect(0, 0, grayscale_image.cols, grayscale_image.rows);
@@ -212,29 +218,354 @@ void CorrectGlobalParametersVideo(const cv::Mat_<uchar> &grayscale_image, CLNF&
 	
 }
 
+// Choosing the search windows for tracking from the expected error (in image pixels) of the predicted pose
+// Fast motion uses the initialisation windows, while a still face skips the coarsest tracking scale and uses fewer iterations
+// Returns the number of optimisation iterations to use
+static int ChooseTrackingWindows(FaceModelParameters& params, const CLNF& clnf_model, float uncertainty)
+{
+	params.window_sizes_current = params.window_sizes_small;
+
+	const std::vector<double>& patch_scaling = clnf_model.model->patch_experts.patch_scaling;
+
+	// The scales used for tracking, coarsest first
+	std::vector<int> tracking_scales;
+	for (size_t scale = 0; scale < params.window_sizes_small.size() && scale < patch_scaling.size(); ++scale)
+	{
+		if (params.window_sizes_small[scale] > 0)
+		{
+			tracking_scales.push_back((int)scale);
+		}
+	}
+
+	if (tracking_scales.empty() || clnf_model.params_global[0] <= 0)
+	{
+		return params.num_optimisation_iteration;
+	}
+
+	// Convert the expected error to response map pixels at a scale, and compare it to the search radius of its window
+	auto error_fraction = [&](int scale) {
+		float radius = std::max(1.0f, (params.window_sizes_small[scale] - 1) / 2.0f);
+		return uncertainty * (float)patch_scaling[scale] / clnf_model.params_global[0] / radius;
+	};
+
+	if (error_fraction(tracking_scales[0]) > params.motion_fast_threshold)
+	{
+		params.window_sizes_current = params.window_sizes_init;
+	}
+	else if (tracking_scales.size() > 1 && error_fraction(tracking_scales[1]) < params.motion_still_threshold)
+	{
+		params.window_sizes_current[tracking_scales[0]] = 0;
+		return std::max(2, params.num_optimisation_iteration / 2);
+	}
+
+	return params.num_optimisation_iteration;
+}
+
+// The optical flow parameters used for propagating landmarks in keyframe tracking
+static const cv::Size flow_window_size(21, 21);
+static const int flow_pyramid_levels = 3;
+
+// Fitting a PDM to the points propagated by optical flow (the unreliable ones are left out), returns false if too few of them are reliable
+static bool FitPropagatedLandmarks(CLNF& clnf_model, const std::vector<cv::Point2f>& points, const std::vector<bool>& reliable, size_t offset)
+{
+	int n = clnf_model.model->pdm.NumberOfPoints();
+
+	cv::Mat_<float> landmarks(2 * n, 1, 0.0f);
+	int num_reliable = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		// Invisible landmarks are marked by 0
+		if (reliable[offset + i])
+		{
+			landmarks.at<float>(i) = points[offset + i].x;
+			landmarks.at<float>(i + n) = points[offset + i].y;
+			num_reliable++;
+		}
+	}
+
+	if (num_reliable < n / 2)
+	{
+		return false;
+	}
+
+	cv::Vec3f rotation(clnf_model.params_global[1], clnf_model.params_global[2], clnf_model.params_global[3]);
+	clnf_model.model->pdm.CalcParams(clnf_model.params_global, clnf_model.params_local, landmarks, rotation);
+	clnf_model.model->pdm.CalcShape2D(clnf_model.detected_landmarks, clnf_model.params_local, clnf_model.params_global);
+
+	return true;
+}
+
+// Propagating the landmarks of the last tracked frame (of the main and part models) to the current one with pyramidal Lucas-Kanade optical flow
+// Returns false if the flow or the resulting landmarks are not reliable, in which case the model is left unchanged and a full fit is needed
+static bool PropagateLandmarks(FrameContext& frame, const std::vector<cv::Mat>& frame_pyramid, CLNF& clnf_model, const FaceModelParameters& params)
+{
+	if (clnf_model.previous_pyramid.empty())
+	{
+		return false;
+	}
+
+	// The landmarks of the main model followed by the ones of the part models
+	std::vector<cv::Point2f> previous_points;
+	std::vector<size_t> offsets;
+	for (size_t model = 0; model <= clnf_model.hierarchical_models.size(); ++model)
+	{
+		const cv::Mat_<float>& landmarks = model == 0 ? clnf_model.detected_landmarks : clnf_model.hierarchical_models[model - 1].detected_landmarks;
+		int n = landmarks.rows / 2;
+
+		offsets.push_back(previous_points.size());
+		for (int i = 0; i < n; ++i)
+		{
+			previous_points.push_back(cv::Point2f(landmarks.at<float>(i), landmarks.at<float>(i + n)));
+		}
+	}
+
+	// Tracking the points forward and back again, the distance to where they started measures how reliable the flow is
+	std::vector<cv::Point2f> points, back_points;
+	std::vector<uchar> status, back_status;
+	std::vector<float> flow_errors;
+	cv::calcOpticalFlowPyrLK(clnf_model.previous_pyramid, frame_pyramid, previous_points, points, status, flow_errors, flow_window_size, flow_pyramid_levels);
+	cv::calcOpticalFlowPyrLK(frame_pyramid, clnf_model.previous_pyramid, points, back_points, back_status, flow_errors, flow_window_size, flow_pyramid_levels);
+
+	// The flow residual of the face as a whole is measured over the landmarks of the main model
+	int n = clnf_model.model->pdm.NumberOfPoints();
+
+	std::vector<bool> reliable(previous_points.size(), false);
+	std::vector<float> residuals;
+	for (size_t i = 0; i < previous_points.size(); ++i)
+	{
+		if (status[i] && back_status[i] && previous_points[i].x != 0)
+		{
+			float residual = (float)cv::norm(back_points[i] - previous_points[i]);
+
+			// Individual points that drifted are left out of the fit
+			reliable[i] = residual < 2 * params.keyframe_flow_threshold;
+
+			if ((int)i < n)
+			{
+				residuals.push_back(residual);
+			}
+		}
+	}
+
+	if ((int)residuals.size() < n / 2)
+	{
+		return false;
+	}
+	std::nth_element(residuals.begin(), residuals.begin() + residuals.size() / 2, residuals.end());
+	if (residuals[residuals.size() / 2] > params.keyframe_flow_threshold)
+	{
+		return false;
+	}
+
+	// Keep the current estimates so that they can be restored if the propagation is rejected
+	cv::Vec6f params_global_init = clnf_model.params_global;
+	cv::Mat_<float> params_local_init = clnf_model.params_local.clone();
+	cv::Mat_<float> detected_landmarks_init = clnf_model.detected_landmarks.clone();
+
+	// Fitting the PDMs keeps the propagated shapes plausible
+	bool success = FitPropagatedLandmarks(clnf_model, points, reliable, offsets[0]);
+	for (size_t part = 0; success && part < clnf_model.hierarchical_models.size(); ++part)
+	{
+		success = FitPropagatedLandmarks(clnf_model.hierarchical_models[part], points, reliable, offsets[part + 1]);
+	}
+
+	float certainty = 1;
+	if (success && params.validate_detections)
+	{
+		cv::Vec3d orientation(clnf_model.params_global[1], clnf_model.params_global[2], clnf_model.params_global[3]);
+		certainty = clnf_model.model->landmark_validator.Check(orientation, frame, clnf_model.detected_landmarks);
+		success = certainty > params.validation_boundary;
+	}
+
+	if (!success)
+	{
+		// The part models are refitted from the main one by the full fit, so only it needs restoring
+		clnf_model.params_global = params_global_init;
+		clnf_model.params_local = params_local_init;
+		clnf_model.detected_landmarks = detected_landmarks_init;
+		return false;
+	}
+
+	clnf_model.detection_certainty = certainty;
+	return true;
+}
+
+// Defined with the landmark detection in images below
+static bool ConcurrentFittingSupported(const CLNFModel& model);
+static void CopyHypothesisResult(CLNF& clnf_model, const CLNF& best_model);
+
+// Carrying on the tracking from a face that was redetected, the motion is tracked anew from it
+static void TrackingReinitialised(CLNF& clnf_model, const FaceModelParameters& params, bool landmark_detection_success, std::vector<cv::Mat>& frame_pyramid,
+	const cv::Mat_<uchar>& grayscale_image)
+{
+	clnf_model.failures_in_a_row = -1;
+
+	clnf_model.motion_model.Reset();
+	if (landmark_detection_success)
+	{
+		clnf_model.motion_model.Update(clnf_model.params_global);
+
+		clnf_model.last_face_box = clnf_model.GetBoundingBox();
+		clnf_model.predicted_face_box = cv::Rect_<float>();
+
+		clnf_model.frames_since_keyframe = 0;
+		clnf_model.previous_pyramid.swap(frame_pyramid);
+	}
+
+	if (params.use_face_template)
+	{
+		UpdateTemplate(grayscale_image, clnf_model);
+	}
+}
+
+// Reinitialising the tracking from a detection done in the background on a frame a few frames back, returns true if that was successful
+// (the tracker is only changed if it was)
+static bool UseAsyncDetection(FrameContext& frame, std::vector<cv::Mat>& frame_pyramid, CLNF& clnf_model, FaceModelParameters& params,
+	const FaceDetectorAsync::Result& detection, int frames_elapsed)
+{
+	clnf_model.redetections_since_full_scan = detection.full_frame ? 0 : clnf_model.redetections_since_full_scan + 1;
+
+	if (detection.regions.empty() || (detection.tracker && !detection.landmark_detection_success))
+	{
+		return false;
+	}
+
+	// The face has moved on since the frame that was searched, so it is moved along with the last known motion of the lost face
+	cv::Point2f motion(0, 0);
+	if (clnf_model.last_face_box.width > 0 && clnf_model.predicted_face_box.width > 0)
+	{
+		motion = ((clnf_model.predicted_face_box.tl() + clnf_model.predicted_face_box.br()) - (clnf_model.last_face_box.tl() + clnf_model.last_face_box.br())) * (0.5f * frames_elapsed);
+	}
+
+	CLNF reinitialised_model(clnf_model);
+	params.window_sizes_current = params.window_sizes_init;
+
+	bool landmark_detection_success;
+	if (detection.tracker)
+	{
+		// The landmarks were detected in the background as well, so they only need refitting on this frame
+		CopyHypothesisResult(reinitialised_model, *detection.tracker);
+		reinitialised_model.params_global[4] += motion.x;
+		reinitialised_model.params_global[5] += motion.y;
+
+		landmark_detection_success = reinitialised_model.DetectLandmarks(frame, params);
+	}
+	else
+	{
+		// Only the face was detected in the background (the model can not be fit by several trackers at once)
+		cv::Rect_<float> bounding_box = detection.chosen_region + motion;
+		reinitialised_model.params_local.setTo(0);
+		reinitialised_model.model->pdm.CalcParams(reinitialised_model.params_global, bounding_box, reinitialised_model.params_local);
+
+		params.multi_view = true;
+		landmark_detection_success = DetectLandmarksInImage(frame, bounding_box, reinitialised_model, params);
+		params.multi_view = false;
+	}
+
+	if (!landmark_detection_success)
+	{
+		return false;
+	}
+
+	CopyHypothesisResult(clnf_model, reinitialised_model);
+	clnf_model.detection_certainty = reinitialised_model.detection_certainty;
+
+	TrackingReinitialised(clnf_model, params, true, frame_pyramid, frame.Grayscale());
+	return true;
+}
+
+// Detecting a single face with the face detector chosen in the parameters, optionally only in a region of interest (relative to the image size)
+// and for a range of face widths (in pixels, -1 if not limited)
+static bool DetectSingleFaceInVideo(cv::Rect_<float>& o_region, FrameContext& frame, CLNF& clnf_model, const FaceModelParameters& params, cv::Point preference,
+	float min_width = -1, float max_width = -1, cv::Rect_<float> roi = cv::Rect_<float>(0.0, 0.0, 1.0, 1.0))
+{
+	float confidence;
+	if (params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
+	{
+		return LandmarkDetector::DetectSingleFaceHOG(o_region, frame.Grayscale(), clnf_model.model->face_detector_HOG, confidence, preference, min_width, roi);
+	}
+	else if (params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
+	{
+		return LandmarkDetector::DetectSingleFace(o_region, frame.Grayscale(), clnf_model.model->face_detector_HAAR, preference, min_width, roi);
+	}
+	else
+	{
+		return LandmarkDetector::DetectSingleFaceMTCNN(o_region, frame, clnf_model.model->face_detector_MTCNN, confidence, preference, min_width, max_width, roi);
+	}
+}
+
 bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat& grayscale_image)
+{
+	FrameContext frame(rgb_image, grayscale_image);
+
+	bool success = DetectLandmarksInVideo(frame, clnf_model, params);
+
+	// Hand the grayscale image back, so the caller can reuse it
+	if (grayscale_image.empty())
+	{
+		grayscale_image = frame.Grayscale();
+	}
+	return success;
+}
+
+bool LandmarkDetector::DetectLandmarksInVideo(FrameContext& frame, CLNF& clnf_model, FaceModelParameters& params)
 {
 	// First need to decide if the landmarks should be "detected" or "tracked"
 	// Detected means running face detection and a larger search area, tracked means initialising from previous step
 	// and using a smaller search area
 
-	if(grayscale_image.empty())
-	{
-		Utilities::ConvertToGrayscale_8bit(rgb_image, grayscale_image);
-	}
+	const cv::Mat_<uchar>& grayscale_image = frame.Grayscale();
 
 	// Indicating that this is a first detection in video sequence or after restart
 	bool initial_detection = !clnf_model.tracking_initialised;
 
+	clnf_model.landmarks_propagated = false;
+
+	// In keyframe tracking the optical flow pyramid of every tracked frame is kept for propagating its landmarks to the next one
+	std::vector<cv::Mat> frame_pyramid;
+	if(params.keyframe_interval > 1)
+	{
+		cv::buildOpticalFlowPyramid(grayscale_image, frame_pyramid, flow_window_size, flow_pyramid_levels);
+	}
+
 	// Only do it if there was a face detection at all
 	if(clnf_model.tracking_initialised)
 	{
 
+		// Between the keyframes the landmarks are propagated with optical flow, as long as that stays reliable (otherwise a full fit is done)
+		if(params.keyframe_interval > 1 && clnf_model.detection_success && clnf_model.frames_since_keyframe + 1 < params.keyframe_interval
+			&& PropagateLandmarks(frame, frame_pyramid, clnf_model, params))
+		{
+			clnf_model.landmarks_propagated = true;
+			clnf_model.frames_since_keyframe++;
+			clnf_model.previous_pyramid.swap(frame_pyramid);
+			clnf_model.motion_model.Update(clnf_model.params_global);
+			clnf_model.last_face_box = clnf_model.GetBoundingBox();
+
+			return true;
+		}
+
+		int num_optimisation_iteration = params.num_optimisation_iteration;
+		clnf_model.motion_uncertainty = -1;
+
+		// Where the face is expected in this frame (if predicted), in case it is lost
+		cv::Rect_<float> predicted_face_box;
+
 		// The area of interest search size will depend if the previous track was successful
 		if(!clnf_model.detection_success)
 		{
 			params.window_sizes_current = params.window_sizes_init;
 		}
+		else if(params.use_motion_prediction && clnf_model.motion_model.Ready())
+		{
+			// Start from the predicted pose, with the search area following how reliable the predictions have been
+			cv::Rect_<float> face_box = clnf_model.GetBoundingBox();
+			clnf_model.motion_uncertainty = clnf_model.motion_model.PredictionUncertainty(0.25f * (face_box.width + face_box.height));
+			clnf_model.params_global = clnf_model.motion_model.Predict();
+			clnf_model.model->pdm.CalcBoundingBox(predicted_face_box, clnf_model.params_global, clnf_model.params_local);
+
+			params.num_optimisation_iteration = ChooseTrackingWindows(params, clnf_model, clnf_model.motion_uncertainty);
+		}
 		else
 		{
 			params.window_sizes_current = params.window_sizes_small;
@@ -246,17 +577,36 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 			CorrectGlobalParametersVideo(grayscale_image, clnf_model, params);
 		}
 
-		bool track_success = clnf_model.DetectLandmarks(grayscale_image, params);
+		// Only a fit starting from a successfully tracked previous frame may skip the finer scales (not a reinitialisation or a hypothesis)
+		bool track_success = clnf_model.DetectLandmarks(frame, params, clnf_model.detection_success);
+
+		params.num_optimisation_iteration = num_optimisation_iteration;
 		
 		if(!track_success)
 		{
 			// Make a record that tracking failed
 			clnf_model.failures_in_a_row++;
+
+			// The motion is no longer known
+			clnf_model.motion_model.Reset();
+
+			if(predicted_face_box.width > 0)
+			{
+				clnf_model.predicted_face_box = predicted_face_box;
+			}
 		}
 		else
 		{
 			// indicate that tracking is a success
 			clnf_model.failures_in_a_row = -1;		
+
+			clnf_model.motion_model.Update(clnf_model.params_global);
+
+			clnf_model.last_face_box = clnf_model.GetBoundingBox();
+			clnf_model.predicted_face_box = cv::Rect_<float>();
+
+			clnf_model.frames_since_keyframe = 0;
+			clnf_model.previous_pyramid.swap(frame_pyramid);
 			
 			if(params.use_face_template)
 			{
@@ -265,32 +615,49 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 		}
 	}
 
-	// This is used for both detection (if it the tracking has not been initialised yet) or if the tracking failed (however we do this every n frames, for speed)
-	// This also has the effect of an attempt to reinitialise just after the tracking has failed, which is useful during large motions
-	if((!clnf_model.tracking_initialised && (clnf_model.failures_in_a_row + 1) % (params.reinit_video_every * 6) == 0) 
-		|| (clnf_model.tracking_initialised && !clnf_model.detection_success && params.reinit_video_every > 0 && clnf_model.failures_in_a_row % params.reinit_video_every == 0))
+	// A reinitialisation running in the background is used once it is due and finished (if it takes longer it is collected on a later frame rather than waited for),
+	// or dropped if the tracking recovered in the meantime
+	if(clnf_model.async_detector && clnf_model.async_detector->Pending())
 	{
+		clnf_model.async_detector->NextFrame();
 
-		cv::Rect_<float> bounding_box;
-		
-		// If the face detector has not been initialised and we're using it, then read it in
-		if(clnf_model.face_detector_HAAR.empty() && params.curr_face_detector == params.HAAR_DETECTOR)
+		int frames_elapsed = clnf_model.async_detector->FramesPending();
+
+		FaceDetectorAsync::Result detection;
+		if(clnf_model.detection_success || !clnf_model.tracking_initialised)
 		{
-			clnf_model.face_detector_HAAR.load(params.haar_face_detector_location);
-			clnf_model.haar_face_detector_location = params.haar_face_detector_location;
+			clnf_model.async_detector->Cancel();
 		}
-		if (clnf_model.face_detector_MTCNN.empty() && params.curr_face_detector == params.MTCNN_DETECTOR)
+		else if(frames_elapsed >= params.async_detection_delay && clnf_model.async_detector->Collect(detection))
 		{
-			clnf_model.face_detector_MTCNN.Read(params.mtcnn_face_detector_location);
-			clnf_model.mtcnn_face_detector_location = params.mtcnn_face_detector_location;
-
-			// If the model is still empty default to HOG
-			if (clnf_model.face_detector_MTCNN.empty())
+			if(UseAsyncDetection(frame, frame_pyramid, clnf_model, params, detection, frames_elapsed))
 			{
-				std::cout << "INFO: defaulting to HOG-SVM face detector" << std::endl;
-				params.curr_face_detector = LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR;
+				return true;
 			}
+		}
+	}
+	bool async_detection_pending = clnf_model.async_detector && clnf_model.async_detector->Pending();
+
+	// A reinitialisation that could not be started on an earlier frame is only still needed while the tracking is failing
+	if(clnf_model.detection_success || !clnf_model.tracking_initialised)
+	{
+		clnf_model.async_detection_deferred = false;
+	}
+
+	// This is used for both detection (if it the tracking has not been initialised yet) or if the tracking failed (however we do this every n frames, for speed)
+	// This also has the effect of an attempt to reinitialise just after the tracking has failed, which is useful during large motions
+	if(!async_detection_pending && ((!clnf_model.tracking_initialised && (clnf_model.failures_in_a_row + 1) % (params.reinit_video_every * 6) == 0) 
+		|| (clnf_model.tracking_initialised && !clnf_model.detection_success && params.reinit_video_every > 0 && clnf_model.failures_in_a_row % params.reinit_video_every == 0)
+		|| clnf_model.async_detection_deferred))
+	{
 
+		cv::Rect_<float> bounding_box;
+		
+		// If the face detector has not been initialised and we're using it, then read it in (if MTCNN cannot be read default to HOG)
+		if (!clnf_model.model->LoadFaceDetector(params.curr_face_detector, params) && params.curr_face_detector == FaceModelParameters::MTCNN_DETECTOR)
+		{
+			std::cout << "INFO: defaulting to HOG-SVM face detector" << std::endl;
+			params.curr_face_detector = LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR;
 		}
 
 		cv::Point preference_det(-1, -1);
@@ -301,20 +668,62 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 			clnf_model.preference_det = cv::Point(-1, -1);
 		}
 
-		bool face_detection_success;
-		if(params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
+		// A lost face is first looked for around where it was last seen and where it was heading, at a similar size,
+		// the whole frame is only scanned every few attempts or if nothing is found there
+		bool roi_search = clnf_model.tracking_initialised && params.redetection_roi_scale > 0 && clnf_model.last_face_box.width > 0 && preference_det.x == -1
+			&& (params.redetection_full_scan_every <= 0 || clnf_model.redetections_since_full_scan + 1 < params.redetection_full_scan_every);
+
+		float min_width = -1;
+		float max_width = -1;
+		cv::Rect_<float> roi(0.0, 0.0, 1.0, 1.0);
+		if(roi_search)
 		{
-			float confidence;
-			face_detection_success = LandmarkDetector::DetectSingleFaceHOG(bounding_box, grayscale_image, clnf_model.face_detector_HOG, confidence, preference_det);
+			std::vector<cv::Rect_<float> > expected_boxes;
+			expected_boxes.push_back(clnf_model.last_face_box);
+			expected_boxes.push_back(clnf_model.predicted_face_box);
+			roi = FaceSearchROI(expected_boxes, params.redetection_roi_scale, grayscale_image.size());
+
+			min_width = 0.5f * clnf_model.last_face_box.width;
+			max_width = 2.0f * clnf_model.last_face_box.width;
 		}
-		else if(params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
+
+		bool face_detection_success = false;
+		if(clnf_model.tracking_initialised && params.async_detection_delay > 0)
 		{
-			face_detection_success = LandmarkDetector::DetectSingleFace(bounding_box, grayscale_image, clnf_model.face_detector_HAAR, preference_det);
+			// A lost face is reinitialised in the background while the tracking carries on, the landmarks are detected there as well if the model can be fit
+			// by several trackers at once
+			if(!clnf_model.async_detector)
+			{
+				clnf_model.async_detector = std::make_shared<FaceDetectorAsync>();
+			}
+
+			// A dropped reinitialisation may still be running, in which case this one is started on the next frame instead
+			bool started;
+			if(ConcurrentFittingSupported(*clnf_model.model))
+			{
+				started = clnf_model.async_detector->Start(frame.Image(), clnf_model, params, preference_det, min_width, max_width, roi);
+			}
+			else
+			{
+				started = clnf_model.async_detector->Start(frame.Image(), clnf_model.model, params, preference_det, min_width, max_width, roi);
+			}
+			clnf_model.async_detection_deferred = !started;
 		}
-		else if (params.curr_face_detector == FaceModelParameters::MTCNN_DETECTOR)
+		else
 		{
-			float confidence;
-			face_detection_success = LandmarkDetector::DetectSingleFaceMTCNN(bounding_box, rgb_image, clnf_model.face_detector_MTCNN, confidence, preference_det);
+			if(roi_search)
+			{
+				face_detection_success = DetectSingleFaceInVideo(bounding_box, frame, clnf_model, params, preference_det, min_width, max_width, roi);
+
+				clnf_model.redetections_since_full_scan++;
+			}
+
+			if(!face_detection_success)
+			{
+				face_detection_success = DetectSingleFaceInVideo(bounding_box, frame, clnf_model, params, preference_det);
+
+				clnf_model.redetections_since_full_scan = 0;
+			}
 		}
 
 		// Attempt to detect landmarks using the detected face (if unseccessful the detection will be ignored)
@@ -332,18 +741,18 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 
 			// Use the detected bounding box and empty local parameters
 			clnf_model.params_local.setTo(0);
-			clnf_model.pdm.CalcParams(clnf_model.params_global, bounding_box, clnf_model.params_local);		
+			clnf_model.model->pdm.CalcParams(clnf_model.params_global, bounding_box, clnf_model.params_local);		
 
 			// Make sure the search size is large
 			params.window_sizes_current = params.window_sizes_init;
 
 			// TODO rem (should the multi-hyp version be only for CEN and not CLNF?), otherwise poss too slow, and poss not accurate
-			//bool landmark_detection_success = clnf_model.DetectLandmarks(grayscale_image, params);
+			//bool landmark_detection_success = clnf_model.DetectLandmarks(frame, params);
 
 			// Do the actual landmark detection (and keep it only if successful)
 			// Perform multi-hypothesis detection here (as face detector can pick up multiple of them)
 			params.multi_view = true;
-			bool landmark_detection_success = DetectLandmarksInImage(rgb_image, bounding_box, clnf_model, params, grayscale_image);
+			bool landmark_detection_success = DetectLandmarksInImage(frame, bounding_box, clnf_model, params);
 			params.multi_view = false;
 
 
@@ -356,7 +765,7 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 				// Restore previous estimates
 				clnf_model.params_global = params_global_init;
 				clnf_model.params_local = params_local_init.clone();
-				clnf_model.pdm.CalcShape2D(clnf_model.detected_landmarks, clnf_model.params_local, clnf_model.params_global);
+				clnf_model.model->pdm.CalcShape2D(clnf_model.detected_landmarks, clnf_model.params_local, clnf_model.params_global);
 				clnf_model.model_likelihood = likelihood_init;
 				clnf_model.detected_landmarks = detected_landmarks_init.clone();
 				clnf_model.landmark_likelihoods = landmark_likelihoods_init.clone();
@@ -365,12 +774,7 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 			}
 			else
 			{
-				clnf_model.failures_in_a_row = -1;			
-				
-				if(params.use_face_template)
-				{
-					UpdateTemplate(grayscale_image, clnf_model);
-				}
+				TrackingReinitialised(clnf_model, params, landmark_detection_success, frame_pyramid, grayscale_image);
 
 				return true;
 			}
@@ -394,18 +798,34 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, CLNF& cl
 }
 
 bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image)
+{
+	FrameContext frame(rgb_image, grayscale_image);
+
+	bool success = DetectLandmarksInVideo(frame, bounding_box, clnf_model, params);
+
+	if (grayscale_image.empty())
+	{
+		grayscale_image = frame.Grayscale();
+	}
+	return success;
+}
+
+bool LandmarkDetector::DetectLandmarksInVideo(FrameContext& frame, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
 {
 	if(bounding_box.width > 0)
 	{
 		// calculate the local and global parameters from the generated 2D shape (mapping from the 2D to 3D because camera params are unknown)
 		clnf_model.params_local.setTo(0);
-		clnf_model.pdm.CalcParams(clnf_model.params_global, bounding_box, clnf_model.params_local);		
+		clnf_model.model->pdm.CalcParams(clnf_model.params_global, bounding_box, clnf_model.params_local);		
 
 		// indicate that face was detected so initialisation is not necessary
 		clnf_model.tracking_initialised = true;
+
+		// The previous motion does not carry over to the new face location
+		clnf_model.motion_model.Reset();
 	}
 
-	return DetectLandmarksInVideo(rgb_image, clnf_model, params, grayscale_image);
+	return DetectLandmarksInVideo(frame, clnf_model, params);
 
 }
 
@@ -414,85 +834,117 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat &rgb_image, const cv
 // Optionally can provide a bounding box in which detection is performed (this is useful if multiple faces are to be detected in images)
 //================================================================================================================
 
-bool DetectLandmarksInImageMultiHypBasic(const cv::Mat_<uchar> &grayscale_image, std::vector<cv::Vec3d> rotation_hypotheses, 
-	const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
+// Checking if the trackers of a model can be fit concurrently (the SVR patch experts cache their DFTs during fitting, so they can not)
+static bool ConcurrentFittingSupported(const CLNFModel& model)
 {
-
-	// Use the initialisation size for the landmark detection
-	params.window_sizes_current = params.window_sizes_init;
-
-	// Store the current best estimate
-	float best_likelihood;
-	float best_detection_certainty;
-	cv::Vec6f best_global_parameters;
-	cv::Mat_<float> best_local_parameters;
-	cv::Mat_<float> best_detected_landmarks;
-	cv::Mat_<float> best_landmark_likelihoods;
-	bool best_success;
-
-	// The hierarchical model parameters
-	std::vector<float> best_likelihood_h(clnf_model.hierarchical_models.size());
-	std::vector<cv::Vec6f> best_global_parameters_h(clnf_model.hierarchical_models.size());
-	std::vector<cv::Mat_<float>> best_local_parameters_h(clnf_model.hierarchical_models.size());
-	std::vector<cv::Mat_<float>> best_detected_landmarks_h(clnf_model.hierarchical_models.size());
-	std::vector<cv::Mat_<float>> best_landmark_likelihoods_h(clnf_model.hierarchical_models.size());
-
-	for (size_t hypothesis = 0; hypothesis < rotation_hypotheses.size(); ++hypothesis)
+	if (model.patch_experts.cen_expert_intensity.empty() && model.patch_experts.ccnf_expert_intensity.empty())
 	{
-		// Reset the potentially set clnf_model parameters
-		clnf_model.params_local.setTo(0.0);
+		return false;
+	}
 
-		for (size_t part = 0; part < clnf_model.hierarchical_models.size(); ++part)
+	for (size_t part = 0; part < model.hierarchical_models.size(); ++part)
+	{
+		if (!ConcurrentFittingSupported(*model.hierarchical_models[part]))
 		{
-			clnf_model.hierarchical_models[part].params_local.setTo(0.0);
+			return false;
 		}
+	}
+	return true;
+}
 
-		// calculate the local and global parameters from the generated 2D shape (mapping from the 2D to 3D because camera params are unknown)
-		clnf_model.pdm.CalcParams(clnf_model.params_global, bounding_box, clnf_model.params_local, rotation_hypotheses[hypothesis]);
-	
-		bool success = clnf_model.DetectLandmarks(grayscale_image, params);	
-
-		if (hypothesis == 0 || best_likelihood < clnf_model.model_likelihood)
-		{
-			best_likelihood = clnf_model.model_likelihood;
-			best_global_parameters = clnf_model.params_global;
-			best_local_parameters = clnf_model.params_local.clone();
-			best_detected_landmarks = clnf_model.detected_landmarks.clone();
-			best_landmark_likelihoods = clnf_model.landmark_likelihoods.clone();
-			best_detection_certainty = clnf_model.detection_certainty;
-			best_success = success;
-			
-			for (size_t part = 0; part < clnf_model.hierarchical_models.size(); ++part)
+// Evaluating a number of hypotheses, concurrently if the model allows it, otherwise in order
+static void EvaluateHypotheses(size_t num_hypotheses, const CLNF& clnf_model, const std::function<void(size_t)>& evaluate)
+{
+	if (ConcurrentFittingSupported(*clnf_model.model))
+	{
+		ParallelFor(cv::Range(0, (int)num_hypotheses), [&](const cv::Range& range) {
+			for (int hypothesis = range.start; hypothesis < range.end; ++hypothesis)
 			{
-				best_likelihood_h[part] = clnf_model.hierarchical_models[part].model_likelihood;
-				best_global_parameters_h[part] = clnf_model.hierarchical_models[part].params_global;
-				best_local_parameters_h[part] = clnf_model.hierarchical_models[part].params_local.clone();
-				best_detected_landmarks_h[part] = clnf_model.hierarchical_models[part].detected_landmarks.clone();
-				best_landmark_likelihoods_h[part] = clnf_model.hierarchical_models[part].landmark_likelihoods.clone();
+				evaluate(hypothesis);
 			}
+		});
+	}
+	else
+	{
+		for (size_t hypothesis = 0; hypothesis < num_hypotheses; ++hypothesis)
+		{
+			evaluate(hypothesis);
 		}
-
 	}
+}
 
-	// Store the best estimates in the clnf_model
-	clnf_model.model_likelihood = best_likelihood;
-	clnf_model.params_global = best_global_parameters;
-	clnf_model.params_local = best_local_parameters.clone();
-	clnf_model.detected_landmarks = best_detected_landmarks.clone();
-	clnf_model.detection_success = best_success;
-	clnf_model.landmark_likelihoods = best_landmark_likelihoods.clone();
-	clnf_model.detection_certainty = best_detection_certainty;
+// Storing the result of the best hypothesis in the tracker
+static void CopyHypothesisResult(CLNF& clnf_model, const CLNF& best_model)
+{
+	clnf_model.model_likelihood = best_model.model_likelihood;
+	clnf_model.params_global = best_model.params_global;
+	clnf_model.params_local = best_model.params_local.clone();
+	clnf_model.detected_landmarks = best_model.detected_landmarks.clone();
+	clnf_model.detection_success = best_model.detection_success;
+	clnf_model.landmark_likelihoods = best_model.landmark_likelihoods.clone();
 
 	for (size_t part = 0; part < clnf_model.hierarchical_models.size(); ++part)
 	{
-		clnf_model.hierarchical_models[part].params_global = best_global_parameters_h[part];
-		clnf_model.hierarchical_models[part].params_local = best_local_parameters_h[part].clone();
-		clnf_model.hierarchical_models[part].detected_landmarks = best_detected_landmarks_h[part].clone();
-		clnf_model.hierarchical_models[part].landmark_likelihoods = best_landmark_likelihoods_h[part].clone();
+		clnf_model.hierarchical_models[part].params_global = best_model.hierarchical_models[part].params_global;
+		clnf_model.hierarchical_models[part].params_local = best_model.hierarchical_models[part].params_local.clone();
+		clnf_model.hierarchical_models[part].detected_landmarks = best_model.hierarchical_models[part].detected_landmarks.clone();
+		clnf_model.hierarchical_models[part].landmark_likelihoods = best_model.hierarchical_models[part].landmark_likelihoods.clone();
+	}
+}
+
+// Setting up a hypothesis tracker to start from a particular orientation
+static void InitialiseHypothesis(CLNF& hypothesis_model, const cv::Rect_<double> bounding_box, const cv::Vec3d& rotation)
+{
+	// Reset the potentially set clnf_model parameters
+	hypothesis_model.params_local.setTo(0.0);
+
+	for (size_t part = 0; part < hypothesis_model.hierarchical_models.size(); ++part)
+	{
+		hypothesis_model.hierarchical_models[part].params_local.setTo(0.0);
 	}
 
-	return best_success;
+	// calculate the local and global parameters from the generated 2D shape (mapping from the 2D to 3D because camera params are unknown)
+	hypothesis_model.model->pdm.CalcParams(hypothesis_model.params_global, bounding_box, hypothesis_model.params_local, rotation);
+}
+
+// Every hypothesis is fit on its own copy of the tracker (sharing the model), so they can be evaluated concurrently
+// The best hypothesis is picked in the hypothesis order, so the result is the same as evaluating them one after another
+bool DetectLandmarksInImageMultiHypBasic(FrameContext& frame, std::vector<cv::Vec3d> rotation_hypotheses, 
+	const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
+{
+
+	// Use the initialisation size for the landmark detection
+	params.window_sizes_current = params.window_sizes_init;
+
+	size_t num_hypotheses = rotation_hypotheses.size();
+
+	std::vector<CLNF> hypothesis_models(num_hypotheses, clnf_model);
+
+	EvaluateHypotheses(num_hypotheses, clnf_model, [&](size_t hypothesis) {
 
+		FaceModelParameters hypothesis_params(params);
+
+		InitialiseHypothesis(hypothesis_models[hypothesis], bounding_box, rotation_hypotheses[hypothesis]);
+
+		hypothesis_models[hypothesis].DetectLandmarks(frame, hypothesis_params);
+	});
+
+	// Pick the most likely hypothesis (the first one in case of ties)
+	size_t best = 0;
+	for (size_t hypothesis = 1; hypothesis < num_hypotheses; ++hypothesis)
+	{
+		if (hypothesis_models[best].model_likelihood < hypothesis_models[hypothesis].model_likelihood)
+		{
+			best = hypothesis;
+		}
+	}
+
+	// The tracker is left in the state of the last evaluated hypothesis, with the best estimates stored in it
+	clnf_model = hypothesis_models[num_hypotheses - 1];
+	CopyHypothesisResult(clnf_model, hypothesis_models[best]);
+	clnf_model.detection_certainty = hypothesis_models[best].detection_certainty;
+
+	return clnf_model.detection_success;
 
 }
 
@@ -510,7 +962,9 @@ template <typename T> std::vector<size_t> sort_indexes(const std::vector<T> &v)
 	return idx;
 }
 
-bool DetectLandmarksInImageMultiHypEarlyTerm(const cv::Mat_<uchar> &grayscale_image, std::vector<cv::Vec3d> rotation_hypotheses, 
+// The hypotheses are first fit at the first scale only, stopping at the first one (in hypothesis order) that passes the
+// early termination cutoff, hypotheses after it that are still running are cancelled
+bool DetectLandmarksInImageMultiHypEarlyTerm(FrameContext& frame, std::vector<cv::Vec3d> rotation_hypotheses, 
 	const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
 {
 	FaceModelParameters old_params(params);
@@ -518,8 +972,6 @@ bool DetectLandmarksInImageMultiHypEarlyTerm(const cv::Mat_<uchar> &grayscale_im
 	// Use the initialisation size for the landmark detection
 	params.window_sizes_current = params.window_sizes_init;
 
-	bool early_term = false;
-
 	// Setup the parameters accordingly
 	// Only do the first iteration
 	for (size_t i = 1; i < params.window_sizes_current.size(); ++i)
@@ -529,69 +981,75 @@ bool DetectLandmarksInImageMultiHypEarlyTerm(const cv::Mat_<uchar> &grayscale_im
 	params.refine_hierarchical = false;
 	params.validate_detections = false;
 
-	bool success = false;
+	size_t num_hypotheses = rotation_hypotheses.size();
+
+	std::vector<CLNF> hypothesis_models(num_hypotheses, clnf_model);
 
 	// Keeping track of converges
-	std::vector<float> likelihoods;
-	std::vector<cv::Vec6f> global_parameters;
-	std::vector<cv::Mat_<float>> local_parameters;
+	std::vector<float> likelihoods(num_hypotheses);
 
-	for (size_t hypothesis = 0; hypothesis < rotation_hypotheses.size(); ++hypothesis)
+	// The first hypothesis that passed the cutoff, and the flags for cancelling the ones after it
+	std::atomic<size_t> first_passed(num_hypotheses);
+	std::vector<std::atomic<bool> > cancelled(num_hypotheses);
+	for (size_t hypothesis = 0; hypothesis < num_hypotheses; ++hypothesis)
 	{
-		// Reset the potentially set clnf_model parameters
-		clnf_model.params_local.setTo(0.0);
+		cancelled[hypothesis] = false;
+	}
+
+	EvaluateHypotheses(num_hypotheses, clnf_model, [&](size_t hypothesis) {
 
-		for (size_t part = 0; part < clnf_model.hierarchical_models.size(); ++part)
+		// No need to start if an earlier hypothesis already passed
+		if (hypothesis > first_passed.load())
 		{
-			clnf_model.hierarchical_models[part].params_local.setTo(0.0);
+			return;
 		}
 
-		// calculate the local and global parameters from the generated 2D shape (mapping from the 2D to 3D because camera params are unknown)
-		clnf_model.pdm.CalcParams(clnf_model.params_global, bounding_box, clnf_model.params_local, rotation_hypotheses[hypothesis]);
+		CLNF& hypothesis_model = hypothesis_models[hypothesis];
+		FaceModelParameters hypothesis_params(params);
 
-		// Perform landmark detection in first scale
-		clnf_model.DetectLandmarks(grayscale_image, params);
+		InitialiseHypothesis(hypothesis_model, bounding_box, rotation_hypotheses[hypothesis]);
 
-		float lhood = clnf_model.model_likelihood * clnf_model.patch_experts.early_term_weights[clnf_model.view_used] + clnf_model.patch_experts.early_term_biases[clnf_model.view_used];
+		// Perform landmark detection in first scale
+		hypothesis_model.SetCancellationFlag(&cancelled[hypothesis]);
+		hypothesis_model.DetectLandmarks(frame, hypothesis_params);
+		hypothesis_model.SetCancellationFlag(nullptr);
 
-		// If likelihood higher than cutoff continue on this model
-		if (lhood > clnf_model.patch_experts.early_term_cutoffs[clnf_model.view_used])
+		if (cancelled[hypothesis])
 		{
-			params.refine_hierarchical = old_params.refine_hierarchical;
-			params.window_sizes_current = params.window_sizes_init;
-			params.window_sizes_current[0] = 0;
-			params.validate_detections = old_params.validate_detections;
-			success = clnf_model.DetectLandmarks(grayscale_image, params);
-			early_term = true;
-			break;
+			return;
 		}
-		else
+
+		float lhood = hypothesis_model.model_likelihood * clnf_model.model->patch_experts.early_term_weights[hypothesis_model.view_used] + clnf_model.model->patch_experts.early_term_biases[hypothesis_model.view_used];
+		likelihoods[hypothesis] = lhood;
+
+		// If likelihood higher than cutoff this hypothesis wins over all of the later ones
+		if (lhood > clnf_model.model->patch_experts.early_term_cutoffs[hypothesis_model.view_used])
 		{
-			likelihoods.push_back(lhood);
-			global_parameters.push_back(clnf_model.params_global);
-			local_parameters.push_back(clnf_model.params_local);
+			size_t current_first = first_passed.load();
+			while (hypothesis < current_first && !first_passed.compare_exchange_weak(current_first, hypothesis));
+
+			for (size_t later = hypothesis + 1; later < num_hypotheses; ++later)
+			{
+				cancelled[later] = true;
+			}
 		}
-	}
+	});
 
+	bool success = false;
 
-	if (!early_term)
+	// Continue on the model that passed the cutoff
+	if (first_passed < num_hypotheses)
 	{
+		params.refine_hierarchical = old_params.refine_hierarchical;
+		params.window_sizes_current = params.window_sizes_init;
+		params.window_sizes_current[0] = 0;
+		params.validate_detections = old_params.validate_detections;
 
-		// Store the current best estimate
-		float best_likelihood;
-		cv::Vec6f best_global_parameters;
-		cv::Mat_<float> best_local_parameters;
-		cv::Mat_<float> best_detected_landmarks;
-		cv::Mat_<float> best_landmark_likelihoods;
-		bool best_success;
-
-		// The hierarchical model parameters
-		std::vector<float> best_likelihood_h(clnf_model.hierarchical_models.size());
-		std::vector<cv::Vec6f> best_global_parameters_h(clnf_model.hierarchical_models.size());
-		std::vector<cv::Mat_<float>> best_local_parameters_h(clnf_model.hierarchical_models.size());
-		std::vector<cv::Mat_<float>> best_detected_landmarks_h(clnf_model.hierarchical_models.size());
-		std::vector<cv::Mat_<float>> best_landmark_likelihoods_h(clnf_model.hierarchical_models.size());
-
+		clnf_model = hypothesis_models[first_passed];
+		success = clnf_model.DetectLandmarks(frame, params);
+	}
+	else
+	{
 		// Sort the likelihoods and pick the best top 3 models
 		std::vector<size_t> indices = sort_indexes(likelihoods);
 
@@ -603,57 +1061,41 @@ bool DetectLandmarksInImageMultiHypEarlyTerm(const cv::Mat_<uchar> &grayscale_im
 		params.window_sizes_current[0] = 0;
 		params.validate_detections = old_params.validate_detections;
 
-
+		std::vector<CLNF> completion_models;
 		for (size_t i = 0; i < max; ++i)
 		{
-			// Reset the potentially set clnf_model parameters
-			clnf_model.params_local = local_parameters[indices[i]];
-			clnf_model.params_global = global_parameters[indices[i]];
-			for (size_t part = 0; part < clnf_model.hierarchical_models.size(); ++part)
-			{
-				clnf_model.hierarchical_models[part].params_local.setTo(0.0);
-			}
-	
-			// Perform landmark detection in first scale
-			success = clnf_model.DetectLandmarks(grayscale_image, params);
+			completion_models.push_back(hypothesis_models[indices[i]]);
+		}
+
+		std::vector<int> successes(max);
+
+		EvaluateHypotheses(max, clnf_model, [&](size_t i) {
 
-			if (i == 0 || best_likelihood < clnf_model.model_likelihood)
+			FaceModelParameters completion_params(params);
+
+			// Reset the potentially set part model parameters
+			for (size_t part = 0; part < completion_models[i].hierarchical_models.size(); ++part)
 			{
-				best_likelihood = clnf_model.model_likelihood;
-				best_global_parameters = clnf_model.params_global;
-				best_local_parameters = clnf_model.params_local.clone();
-				best_detected_landmarks = clnf_model.detected_landmarks.clone();
-				best_landmark_likelihoods = clnf_model.landmark_likelihoods.clone();
-				best_success = success;
-
-				for (size_t part = 0; part < clnf_model.hierarchical_models.size(); ++part)
-				{
-					best_likelihood_h[part] = clnf_model.hierarchical_models[part].model_likelihood;
-					best_global_parameters_h[part] = clnf_model.hierarchical_models[part].params_global;
-					best_local_parameters_h[part] = clnf_model.hierarchical_models[part].params_local.clone();
-					best_detected_landmarks_h[part] = clnf_model.hierarchical_models[part].detected_landmarks.clone();
-					best_landmark_likelihoods_h[part] = clnf_model.hierarchical_models[part].landmark_likelihoods.clone();
-				}
+				completion_models[i].hierarchical_models[part].params_local.setTo(0.0);
 			}
 
-		}
-
-		// Store the best estimates in the clnf_model
-		clnf_model.model_likelihood = best_likelihood;
-		clnf_model.params_global = best_global_parameters;
-		clnf_model.params_local = best_local_parameters.clone();
-		clnf_model.detected_landmarks = best_detected_landmarks.clone();
-		clnf_model.detection_success = best_success;
-		clnf_model.landmark_likelihoods = best_landmark_likelihoods.clone();
+			successes[i] = completion_models[i].DetectLandmarks(frame, completion_params);
+		});
 
-		for (size_t part = 0; part < clnf_model.hierarchical_models.size(); ++part)
+		// Pick the most likely completed hypothesis (the first one in case of ties)
+		size_t best = 0;
+		for (size_t i = 1; i < max; ++i)
 		{
-			clnf_model.hierarchical_models[part].params_global = best_global_parameters_h[part];
-			clnf_model.hierarchical_models[part].params_local = best_local_parameters_h[part].clone();
-			clnf_model.hierarchical_models[part].detected_landmarks = best_detected_landmarks_h[part].clone();
-			clnf_model.hierarchical_models[part].landmark_likelihoods = best_landmark_likelihoods_h[part].clone();
+			if (completion_models[best].model_likelihood < completion_models[i].model_likelihood)
+			{
+				best = i;
+			}
 		}
 
+		// The tracker is left in the state of the last completed hypothesis, with the best estimates stored in it
+		clnf_model = completion_models[max - 1];
+		CopyHypothesisResult(clnf_model, completion_models[best]);
+		success = successes[max - 1] != 0;
 	}
 
 	params = old_params;
@@ -662,15 +1104,21 @@ bool DetectLandmarksInImageMultiHypEarlyTerm(const cv::Mat_<uchar> &grayscale_im
 
 }
 
-
-// This is the one where the actual work gets done, other DetectLandmarksInImage calls lead to this one
 bool LandmarkDetector::DetectLandmarksInImage(const cv::Mat &rgb_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image)
 {
+	FrameContext frame(rgb_image, grayscale_image);
+
+	bool success = DetectLandmarksInImage(frame, bounding_box, clnf_model, params);
 
 	if (grayscale_image.empty())
 	{
-		Utilities::ConvertToGrayscale_8bit(rgb_image, grayscale_image);
+		grayscale_image = frame.Grayscale();
 	}
+	return success;
+}
+
+bool LandmarkDetector::DetectLandmarksInImage(FrameContext& frame, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
+{
 
 	// Can have multiple hypotheses
 	std::vector<cv::Vec3d> rotation_hypotheses;
@@ -700,61 +1148,57 @@ bool LandmarkDetector::DetectLandmarksInImage(const cv::Mat &rgb_image, const cv
 	bool success;
 
 	// Either use basic multi-hypothesis testing or clever testing if early termination parameters are present
-	if(clnf_model.patch_experts.early_term_biases.size() == 0)
+	if(clnf_model.model->patch_experts.early_term_biases.size() == 0)
 	{
-		success = DetectLandmarksInImageMultiHypBasic(grayscale_image, rotation_hypotheses, bounding_box, clnf_model, params);
+		success = DetectLandmarksInImageMultiHypBasic(frame, rotation_hypotheses, bounding_box, clnf_model, params);
 	}
 	else
 	{
-		success = DetectLandmarksInImageMultiHypEarlyTerm(grayscale_image, rotation_hypotheses, bounding_box, clnf_model, params);
+		success = DetectLandmarksInImageMultiHypEarlyTerm(frame, rotation_hypotheses, bounding_box, clnf_model, params);
 	}
 	return success;
 }
 
 bool LandmarkDetector::DetectLandmarksInImage(const cv::Mat &rgb_image, CLNF& clnf_model, FaceModelParameters& params, cv::Mat &grayscale_image)
 {
+	FrameContext frame(rgb_image, grayscale_image);
+
+	bool success = DetectLandmarksInImage(frame, clnf_model, params);
+
 	if (grayscale_image.empty())
 	{
-		Utilities::ConvertToGrayscale_8bit(rgb_image, grayscale_image);
+		grayscale_image = frame.Grayscale();
 	}
+	return success;
+}
+
+bool LandmarkDetector::DetectLandmarksInImage(FrameContext& frame, CLNF& clnf_model, FaceModelParameters& params)
+{
+	const cv::Mat_<uchar>& grayscale_image = frame.Grayscale();
 
 	cv::Rect_<float> bounding_box;
 
-	// If the face detector has not been initialised read it in
-	if(clnf_model.face_detector_HAAR.empty() && params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
+	// If the face detector has not been initialised read it in (if MTCNN cannot be read default to HOG)
+	if (!clnf_model.model->LoadFaceDetector(params.curr_face_detector, params) && params.curr_face_detector == FaceModelParameters::MTCNN_DETECTOR)
 	{
-		clnf_model.face_detector_HAAR.load(params.haar_face_detector_location);
-		clnf_model.haar_face_detector_location = params.haar_face_detector_location;
-	}
-	
-	if (clnf_model.face_detector_MTCNN.empty() && params.curr_face_detector == FaceModelParameters::MTCNN_DETECTOR)
-	{
-		clnf_model.face_detector_MTCNN.Read(params.mtcnn_face_detector_location);
-		clnf_model.mtcnn_face_detector_location = params.mtcnn_face_detector_location;
-
-		// If the model is still empty default to HOG
-		if (clnf_model.face_detector_MTCNN.empty())
-		{
-			std::cout << "INFO: defaulting to HOG-SVM face detector" << std::endl;
-			params.curr_face_detector = LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR;
-		}
-
+		std::cout << "INFO: defaulting to HOG-SVM face detector" << std::endl;
+		params.curr_face_detector = LandmarkDetector::FaceModelParameters::HOG_SVM_DETECTOR;
 	}
 
 	// Detect the face first
 	if(params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
 	{
 		float confidence;
-		LandmarkDetector::DetectSingleFaceHOG(bounding_box, grayscale_image, clnf_model.face_detector_HOG, confidence);
+		LandmarkDetector::DetectSingleFaceHOG(bounding_box, grayscale_image, clnf_model.model->face_detector_HOG, confidence);
 	}
 	else if(params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
 	{
-		LandmarkDetector::DetectSingleFace(bounding_box, rgb_image, clnf_model.face_detector_HAAR);
+		LandmarkDetector::DetectSingleFace(bounding_box, grayscale_image, clnf_model.model->face_detector_HAAR);
 	}
 	else if (params.curr_face_detector == FaceModelParameters::MTCNN_DETECTOR)
 	{
 		float confidence;
-		LandmarkDetector::DetectSingleFaceMTCNN(bounding_box, rgb_image, clnf_model.face_detector_MTCNN, confidence);
+		LandmarkDetector::DetectSingleFaceMTCNN(bounding_box, frame, clnf_model.model->face_detector_MTCNN, confidence);
 	}
 
 	if(bounding_box.width == 0)
@@ -763,6 +1207,6 @@ bool LandmarkDetector::DetectLandmarksInImage(const cv::Mat &rgb_image, CLNF& cl
 	}
 	else
 	{
-		return DetectLandmarksInImage(rgb_image, bounding_box, clnf_model, params, grayscale_image);
+		return DetectLandmarksInImage(frame, bounding_box, clnf_model, params);
 	}
 }
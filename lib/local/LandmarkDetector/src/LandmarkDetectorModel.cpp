@@ -36,8 +36,14 @@
 
 #include <LandmarkDetectorModel.h>
 
+// OpenCV includes
+#include <opencv2/core/hal/hal.hpp>
+
 // Local includes
+#include <FaceDetectorAsync.h>
 #include <LandmarkDetectorUtils.h>
+#include <SimdDispatch.h>
+#include <ThreadingPolicy.h>
 #include <RotationHelpers.h>
 
 using namespace LandmarkDetector;
@@ -47,7 +53,7 @@ using namespace LandmarkDetector;
 
 // Constructors
 // A default constructor
-CLNF::CLNF()
+CLNFModel::CLNFModel()
 {
 	FaceModelParameters parameters;
 
@@ -58,7 +64,7 @@ CLNF::CLNF()
 }
 
 // Constructor from a model file
-CLNF::CLNF(std::string fname)
+CLNFModel::CLNFModel(std::string fname)
 {
 	// A successful read wil set this to true
 	loaded_successfully = false;
@@ -66,95 +72,96 @@ CLNF::CLNF(std::string fname)
 	this->Read(fname);
 }
 
-// Copy constructor (makes a deep copy of CLNF)
-CLNF::CLNF(const CLNF& other): pdm(other.pdm), params_local(other.params_local.clone()), params_global(other.params_global), detected_landmarks(other.detected_landmarks.clone()),
-	landmark_likelihoods(other.landmark_likelihoods.clone()), patch_experts(other.patch_experts), landmark_validator(other.landmark_validator), haar_face_detector_location(other.haar_face_detector_location),
-	mtcnn_face_detector_location(other.mtcnn_face_detector_location), hierarchical_mapping(other.hierarchical_mapping), hierarchical_models(other.hierarchical_models), hierarchical_model_names(other.hierarchical_model_names),
-	hierarchical_params(other.hierarchical_params), eye_model(other.eye_model), face_detector_MTCNN(other.face_detector_MTCNN), preference_det(other.preference_det), loaded_successfully(other.loaded_successfully)
+// Constructor from a model bundle
+CLNFModel::CLNFModel(const ModelBundle& bundle, const std::string& prefix)
+{
+	loaded_successfully = this->Read(bundle, prefix);
+}
+
+// A default constructor
+CLNF::CLNF()
+{
+	FaceModelParameters parameters;
+
+	this->Read(parameters.model_location);
+}
+
+// Constructor from a model file
+CLNF::CLNF(std::string fname)
+{
+	this->Read(fname);
+}
+
+// Constructor of a tracker from an already loaded model
+CLNF::CLNF(std::shared_ptr<CLNFModel> model) : model(model)
+{
+	this->Init();
+}
+
+// Copy constructor (makes a deep copy of the tracking state, the model itself is shared)
+CLNF::CLNF(const CLNF& other): model(other.model), params_local(other.params_local.clone()), params_global(other.params_global), hierarchical_models(other.hierarchical_models), 
+	hierarchical_params(other.hierarchical_params), detected_landmarks(other.detected_landmarks.clone()), landmark_likelihoods(other.landmark_likelihoods.clone()), 
+	face_template(other.face_template.clone()), preference_det(other.preference_det), window_sizes_used(other.window_sizes_used), 
+	motion_model(other.motion_model), previous_pyramid(other.previous_pyramid), cancel_flag(nullptr)
 {
 	this->detection_success = other.detection_success;
 	this->tracking_initialised = other.tracking_initialised;
 	this->detection_certainty = other.detection_certainty;
+	this->eye_model = other.eye_model;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
-
-	// Load the CascadeClassifier (as it does not have a proper copy constructor)
-	if(!haar_face_detector_location.empty())
-	{
-		this->face_detector_HAAR.load(haar_face_detector_location);
-	}
-	// Make sure the matrices are allocated properly
-	this->triangulations.resize(other.triangulations.size());
-	for(size_t i = 0; i < other.triangulations.size(); ++i)
-	{
-		// Make sure the matrix is copied.
-		this->triangulations[i] = other.triangulations[i].clone();
-	}
-
-	// Make sure the matrices are allocated properly
-	for(std::map<int, cv::Mat_<float>>::const_iterator it = other.kde_resp_precalc.begin(); it!= other.kde_resp_precalc.end(); it++)
-	{
-		// Make sure the matrix is copied.
-		this->kde_resp_precalc.insert(std::pair<int, cv::Mat_<float>>(it->first, it->second.clone()));
-	}
-
+	this->view_used = other.view_used;
+	this->scales_used = other.scales_used;
+	this->iterations_used = other.iterations_used;
+	this->motion_uncertainty = other.motion_uncertainty;
+	this->landmarks_propagated = other.landmarks_propagated;
+	this->frames_since_keyframe = other.frames_since_keyframe;
+	this->last_face_box = other.last_face_box;
+	this->predicted_face_box = other.predicted_face_box;
+	this->redetections_since_full_scan = other.redetections_since_full_scan;
+	this->async_detection_deferred = other.async_detection_deferred;
+	this->loaded_successfully = other.loaded_successfully;
 }
 
-// Assignment operator for lvalues (makes a deep copy of CLNF)
+// Assignment operator for lvalues (makes a deep copy of the tracking state, the model itself is shared)
 CLNF & CLNF::operator= (const CLNF& other)
 {
 	if (this != &other) // protect against invalid self-assignment
 	{
-		pdm = PDM(other.pdm);
+		model = other.model;
+
 		params_local = other.params_local.clone();
 		params_global = other.params_global;
 		detected_landmarks = other.detected_landmarks.clone();
-		
-		landmark_likelihoods =other.landmark_likelihoods.clone();
-		patch_experts = Patch_experts(other.patch_experts);
-		landmark_validator = DetectionValidator(other.landmark_validator);
-		haar_face_detector_location = other.haar_face_detector_location;
-		mtcnn_face_detector_location = other.mtcnn_face_detector_location;
+		landmark_likelihoods = other.landmark_likelihoods.clone();
+		face_template = other.face_template.clone();
+
+		// Copy over the hierarchical trackers
+		this->hierarchical_models = other.hierarchical_models;
+		this->hierarchical_params = other.hierarchical_params;
 
 		this->detection_success = other.detection_success;
 		this->tracking_initialised = other.tracking_initialised;
 		this->detection_certainty = other.detection_certainty;
+		this->eye_model = other.eye_model;
 		this->model_likelihood = other.model_likelihood;
 		this->failures_in_a_row = other.failures_in_a_row;
+		this->view_used = other.view_used;
+		this->scales_used = other.scales_used;
+		this->iterations_used = other.iterations_used;
+		this->window_sizes_used = other.window_sizes_used;
+		this->motion_uncertainty = other.motion_uncertainty;
+		this->motion_model = other.motion_model;
+		this->landmarks_propagated = other.landmarks_propagated;
+		this->frames_since_keyframe = other.frames_since_keyframe;
+		this->previous_pyramid = other.previous_pyramid;
+		this->last_face_box = other.last_face_box;
+		this->predicted_face_box = other.predicted_face_box;
+		this->redetections_since_full_scan = other.redetections_since_full_scan;
+		this->async_detection_deferred = other.async_detection_deferred;
 
-		this->eye_model = other.eye_model;
-		
 		this->preference_det = other.preference_det;
 
-		// Load the CascadeClassifier (as it does not have a proper copy constructor)
-		if(!haar_face_detector_location.empty())
-		{
-			this->face_detector_HAAR.load(haar_face_detector_location);
-		}
-		// Make sure the matrices are allocated properly
-		this->triangulations.resize(other.triangulations.size());
-		for(size_t i = 0; i < other.triangulations.size(); ++i)
-		{
-			// Make sure the matrix is copied.
-			this->triangulations[i] = other.triangulations[i].clone();
-		}
-
-		// Make sure the matrices are allocated properly
-		for(std::map<int, cv::Mat_<float>>::const_iterator it = other.kde_resp_precalc.begin(); it!= other.kde_resp_precalc.end(); it++)
-		{
-			// Make sure the matrix is copied.
-			this->kde_resp_precalc.insert(std::pair<int, cv::Mat_<float>>(it->first, it->second.clone()));
-		}
-
-		// Copy over the hierarchical models
-		this->hierarchical_mapping = other.hierarchical_mapping;
-		this->hierarchical_models = other.hierarchical_models;
-		this->hierarchical_model_names = other.hierarchical_model_names;
-		this->hierarchical_params = other.hierarchical_params;
-
-		mtcnn_face_detector_location = other.mtcnn_face_detector_location;
-		face_detector_MTCNN = other.face_detector_MTCNN;
-
 		loaded_successfully = other.loaded_successfully;
 	}
 
@@ -162,38 +169,39 @@ CLNF & CLNF::operator= (const CLNF& other)
 }
 
 // Move constructor
-CLNF::CLNF(const CLNF&& other)
+CLNF::CLNF(const CLNF&& other) : cancel_flag(nullptr)
 {
-	this->detection_success = other.detection_success;
-	this->tracking_initialised = other.tracking_initialised;
-	this->detection_certainty = other.detection_certainty;
-	this->model_likelihood = other.model_likelihood;
-	this->failures_in_a_row = other.failures_in_a_row;
+	model = other.model;
 
-	pdm = other.pdm;
 	params_local = other.params_local;
 	params_global = other.params_global;
 	detected_landmarks = other.detected_landmarks;
 	landmark_likelihoods = other.landmark_likelihoods;
-	patch_experts = other.patch_experts;
-	landmark_validator = other.landmark_validator;
-	haar_face_detector_location = other.haar_face_detector_location;
-	mtcnn_face_detector_location = other.mtcnn_face_detector_location;
-
-	face_detector_HAAR = other.face_detector_HAAR;
+	face_template = other.face_template;
 
-	triangulations = other.triangulations;
-	kde_resp_precalc = other.kde_resp_precalc;
-
-	face_detector_MTCNN = other.face_detector_MTCNN;
-
-	// Copy over the hierarchical models
-	this->hierarchical_mapping = other.hierarchical_mapping;
+	// Copy over the hierarchical trackers
 	this->hierarchical_models = other.hierarchical_models;
-	this->hierarchical_model_names = other.hierarchical_model_names;
 	this->hierarchical_params = other.hierarchical_params;
 
+	this->detection_success = other.detection_success;
+	this->tracking_initialised = other.tracking_initialised;
+	this->detection_certainty = other.detection_certainty;
 	this->eye_model = other.eye_model;
+	this->model_likelihood = other.model_likelihood;
+	this->failures_in_a_row = other.failures_in_a_row;
+	this->view_used = other.view_used;
+	this->scales_used = other.scales_used;
+	this->iterations_used = other.iterations_used;
+	this->window_sizes_used = other.window_sizes_used;
+	this->motion_uncertainty = other.motion_uncertainty;
+	this->motion_model = other.motion_model;
+	this->landmarks_propagated = other.landmarks_propagated;
+	this->frames_since_keyframe = other.frames_since_keyframe;
+	this->previous_pyramid = other.previous_pyramid;
+	this->last_face_box = other.last_face_box;
+	this->predicted_face_box = other.predicted_face_box;
+	this->redetections_since_full_scan = other.redetections_since_full_scan;
+	this->async_detection_deferred = other.async_detection_deferred;
 
 	this->preference_det = other.preference_det;
 
@@ -204,36 +212,37 @@ CLNF::CLNF(const CLNF&& other)
 // Assignment operator for rvalues
 CLNF & CLNF::operator= (const CLNF&& other)
 {
-	this->detection_success = other.detection_success;
-	this->tracking_initialised = other.tracking_initialised;
-	this->detection_certainty = other.detection_certainty;
-	this->model_likelihood = other.model_likelihood;
-	this->failures_in_a_row = other.failures_in_a_row;
+	model = other.model;
 
-	pdm = other.pdm;
 	params_local = other.params_local;
 	params_global = other.params_global;
 	detected_landmarks = other.detected_landmarks;
 	landmark_likelihoods = other.landmark_likelihoods;
-	patch_experts = other.patch_experts;
-	landmark_validator = other.landmark_validator;
-	haar_face_detector_location = other.haar_face_detector_location;
-	mtcnn_face_detector_location = other.mtcnn_face_detector_location;
+	face_template = other.face_template;
 
-	face_detector_HAAR = other.face_detector_HAAR;
-
-	triangulations = other.triangulations;
-	kde_resp_precalc = other.kde_resp_precalc;
-
-	face_detector_MTCNN = other.face_detector_MTCNN;
-
-	// Copy over the hierarchical models
-	this->hierarchical_mapping = other.hierarchical_mapping;
+	// Copy over the hierarchical trackers
 	this->hierarchical_models = other.hierarchical_models;
-	this->hierarchical_model_names = other.hierarchical_model_names;
 	this->hierarchical_params = other.hierarchical_params;
 
+	this->detection_success = other.detection_success;
+	this->tracking_initialised = other.tracking_initialised;
+	this->detection_certainty = other.detection_certainty;
 	this->eye_model = other.eye_model;
+	this->model_likelihood = other.model_likelihood;
+	this->failures_in_a_row = other.failures_in_a_row;
+	this->view_used = other.view_used;
+	this->scales_used = other.scales_used;
+	this->iterations_used = other.iterations_used;
+	this->window_sizes_used = other.window_sizes_used;
+	this->motion_uncertainty = other.motion_uncertainty;
+	this->motion_model = other.motion_model;
+	this->landmarks_propagated = other.landmarks_propagated;
+	this->frames_since_keyframe = other.frames_since_keyframe;
+	this->previous_pyramid = other.previous_pyramid;
+	this->last_face_box = other.last_face_box;
+	this->predicted_face_box = other.predicted_face_box;
+	this->redetections_since_full_scan = other.redetections_since_full_scan;
+	this->async_detection_deferred = other.async_detection_deferred;
 
 	this->preference_det = other.preference_det;
 
@@ -242,8 +251,7 @@ CLNF & CLNF::operator= (const CLNF&& other)
 	return *this;
 }
 
-
-bool CLNF::Read_CLNF(std::string clnf_location)
+bool CLNFModel::Read_CLNF(std::string clnf_location)
 {
 	// Location of modules
 	std::ifstream locations(clnf_location.c_str(), std::ios_base::in);
@@ -360,9 +368,125 @@ bool CLNF::Read_CLNF(std::string clnf_location)
 	
 }
 
-void CLNF::Read(std::string main_location)
+FaceModelParameters CLNFModel::Part_parameters(const std::string& part_name, const std::string& root_loc)
+{
+	// Making sure we look based on model directory
+	std::vector<std::string> sub_arguments{ root_loc };
+	
+	FaceModelParameters params(sub_arguments);
+	
+	params.validate_detections = false;
+	params.refine_hierarchical = false;
+	params.refine_parameters = false;
+
+	if(part_name.compare("left_eye") == 0 || part_name.compare("right_eye") == 0)
+	{
+		
+		std::vector<int> windows_large;
+		windows_large.push_back(5);
+		windows_large.push_back(3);
+
+		std::vector<int> windows_small;
+		windows_small.push_back(5);
+		windows_small.push_back(3);
+
+		params.window_sizes_init = windows_large;
+		params.window_sizes_small = windows_small;
+		params.window_sizes_current = windows_large;
+
+		params.reg_factor = 0.1;
+		params.sigma = 2;
+	}
+	else if(part_name.compare("left_eye_28") == 0 || part_name.compare("right_eye_28") == 0)
+	{
+		std::vector<int> windows_large;
+		windows_large.push_back(3);
+		windows_large.push_back(5);
+		windows_large.push_back(9);
+
+		std::vector<int> windows_small;
+		windows_small.push_back(3);
+		windows_small.push_back(5);
+		windows_small.push_back(9);
+
+		params.window_sizes_init = windows_large;
+		params.window_sizes_small = windows_small;
+		params.window_sizes_current = windows_large;
+
+		params.reg_factor = 0.5;
+		params.sigma = 1.0;
+
+		eye_model = true;
+
+	}
+	else if(part_name.compare("mouth") == 0)
+	{
+		std::vector<int> windows_large;
+		windows_large.push_back(7);
+		windows_large.push_back(7);
+
+		std::vector<int> windows_small;
+		windows_small.push_back(7);
+		windows_small.push_back(7);
+
+		params.window_sizes_init = windows_large;
+		params.window_sizes_small = windows_small;
+		params.window_sizes_current = windows_large;
+
+		params.reg_factor = 1.0;
+		params.sigma = 2.0;
+	}
+	else if(part_name.compare("brow") == 0)
+	{
+		std::vector<int> windows_large;
+		windows_large.push_back(11);
+		windows_large.push_back(9);
+
+		std::vector<int> windows_small;
+		windows_small.push_back(11);
+		windows_small.push_back(9);
+
+		params.window_sizes_init = windows_large;
+		params.window_sizes_small = windows_small;
+		params.window_sizes_current = windows_large;
+
+		params.reg_factor = 10.0;
+		params.sigma = 3.5;
+	}
+	else if(part_name.compare("inner") == 0)
+	{
+		std::vector<int> windows_large;
+		windows_large.push_back(9);
+
+		std::vector<int> windows_small;
+		windows_small.push_back(9);
+
+		params.window_sizes_init = windows_large;
+		params.window_sizes_small = windows_small;
+		params.window_sizes_current = windows_large;
+
+		params.reg_factor = 2.5;
+		params.sigma = 1.75;
+		params.weight_factor = 2.5;
+	}
+
+	return params;
+}
+
+void CLNFModel::Read(std::string main_location)
 {
 
+	// Model bundles contain the whole model description in one memory mapped file
+	if (ModelBundle::IsBundle(main_location))
+	{
+		std::cout << "Reading the landmark detector/tracker from bundle: " << main_location << std::endl;
+
+		std::shared_ptr<const ModelBundle> bundle = ModelBundle::Open(main_location);
+
+		loaded_successfully = bundle && this->Read(*bundle, "clnf/");
+		return;
+	}
+
 	std::cout << "Reading the landmark detector/tracker from: " << main_location << std::endl;
 	
 	std::ifstream locations(main_location.c_str(), std::ios_base::in);
@@ -436,9 +560,9 @@ void CLNF::Read(std::string main_location)
 		
 			this->hierarchical_mapping.push_back(mappings);
 
-			CLNF part_model(location);
+			std::shared_ptr<CLNFModel> part_model = std::make_shared<CLNFModel>(location);
 
-			if (!part_model.loaded_successfully)
+			if (!part_model->loaded_successfully)
 			{
 				loaded_successfully = false;
 				return;
@@ -450,118 +574,344 @@ void CLNF::Read(std::string main_location)
 
 			// Making sure we look based on model directory
 			std::string root_loc = fs::path(main_location).parent_path().string();
-			std::vector<std::string> sub_arguments{ root_loc };
-			
-			FaceModelParameters params(sub_arguments);
-			
-			params.validate_detections = false;
-			params.refine_hierarchical = false;
-			params.refine_parameters = false;
+			this->hierarchical_params.push_back(Part_parameters(part_name, root_loc));
 
-			if(part_name.compare("left_eye") == 0 || part_name.compare("right_eye") == 0)
-			{
-				
-				std::vector<int> windows_large;
-				windows_large.push_back(5);
-				windows_large.push_back(3);
+			// The parts are fitted with their own parameters, so their KDE responses can be prepared now
+			part_model->PrecomputeKDE(this->hierarchical_params.back());
 
-				std::vector<int> windows_small;
-				windows_small.push_back(5);
-				windows_small.push_back(3);
+			std::cout << "Done" << std::endl;
+		}
+		else if (module.compare("DetectionValidator") == 0)
+		{            
+			std::cout << "Reading the landmark validation module....";
+			landmark_validator.Read(location);
+			std::cout << "Done" << std::endl;
+		}
+	}
+ 
+	loaded_successfully = true;
 
-				params.window_sizes_init = windows_large;
-				params.window_sizes_small = windows_small;
-				params.window_sizes_current = windows_large;
+}
 
-				params.reg_factor = 0.1;
-				params.sigma = 2;
-			}
-			else if(part_name.compare("left_eye_28") == 0 || part_name.compare("right_eye_28") == 0)
-			{
-				std::vector<int> windows_large;
-				windows_large.push_back(3);
-				windows_large.push_back(5);
-				windows_large.push_back(9);
+bool CLNFModel::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	std::cout << "Reading the PDM module....";
+	if (!pdm.Read(bundle, prefix + "pdm/"))
+	{
+		std::cout << "Could not find the PDM in the model bundle " << bundle.Location() << std::endl;
+		return false;
+	}
+	std::cout << "Done" << std::endl;
 
-				std::vector<int> windows_small;
-				windows_small.push_back(3);
-				windows_small.push_back(5);
-				windows_small.push_back(9);
+	int num_views = bundle.GetInt(prefix + "triangulations/num_views");
+	triangulations.resize(num_views);
+	for (int i = 0; i < num_views; ++i)
+	{
+		bundle.GetMat(prefix + "triangulations/" + std::to_string(i), triangulations[i]);
+	}
 
-				params.window_sizes_init = windows_large;
-				params.window_sizes_small = windows_small;
-				params.window_sizes_current = windows_large;
+	std::cout << "Reading the patch experts....";
+	if (!patch_experts.Read(bundle, prefix + "patch_experts/"))
+	{
+		return false;
+	}
+	std::cout << "Done" << std::endl;
 
-				params.reg_factor = 0.5;
-				params.sigma = 1.0;
+	// Assume no eye model, unless read-in
+	eye_model = false;
 
-				eye_model = true;
+	// The part parameters are looked up relative to the bundle location
+	std::string root_loc = fs::path(bundle.Location()).parent_path().string();
 
-			}
-			else if(part_name.compare("mouth") == 0)
-			{
-				std::vector<int> windows_large;
-				windows_large.push_back(7);
-				windows_large.push_back(7);
+	std::vector<std::string> part_names = bundle.GetStrings(prefix + "parts/names");
+	for (size_t part = 0; part < part_names.size(); ++part)
+	{
+		std::string part_prefix = prefix + "parts/" + std::to_string(part) + "/";
+		std::cout << "Reading part based module...." << part_names[part] << std::endl;
 
-				std::vector<int> windows_small;
-				windows_small.push_back(7);
-				windows_small.push_back(7);
+		// Mappings are stored as rows of (index in main, index in part)
+		cv::Mat_<int> mapping_mat;
+		bundle.GetMat(part_prefix + "mapping", mapping_mat);
 
-				params.window_sizes_init = windows_large;
-				params.window_sizes_small = windows_small;
-				params.window_sizes_current = windows_large;
+		std::vector<std::pair<int, int>> mappings;
+		for (int i = 0; i < mapping_mat.rows; ++i)
+		{
+			mappings.push_back(std::pair<int, int>(mapping_mat(i, 0), mapping_mat(i, 1)));
+		}
+		this->hierarchical_mapping.push_back(mappings);
 
-				params.reg_factor = 1.0;
-				params.sigma = 2.0;
-			}
-			else if(part_name.compare("brow") == 0)
-			{
-				std::vector<int> windows_large;
-				windows_large.push_back(11);
-				windows_large.push_back(9);
+		std::shared_ptr<CLNFModel> part_model = std::make_shared<CLNFModel>(bundle, part_prefix);
+
+		if (!part_model->loaded_successfully)
+		{
+			return false;
+		}
 
-				std::vector<int> windows_small;
-				windows_small.push_back(11);
-				windows_small.push_back(9);
+		this->hierarchical_models.push_back(part_model);
+		this->hierarchical_model_names.push_back(part_names[part]);
+		this->hierarchical_params.push_back(Part_parameters(part_names[part], root_loc));
+		part_model->PrecomputeKDE(this->hierarchical_params.back());
 
-				params.window_sizes_init = windows_large;
-				params.window_sizes_small = windows_small;
-				params.window_sizes_current = windows_large;
+		std::cout << "Done" << std::endl;
+	}
 
-				params.reg_factor = 10.0;
-				params.sigma = 3.5;
-			}
-			else if(part_name.compare("inner") == 0)
+	if (bundle.Has(prefix + "validator/orientations"))
+	{
+		std::cout << "Reading the landmark validation module....";
+		landmark_validator.Read(bundle, prefix + "validator/");
+		std::cout << "Done" << std::endl;
+	}
+
+	return true;
+}
+
+void CLNFModel::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	pdm.Write(bundle, prefix + "pdm/");
+
+	bundle.AddInt(prefix + "triangulations/num_views", (int)triangulations.size());
+	for (size_t i = 0; i < triangulations.size(); ++i)
+	{
+		bundle.AddMat(prefix + "triangulations/" + std::to_string(i), triangulations[i]);
+	}
+
+	patch_experts.Write(bundle, prefix + "patch_experts/");
+
+	bundle.AddStrings(prefix + "parts/names", hierarchical_model_names);
+	for (size_t part = 0; part < hierarchical_models.size(); ++part)
+	{
+		std::string part_prefix = prefix + "parts/" + std::to_string(part) + "/";
+
+		cv::Mat_<int> mapping_mat((int)hierarchical_mapping[part].size(), 2);
+		for (size_t i = 0; i < hierarchical_mapping[part].size(); ++i)
+		{
+			mapping_mat((int)i, 0) = hierarchical_mapping[part][i].first;
+			mapping_mat((int)i, 1) = hierarchical_mapping[part][i].second;
+		}
+		bundle.AddMat(part_prefix + "mapping", mapping_mat);
+
+		hierarchical_models[part]->Write(bundle, part_prefix);
+	}
+
+	landmark_validator.Write(bundle, prefix + "validator/");
+}
+
+void CLNFModel::QuantisePatchExperts()
+{
+	patch_experts.Quantise_CEN();
+
+	for (size_t part = 0; part < hierarchical_models.size(); ++part)
+	{
+		hierarchical_models[part]->QuantisePatchExperts();
+	}
+}
+
+size_t CLNFModel::KDESize(int resp_size)
+{
+	size_t grid_size = (size_t)(resp_size / kde_step_size + 0.5f);
+	return grid_size * grid_size * resp_size * resp_size;
+}
+
+// The table rows follow the grid locations (dx major, dy minor), the KDE is separable so it is built from the 1D kernels exp(a * (d - i)^2)
+void CLNFModel::ComputeKDE(float* kde, int resp_size, float a)
+{
+	int grid_size = (int)(resp_size / kde_step_size + 0.5f);
+
+	cv::Mat_<float> kernels_1D(grid_size, resp_size);
+	for (int g = 0; g < grid_size; ++g)
+	{
+		float d = g * kde_step_size;
+		for (int i = 0; i < resp_size; ++i)
+		{
+			kernels_1D(g, i) = exp(a * (d - i) * (d - i));
+		}
+	}
+
+	for (int x = 0; x < grid_size; ++x)
+	{
+		const float* kernel_x = kernels_1D.ptr<float>(x);
+		for (int y = 0; y < grid_size; ++y)
+		{
+			const float* kernel_y = kernels_1D.ptr<float>(y);
+			for (int ii = 0; ii < resp_size; ++ii)
 			{
-				std::vector<int> windows_large;
-				windows_large.push_back(9);
+				for (int jj = 0; jj < resp_size; ++jj)
+				{
+					*kde++ = kernel_y[ii] * kernel_x[jj];
+				}
+			}
+		}
+	}
+}
+
+void CLNFModel::PrecomputeKDE(const FaceModelParameters& parameters)
+{
+	kde_tables.clear();
+
+	int num_scales = (int)patch_experts.patch_scaling.size();
 
-				std::vector<int> windows_small;
-				windows_small.push_back(9);
+	// Every response size and KDE sigma the fitting can use
+	FaceModelParameters scale_parameters = parameters;
+	size_t total_size = 0;
+	const std::vector<int>* window_sizes[2] = { &parameters.window_sizes_init, &parameters.window_sizes_small };
+	for (int w = 0; w < 2; ++w)
+	{
+		for (int scale = 0; scale < num_scales && scale < (int)window_sizes[w]->size(); ++scale)
+		{
+			int resp_size = window_sizes[w]->at(scale);
+			if (resp_size == 0)
+				continue;
 
-				params.window_sizes_init = windows_large;
-				params.window_sizes_small = windows_small;
-				params.window_sizes_current = windows_large;
+			if (parameters.refine_parameters)
+			{
+				scale_parameters.AdaptToScale(parameters, patch_experts.patch_scaling, scale);
+			}
+			float a = KDEParameter(scale_parameters.sigma);
 
-				params.reg_factor = 2.5;
-				params.sigma = 1.75;
-				params.weight_factor = 2.5;
+			bool found = false;
+			for (size_t t = 0; t < kde_tables.size() && !found; ++t)
+			{
+				found = kde_tables[t].resp_size == resp_size && kde_tables[t].a == a;
+			}
+			if (!found)
+			{
+				kde_tables.push_back({ resp_size, a, total_size });
+				total_size += KDESize(resp_size);
 			}
+		}
+	}
+
+	// One block of memory for all of the tables
+	kde_responses.assign(total_size, 0.0f);
+	kde_responses.shrink_to_fit();
+	for (size_t t = 0; t < kde_tables.size(); ++t)
+	{
+		ComputeKDE(kde_responses.data() + kde_tables[t].offset, kde_tables[t].resp_size, kde_tables[t].a);
+	}
+}
 
-			this->hierarchical_params.push_back(params);
+bool CLNFModel::LoadFaceDetector(FaceModelParameters::FaceDetector detector, const FaceModelParameters& params)
+{
+	std::lock_guard<std::mutex> lock(face_detector_mutex);
 
-			std::cout << "Done" << std::endl;
+	if (detector == FaceModelParameters::HAAR_DETECTOR)
+	{
+		if (face_detector_HAAR.empty())
+		{
+			face_detector_HAAR.load(params.haar_face_detector_location);
+			haar_face_detector_location = params.haar_face_detector_location;
 		}
-		else if (module.compare("DetectionValidator") == 0)
-		{            
-			std::cout << "Reading the landmark validation module....";
-			landmark_validator.Read(location);
-			std::cout << "Done" << std::endl;
+		return !face_detector_HAAR.empty();
+	}
+	else if (detector == FaceModelParameters::MTCNN_DETECTOR)
+	{
+		if (face_detector_MTCNN.empty())
+		{
+			face_detector_MTCNN.Read(params.mtcnn_face_detector_location);
+			mtcnn_face_detector_location = params.mtcnn_face_detector_location;
 		}
+		return !face_detector_MTCNN.empty();
 	}
- 
-	detected_landmarks.create(2 * pdm.NumberOfPoints(), 1);
+	return true;
+}
+
+const float* CLNFModel::KDEResponses(int resp_size, float a) const
+{
+	for (size_t t = 0; t < kde_tables.size(); ++t)
+	{
+		if (kde_tables[t].resp_size == resp_size && kde_tables[t].a == a)
+		{
+			return kde_responses.data() + kde_tables[t].offset;
+		}
+	}
+	return nullptr;
+}
+
+FaceModelParameters::LandmarkDetector CLNFModel::DetectorType() const
+{
+	if (!patch_experts.cen_expert_intensity.empty())
+	{
+		return FaceModelParameters::CECLM_DETECTOR;
+	}
+	else if (!patch_experts.ccnf_expert_intensity.empty())
+	{
+		return FaceModelParameters::CLNF_DETECTOR;
+	}
+	return FaceModelParameters::CLM_DETECTOR;
+}
+
+// The buffers are only (re)allocated when the PDM size changes
+void NU_RLMS_workspace::Allocate(int num_points, int num_modes)
+{
+	if (this->num_points == num_points && this->num_modes == num_modes)
+	{
+		return;
+	}
+
+	this->num_points = num_points;
+	this->num_modes = num_modes;
+
+	int num_params[2] = { 6, 6 + num_modes };
+	Parametrisation* parametrisations[2] = { &rigid, &non_rigid };
+	for (int i = 0; i < 2; ++i)
+	{
+		parametrisations[i]->J.create(2 * num_points, num_params[i]);
+		parametrisations[i]->J_w_t.create(num_params[i], 2 * num_points);
+		parametrisations[i]->reg_term.create(num_params[i], num_params[i]);
+		parametrisations[i]->hessian.create(num_params[i], num_params[i]);
+		parametrisations[i]->J_w_t_m.create(num_params[i], 1);
+	}
+
+	current_local.create(num_modes, 1);
+	current_shape.create(2 * num_points, 1);
+	previous_shape.create(2 * num_points, 1);
+	shape_3D.create(3 * num_points, 1);
+	weight_matrix.create(2 * num_points, 2 * num_points);
+	dxs.create(num_points, 1);
+	dys.create(num_points, 1);
+	mean_shifts.create(2 * num_points, 1);
+	fit_shape.create(2 * num_points, 1);
+	scale_start_shape.create(2 * num_points, 1);
+	response_coordinates.clear();
+
+	mean_shift_landmarks.reserve(num_points);
+	mean_shift_responses.reserve(num_points);
+	mean_shift_kde_rows.reserve(num_points);
+	continuous_responses.resize(num_points);
+	patch_expert_responses.resize(num_points);
+	mean_shift_locations.create(2, num_points);
+	mean_shift_outputs.create(2, num_points);
+}
+
+// Reading in a new model for the tracker
+void CLNF::Read(std::string main_location)
+{
+	model = std::make_shared<CLNFModel>(main_location);
+
+	// Prepare the KDE responses for the default parameters of the detector, other parameters will compute theirs on first use
+	if (model->loaded_successfully)
+	{
+		model->PrecomputeKDE(FaceModelParameters(model->DetectorType()));
+	}
+
+	this->Init();
+}
+
+// Setting up the tracking state to match the model
+void CLNF::Init()
+{
+	loaded_successfully = model->loaded_successfully;
+	eye_model = model->eye_model;
+
+	// Create the trackers for the part models (sharing the part model descriptions)
+	hierarchical_models.clear();
+	for (size_t part = 0; part < model->hierarchical_models.size(); ++part)
+	{
+		hierarchical_models.push_back(CLNF(model->hierarchical_models[part]));
+	}
+	hierarchical_params = model->hierarchical_params;
+
+	detected_landmarks.create(2 * model->pdm.NumberOfPoints(), 1);
 	detected_landmarks.setTo(0);
 
 	detection_success = false;
@@ -572,7 +922,7 @@ void CLNF::Read(std::string main_location)
 	// Initialising default values for the rest of the variables
 
 	// local parameters (shape)
-	params_local.create(pdm.NumberOfModes(), 1);
+	params_local.create(model->pdm.NumberOfModes(), 1);
 	params_local.setTo(0.0);
 
 	// global parameters (pose) [scale, euler_x, euler_y, euler_z, tx, ty]
@@ -583,8 +933,23 @@ void CLNF::Read(std::string main_location)
 	preference_det.x = -1;
 	preference_det.y = -1;
 
-	loaded_successfully = true;
-
+	view_used = 0;
+	scales_used = 0;
+	iterations_used = 0;
+	window_sizes_used.clear();
+	motion_uncertainty = -1;
+	motion_model.Reset();
+	landmarks_propagated = false;
+	frames_since_keyframe = 0;
+	previous_pyramid.clear();
+
+	last_face_box = cv::Rect_<float>();
+	predicted_face_box = cv::Rect_<float>();
+	redetections_since_full_scan = 0;
+	async_detection_deferred = false;
+
+	preallocated_im2col.clear();
+	cancel_flag = nullptr;
 }
 
 // Resetting the model (for a new video, or complet reinitialisation
@@ -605,6 +970,24 @@ void CLNF::Reset()
 
 	failures_in_a_row = -1;
 	face_template = cv::Mat_<uchar>();
+
+	// A reinitialisation in progress is of no use any more
+	if (async_detector)
+	{
+		async_detector->Cancel();
+	}
+
+	motion_uncertainty = -1;
+	motion_model.Reset();
+
+	landmarks_propagated = false;
+	frames_since_keyframe = 0;
+	previous_pyramid.clear();
+
+	last_face_box = cv::Rect_<float>();
+	predicted_face_box = cv::Rect_<float>();
+	redetections_since_full_scan = 0;
+	async_detection_deferred = false;
 }
 
 // Resetting the model, choosing the face nearest (x,y)
@@ -622,30 +1005,36 @@ void CLNF::Reset(double x, double y)
 
 // The main internal landmark detection call (should not be used externally?)
 bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& params)
+{
+	FrameContext frame(image, image);
+
+	return DetectLandmarks(frame, params);
+}
+
+bool CLNF::DetectLandmarks(FrameContext& frame, FaceModelParameters& params, bool tracking)
 {
 
-	// TODO this could be moved out
-	cv::Mat_<float> gray_image_flt;
-	image.convertTo(gray_image_flt, CV_32F);
+	// The float image is converted once per frame
+	const cv::Mat_<float>& gray_image_flt = frame.GrayscaleFloat();
 
 	// Fits from the current estimate of local and global parameters in the model
-	bool fit_success = Fit(gray_image_flt, params.window_sizes_current, params);
+	bool fit_success = Fit(gray_image_flt, params.window_sizes_current, params, tracking);
 
 	// Store the landmarks converged on in detected_landmarks
-	pdm.CalcShape2D(detected_landmarks, params_local, params_global);	
+	model->pdm.CalcShape2D(detected_landmarks, params_local, params_global, optimisation_workspace.shape_3D);
 
 	if(params.refine_hierarchical && hierarchical_models.size() > 0)
 	{
 		bool parts_used = false;		
 
 		// Do the hierarchical models in parallel
-		parallel_for_(cv::Range(0, hierarchical_models.size()), [&](const cv::Range& range) {
+		ParallelFor(cv::Range(0, hierarchical_models.size()), [&](const cv::Range& range) {
 			for (int part_model = range.start; part_model < range.end; part_model++)
 			{
 				
-				int n_part_points = hierarchical_models[part_model].pdm.NumberOfPoints();
+				int n_part_points = hierarchical_models[part_model].model->pdm.NumberOfPoints();
 
-				std::vector<std::pair<int, int>> mappings = this->hierarchical_mapping[part_model];
+				std::vector<std::pair<int, int>> mappings = model->hierarchical_mapping[part_model];
 
 				cv::Mat_<float> part_model_locs(n_part_points * 2, 1, 0.0f);
 
@@ -653,26 +1042,26 @@ bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& pa
 				for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
 				{
 					part_model_locs.at<float>(mappings[mapping_ind].second) = detected_landmarks.at<float>(mappings[mapping_ind].first);
-					part_model_locs.at<float>(mappings[mapping_ind].second + n_part_points) = detected_landmarks.at<float>(mappings[mapping_ind].first + this->pdm.NumberOfPoints());
+					part_model_locs.at<float>(mappings[mapping_ind].second + n_part_points) = detected_landmarks.at<float>(mappings[mapping_ind].first + model->pdm.NumberOfPoints());
 				}
 
 				// Fit the part based model PDM
-				hierarchical_models[part_model].pdm.CalcParams(hierarchical_models[part_model].params_global, hierarchical_models[part_model].params_local, part_model_locs);
+				hierarchical_models[part_model].model->pdm.CalcParams(hierarchical_models[part_model].params_global, hierarchical_models[part_model].params_local, part_model_locs);
 
 				// Only do this if we don't need to upsample
-				if (params_global[0] > 0.9 * hierarchical_models[part_model].patch_experts.patch_scaling[0])
+				if (params_global[0] > 0.9 * hierarchical_models[part_model].model->patch_experts.patch_scaling[0])
 				{
 					parts_used = true;
 
 					this->hierarchical_params[part_model].window_sizes_current = this->hierarchical_params[part_model].window_sizes_init;
 
 					// Do the actual landmark detection
-					hierarchical_models[part_model].DetectLandmarks(image, hierarchical_params[part_model]);
+					hierarchical_models[part_model].DetectLandmarks(frame, hierarchical_params[part_model]);
 
 				}
 				else
 				{
-					hierarchical_models[part_model].pdm.CalcShape2D(hierarchical_models[part_model].detected_landmarks, hierarchical_models[part_model].params_local, hierarchical_models[part_model].params_global);
+					hierarchical_models[part_model].model->pdm.CalcShape2D(hierarchical_models[part_model].detected_landmarks, hierarchical_models[part_model].params_local, hierarchical_models[part_model].params_global);
 				}
 		
 			}
@@ -684,18 +1073,18 @@ bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& pa
 
 			for (size_t part_model = 0; part_model < hierarchical_models.size(); ++part_model)
 			{
-				std::vector<std::pair<int, int>> mappings = this->hierarchical_mapping[part_model];
+				std::vector<std::pair<int, int>> mappings = model->hierarchical_mapping[part_model];
 
 				// Reincorporate the models into main tracker
 				for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
 				{
 					detected_landmarks.at<float>(mappings[mapping_ind].first) = hierarchical_models[part_model].detected_landmarks.at<float>(mappings[mapping_ind].second);
-					detected_landmarks.at<float>(mappings[mapping_ind].first + pdm.NumberOfPoints()) = hierarchical_models[part_model].detected_landmarks.at<float>(mappings[mapping_ind].second + hierarchical_models[part_model].pdm.NumberOfPoints());
+					detected_landmarks.at<float>(mappings[mapping_ind].first + model->pdm.NumberOfPoints()) = hierarchical_models[part_model].detected_landmarks.at<float>(mappings[mapping_ind].second + hierarchical_models[part_model].model->pdm.NumberOfPoints());
 				}
 			}
 
-			pdm.CalcParams(params_global, params_local, detected_landmarks);		
-			pdm.CalcShape2D(detected_landmarks, params_local, params_global);
+			model->pdm.CalcParams(params_global, params_local, detected_landmarks);		
+			model->pdm.CalcShape2D(detected_landmarks, params_local, params_global);
 		}
 
 	}
@@ -706,7 +1095,7 @@ bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& pa
 
 		cv::Vec3d orientation(params_global[1], params_global[2], params_global[3]);
 
-		detection_certainty = landmark_validator.Check(orientation, image, detected_landmarks);
+		detection_certainty = model->landmark_validator.Check(orientation, frame, detected_landmarks);
 
 		detection_success = detection_certainty > params.validation_boundary;
 
@@ -729,30 +1118,40 @@ bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, FaceModelParameters& pa
 }
 
 //=============================================================================
-bool CLNF::Fit(const cv::Mat_<float>& im, const std::vector<int>& window_sizes, const FaceModelParameters& parameters)
+bool CLNF::Fit(const cv::Mat_<float>& im, const std::vector<int>& window_sizes, const FaceModelParameters& parameters, bool tracking)
 {
 	// Making sure it is a single channel image
 	assert(im.channels() == 1);	
 	
-	// Placeholder for the landmarks
-	cv::Mat_<float> current_shape(2 * pdm.NumberOfPoints() , 1, 0.0f);
+	int n = model->pdm.NumberOfPoints(); 
 
-	int n = pdm.NumberOfPoints(); 
+	optimisation_workspace.Allocate(n, model->pdm.NumberOfModes());
+
+	// Placeholder for the landmarks
+	cv::Mat_<float>& current_shape = optimisation_workspace.fit_shape;
 		
-	int num_scales = patch_experts.patch_scaling.size();
+	int num_scales = model->patch_experts.patch_scaling.size();
 
 	// Storing the patch expert response maps
-	std::vector<cv::Mat_<float> > patch_expert_responses(n);
+	std::vector<cv::Mat_<float> >& patch_expert_responses = optimisation_workspace.patch_expert_responses;
 
 	// Converting from image space to patch expert space (normalised for rotation and scale)
 	cv::Matx22f sim_ref_to_img;
 	cv::Matx22f sim_img_to_ref;
 
-	FaceModelParameters tmp_parameters = parameters;
+	FaceModelParameters& tmp_parameters = optimisation_workspace.scale_parameters;
+	tmp_parameters = parameters;
 
 	// Active scale is there in case we need to upsample too much
 	int active_scale = 0;
 
+	scales_used = 0;
+	iterations_used = 0;
+	window_sizes_used = window_sizes;
+
+	// When tracking from the previous frame the fitting can stop after any scale once converged, so the likelihood is needed at every scale
+	bool scale_early_exit = tracking && parameters.scale_convergence_threshold > 0;
+
 	// Optimise the model across a number of areas of interest (usually in descending window size and ascending scale size)
 	for(int scale = 0; scale < num_scales; scale++)
 	{
@@ -760,45 +1159,49 @@ bool CLNF::Fit(const cv::Mat_<float>& im, const std::vector<int>& window_sizes,
 		if (window_sizes[scale] == 0)
 			continue;
 
+		// Abandon the fitting if it is no longer needed
+		if (cancel_flag != nullptr && cancel_flag->load())
+			return false;
+
 		int window_size = window_sizes[scale];
 
 		// The patch expert response computation
-		patch_experts.Response(patch_expert_responses, sim_ref_to_img, sim_img_to_ref, im, pdm, params_global, params_local, window_size, scale);
+		model->patch_experts.Response(patch_expert_responses, sim_ref_to_img, sim_img_to_ref, im, model->pdm, params_global, params_local, window_size, scale, preallocated_im2col);
 
 		if(parameters.refine_parameters == true)
 		{
-			int scale_max = scale >= 2 ? 2 : scale;
-
-			// Adapt the parameters based on scale (wan't to reduce regularisation as scale increases, but increase sigma and Tikhonov)
-			tmp_parameters.reg_factor = parameters.reg_factor - 15 * log(patch_experts.patch_scaling[scale_max]/0.25)/log(2);
-			
-			if(tmp_parameters.reg_factor <= 0)
-				tmp_parameters.reg_factor = 0.001;
-
-			tmp_parameters.sigma = parameters.sigma + 0.25 * log(patch_experts.patch_scaling[scale_max]/0.25)/log(2);
-			tmp_parameters.weight_factor = parameters.weight_factor + 2 * parameters.weight_factor *  log(patch_experts.patch_scaling[scale_max]/0.25)/log(2);
+			// Adapt the parameters based on scale
+			tmp_parameters.AdaptToScale(parameters, model->patch_experts.patch_scaling, scale);
 		}
 
 		// Get the current landmark locations
-		pdm.CalcShape2D(current_shape, params_local, params_global);
+		model->pdm.CalcShape2D(current_shape, params_local, params_global, optimisation_workspace.shape_3D);
 
 		// Get the view used by patch experts
-		int view_id = patch_experts.GetViewIdx(params_global, scale);
+		int view_id = model->patch_experts.GetViewIdx(params_global, scale);
 		this->view_used = view_id;
+		scales_used++;
+
+		// Keep the landmarks at the start of the scale for checking convergence
+		cv::Mat_<float>& scale_start_shape = optimisation_workspace.scale_start_shape;
+		current_shape.copyTo(scale_start_shape);
 
 		// the actual optimisation step
-		this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6f(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, true, scale, this->landmark_likelihoods, tmp_parameters, false);
+		this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6f(params_global), params_local, current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, true, scale, this->landmark_likelihoods, tmp_parameters, false);
 
 		// non-rigid optimisation
 
+		if (cancel_flag != nullptr && cancel_flag->load())
+			return false;
+
 		// If we are terminating next iteration, make sure to record the model likelihood
-		if(scale == num_scales - 1 || window_sizes[scale + 1] == 0 || params_global[0] < 0.30)
+		if(scale_early_exit || scale == num_scales - 1 || window_sizes[scale + 1] == 0 || params_global[0] < 0.30)
 		{			
-			this->model_likelihood = this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6f(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, false, scale, this->landmark_likelihoods, tmp_parameters, true);
+			this->model_likelihood = this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6f(params_global), params_local, current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, false, scale, this->landmark_likelihoods, tmp_parameters, true);
 		}
 		else
 		{
-			this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6f(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, false, scale, this->landmark_likelihoods, tmp_parameters, false);
+			this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6f(params_global), params_local, current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, false, scale, this->landmark_likelihoods, tmp_parameters, false);
 		}
 
 		// Can't track very small images reliably (less than ~30px across)
@@ -809,68 +1212,43 @@ bool CLNF::Fit(const cv::Mat_<float>& im, const std::vector<int>& window_sizes,
 		}
 
 		// Making sure we do not upsample too much
-		if (active_scale < num_scales - 1 && 0.9 * patch_experts.patch_scaling[active_scale + 1] < params_global[0])
+		if (active_scale < num_scales - 1 && 0.9 * model->patch_experts.patch_scaling[active_scale + 1] < params_global[0])
 			active_scale = active_scale + 1;
 
+		// If the landmarks barely moved at this scale the finer ones will not move them either
+		if (scale_early_exit)
+		{
+			model->pdm.CalcShape2D(current_shape, params_local, params_global, optimisation_workspace.shape_3D);
+			if (cv::norm(current_shape, scale_start_shape) / sqrt((float)n) < parameters.scale_convergence_threshold)
+				break;
+		}
+
 	}
 
 	return true;
 }
 
-void CLNF::NonVectorisedMeanShift_precalc_kde(cv::Mat_<float>& out_mean_shifts, const std::vector<cv::Mat_<float> >& patch_expert_responses,
-	const cv::Mat_<float> &dxs, const cv::Mat_<float> &dys, int resp_size, float a, int scale, int view_id, 
-	std::map<int, cv::Mat_<float> >& kde_resp_precalc)
+void CLNF::MeanShift_precalc_kde(cv::Mat_<float>& out_mean_shifts, const std::vector<cv::Mat_<float> >& patch_expert_responses,
+	const cv::Mat_<float> &dxs, const cv::Mat_<float> &dys, int resp_size, float a, int scale, int view_id)
 {
 	
 	int n = dxs.rows;
 	
-	cv::Mat_<float> kde_resp;
-	float step_size = 0.1;
-
-	// if this has not been precomputer, precompute it, otherwise use it
-	if(kde_resp_precalc.find(resp_size) == kde_resp_precalc.end())
-	{		
-		kde_resp = cv::Mat_<float>((int)((resp_size / step_size)*(resp_size/step_size)), resp_size * resp_size);
-		cv::MatIterator_<float> kde_it = kde_resp.begin();
-
-		for(int x = 0; x < resp_size/step_size; x++)
-		{
-			float dx = x * step_size;
-			for(int y = 0; y < resp_size/step_size; y++)
-			{
-				float dy = y * step_size;
+	const float step_size = CLNFModel::kde_step_size;
+	int grid_size = (int)(resp_size / step_size + 0.5f);
+	int kde_row_size = resp_size * resp_size;
 
-				int ii,jj;
-				float v,vx,vy;
-			
-				for(ii = 0; ii < resp_size; ii++)
-				{
-					vx = (dy-ii)*(dy-ii);
-					for(jj = 0; jj < resp_size; jj++)
-					{
-						vy = (dx-jj)*(dx-jj);
-
-						// the KDE evaluation of that point
-						v = exp(a*(vx+vy));
-						
-						*kde_it++ = v;
-					}
-				}
-			}
-		}
+	const float* kde_resp = KDEResponses(resp_size, a);
 
-		kde_resp_precalc[resp_size] = kde_resp.clone();
-	}
-	else
-	{
-		// use the precomputed version
-		kde_resp = kde_resp_precalc.find(resp_size)->second;
-	}
+	NU_RLMS_workspace& ws = optimisation_workspace;
+	ws.mean_shift_landmarks.clear();
+	ws.mean_shift_responses.clear();
+	ws.mean_shift_kde_rows.clear();
 
-	// for every point (patch) calculating mean-shift
+	// Collect the visible landmarks, together with their response maps and the KDE rows closest to their current locations
 	for(int i = 0; i < n; i++)
 	{
-		if(patch_experts.visibilities[scale][view_id].at<int>(i,0) == 0)
+		if(model->patch_experts.visibilities[scale][view_id].at<int>(i,0) == 0)
 		{
 			out_mean_shifts.at<float>(i,0) = 0;
 			out_mean_shifts.at<float>(i+n,0) = 0;
@@ -895,71 +1273,109 @@ void CLNF::NonVectorisedMeanShift_precalc_kde(cv::Mat_<float>& out_mean_shifts,
 		int closest_col = (int)(dy /step_size + 0.5); // Plus 0.5 is there, as C++ rounds down with int cast
 		int closest_row = (int)(dx /step_size + 0.5); // Plus 0.5 is there, as C++ rounds down with int cast
 		
-		int idx = closest_row * ((int)(resp_size/step_size + 0.5)) + closest_col; // Plus 0.5 is there, as C++ rounds down with int cast
-
-		cv::MatIterator_<float> kde_it = kde_resp.begin() + kde_resp.cols*idx;
-		
-		float mx=0.0;
-		float my=0.0;
-		float sum=0.0;
+		int idx = closest_row * grid_size + closest_col;
 
-		// Iterate over the patch responses here
-		cv::MatConstIterator_<float> p = patch_expert_responses[i].begin();
-			
-		// TODO maybe do through MatMuls instead?
-		for(int ii = 0; ii < resp_size; ii++)
+		// The kernel needs continuous responses
+		const cv::Mat_<float>& response = patch_expert_responses[i];
+		if (!response.isContinuous())
 		{
-			for(int jj = 0; jj < resp_size; jj++)
-			{
+			response.copyTo(ws.continuous_responses[i]);
+		}
 
-				// the KDE evaluation of that point multiplied by the probability at the current, xi, yi
-				float v = (*p++) * (*kde_it++);
+		int k = (int)ws.mean_shift_landmarks.size();
+		ws.mean_shift_landmarks.push_back(i);
+		ws.mean_shift_responses.push_back(response.isContinuous() ? response.ptr<float>() : ws.continuous_responses[i].ptr<float>());
+		ws.mean_shift_kde_rows.push_back(kde_resp + (size_t)idx * kde_row_size);
+		ws.mean_shift_locations(0, k) = dx;
+		ws.mean_shift_locations(1, k) = dy;
+	}
 
-				sum += v;
+	int num_visible = (int)ws.mean_shift_landmarks.size();
+	if (num_visible == 0)
+		return;
 
-				// mean shift in x and y
-				mx += v*jj;
-				my += v*ii; 
+	// The column and row of every response element, for computing the mean shift with the dispatched kernel
+	const cv::Mat_<float>& coordinates = ResponseCoordinates(resp_size);
 
-			}
-		}
-		
-		float msx = (mx/sum - dx);
-		float msy = (my/sum - dy);
+	// The KDE evaluation of every point multiplied by the probability at the current xi, yi, together with the mean shift in x and y, for all landmarks at once
+	GetSimdKernels().mean_shifts(ws.mean_shift_responses.data(), ws.mean_shift_kde_rows.data(), coordinates.ptr<float>(0), coordinates.ptr<float>(1), kde_row_size,
+		ws.mean_shift_locations.ptr<float>(0), ws.mean_shift_locations.ptr<float>(1), num_visible, ws.mean_shift_outputs.ptr<float>(0), ws.mean_shift_outputs.ptr<float>(1));
 
-		out_mean_shifts.at<float>(i,0) = msx;
-		out_mean_shifts.at<float>(i+n,0) = msy;
+	for (int k = 0; k < num_visible; ++k)
+	{
+		int i = ws.mean_shift_landmarks[k];
+		out_mean_shifts.at<float>(i,0) = ws.mean_shift_outputs(0, k);
+		out_mean_shifts.at<float>(i+n,0) = ws.mean_shift_outputs(1, k);
+	}
+
+}
+
+// The model precomputes the tables for the parameters it was prepared for, anything else is computed once per tracker (leaving the shared model untouched)
+const float* CLNF::KDEResponses(int resp_size, float a)
+{
+	const float* kde_resp = model->KDEResponses(resp_size, a);
+	if (kde_resp != nullptr)
+	{
+		return kde_resp;
+	}
 
+	std::vector<float>& local_kde = optimisation_workspace.kde_responses[std::make_pair(resp_size, a)];
+	if (local_kde.empty())
+	{
+		local_kde.resize(CLNFModel::KDESize(resp_size));
+		CLNFModel::ComputeKDE(local_kde.data(), resp_size, a);
 	}
+	return local_kde.data();
+}
+
+const cv::Mat_<float>& CLNF::ResponseCoordinates(int resp_size)
+{
+	cv::Mat_<float>& coordinates = optimisation_workspace.response_coordinates[resp_size];
 
+	if (coordinates.empty())
+	{
+		coordinates.create(2, resp_size * resp_size);
+		for (int ii = 0; ii < resp_size; ii++)
+		{
+			for (int jj = 0; jj < resp_size; jj++)
+			{
+				coordinates(0, ii * resp_size + jj) = (float)jj;
+				coordinates(1, ii * resp_size + jj) = (float)ii;
+			}
+		}
+	}
+	return coordinates;
 }
 
+// The weight matrix is written in place, so its memory is reused across calls
 void CLNF::GetWeightMatrix(cv::Mat_<float>& WeightMatrix, int scale, int view_id, const FaceModelParameters& parameters)
 {
-	int n = pdm.NumberOfPoints();  
+	int n = model->pdm.NumberOfPoints();  
+
+	WeightMatrix.create(n*2, n*2);
 
 	// Is the weight matrix needed at all
 	if(parameters.weight_factor > 0)
 	{
-		WeightMatrix = cv::Mat_<float>::zeros(n*2, n*2);
+		WeightMatrix.setTo(0);
 
 		for (int p=0; p < n; p++)
 		{
-			if (!patch_experts.cen_expert_intensity.empty())
+			if (!model->patch_experts.cen_expert_intensity.empty())
 			{
 
 				// for the x dimension
-				WeightMatrix.at<float>(p, p) = WeightMatrix.at<float>(p, p) + patch_experts.cen_expert_intensity[scale][view_id][p].confidence;
+				WeightMatrix.at<float>(p, p) = WeightMatrix.at<float>(p, p) + model->patch_experts.cen_expert_intensity[scale][view_id][p].confidence;
 
 				// for they y dimension
 				WeightMatrix.at<float>(p + n, p + n) = WeightMatrix.at<float>(p, p);
 
 			}
-			else if(!patch_experts.ccnf_expert_intensity.empty())
+			else if(!model->patch_experts.ccnf_expert_intensity.empty())
 			{
 
 				// for the x dimension
-				WeightMatrix.at<float>(p,p) = WeightMatrix.at<float>(p,p)  + patch_experts.ccnf_expert_intensity[scale][view_id][p].patch_confidence;
+				WeightMatrix.at<float>(p,p) = WeightMatrix.at<float>(p,p)  + model->patch_experts.ccnf_expert_intensity[scale][view_id][p].patch_confidence;
 				
 				// for they y dimension
 				WeightMatrix.at<float>(p+n,p+n) = WeightMatrix.at<float>(p,p);
@@ -968,20 +1384,20 @@ void CLNF::GetWeightMatrix(cv::Mat_<float>& WeightMatrix, int scale, int view_id
 			else
 			{
 				// Across the modalities add the confidences
-				for(size_t pc=0; pc < patch_experts.svr_expert_intensity[scale][view_id][p].svr_patch_experts.size(); pc++)
+				for(size_t pc=0; pc < model->patch_experts.svr_expert_intensity[scale][view_id][p].svr_patch_experts.size(); pc++)
 				{
 					// for the x dimension
-					WeightMatrix.at<float>(p,p) = WeightMatrix.at<float>(p,p)  + patch_experts.svr_expert_intensity[scale][view_id][p].svr_patch_experts.at(pc).confidence;
+					WeightMatrix.at<float>(p,p) = WeightMatrix.at<float>(p,p)  + model->patch_experts.svr_expert_intensity[scale][view_id][p].svr_patch_experts.at(pc).confidence;
 				}	
 				// for the y dimension
 				WeightMatrix.at<float>(p+n,p+n) = WeightMatrix.at<float>(p,p);
 			}
 		}
-		WeightMatrix = parameters.weight_factor * WeightMatrix;
+		WeightMatrix *= parameters.weight_factor;
 	}
 	else
 	{
-		WeightMatrix = cv::Mat_<float>::eye(n*2, n*2);
+		cv::setIdentity(WeightMatrix);
 	}
 
 }
@@ -992,56 +1408,63 @@ float CLNF::NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const
 				  const FaceModelParameters& parameters, bool compute_lhood)
 {		
 
-	int n = pdm.NumberOfPoints();  
+	int n = model->pdm.NumberOfPoints();  
 	
 	// Mean, eigenvalues, eigenvectors
-	cv::Mat_<float> M = this->pdm.mean_shape;
-	cv::Mat_<float> E = this->pdm.eigen_values;
-	//Mat_<float> V = this->pdm.princ_comp;
+	const cv::Mat_<float>& E = model->pdm.eigen_values;
+
+	int m = model->pdm.NumberOfModes();
+
+	// All of the intermediate results live in the preallocated workspace
+	NU_RLMS_workspace& ws = optimisation_workspace;
+	ws.Allocate(n, m);
+	NU_RLMS_workspace::Parametrisation& buffers = rigid ? ws.rigid : ws.non_rigid;
 
-	int m = pdm.NumberOfModes();
-	
 	cv::Vec6f current_global(initial_global);
 
-	cv::Mat_<float> current_local = initial_local.clone();
+	cv::Mat_<float>& current_local = ws.current_local;
+	initial_local.copyTo(current_local);
 
-	cv::Mat_<float> current_shape;
-	cv::Mat_<float> previous_shape;
+	cv::Mat_<float>& current_shape = ws.current_shape;
+	cv::Mat_<float>& previous_shape = ws.previous_shape;
 
-	// Pre-calculate the regularisation term
-	cv::Mat_<float> regTerm;
+	// Pre-calculate the regularisation term (diagonal, set to the inverse of eigenvalues for the non-rigid parameters)
+	cv::Mat_<float>& regTerm = buffers.reg_term;
+	regTerm.setTo(0);
 
-	if(rigid)
+	if(!rigid)
 	{
-		regTerm = cv::Mat_<float>::zeros(6,6);
-	}
-	else
-	{
-		cv::Mat_<float> regularisations = cv::Mat_<float>::zeros(1, 6 + m);
-
-		// Setting the regularisation to the inverse of eigenvalues
-		cv::Mat(parameters.reg_factor / E).copyTo(regularisations(cv::Rect(6, 0, m, 1)));
-		regTerm = cv::Mat::diag(regularisations.t());
+		for (int i = 0; i < m; ++i)
+		{
+			regTerm(6 + i, 6 + i) = parameters.reg_factor / E(i);
+		}
 	}	
 
-	cv::Mat_<float> WeightMatrix;
+	cv::Mat_<float>& WeightMatrix = ws.weight_matrix;
 	GetWeightMatrix(WeightMatrix, scale, view_id, parameters);
 
-	cv::Mat_<float> dxs, dys;
+	cv::Mat_<float>& dxs = ws.dxs;
+	cv::Mat_<float>& dys = ws.dys;
 	
 	// The preallocated memory for the mean shifts
-	cv::Mat_<float> mean_shifts(2 * pdm.NumberOfPoints(), 1, 0.0);
+	cv::Mat_<float>& mean_shifts = ws.mean_shifts;
+	mean_shifts.setTo(0);
+
+	// Jacobian, and transposed weighted jacobian
+	cv::Mat_<float>& J = buffers.J;
+	cv::Mat_<float>& J_w_t = buffers.J_w_t;
 
 	// Number of iterations
 	for(int iter = 0; iter < parameters.num_optimisation_iteration; iter++)
 	{
 		// get the current estimates of x
-		pdm.CalcShape2D(current_shape, current_local, current_global);
+		model->pdm.CalcShape2D(current_shape, current_local, current_global, ws.shape_3D);
 		
 		if(iter > 0)
 		{
-			// if the shape hasn't changed terminate
-			if(norm(current_shape, previous_shape) < 0.01)
+			// if the shape hasn't changed terminate (or the RMS landmark movement is negligible)
+			float shape_change = norm(current_shape, previous_shape);
+			if(shape_change < 0.01 || shape_change / sqrt((float)n) < parameters.convergence_landmark_threshold)
 			{				
 				break;
 			}
@@ -1049,44 +1472,46 @@ float CLNF::NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const
 
 		current_shape.copyTo(previous_shape);
 		
-		// Jacobian, and transposed weighted jacobian
-		cv::Mat_<float> J, J_w_t;
-
 		// calculate the appropriate Jacobians in 2D, even though the actual behaviour is in 3D, using small angle approximation and oriented shape
 		if(rigid)
 		{
-			pdm.ComputeRigidJacobian(current_local, current_global, J, WeightMatrix, J_w_t);
+			model->pdm.ComputeRigidJacobian(current_local, current_global, J, WeightMatrix, J_w_t, ws.shape_3D);
 		}
 		else
 		{
-			pdm.ComputeJacobian(current_local, current_global, J, WeightMatrix, J_w_t);
+			model->pdm.ComputeJacobian(current_local, current_global, J, WeightMatrix, J_w_t, ws.shape_3D);
 		}
 		
 		// useful for mean shift calculation
-		float a = -0.5/(parameters.sigma * parameters.sigma);
+		float a = CLNFModel::KDEParameter(parameters.sigma);
 
-		cv::Mat_<float> current_shape_2D = current_shape.reshape(1, 2).t();
-		cv::Mat_<float> base_shape_2D = base_shape.reshape(1, 2).t();
+		// The offsets of the landmarks from the base shape in the reference frame (where the responses were computed)
+		for (int i = 0; i < n; ++i)
+		{
+			float offset_x = current_shape(i) - base_shape(i);
+			float offset_y = current_shape(i + n) - base_shape(i + n);
 
-		cv::Mat_<float> offsets;
-		cv::Mat((current_shape_2D - base_shape_2D) * cv::Mat(sim_img_to_ref).t()).convertTo(offsets, CV_32F);
-		
-		dxs = offsets.col(0) + (resp_size-1)/2;
-		dys = offsets.col(1) + (resp_size-1)/2;
+			dxs(i) = sim_img_to_ref(0, 0) * offset_x + sim_img_to_ref(0, 1) * offset_y + (resp_size - 1) / 2;
+			dys(i) = sim_img_to_ref(1, 0) * offset_x + sim_img_to_ref(1, 1) * offset_y + (resp_size - 1) / 2;
+		}
 		
-		NonVectorisedMeanShift_precalc_kde(mean_shifts, patch_expert_responses, dxs, dys, resp_size, a, scale, view_id, kde_resp_precalc);
+		MeanShift_precalc_kde(mean_shifts, patch_expert_responses, dxs, dys, resp_size, a, scale, view_id);
 
 		// Now transform the mean shifts to the the image reference frame, as opposed to one of ref shape (object space)
-		cv::Mat_<float> mean_shifts_2D = (mean_shifts.reshape(1, 2)).t();
-		
-		mean_shifts_2D = mean_shifts_2D * cv::Mat(sim_ref_to_img).t();
-		mean_shifts = cv::Mat(mean_shifts_2D.t()).reshape(1, n*2);
+		for (int i = 0; i < n; ++i)
+		{
+			float ms_x = mean_shifts(i);
+			float ms_y = mean_shifts(i + n);
+
+			mean_shifts(i) = sim_ref_to_img(0, 0) * ms_x + sim_ref_to_img(0, 1) * ms_y;
+			mean_shifts(i + n) = sim_ref_to_img(1, 0) * ms_x + sim_ref_to_img(1, 1) * ms_y;
+		}
 
 		// remove non-visible observations
 		for(int i = 0; i < n; ++i)
 		{
 			// if patch unavailable for current index
-			if(patch_experts.visibilities[scale][view_id].at<int>(i,0) == 0)
+			if(model->patch_experts.visibilities[scale][view_id].at<int>(i,0) == 0)
 			{				
 				cv::Mat Jx = J.row(i);
 				Jx = cvScalar(0);
@@ -1104,35 +1529,52 @@ float CLNF::NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const
 		}
 
 		// projection of the meanshifts onto the jacobians (using the weighted Jacobian, see Baltrusaitis 2013)
-		cv::Mat_<float> J_w_t_m = J_w_t * mean_shifts;
+		cv::Mat_<float>& J_w_t_m = buffers.J_w_t_m;
+
+		// Perform matrix multiplication in OpenBLAS (fortran call)
+		int num_params = J_w_t.rows;
+		int num_obs = J_w_t.cols;
+		int one = 1;
+		float alpha1 = 1.0;
+		float beta0 = 0.0;
+		char N[2]; N[0] = 'N';
+		char T[2]; T[0] = 'T';
+		sgemm_(T, N, &num_params, &one, &num_obs, &alpha1, (float*)J_w_t.data, &num_obs, (float*)mean_shifts.data, &num_obs, &beta0, (float*)J_w_t_m.data, &num_params);
 
-		// Add the regularisation term
+		// Add the regularisation term (diagonal)
 		if(!rigid)
 		{
-			J_w_t_m(cv::Rect(0,6,1, m)) = J_w_t_m(cv::Rect(0,6,1, m)) - regTerm(cv::Rect(6,6, m, m)) * current_local;
+			for (int i = 0; i < m; ++i)
+			{
+				J_w_t_m(6 + i) -= regTerm(6 + i, 6 + i) * current_local(i);
+			}
 		}
 
-		cv::Mat_<float> Hessian = regTerm.clone();
+		cv::Mat_<float>& Hessian = buffers.hessian;
+		regTerm.copyTo(Hessian);
 
 		// Perform matrix multiplication in OpenBLAS (fortran call)
-		float alpha1 = 1.0;
 		float beta1 = 1.0;
-		char N[2]; N[0] = 'N';
 		sgemm_(N, N, &J.cols, &J_w_t.rows, &J_w_t.cols, &alpha1, (float*)J.data, &J.cols, (float*)J_w_t.data, &J_w_t.cols, &beta1, (float*)Hessian.data, &J.cols);
 
 		// Above is a fast (but ugly) version of 
 		// cv::Mat_<float> Hessian = J_w_t * J + regTerm;
 
-		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011)
-		cv::Mat_<float> param_update;
-		cv::solve(Hessian, J_w_t_m, param_update, cv::DECOMP_CHOLESKY);
+		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011), in place so that no memory is allocated
+		// the Hessian is overwritten by its decomposition and J_w_t_m by the update (zero if the Hessian is not positive definite, as with cv::solve)
+		if (!cv::hal::Cholesky32f(Hessian.ptr<float>(), Hessian.step, Hessian.rows, J_w_t_m.ptr<float>(), J_w_t_m.step, 1))
+		{
+			J_w_t_m.setTo(0);
+		}
+		const cv::Mat_<float>& param_update = J_w_t_m;
 		
 		// update the reference
-		pdm.UpdateModelParameters(param_update, current_local, current_global);		
+		model->pdm.UpdateModelParameters(param_update, current_local, current_global);		
 		
 		// clamp to the local parameters for valid expressions
-		pdm.Clamp(current_local, current_global, parameters);
+		model->pdm.Clamp(current_local, current_global, parameters);
 
+		iterations_used++;
 	}
 
 	// compute the log likelihood
@@ -1140,12 +1582,13 @@ float CLNF::NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const
 	
 	if(compute_lhood)
 	{
-		landmark_lhoods = cv::Mat_<float>(n, 1, -1e8);
+		landmark_lhoods.create(n, 1);
+		landmark_lhoods.setTo(-1e8);
 	
 		for(int i = 0; i < n; i++)
 		{
 
-			if(patch_experts.visibilities[scale][view_id].at<int>(i,0) == 0 )
+			if(model->patch_experts.visibilities[scale][view_id].at<int>(i,0) == 0 )
 			{
 				continue;
 			}
@@ -1180,11 +1623,11 @@ float CLNF::NU_RLMS(cv::Vec6f& final_global, cv::Mat_<float>& final_local, const
 			loglhood += log(sum + 1e-8);
 
 		}	
-		loglhood = loglhood/sum(patch_experts.visibilities[scale][view_id])[0];
+		loglhood = loglhood/sum(model->patch_experts.visibilities[scale][view_id])[0];
 	}
 
 	final_global = current_global;
-	final_local = current_local;
+	current_local.copyTo(final_local);
 
 	return loglhood;
 
@@ -1196,7 +1639,7 @@ cv::Mat_<float> CLNF::GetShape(float fx, float fy, float cx, float cy) const
 	int n = this->detected_landmarks.rows/2;
 
 	cv::Mat_<float> shape3d(n*3, 1);
-	this->pdm.CalcShape3D(shape3d, this->params_local);
+	model->pdm.CalcShape3D(shape3d, this->params_local);
 
 	// Need to rotate the shape to get the actual 3D representation
 	
@@ -1234,10 +1677,10 @@ cv::Mat_<float> CLNF::GetShape(float fx, float fy, float cx, float cy) const
 cv::Mat_<int> CLNF::GetVisibilities() const
 {
 	// Get the view of the largest scale
-	int scale = patch_experts.visibilities.size() - 1;
-	int view_id = patch_experts.GetViewIdx(params_global, scale);
+	int scale = model->patch_experts.visibilities.size() - 1;
+	int view_id = model->patch_experts.GetViewIdx(params_global, scale);
 
-	cv::Mat_<int> visibilities_to_ret = this->patch_experts.visibilities[scale][view_id].clone();
+	cv::Mat_<int> visibilities_to_ret = model->patch_experts.visibilities[scale][view_id].clone();
 	return visibilities_to_ret;
 }
 
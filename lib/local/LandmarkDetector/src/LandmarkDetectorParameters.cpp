@@ -55,6 +55,13 @@ FaceModelParameters::FaceModelParameters()
 
 }
 
+FaceModelParameters::FaceModelParameters(LandmarkDetector landmark_detector)
+{
+	// initialise the default values
+	init();
+	init_detector(landmark_detector);
+}
+
 FaceModelParameters::FaceModelParameters(std::vector<std::string> &arguments)
 {
 	// initialise the default values
@@ -135,6 +142,49 @@ FaceModelParameters::FaceModelParameters(std::vector<std::string> &arguments)
 			valid[i + 1] = false;
 			i++;
 		}
+		else if (arguments[i].compare("-motion_pred") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			int m_pred;
+			data >> m_pred;
+
+			use_motion_prediction = (bool)(m_pred != 0);
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-redetect_roi") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> redetection_roi_scale;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-full_scan_every") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> redetection_full_scan_every;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-async_detect") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> async_detection_delay;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-keyframe_every") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> keyframe_interval;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
 		else if (arguments[i].compare("-n_iter") == 0)
 		{
 			std::stringstream data(arguments[i + 1]);
@@ -144,6 +194,22 @@ FaceModelParameters::FaceModelParameters(std::vector<std::string> &arguments)
 			valid[i + 1] = false;
 			i++;
 		}
+		else if (arguments[i].compare("-conv_landmark") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> convergence_landmark_threshold;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-scale_conv") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> scale_convergence_threshold;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
 		else if (arguments[i].compare("-wild") == 0)
 		{
 			// For in the wild fitting these parameters are suitable
@@ -197,17 +263,15 @@ FaceModelParameters::FaceModelParameters(std::vector<std::string> &arguments)
 
 	if (model_path.stem().string().compare("main_ceclm_general") == 0)
 	{
-		curr_landmark_detector = CECLM_DETECTOR;
-		sigma = 1.5f * sigma;
-		reg_factor = 0.9f * reg_factor;
+		init_detector(CECLM_DETECTOR);
 	}
 	else if (model_path.stem().string().compare("main_clnf_general") == 0)
 	{
-		curr_landmark_detector = CLNF_DETECTOR;
+		init_detector(CLNF_DETECTOR);
 	}
 	else if (model_path.stem().string().compare("main_clm_general") == 0)
 	{
-		curr_landmark_detector = CLM_DETECTOR;
+		init_detector(CLM_DETECTOR);
 	}
 
 	// Make sure face detector location is valid
@@ -278,12 +342,43 @@ void FaceModelParameters::check_model_path(const std::string& root)
 	}
 }
 
+void FaceModelParameters::init_detector(LandmarkDetector landmark_detector)
+{
+	curr_landmark_detector = landmark_detector;
+
+	// CE-CLM benefits from more smoothing and less regularisation
+	if (landmark_detector == CECLM_DETECTOR)
+	{
+		sigma = 1.5f * sigma;
+		reg_factor = 0.9f * reg_factor;
+	}
+}
+
+void FaceModelParameters::AdaptToScale(const FaceModelParameters& base, const std::vector<double>& patch_scaling, int scale)
+{
+	int scale_max = scale >= 2 ? 2 : scale;
+
+	// Want to reduce regularisation as scale increases, but increase sigma and Tikhonov
+	reg_factor = base.reg_factor - 15 * log(patch_scaling[scale_max] / 0.25) / log(2);
+
+	if (reg_factor <= 0)
+		reg_factor = 0.001;
+
+	sigma = base.sigma + 0.25 * log(patch_scaling[scale_max] / 0.25) / log(2);
+	weight_factor = base.weight_factor + 2 * base.weight_factor * log(patch_scaling[scale_max] / 0.25) / log(2);
+}
+
 void FaceModelParameters::init()
 {
 
 	// number of iterations that will be performed at each scale
 	num_optimisation_iteration = 5;
 
+	// early termination of the optimisation when it has converged, off by default so that the results match earlier versions
+	// (-conv_landmark and -scale_conv turn it on, e.g. with 0.01 and 0.1)
+	convergence_landmark_threshold = 0.0f;
+	scale_convergence_threshold = 0.0f;
+
 	// using an external face checker based on SVM
 	validate_detections = true;
 
@@ -315,6 +410,15 @@ void FaceModelParameters::init()
 	// For first frame use the initialisation
 	window_sizes_current = window_sizes_init;
 
+	// Adapting the search windows to the predicted head motion, off by default as it changes the tracking results (-motion_pred 1 turns it on)
+	use_motion_prediction = false;
+	motion_fast_threshold = 1.0f;
+	motion_still_threshold = 0.35f;
+
+	// Fitting every frame by default
+	keyframe_interval = 1;
+	keyframe_flow_threshold = 0.5f;
+
 	model_location = "model/main_ceclm_general.txt";
 	curr_landmark_detector = CECLM_DETECTOR;
 
@@ -329,6 +433,14 @@ void FaceModelParameters::init()
 
 	reinit_video_every = 2;
 
+	// Reinitialising lost faces by scanning the whole frame by default, -redetect_roi 3 searches around where they were last seen first
+	// (with a full frame scan every 4th attempt)
+	redetection_roi_scale = 0.0f;
+	redetection_full_scan_every = 4;
+
+	// Detecting synchronously by default, so the results do not depend on the frames processed while detecting
+	async_detection_delay = 0;
+
 	// Face detection
 	haar_face_detector_location = "classifiers/haarcascade_frontalface_alt.xml";
 	mtcnn_face_detector_location = "model/mtcnn_detector/MTCNN_detector.txt";
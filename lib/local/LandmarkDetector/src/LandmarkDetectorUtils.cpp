@@ -410,9 +410,9 @@ namespace LandmarkDetector
 		// If the detection was not successful no landmarks are visible
 		if (clnf_model.detection_success)
 		{
-			int idx = clnf_model.patch_experts.GetViewIdx(clnf_model.params_global, 0);
+			int idx = clnf_model.model->patch_experts.GetViewIdx(clnf_model.params_global, 0);
 			// Because we only draw visible points, need to find which points patch experts consider visible at a certain orientation
-			return CalculateVisibleLandmarks(clnf_model.detected_landmarks, clnf_model.patch_experts.visibilities[0][idx]);
+			return CalculateVisibleLandmarks(clnf_model.detected_landmarks, clnf_model.model->patch_experts.visibilities[0][idx]);
 		}
 		else
 		{
@@ -429,8 +429,8 @@ namespace LandmarkDetector
 		for (size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
 		{
 
-			if (clnf_model.hierarchical_model_names[i].compare("left_eye_28") == 0 ||
-				clnf_model.hierarchical_model_names[i].compare("right_eye_28") == 0)
+			if (clnf_model.model->hierarchical_model_names[i].compare("left_eye_28") == 0 ||
+				clnf_model.model->hierarchical_model_names[i].compare("right_eye_28") == 0)
 			{
 
 				auto lmks = CalculateVisibleLandmarks(clnf_model.hierarchical_models[i]);
@@ -451,8 +451,8 @@ namespace LandmarkDetector
 		for (size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
 		{
 
-			if (clnf_model.hierarchical_model_names[i].compare("left_eye_28") == 0 ||
-				clnf_model.hierarchical_model_names[i].compare("right_eye_28") == 0)
+			if (clnf_model.model->hierarchical_model_names[i].compare("left_eye_28") == 0 ||
+				clnf_model.model->hierarchical_model_names[i].compare("right_eye_28") == 0)
 			{
 
 				auto lmks = clnf_model.hierarchical_models[i].GetShape(fx, fy, cx, cy);
@@ -478,8 +478,8 @@ namespace LandmarkDetector
 		for (size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
 		{
 
-			if (clnf_model.hierarchical_model_names[i].compare("left_eye_28") == 0 ||
-				clnf_model.hierarchical_model_names[i].compare("right_eye_28") == 0)
+			if (clnf_model.model->hierarchical_model_names[i].compare("left_eye_28") == 0 ||
+				clnf_model.model->hierarchical_model_names[i].compare("right_eye_28") == 0)
 			{
 
 				auto lmks = CalculateAllLandmarks(clnf_model.hierarchical_models[i]);
@@ -497,6 +497,14 @@ namespace LandmarkDetector
 	//============================================================================
 	// Face detection helpers
 	//============================================================================
+
+	// The pixel area of a region of interest given relative to the image size (clipped to the image)
+	static cv::Rect RoiInPixels(const cv::Rect_<float>& roi, const cv::Size& image_size)
+	{
+		cv::Rect roi_px((int)(roi.x * image_size.width), (int)(roi.y * image_size.height), (int)ceil(roi.width * image_size.width), (int)ceil(roi.height * image_size.height));
+		return roi_px & cv::Rect(0, 0, image_size.width, image_size.height);
+	}
+
 	bool DetectFaces(std::vector<cv::Rect_<float> >& o_regions, const cv::Mat_<uchar>& intensity, float min_width, cv::Rect_<float> roi)
 	{
 		cv::CascadeClassifier classifier("./classifiers/haarcascade_frontalface_alt.xml");
@@ -515,14 +523,22 @@ namespace LandmarkDetector
 	bool DetectFaces(std::vector<cv::Rect_<float> >& o_regions, const cv::Mat_<uchar>& intensity, cv::CascadeClassifier& classifier, float min_width, cv::Rect_<float> roi)
 	{
 
+		// Only the region of interest is scanned
+		cv::Rect roi_px = RoiInPixels(roi, intensity.size());
+		if (roi_px.area() == 0)
+		{
+			return false;
+		}
+		cv::Mat_<uchar> roi_intensity = intensity(roi_px);
+
 		std::vector<cv::Rect> face_detections;
 		if (min_width == -1)
 		{
-			classifier.detectMultiScale(intensity, face_detections, 1.2, 2, 0, cv::Size(50, 50));
+			classifier.detectMultiScale(roi_intensity, face_detections, 1.2, 2, 0, cv::Size(50, 50));
 		}
 		else
 		{
-			classifier.detectMultiScale(intensity, face_detections, 1.2, 2, 0, cv::Size(min_width, min_width));
+			classifier.detectMultiScale(roi_intensity, face_detections, 1.2, 2, 0, cv::Size(min_width, min_width));
 		}
 
 		// Convert from int bounding box do a double one with corrections
@@ -538,13 +554,13 @@ namespace LandmarkDetector
 			region.height = face_detections[face].height * 0.8676f;
 
 			// Move the face slightly to the right (as the width was made smaller)
-			region.x = face_detections[face].x + 0.0578f * face_detections[face].width;
+			region.x = roi_px.x + face_detections[face].x + 0.0578f * face_detections[face].width;
 			// Shift face down as OpenCV Haar Cascade detects the forehead as well, and we're not interested
-			region.y = face_detections[face].y + face_detections[face].height * 0.2166f;
+			region.y = roi_px.y + face_detections[face].y + face_detections[face].height * 0.2166f;
 
 			if (min_width != -1)
 			{
-				if (region.width < min_width || region.x < ((float)intensity.cols) * roi.x || region.y < ((float)intensity.cols) * roi.y || region.x + region.width >((float)intensity.cols) * (roi.x + roi.width) || region.y + region.height >((float)intensity.rows) * (roi.y + roi.height))
+				if (region.width < min_width || region.x < ((float)intensity.cols) * roi.x || region.y < ((float)intensity.rows) * roi.y || region.x + region.width >((float)intensity.cols) * (roi.x + roi.width) || region.y + region.height >((float)intensity.rows) * (roi.y + roi.height))
 					continue;
 			}
 
@@ -630,11 +646,19 @@ namespace LandmarkDetector
 			detector = dlib::get_frontal_face_detector();
 		}
 
+		// Only the region of interest is scanned
+		cv::Rect roi_px = RoiInPixels(roi, intensity.size());
+		if (roi_px.area() == 0)
+		{
+			return false;
+		}
+		cv::Mat_<uchar> roi_intensity = intensity(roi_px);
+
 		cv::Mat_<uchar> upsampled_intensity;
 
 		float scaling = 1.3f;
 
-		cv::resize(intensity, upsampled_intensity, cv::Size((int)(intensity.cols * scaling), (int)(intensity.rows * scaling)));
+		cv::resize(roi_intensity, upsampled_intensity, cv::Size((int)(roi_intensity.cols * scaling), (int)(roi_intensity.rows * scaling)));
 
 		dlib::cv_image<uchar> cv_grayscale(upsampled_intensity);
 
@@ -648,9 +672,9 @@ namespace LandmarkDetector
 
 			cv::Rect_<float> region;
 			// Move the face slightly to the right (as the width was made smaller)
-			region.x = (face_detections[face].rect.get_rect().tl_corner().x() + 0.0389f * face_detections[face].rect.get_rect().width()) / scaling;
+			region.x = roi_px.x + (face_detections[face].rect.get_rect().tl_corner().x() + 0.0389f * face_detections[face].rect.get_rect().width()) / scaling;
 			// Shift face down as OpenCV Haar Cascade detects the forehead as well, and we're not interested
-			region.y = (face_detections[face].rect.get_rect().tl_corner().y() + 0.1278f * face_detections[face].rect.get_rect().height()) / scaling;
+			region.y = roi_px.y + (face_detections[face].rect.get_rect().tl_corner().y() + 0.1278f * face_detections[face].rect.get_rect().height()) / scaling;
 
 			// Correct for scale
 			region.width = (face_detections[face].rect.get_rect().width() * 0.9611) / scaling;
@@ -659,7 +683,7 @@ namespace LandmarkDetector
 			// The scalings were learned using the Face Detections on LFPW and Helen using ground truth and detections from the HOG detector
 			if (min_width != -1)
 			{
-				if (region.width < min_width || region.x < ((float)intensity.cols) * roi.x || region.y < ((float)intensity.cols) * roi.y ||
+				if (region.width < min_width || region.x < ((float)intensity.cols) * roi.x || region.y < ((float)intensity.rows) * roi.y ||
 					region.x + region.width >((float)intensity.cols) * (roi.x + roi.width) || region.y + region.height >((float)intensity.rows) * (roi.y + roi.height))
 					continue;
 			}
@@ -764,15 +788,34 @@ bool DetectFacesMTCNN(std::vector<cv::Rect_<float> >& o_regions, const cv::Mat&
 	return o_regions.size() > 0;
 }
 
-bool DetectSingleFaceMTCNN(cv::Rect_<float>& o_region, const cv::Mat& image, LandmarkDetector::FaceDetectorMTCNN& detector, 
-	float& confidence, cv::Point preference)
+bool DetectFacesMTCNN(std::vector<cv::Rect_<float> >& o_regions, FrameContext& frame, LandmarkDetector::FaceDetectorMTCNN& detector,
+	std::vector<float>& o_confidences, float min_width, float max_width, cv::Rect_<float> roi)
 {
-	// The tracker can return multiple faces
-	std::vector<cv::Rect_<float> > face_detections;
-	std::vector<float> confidences;
+	// A restricted search only scans part of the frame (or of the pyramid scales), so is not shared with the frame
+	if (min_width != -1 || max_width != -1 || roi != cv::Rect_<float>(0.0, 0.0, 1.0, 1.0))
+	{
+		// The detector does not look for faces smaller than 12px
+		int min_face = min_width == -1 ? 60 : std::max((int)min_width, 12);
+		int max_face = max_width == -1 ? -1 : (int)ceil(max_width);
+		detector.DetectFaces(o_regions, frame, o_confidences, min_face, 0.6f, 0.7f, 0.7f, max_face, roi);
 
-	detector.DetectFaces(face_detections, image, confidences);
+		return o_regions.size() > 0;
+	}
+
+	// The detections are kept with the frame, so the detector runs at most once per frame
+	if (!frame.GetFaceDetections(FaceModelParameters::MTCNN_DETECTOR, o_regions, o_confidences))
+	{
+		detector.DetectFaces(o_regions, frame, o_confidences);
+		frame.SetFaceDetections(FaceModelParameters::MTCNN_DETECTOR, o_regions, o_confidences);
+	}
+
+	return o_regions.size() > 0;
+}
 
+// Picking one of the MTCNN detections, the closest to the preference point if set or the biggest one otherwise
+static bool PickSingleFaceMTCNN(cv::Rect_<float>& o_region, float& confidence, const std::vector<cv::Rect_<float> >& face_detections,
+	const std::vector<float>& confidences, cv::Point preference)
+{
 	bool detect_success = face_detections.size() > 0;
 	if (detect_success)
 	{
@@ -831,6 +874,71 @@ bool DetectSingleFaceMTCNN(cv::Rect_<float>& o_region, const cv::Mat& image, Lan
 	return detect_success;
 }
 
+bool DetectSingleFaceMTCNN(cv::Rect_<float>& o_region, const cv::Mat& image, LandmarkDetector::FaceDetectorMTCNN& detector, 
+	float& confidence, cv::Point preference)
+{
+	// The tracker can return multiple faces
+	std::vector<cv::Rect_<float> > face_detections;
+	std::vector<float> confidences;
+
+	detector.DetectFaces(face_detections, image, confidences);
+
+	return PickSingleFaceMTCNN(o_region, confidence, face_detections, confidences, preference);
+}
+
+bool DetectSingleFaceMTCNN(cv::Rect_<float>& o_region, FrameContext& frame, LandmarkDetector::FaceDetectorMTCNN& detector,
+	float& confidence, cv::Point preference, float min_width, float max_width, cv::Rect_<float> roi)
+{
+	std::vector<cv::Rect_<float> > face_detections;
+	std::vector<float> confidences;
+
+	DetectFacesMTCNN(face_detections, frame, detector, confidences, min_width, max_width, roi);
+
+	return PickSingleFaceMTCNN(o_region, confidence, face_detections, confidences, preference);
+}
+
+
+bool DetectFacesInFrame(std::vector<cv::Rect_<float> >& o_regions, std::vector<float>& o_confidences, FrameContext& frame, CLNFModel& model, FaceModelParameters::FaceDetector detector,
+	float min_width, float max_width, cv::Rect_<float> roi)
+{
+	if (detector == FaceModelParameters::HOG_SVM_DETECTOR)
+	{
+		return DetectFacesHOG(o_regions, frame.Grayscale(), model.face_detector_HOG, o_confidences, min_width, roi);
+	}
+	else if (detector == FaceModelParameters::HAAR_DETECTOR)
+	{
+		bool detection_success = DetectFaces(o_regions, frame.Grayscale(), model.face_detector_HAAR, min_width, roi);
+		o_confidences.resize(o_regions.size(), 1.0f);
+		return detection_success;
+	}
+	else
+	{
+		return DetectFacesMTCNN(o_regions, frame, model.face_detector_MTCNN, o_confidences, min_width, max_width, roi);
+	}
+}
+
+cv::Rect_<float> FaceSearchROI(const std::vector<cv::Rect_<float> >& face_boxes, float scale, const cv::Size& image_size)
+{
+	cv::Rect_<float> roi;
+	for (size_t i = 0; i < face_boxes.size(); ++i)
+	{
+		if (face_boxes[i].width <= 0 || face_boxes[i].height <= 0)
+		{
+			continue;
+		}
+
+		// Enlarging the box around its centre
+		float width = face_boxes[i].width * scale;
+		float height = face_boxes[i].height * scale;
+		cv::Rect_<float> search_box(face_boxes[i].x + 0.5f * face_boxes[i].width - 0.5f * width, face_boxes[i].y + 0.5f * face_boxes[i].height - 0.5f * height, width, height);
+
+		roi = roi.area() == 0 ? search_box : (roi | search_box);
+	}
+
+	// Relative to the image and clipped to it
+	roi = roi & cv::Rect_<float>(0, 0, (float)image_size.width, (float)image_size.height);
+	return cv::Rect_<float>(roi.x / image_size.width, roi.y / image_size.height, roi.width / image_size.width, roi.height / image_size.height);
+}
 
 //============================================================================
 // Matrix reading functionality
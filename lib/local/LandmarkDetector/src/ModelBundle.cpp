@@ -0,0 +1,458 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "ModelBundle.h"
+
+// System includes
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace LandmarkDetector;
+
+// The bundle header: magic, version, number of entries and the offset of the index
+static const char BUNDLE_MAGIC[8] = { 'O', 'F', 'B', 'U', 'N', 'D', 'L', 'E' };
+static const size_t BUNDLE_HEADER_SIZE = 64;
+static const size_t BUNDLE_ALIGNMENT = 64;
+
+//===========================================================================
+// Reading the bundle
+//===========================================================================
+
+std::shared_ptr<const ModelBundle> ModelBundle::Open(const std::string& location)
+{
+	// Bundles are kept open for the lifetime of the process, so that model matrices can point to the mapped data
+	static std::map<std::string, std::shared_ptr<const ModelBundle> > open_bundles;
+	static std::mutex open_bundles_mutex;
+
+	std::lock_guard<std::mutex> lock(open_bundles_mutex);
+
+	auto found = open_bundles.find(location);
+	if (found != open_bundles.end())
+	{
+		return found->second;
+	}
+
+	std::shared_ptr<ModelBundle> bundle(new ModelBundle());
+	if (!bundle->Map(location))
+	{
+		return std::shared_ptr<const ModelBundle>();
+	}
+
+	open_bundles[location] = bundle;
+	return bundle;
+}
+
+bool ModelBundle::IsBundle(const std::string& location)
+{
+	std::ifstream stream(location, std::ios::in | std::ios::binary);
+	if (!stream.is_open())
+	{
+		return false;
+	}
+
+	char magic[8];
+	stream.read(magic, 8);
+
+	return stream.gcount() == 8 && memcmp(magic, BUNDLE_MAGIC, 8) == 0;
+}
+
+bool ModelBundle::Map(const std::string& location)
+{
+	this->location = location;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(location.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Could not open the model bundle: " << location << std::endl;
+		return false;
+	}
+	file_handle = file;
+
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
+	size = (size_t)file_size.QuadPart;
+
+	// Copy on write mapping, pages are shared until (if ever) written to
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		std::cout << "Could not map the model bundle: " << location << std::endl;
+		return false;
+	}
+	mapping_handle = mapping;
+
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (data == NULL)
+	{
+		std::cout << "Could not map the model bundle: " << location << std::endl;
+		return false;
+	}
+#else
+	int file = open(location.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		std::cout << "Could not open the model bundle: " << location << std::endl;
+		return false;
+	}
+
+	struct stat file_stat;
+	if (fstat(file, &file_stat) != 0)
+	{
+		close(file);
+		return false;
+	}
+	size = (size_t)file_stat.st_size;
+
+	// Copy on write mapping, pages are shared until (if ever) written to
+	void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (mapped == MAP_FAILED)
+	{
+		std::cout << "Could not map the model bundle: " << location << std::endl;
+		return false;
+	}
+	data = (const char*)mapped;
+#endif
+
+	// Parse the header
+	if (size < BUNDLE_HEADER_SIZE || memcmp(data, BUNDLE_MAGIC, 8) != 0)
+	{
+		std::cout << "Not a model bundle: " << location << std::endl;
+		return false;
+	}
+
+	int version;
+	int num_entries;
+	long long index_offset;
+	memcpy(&version, data + 8, 4);
+	memcpy(&num_entries, data + 12, 4);
+	memcpy(&index_offset, data + 16, 8);
+
+	if (version != VERSION)
+	{
+		std::cout << "Unsupported model bundle version " << version << " in: " << location << ", expected " << VERSION << std::endl;
+		return false;
+	}
+
+	// The index follows the header and the matrix data
+	if (num_entries < 0 || index_offset < (long long)BUNDLE_HEADER_SIZE || index_offset > (long long)size)
+	{
+		std::cout << "Corrupt model bundle header: " << location << std::endl;
+		return false;
+	}
+
+	// Parse the index, all of the lengths are checked against the bytes left before they are used
+	const char* index_it = data + index_offset;
+	const char* index_end = data + size;
+
+	for (int i = 0; i < num_entries; ++i)
+	{
+		if (index_end - index_it < 4)
+		{
+			std::cout << "Corrupt model bundle index: " << location << std::endl;
+			return false;
+		}
+
+		int name_length;
+		memcpy(&name_length, index_it, 4);
+		index_it += 4;
+
+		if (name_length < 0 || index_end - index_it < (ptrdiff_t)name_length + 20)
+		{
+			std::cout << "Corrupt model bundle index: " << location << std::endl;
+			return false;
+		}
+
+		std::string name(index_it, name_length);
+		index_it += name_length;
+
+		Entry entry;
+		long long offset;
+		memcpy(&entry.rows, index_it, 4);
+		memcpy(&entry.cols, index_it + 4, 4);
+		memcpy(&entry.type, index_it + 8, 4);
+		memcpy(&offset, index_it + 12, 8);
+		index_it += 20;
+
+		if (entry.rows < 0 || entry.cols < 0 || entry.type != CV_MAT_TYPE(entry.type) || offset < 0 || offset > (long long)size)
+		{
+			std::cout << "Corrupt model bundle entry " << name << " in: " << location << std::endl;
+			return false;
+		}
+		entry.offset = (size_t)offset;
+
+		// Dividing rather than multiplying, so that huge dimensions cannot wrap around
+		size_t row_size = (size_t)entry.cols * CV_ELEM_SIZE(entry.type);
+		if (row_size != 0 && (size_t)entry.rows > (size - entry.offset) / row_size)
+		{
+			std::cout << "Corrupt model bundle entry " << name << " in: " << location << std::endl;
+			return false;
+		}
+
+		index[name] = entry;
+	}
+
+	return true;
+}
+
+ModelBundle::~ModelBundle()
+{
+#ifdef _WIN32
+	if (data != NULL)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mapping_handle != NULL)
+	{
+		CloseHandle((HANDLE)mapping_handle);
+	}
+	if (file_handle != NULL)
+	{
+		CloseHandle((HANDLE)file_handle);
+	}
+#else
+	if (data != nullptr)
+	{
+		munmap((void*)data, size);
+	}
+#endif
+}
+
+bool ModelBundle::Has(const std::string& name) const
+{
+	return index.find(name) != index.end();
+}
+
+bool ModelBundle::GetMat(const std::string& name, cv::Mat& output_mat) const
+{
+	auto entry = index.find(name);
+	if (entry == index.end())
+	{
+		output_mat = cv::Mat();
+		return false;
+	}
+
+	if (entry->second.rows == 0 || entry->second.cols == 0)
+	{
+		output_mat = cv::Mat();
+		return true;
+	}
+
+	// Point directly to the mapped data
+	output_mat = cv::Mat(entry->second.rows, entry->second.cols, entry->second.type, (void*)(data + entry->second.offset));
+	return true;
+}
+
+int ModelBundle::GetInt(const std::string& name, int default_value) const
+{
+	cv::Mat value;
+	if (!GetMat(name, value) || value.empty() || value.type() != CV_32SC1)
+	{
+		return default_value;
+	}
+	return value.at<int>(0);
+}
+
+double ModelBundle::GetDouble(const std::string& name, double default_value) const
+{
+	cv::Mat value;
+	if (!GetMat(name, value) || value.empty() || value.type() != CV_64FC1)
+	{
+		return default_value;
+	}
+	return value.at<double>(0);
+}
+
+std::vector<double> ModelBundle::GetDoubles(const std::string& name) const
+{
+	cv::Mat values;
+	if (!GetMat(name, values) || values.empty() || values.type() != CV_64FC1)
+	{
+		return std::vector<double>();
+	}
+	return std::vector<double>(values.ptr<double>(0), values.ptr<double>(0) + values.total());
+}
+
+std::string ModelBundle::GetString(const std::string& name) const
+{
+	cv::Mat value;
+	if (!GetMat(name, value) || value.empty() || value.type() != CV_8UC1)
+	{
+		return std::string();
+	}
+	return std::string((const char*)value.data, value.total());
+}
+
+std::vector<std::string> ModelBundle::GetStrings(const std::string& name) const
+{
+	// Strings are stored new line separated
+	std::vector<std::string> values;
+
+	std::stringstream stream(GetString(name));
+	std::string value;
+	while (std::getline(stream, value))
+	{
+		values.push_back(value);
+	}
+	return values;
+}
+
+//===========================================================================
+// Writing the bundle
+//===========================================================================
+
+void ModelBundleWriter::AddMat(const std::string& name, const cv::Mat& mat)
+{
+	// Make sure the data is continuous, so that it can be written out in one go
+	if (mat.isContinuous())
+	{
+		entries.push_back(std::pair<std::string, cv::Mat>(name, mat));
+	}
+	else
+	{
+		entries.push_back(std::pair<std::string, cv::Mat>(name, mat.clone()));
+	}
+}
+
+void ModelBundleWriter::AddInt(const std::string& name, int value)
+{
+	AddMat(name, cv::Mat_<int>(1, 1, value));
+}
+
+void ModelBundleWriter::AddDouble(const std::string& name, double value)
+{
+	AddMat(name, cv::Mat_<double>(1, 1, value));
+}
+
+void ModelBundleWriter::AddDoubles(const std::string& name, const std::vector<double>& values)
+{
+	AddMat(name, cv::Mat_<double>(values, true));
+}
+
+void ModelBundleWriter::AddString(const std::string& name, const std::string& value)
+{
+	cv::Mat_<uchar> value_mat(1, (int)value.size());
+	if (!value.empty())
+	{
+		memcpy(value_mat.data, value.data(), value.size());
+	}
+	AddMat(name, value_mat);
+}
+
+void ModelBundleWriter::AddStrings(const std::string& name, const std::vector<std::string>& values)
+{
+	// Strings are stored new line separated
+	std::string joined;
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		joined += values[i];
+		joined += '\n';
+	}
+	AddString(name, joined);
+}
+
+bool ModelBundleWriter::Write(const std::string& location) const
+{
+	std::ofstream stream(location, std::ios::out | std::ios::binary);
+	if (!stream.is_open())
+	{
+		std::cout << "Could not open the model bundle for writing: " << location << std::endl;
+		return false;
+	}
+
+	// Header is filled in at the end, once the index location is known
+	std::vector<char> padding(BUNDLE_ALIGNMENT, 0);
+	stream.write(padding.data(), BUNDLE_HEADER_SIZE);
+
+	// Write out the aligned matrix data
+	std::vector<long long> offsets(entries.size());
+	long long position = BUNDLE_HEADER_SIZE;
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		size_t pad = (BUNDLE_ALIGNMENT - position % BUNDLE_ALIGNMENT) % BUNDLE_ALIGNMENT;
+		stream.write(padding.data(), pad);
+		position += pad;
+
+		const cv::Mat& mat = entries[i].second;
+		size_t data_size = mat.total() * mat.elemSize();
+
+		offsets[i] = position;
+		stream.write((const char*)mat.data, data_size);
+		position += data_size;
+	}
+
+	// Write out the index
+	long long index_offset = position;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const std::string& name = entries[i].first;
+		const cv::Mat& mat = entries[i].second;
+
+		int name_length = (int)name.size();
+		int type = mat.type();
+		stream.write((const char*)&name_length, 4);
+		stream.write(name.data(), name_length);
+		stream.write((const char*)&mat.rows, 4);
+		stream.write((const char*)&mat.cols, 4);
+		stream.write((const char*)&type, 4);
+		stream.write((const char*)&offsets[i], 8);
+	}
+
+	// Fill in the header
+	int version = ModelBundle::VERSION;
+	int num_entries = (int)entries.size();
+	stream.seekp(0, std::ios::beg);
+	stream.write(BUNDLE_MAGIC, 8);
+	stream.write((const char*)&version, 4);
+	stream.write((const char*)&num_entries, 4);
+	stream.write((const char*)&index_offset, 8);
+
+	return stream.good();
+}
@@ -313,6 +313,41 @@ void PAW::Read(std::ifstream& stream)
 	source_landmarks = destination_landmarks;
 }
 
+void PAW::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	number_of_pixels = bundle.GetInt(prefix + "number_of_pixels");
+	min_x = (float)bundle.GetDouble(prefix + "min_x");
+	min_y = (float)bundle.GetDouble(prefix + "min_y");
+
+	bundle.GetMat(prefix + "destination_landmarks", destination_landmarks);
+	bundle.GetMat(prefix + "triangulation", triangulation);
+	bundle.GetMat(prefix + "triangle_id", triangle_id);
+	bundle.GetMat(prefix + "pixel_mask", pixel_mask);
+	bundle.GetMat(prefix + "alpha", alpha);
+	bundle.GetMat(prefix + "beta", beta);
+
+	map_x.create(pixel_mask.rows, pixel_mask.cols);
+	map_y.create(pixel_mask.rows, pixel_mask.cols);
+
+	coefficients.create(this->NumberOfTriangles(), 6);
+
+	source_landmarks = destination_landmarks;
+}
+
+void PAW::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	bundle.AddInt(prefix + "number_of_pixels", number_of_pixels);
+	bundle.AddDouble(prefix + "min_x", min_x);
+	bundle.AddDouble(prefix + "min_y", min_y);
+
+	bundle.AddMat(prefix + "destination_landmarks", destination_landmarks);
+	bundle.AddMat(prefix + "triangulation", triangulation);
+	bundle.AddMat(prefix + "triangle_id", triangle_id);
+	bundle.AddMat(prefix + "pixel_mask", pixel_mask);
+	bundle.AddMat(prefix + "alpha", alpha);
+	bundle.AddMat(prefix + "beta", beta);
+}
+
 //=============================================================================
 // cropping from the source image to the destination image using the shape in s, used to determine if shape fitting converged successfully
 void PAW::Warp(const cv::Mat& image_to_warp, cv::Mat& destination_image, const cv::Mat_<float>& landmarks_to_warp)
@@ -52,26 +52,171 @@
 #include <LandmarkDetectorUtils.h>
 
 using namespace LandmarkDetector;
+
 //===========================================================================
+// Versions of the shape and Jacobian computations for the PDM sizes of the shipped models, with the number of points and modes known at compile time
+// The loops have fixed trip counts (so the compiler can unroll and vectorise them) and the intermediate 3D shape is kept on the stack
+
+// Dot product with four independent partial sums, so that it is not serialised on a single accumulator
+template<int M>
+static inline float FixedDot(const float* a, const float* b)
+{
+	float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+	int j = 0;
+	for (; j + 4 <= M; j += 4)
+	{
+		sum0 += a[j] * b[j];
+		sum1 += a[j + 1] * b[j + 1];
+		sum2 += a[j + 2] * b[j + 2];
+		sum3 += a[j + 3] * b[j + 3];
+	}
+	for (; j < M; ++j)
+	{
+		sum0 += a[j] * b[j];
+	}
+	return (sum0 + sum1) + (sum2 + sum3);
+}
+
+template<int N, int M>
+struct FixedShapePDM
+{
+	// out_shape = mean_shape + princ_comp * p_local
+	static void CalcShape3D(const float* mean_shape, const float* princ_comp, const float* p_local, float* out_shape)
+	{
+		for (int i = 0; i < 3 * N; ++i)
+		{
+			out_shape[i] = mean_shape[i] + FixedDot<M>(princ_comp + i * M, p_local);
+		}
+	}
+
+	// Weak perspective projection of the 3D shape
+	static void CalcShape2D(const float* mean_shape, const float* princ_comp, const float* p_local, const cv::Matx33f& R, float s, float tx, float ty, float* out_shape)
+	{
+		float shape_3D[3 * N];
+		CalcShape3D(mean_shape, princ_comp, p_local, shape_3D);
+
+		for (int i = 0; i < N; ++i)
+		{
+			float X = shape_3D[i];
+			float Y = shape_3D[i + N];
+			float Z = shape_3D[i + 2 * N];
+			out_shape[i] = s * (R(0, 0) * X + R(0, 1) * Y + R(0, 2) * Z) + tx;
+			out_shape[i + N] = s * (R(1, 0) * X + R(1, 1) * Y + R(1, 2) * Z) + ty;
+		}
+	}
+
+	// The rigid (2N x 6) or full (2N x (6 + M)) Jacobian, see ComputeJacobian for the derivation
+	static void Jacobian(const float* mean_shape, const float* princ_comp, const float* p_local, const cv::Matx33f& R, float s, bool rigid, float* J)
+	{
+		float shape_3D[3 * N];
+		CalcShape3D(mean_shape, princ_comp, p_local, shape_3D);
+
+		const int cols = rigid ? 6 : 6 + M;
+
+		for (int i = 0; i < N; ++i)
+		{
+			float X = shape_3D[i];
+			float Y = shape_3D[i + N];
+			float Z = shape_3D[i + 2 * N];
+
+			float* Jx = J + i * cols;
+			float* Jy = J + (i + N) * cols;
+
+			// scaling term
+			Jx[0] = X * R(0, 0) + Y * R(0, 1) + Z * R(0, 2);
+			Jy[0] = X * R(1, 0) + Y * R(1, 1) + Z * R(1, 2);
+
+			// rotation terms
+			Jx[1] = s * (Y * R(0, 2) - Z * R(0, 1));
+			Jy[1] = s * (Y * R(1, 2) - Z * R(1, 1));
+			Jx[2] = -s * (X * R(0, 2) - Z * R(0, 0));
+			Jy[2] = -s * (X * R(1, 2) - Z * R(1, 0));
+			Jx[3] = s * (X * R(0, 1) - Y * R(0, 0));
+			Jy[3] = s * (X * R(1, 1) - Y * R(1, 0));
+
+			// translation terms
+			Jx[4] = 1.0f;
+			Jy[4] = 0.0f;
+			Jx[5] = 0.0f;
+			Jy[5] = 1.0f;
+
+			if (!rigid)
+			{
+				// How much the change of the non-rigid parameters (when object is rotated) affect 2D motion
+				const float* Vx = princ_comp + i * M;
+				const float* Vy = princ_comp + (i + N) * M;
+				const float* Vz = princ_comp + (i + 2 * N) * M;
+				for (int j = 0; j < M; ++j)
+				{
+					Jx[6 + j] = s * (R(0, 0) * Vx[j] + R(0, 1) * Vy[j] + R(0, 2) * Vz[j]);
+					Jy[6 + j] = s * (R(1, 0) * Vx[j] + R(1, 1) * Vy[j] + R(1, 2) * Vz[j]);
+				}
+			}
+		}
+	}
+};
+
+struct FixedShapeKernels
+{
+	int num_points;
+	int num_modes;
+	void(*calc_shape_3D)(const float* mean_shape, const float* princ_comp, const float* p_local, float* out_shape);
+	void(*calc_shape_2D)(const float* mean_shape, const float* princ_comp, const float* p_local, const cv::Matx33f& R, float s, float tx, float ty, float* out_shape);
+	void(*jacobian)(const float* mean_shape, const float* princ_comp, const float* p_local, const cv::Matx33f& R, float s, bool rigid, float* J);
+};
+
+template<int N, int M>
+static FixedShapeKernels MakeFixedShapeKernels()
+{
+	FixedShapeKernels kernels = { N, M, FixedShapePDM<N, M>::CalcShape3D, FixedShapePDM<N, M>::CalcShape2D, FixedShapePDM<N, M>::Jacobian };
+	return kernels;
+}
+
+// The kernels matching the PDM and local parameters, nullptr if there are none (any other size uses the dynamic path)
+static const FixedShapeKernels* GetFixedShapeKernels(const PDM& pdm, const cv::Mat_<float>& p_local)
+{
+	// The shipped PDMs: 68 points (In-the-wild, Menpo and Multi-PIE), the 51 point inner face and the 28 point eyes
+	static const FixedShapeKernels shipped[] = { MakeFixedShapeKernels<68, 34>(), MakeFixedShapeKernels<68, 30>(), MakeFixedShapeKernels<68, 23>(),
+		MakeFixedShapeKernels<51, 32>(), MakeFixedShapeKernels<28, 10>() };
+
+	int n = pdm.NumberOfPoints();
+	int m = pdm.NumberOfModes();
+
+	if (!pdm.mean_shape.isContinuous() || !pdm.princ_comp.isContinuous() || !p_local.isContinuous() || (int)p_local.total() != m)
+	{
+		return nullptr;
+	}
+
+	for (const FixedShapeKernels& kernels : shipped)
+	{
+		if (kernels.num_points == n && kernels.num_modes == m)
+		{
+			return &kernels;
+		}
+	}
+	return nullptr;
+}
+
 
 //=============================================================================
 // Orthonormalising the 3x3 rotation matrix
 void PDM::Orthonormalise(cv::Matx33f &R)
 {
 
-	cv::SVD svd(R, cv::SVD::MODIFY_A);
+	// Fixed size decomposition, so that no memory is allocated in the optimisation iterations
+	cv::Matx31f w;
+	cv::Matx33f u, vt;
+	cv::SVD::compute(R, w, u, vt);
   
 	// get the orthogonal matrix from the initial rotation matrix
-	cv::Mat_ <float> X = svd.u*svd.vt;
+	cv::Matx33f X = u*vt;
   
 	// This makes sure that the handedness is preserved and no reflection happened
 	// by making sure the determinant is 1 and not -1
-	cv::Mat_<float> W = cv::Mat_<float>::eye(3,3);
-	float d = determinant(X);
-	W(2,2) = determinant(X);
-	cv::Mat Rt = svd.u*W*svd.vt;
+	cv::Matx33f W = cv::Matx33f::eye();
+	W(2,2) = cv::determinant(X);
 
-	Rt.copyTo(R);
+	R = u*W*vt;
 
 }
 
@@ -86,7 +231,7 @@ PDM::PDM(const PDM& other) {
 
 //===========================================================================
 // Clamping the parameter values to be within 3 standard deviations
-void PDM::Clamp(cv::Mat_<float>& local_params, cv::Vec6f& params_global, const FaceModelParameters& parameters)
+void PDM::Clamp(cv::Mat_<float>& local_params, cv::Vec6f& params_global, const FaceModelParameters& parameters) const
 {
 	float n_sigmas = 3;
 	cv::MatConstIterator_<float> e_it  = this->eigen_values.begin();
@@ -138,7 +283,15 @@ void PDM::Clamp(cv::Mat_<float>& local_params, cv::Vec6f& params_global, const F
 // Compute the 3D representation of shape (in object space) using the local parameters
 void PDM::CalcShape3D(cv::Mat_<float>& out_shape, const cv::Mat_<float>& p_local) const
 {
-	out_shape = mean_shape.clone();
+	if (const FixedShapeKernels* kernels = GetFixedShapeKernels(*this, p_local))
+	{
+		out_shape.create(mean_shape.rows, 1);
+		kernels->calc_shape_3D(mean_shape.ptr<float>(), princ_comp.ptr<float>(), p_local.ptr<float>(), out_shape.ptr<float>());
+		return;
+	}
+
+	// Reuses the output memory if it has the right size
+	mean_shape.copyTo(out_shape);
 
 	// Perform matrix vector multiplication in OpenBLAS (fortran call)
 	float alpha1 = 1.0;
@@ -157,6 +310,12 @@ void PDM::CalcShape3D(cv::Mat_<float>& out_shape, const cv::Mat_<float>& p_local
 //===========================================================================
 // Get the 2D shape (in image space) from global and local parameters
 void PDM::CalcShape2D(cv::Mat_<float>& out_shape, const cv::Mat_<float>& params_local, const cv::Vec6f& params_global) const
+{
+	cv::Mat_<float> Shape_3D;
+	CalcShape2D(out_shape, params_local, params_global, Shape_3D);
+}
+
+void PDM::CalcShape2D(cv::Mat_<float>& out_shape, const cv::Mat_<float>& params_local, const cv::Vec6f& params_global, cv::Mat_<float>& Shape_3D) const
 {
 
 	int n = this->NumberOfPoints();
@@ -168,16 +327,22 @@ void PDM::CalcShape2D(cv::Mat_<float>& out_shape, const cv::Mat_<float>& params_
 	// get the rotation matrix from the euler angles
 	cv::Vec3f euler(params_global[1], params_global[2], params_global[3]);
 	cv::Matx33f currRot = Utilities::Euler2RotationMatrix(euler);
-	
-	// get the 3D shape of the object
-	cv::Mat_<float> Shape_3D;
-	this->CalcShape3D(Shape_3D, params_local);
 
 	// create the 2D shape matrix (if it has not been defined yet)
 	if((out_shape.rows != 2 * mean_shape.rows / 3) || (out_shape.cols != 1))
 	{
 		out_shape.create(2*n,1);
 	}
+
+	if (const FixedShapeKernels* kernels = GetFixedShapeKernels(*this, params_local))
+	{
+		kernels->calc_shape_2D(mean_shape.ptr<float>(), princ_comp.ptr<float>(), params_local.ptr<float>(), currRot, s, tx, ty, out_shape.ptr<float>());
+		return;
+	}
+	
+	// get the 3D shape of the object
+	this->CalcShape3D(Shape_3D, params_local);
+
 	// for every vertex
 	for(int i = 0; i < n; i++)
 	{
@@ -190,7 +355,7 @@ void PDM::CalcShape2D(cv::Mat_<float>& out_shape, const cv::Mat_<float>& params_
 //===========================================================================
 // provided the bounding box of a face and the local parameters (with optional rotation), generates the global parameters that can generate the face with the provided bounding box
 // This all assumes that the bounding box describes face from left outline to right outline of the face and chin to eyebrows
-void PDM::CalcParams(cv::Vec6f& out_params_global, const cv::Rect_<float>& bounding_box, const cv::Mat_<float>& params_local, const cv::Vec3f rotation)
+void PDM::CalcParams(cv::Vec6f& out_params_global, const cv::Rect_<float>& bounding_box, const cv::Mat_<float>& params_local, const cv::Vec3f rotation) const
 {
 
 	// get the shape instance based on local params
@@ -233,7 +398,7 @@ void PDM::CalcParams(cv::Vec6f& out_params_global, const cv::Rect_<float>& bound
 //===========================================================================
 // provided the model parameters, compute the bounding box of a face
 // The bounding box describes face from left outline to right outline of the face and chin to eyebrows
-void PDM::CalcBoundingBox(cv::Rect_<float>& out_bounding_box, const cv::Vec6f& params_global, const cv::Mat_<float>& params_local)
+void PDM::CalcBoundingBox(cv::Rect_<float>& out_bounding_box, const cv::Vec6f& params_global, const cv::Mat_<float>& params_local) const
 {
 	
 	// get the shape instance based on local params
@@ -252,7 +417,13 @@ void PDM::CalcBoundingBox(cv::Rect_<float>& out_bounding_box, const cv::Vec6f& p
 
 //===========================================================================
 // Calculate the PDM's Jacobian over rigid parameters (rotation, translation and scaling), the additional input W represents trust for each of the landmarks and is part of Non-Uniform RLMS 
-void PDM::ComputeRigidJacobian(const cv::Mat_<float>& p_local, const cv::Vec6f& params_global, cv::Mat_<float> &Jacob, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w)
+void PDM::ComputeRigidJacobian(const cv::Mat_<float>& p_local, const cv::Vec6f& params_global, cv::Mat_<float> &Jacob, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w) const
+{
+	cv::Mat_<float> shape_3D;
+	ComputeRigidJacobian(p_local, params_global, Jacob, W, Jacob_t_w, shape_3D);
+}
+
+void PDM::ComputeRigidJacobian(const cv::Mat_<float>& p_local, const cv::Vec6f& params_global, cv::Mat_<float> &Jacob, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w, cv::Mat_<float>& shape_3D) const
 {
   	
 	// number of verts
@@ -263,13 +434,19 @@ void PDM::ComputeRigidJacobian(const cv::Mat_<float>& p_local, const cv::Vec6f&
 	float X,Y,Z;
 
 	float s = params_global[0];
-  	
-	cv::Mat_<float> shape_3D;
-	this->CalcShape3D(shape_3D, p_local);
 		
 	 // Get the rotation matrix
 	cv::Vec3f euler(params_global[1], params_global[2], params_global[3]);
 	cv::Matx33f currRot = Utilities::Euler2RotationMatrix(euler);
+
+	if (const FixedShapeKernels* kernels = GetFixedShapeKernels(*this, p_local))
+	{
+		kernels->jacobian(mean_shape.ptr<float>(), princ_comp.ptr<float>(), p_local.ptr<float>(), currRot, s, true, Jacob.ptr<float>());
+		WeightedTranspose(Jacob, W, Jacob_t_w);
+		return;
+	}
+  	
+	this->CalcShape3D(shape_3D, p_local);
 	
 	float r11 = currRot(0,0);
 	float r12 = currRot(0,1);
@@ -317,33 +494,18 @@ void PDM::ComputeRigidJacobian(const cv::Mat_<float>& p_local, const cv::Vec6f&
 
 	}
 
-	cv::Mat Jacob_w = cv::Mat::zeros(Jacob.rows, Jacob.cols, Jacob.type());
-	
-	Jx =  Jacob.begin();
-	Jy =  Jx + n*6;
-
-	cv::MatIterator_<float> Jx_w =  Jacob_w.begin<float>();
-	cv::MatIterator_<float> Jy_w =  Jx_w + n*6;
-
-	// Iterate over all Jacobian values and multiply them by the weight in diagonal of W
-	for(int i = 0; i < n; i++)
-	{
-		float w_x = W.at<float>(i, i);
-		float w_y = W.at<float>(i+n, i+n);
-
-		for(int j = 0; j < Jacob.cols; ++j)
-		{
-			*Jx_w++ = *Jx++ * w_x;
-			*Jy_w++ = *Jy++ * w_y;
-		}		
-	}
-
-	Jacob_t_w = Jacob_w.t();
+	WeightedTranspose(Jacob, W, Jacob_t_w);
 }
 
 //===========================================================================
 // Calculate the PDM's Jacobian over all parameters (rigid and non-rigid), the additional input W represents trust for each of the landmarks and is part of Non-Uniform RLMS
-void PDM::ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f& params_global, cv::Mat_<float> &Jacobian, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w)
+void PDM::ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f& params_global, cv::Mat_<float> &Jacobian, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w) const
+{
+	cv::Mat_<float> shape_3D;
+	ComputeJacobian(params_local, params_global, Jacobian, W, Jacob_t_w, shape_3D);
+}
+
+void PDM::ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f& params_global, cv::Mat_<float> &Jacobian, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w, cv::Mat_<float>& shape_3D) const
 { 
 	
 	// number of vertices
@@ -357,12 +519,18 @@ void PDM::ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f&
 	float X,Y,Z;
 	
 	float s = params_global[0];
-  	
-	cv::Mat_<float> shape_3D;
-	this->CalcShape3D(shape_3D, params_local);
 	
 	cv::Vec3f euler(params_global[1], params_global[2], params_global[3]);
 	cv::Matx33f currRot = Utilities::Euler2RotationMatrix(euler);
+
+	if (const FixedShapeKernels* kernels = GetFixedShapeKernels(*this, params_local))
+	{
+		kernels->jacobian(mean_shape.ptr<float>(), princ_comp.ptr<float>(), params_local.ptr<float>(), currRot, s, false, Jacobian.ptr<float>());
+		WeightedTranspose(Jacobian, W, Jacob_t_w);
+		return;
+	}
+  	
+	this->CalcShape3D(shape_3D, params_local);
 	
 	float r11 = currRot(0, 0);
 	float r12 = currRot(0, 1);
@@ -419,39 +587,37 @@ void PDM::ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6f&
 		}
 	}	
 
-	// Adding the weights here	
-	if(cv::trace(W)[0] != W.rows) 
+	// Adding the weights here
+	WeightedTranspose(Jacobian, W, Jacob_t_w);
+}
+
+//===========================================================================
+// The transpose of the Jacobian with every landmark row multiplied by its weight in the diagonal of W, reusing the output memory
+void PDM::WeightedTranspose(const cv::Mat_<float>& Jacobian, const cv::Mat_<float>& W, cv::Mat_<float>& Jacob_t_w)
+{
+	int n = Jacobian.rows / 2;
+
+	Jacob_t_w.create(Jacobian.cols, Jacobian.rows);
+
+	for (int i = 0; i < n; i++)
 	{
-		cv::Mat Jacob_w = Jacobian.clone();
-		Jx =  Jacobian.begin();
-		Jy =  Jx + n*(6+m);
+		float w_x = W.at<float>(i, i);
+		float w_y = W.at<float>(i + n, i + n);
 
-		cv::MatIterator_<float> Jx_w =  Jacob_w.begin<float>();
-		cv::MatIterator_<float> Jy_w =  Jx_w + n*(6+m);
+		const float* Jx = Jacobian.ptr<float>(i);
+		const float* Jy = Jacobian.ptr<float>(i + n);
 
-		// Iterate over all Jacobian values and multiply them by the weight in diagonal of W
-		for(int i = 0; i < n; i++)
+		for (int j = 0; j < Jacobian.cols; ++j)
 		{
-			float w_x = W.at<float>(i, i);
-			float w_y = W.at<float>(i+n, i+n);
-
-			for(int j = 0; j < Jacobian.cols; ++j)
-			{
-				*Jx_w++ = *Jx++ * w_x;
-				*Jy_w++ = *Jy++ * w_y;
-			}
+			Jacob_t_w(j, i) = Jx[j] * w_x;
+			Jacob_t_w(j, i + n) = Jy[j] * w_y;
 		}
-		Jacob_t_w = Jacob_w.t();
-	}
-	else
-	{
-		Jacob_t_w = Jacobian.t();
 	}
 }
 
 //===========================================================================
 // Updating the parameters (more details in my thesis)
-void PDM::UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>& params_local, cv::Vec6f& params_global)
+void PDM::UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>& params_local, cv::Vec6f& params_global) const
 {
 
 	// The scaling and translation parameters can be just added
@@ -500,12 +666,12 @@ void PDM::UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>&
 	// Local parameter update, just simple addition
 	if(delta_p.rows > 6)
 	{
-		params_local = params_local + delta_p(cv::Rect(0,6,1, this->NumberOfModes()));
+		params_local += delta_p(cv::Rect(0,6,1, this->NumberOfModes()));
 	}
 
 }
 
-void PDM::CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_local, const cv::Mat_<float> & landmark_locations, const cv::Vec3f rotation)
+void PDM::CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_local, const cv::Mat_<float> & landmark_locations, const cv::Vec3f rotation) const
 {
 		
 	int m = this->NumberOfModes();
@@ -545,11 +711,11 @@ void PDM::CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_l
 		}
 	}
 
-	cv::Mat_<float> m_old = this->mean_shape.clone();
-	cv::Mat_<float> v_old = this->princ_comp.clone();
-
-	this->mean_shape = M;
-	this->princ_comp = V;
+	// Fit using a PDM restricted to the visible landmarks, so that the model itself is not modified (it can be shared across trackers)
+	PDM pdm_visible;
+	pdm_visible.mean_shape = M;
+	pdm_visible.princ_comp = V;
+	pdm_visible.eigen_values = this->eigen_values;
 
 	// The new number of points
 	n  = M.rows / 3;
@@ -574,7 +740,7 @@ void PDM::CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_l
 	float height = abs(min_y - max_y);
 
 	cv::Rect_<float> model_bbox;
-	CalcBoundingBox(model_bbox, cv::Vec6f(1.0, 0.0, 0.0, 0.0, 0.0, 0.0), cv::Mat_<float>(this->NumberOfModes(), 1, 0.0));
+	pdm_visible.CalcBoundingBox(model_bbox, cv::Vec6f(1.0, 0.0, 0.0, 0.0, 0.0, 0.0), cv::Mat_<float>(this->NumberOfModes(), 1, 0.0));
 
 	cv::Rect_<float> bbox(min_x, min_y, width, height);
 
@@ -633,7 +799,7 @@ void PDM::CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_l
 		cv::Mat(landmark_locs_vis - curr_shape_2D).convertTo(error_resid, CV_32F);
         
 		cv::Mat_<float> J, J_w_t;
-		this->ComputeJacobian(loc_params, glob_params, J, WeightMatrix, J_w_t);
+		pdm_visible.ComputeJacobian(loc_params, glob_params, J, WeightMatrix, J_w_t);
         
 		// projection of the meanshifts onto the jacobians (using the weighted Jacobian, see Baltrusaitis 2013)
 		cv::Mat_<float> J_w_t_m = J_w_t * error_resid;
@@ -697,9 +863,6 @@ void PDM::CalcParams(cv::Vec6f& out_params_global, cv::Mat_<float>& out_params_l
 
 	out_params_global = glob_params;
 	out_params_local = loc_params;
-    	
-	this->mean_shape = m_old;
-	this->princ_comp = v_old;
 
 
 }
@@ -736,3 +899,23 @@ bool PDM::Read(std::string location)
 
 	return true;
 }
+
+bool PDM::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	if (!bundle.GetMat(prefix + "mean_shape", mean_shape))
+	{
+		return false;
+	}
+
+	bundle.GetMat(prefix + "princ_comp", princ_comp);
+	bundle.GetMat(prefix + "eigen_values", eigen_values);
+
+	return true;
+}
+
+void PDM::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	bundle.AddMat(prefix + "mean_shape", mean_shape);
+	bundle.AddMat(prefix + "princ_comp", princ_comp);
+	bundle.AddMat(prefix + "eigen_values", eigen_values);
+}
@@ -47,6 +47,7 @@
 #endif
 
 #include "LandmarkDetectorUtils.h"
+#include "ThreadingPolicy.h"
 
 using namespace LandmarkDetector;
 
@@ -83,8 +84,6 @@ Patch_experts::Patch_experts(const Patch_experts& other) : patch_scaling(other.p
 			this->visibilities[i][j] = other.visibilities[i][j].clone();
 		}
 	}
-
-	preallocated_im2col.resize(other.preallocated_im2col.size());
 }
 
 // Returns indices to landmarks that need to have patch responses computed (omits mirrored frontal landmarks for CEN as they will be computed together with their mirrored pair)
@@ -132,13 +131,19 @@ std::vector<int> Patch_experts::Collect_visible_landmarks(std::vector<std::vecto
 // Also need to provide the size of the area of interest and the desired scale of analysis
 void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_responses, cv::Matx22f& sim_ref_to_img, 
 	cv::Matx22f& sim_img_to_ref, const cv::Mat_<float>& grayscale_image, const PDM& pdm, const cv::Vec6f& params_global,
-	const cv::Mat_<float>& params_local, int window_size, int scale)
+	const cv::Mat_<float>& params_local, int window_size, int scale, std::vector<std::map<int, cv::Mat_<float> > >& preallocated_im2col)
 {
 
 	int view_id = GetViewIdx(params_global, scale);
 
 	int n = pdm.NumberOfPoints();
 
+	// Make sure there is scratch memory for every landmark
+	if ((int)preallocated_im2col.size() < n)
+	{
+		preallocated_im2col.resize(n);
+	}
+
 	// Compute the current landmark locations (around which responses will be computed)
 	cv::Mat_<float> landmark_locations;
 
@@ -168,6 +173,8 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 	// If using CCNF patch experts might need to precalculate Sigmas
 	if (use_ccnf)
 	{
+		std::lock_guard<std::mutex> lock(sigma_mutex);
+
 		std::vector<cv::Mat_<float> > sigma_components;
 
 		// Retrieve the correct sigma component size
@@ -195,23 +202,18 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 
 	}
 
-	// If using CEN precalculate interpolation matrix
-	cv::Mat_<float> interp_mat;
+	// If using CEN grab the interpolation stencil (assuming the same size for all experts)
+	const CEN_interpolation_stencil* interp_stencil = nullptr;
 	if (use_cen)
 	{
-		// Assuming the same size for all experts
-		int support_region = 11;
-		int area_of_interest_width = window_size + support_region - 1;
-		int area_of_interest_height = window_size + support_region - 1;
-		int resp_size = area_of_interest_height - support_region + 1;
-		interpolationMatrix(interp_mat, resp_size, resp_size, area_of_interest_width, area_of_interest_height);
+		interp_stencil = &Get_CEN_interpolation_stencil(window_size);
 	}
 
 	// We do not want to create threads for invisible landmarks, so construct an index of visible ones
 	std::vector<int> vis_lmk = Collect_visible_landmarks(visibilities, scale, view_id, n);
 
 	// calculate the patch responses for every landmark (this is the heavy lifting of landmark detection)
-	parallel_for_(cv::Range(0, vis_lmk.size()), [&](const cv::Range& range) {
+	ParallelFor(cv::Range(0, vis_lmk.size()), [&](const cv::Range& range) {
 		for (int i = range.start; i < range.end; i++)
 		{
 
@@ -236,21 +238,16 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 				area_of_interest_height = window_size + svr_expert_intensity[scale][view_id][ind].height - 1;
 			}
 
-			// scale and rotate to mean shape to reference frame
-			cv::Mat sim = (cv::Mat_<float>(2, 3) << a1, -b1, landmark_locations.at<float>(ind, 0) - a1 * (area_of_interest_width - 1.0f) / 2.0f + b1 * (area_of_interest_width - 1.0f) / 2.0f, b1, a1, landmark_locations.at<float>(ind + n, 0) - a1 * (area_of_interest_width - 1.0f) / 2.0f - b1 * (area_of_interest_width - 1.0f) / 2.0f);
-
 			// Extract the region of interest around the current landmark location
-			cv::Mat_<float> area_of_interest(area_of_interest_height, area_of_interest_width, 0.0f);
-
-			cv::warpAffine(grayscale_image, area_of_interest, sim, area_of_interest.size(), cv::WARP_INVERSE_MAP + cv::INTER_LINEAR);
+			cv::Mat_<float> area_of_interest;
+			Extract_area_of_interest(grayscale_image, landmark_locations, ind, a1, b1, area_of_interest_width, area_of_interest_height, area_of_interest);
 
 			// Get intensity response either from the SVR, CCNF, or CEN patch experts (prefer CEN as they are the most accurate so far)
 			if (!cen_expert_intensity.empty())
 			{
 
-				int im2col_size = (area_of_interest_width * area_of_interest_height - 1) / 2;
-
-				cv::Mat_<float> prealloc_mat = preallocated_im2col[ind][im2col_size];
+				// The scratch memory of the tiled response is keyed by the window size
+				cv::Mat_<float> prealloc_mat = preallocated_im2col[ind][window_size];
 
 				// If frontal view we can do mirrored landmarks together
 				if (view_id == 0)
@@ -263,27 +260,15 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 						if (mirror_id == ind)
 						{
 							cv::Mat_<float> empty(0, 0, 0.0f);
-							cen_expert_intensity[scale][view_id][ind].ResponseSparse(area_of_interest, empty, patch_expert_responses[ind], empty, interp_mat, prealloc_mat, empty);
+							cen_expert_intensity[scale][view_id][ind].ResponseSparse(area_of_interest, empty, patch_expert_responses[ind], empty, *interp_stencil, prealloc_mat);
 						}
 						else
 						{
-
 							// Grab mirrored area of interest
+							cv::Mat_<float> area_of_interest_r;
+							Extract_area_of_interest(grayscale_image, landmark_locations, mirror_id, a1, b1, area_of_interest_width, area_of_interest_height, area_of_interest_r);
 
-							// scale and rotate to mean shape to reference frame
-							cv::Mat sim_r = (cv::Mat_<float>(2, 3) << a1, -b1, landmark_locations.at<float>(mirror_id, 0) - a1 * (area_of_interest_width - 1.0f) / 2.0f + b1 * (area_of_interest_width - 1.0f) / 2.0f, b1, a1, landmark_locations.at<float>(mirror_id + n, 0) - a1 * (area_of_interest_width - 1.0f) / 2.0f - b1 * (area_of_interest_width - 1.0f) / 2.0f);
-
-							// Extract the region of interest around the current landmark location
-							cv::Mat_<float> area_of_interest_r(area_of_interest_height, area_of_interest_width, 0.0f);
-
-							cv::warpAffine(grayscale_image, area_of_interest_r, sim_r, area_of_interest_r.size(), cv::WARP_INVERSE_MAP + cv::INTER_LINEAR);
-
-							cv::Mat_<float> prealloc_mat_right = preallocated_im2col[mirror_id][im2col_size];
-
-							cen_expert_intensity[scale][view_id][ind].ResponseSparse(area_of_interest, area_of_interest_r, patch_expert_responses[ind], patch_expert_responses[mirror_id], interp_mat, prealloc_mat, prealloc_mat_right);
-
-							preallocated_im2col[mirror_id][im2col_size] = prealloc_mat_right;
-
+							cen_expert_intensity[scale][view_id][ind].ResponseSparse(area_of_interest, area_of_interest_r, patch_expert_responses[ind], patch_expert_responses[mirror_id], *interp_stencil, prealloc_mat);
 						}
 					}
 				}
@@ -293,7 +278,7 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 					if (!cen_expert_intensity[scale][view_id][ind].biases.empty())
 					{
 						cv::Mat_<float> empty(0, 0, 0.0f);
-						cen_expert_intensity[scale][view_id][ind].ResponseSparse(area_of_interest, empty, patch_expert_responses[ind], empty, interp_mat, prealloc_mat, empty);
+						cen_expert_intensity[scale][view_id][ind].ResponseSparse(area_of_interest, empty, patch_expert_responses[ind], empty, *interp_stencil, prealloc_mat);
 
 						// A slower, but slightly more accurate version
 						//cen_expert_intensity[scale][view_id][ind].Response(area_of_interest, patch_expert_responses[ind]);
@@ -301,17 +286,17 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 					else
 					{
 						cv::Mat_<float> empty(0, 0, 0.0f);
-						cen_expert_intensity[scale][mirror_views.at<int>(view_id)][mirror_inds.at<int>(ind)].ResponseSparse(empty, area_of_interest, empty, patch_expert_responses[ind], interp_mat, empty, prealloc_mat);
+						cen_expert_intensity[scale][mirror_views.at<int>(view_id)][mirror_inds.at<int>(ind)].ResponseSparse(empty, area_of_interest, empty, patch_expert_responses[ind], *interp_stencil, prealloc_mat);
 					}
 				}
 
-				preallocated_im2col[ind][im2col_size] = prealloc_mat;
+				preallocated_im2col[ind][window_size] = prealloc_mat;
 
 			}
 			else if (!ccnf_expert_intensity.empty())
 			{
-				// get the correct size response window			
-				patch_expert_responses[ind] = cv::Mat_<float>(window_size, window_size);
+				// get the correct size response window (reusing its memory from the previous call)
+				patch_expert_responses[ind].create(window_size, window_size);
 
 				int im2col_size = area_of_interest_width * area_of_interest_height;
 
@@ -327,8 +312,8 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 			}
 			else
 			{
-				// get the correct size response window			
-				patch_expert_responses[ind] = cv::Mat_<float>(window_size, window_size);
+				// get the correct size response window (reusing its memory from the previous call)
+				patch_expert_responses[ind].create(window_size, window_size);
 
 				svr_expert_intensity[scale][view_id][ind].Response(area_of_interest, patch_expert_responses[ind]);
 			}
@@ -337,6 +322,36 @@ void Patch_experts::Response(std::vector<cv::Mat_<float> >& patch_expert_respons
 }
 
 
+// Extract the area of interest around a landmark, in the reference frame given by the similarity transform
+void Patch_experts::Extract_area_of_interest(const cv::Mat_<float>& grayscale_image, const cv::Mat_<float>& landmark_locations, int ind, float a1, float b1, 
+	int area_of_interest_width, int area_of_interest_height, cv::Mat_<float>& area_of_interest) const
+{
+	int n = landmark_locations.rows / 2;
+
+	// scale and rotate to mean shape to reference frame
+	cv::Mat sim = (cv::Mat_<float>(2, 3) << a1, -b1, landmark_locations.at<float>(ind, 0) - a1 * (area_of_interest_width - 1.0f) / 2.0f + b1 * (area_of_interest_width - 1.0f) / 2.0f, b1, a1, landmark_locations.at<float>(ind + n, 0) - a1 * (area_of_interest_width - 1.0f) / 2.0f - b1 * (area_of_interest_width - 1.0f) / 2.0f);
+
+	// Extract the region of interest around the current landmark location
+	area_of_interest.create(area_of_interest_height, area_of_interest_width);
+	area_of_interest.setTo(0.0f);
+
+	cv::warpAffine(grayscale_image, area_of_interest, sim, area_of_interest.size(), cv::WARP_INVERSE_MAP + cv::INTER_LINEAR);
+}
+
+// The CEN interpolation stencil for a particular response size, computed once and then reused
+const CEN_interpolation_stencil& Patch_experts::Get_CEN_interpolation_stencil(int response_size)
+{
+	std::lock_guard<std::mutex> lock(stencil_mutex);
+
+	std::map<int, CEN_interpolation_stencil>::iterator stencil = cen_interpolation_stencils.find(response_size);
+	if (stencil == cen_interpolation_stencils.end())
+	{
+		stencil = cen_interpolation_stencils.emplace(response_size, CEN_interpolation_stencil()).first;
+		interpolationStencil(stencil->second, response_size, response_size);
+	}
+	return stencil->second;
+}
+
 //=============================================================================
 // Getting the closest view center based on orientation
 int Patch_experts::GetViewIdx(const cv::Vec6f& params_global, int scale) const
@@ -411,10 +426,6 @@ bool Patch_experts::Read(std::vector<std::string> intensity_svr_expert_locations
 			return false;
 		}
 
-		if (scale == 0)
-		{
-			preallocated_im2col.resize(ccnf_expert_intensity[0][0].size());
-		}
 	}
 
 	// Initialise and read CEN patch experts (currently only intensity based), 
@@ -439,11 +450,6 @@ bool Patch_experts::Read(std::vector<std::string> intensity_svr_expert_locations
 			return false;
 		}
 
-		if (scale == 0)
-		{
-			preallocated_im2col.resize(cen_expert_intensity[0][0].size());
-		}
-
 	}
 
 
@@ -481,6 +487,201 @@ bool Patch_experts::Read(std::vector<std::string> intensity_svr_expert_locations
 	}
 	return true;
 }
+//======================= Reading and writing model bundles =========================================//
+bool Patch_experts::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	patch_scaling = bundle.GetDoubles(prefix + "patch_scaling");
+
+	int num_scales = (int)patch_scaling.size();
+
+	if (num_scales == 0)
+	{
+		std::cout << "Could not find patch experts in the model bundle " << bundle.Location() << std::endl;
+		return false;
+	}
+
+	centers.resize(num_scales);
+	visibilities.resize(num_scales);
+
+	for (int scale = 0; scale < num_scales; ++scale)
+	{
+		std::string scale_prefix = prefix + std::to_string(scale) + "/";
+
+		// The centers of each view are stored as rows (in radians)
+		cv::Mat_<double> scale_centers;
+		bundle.GetMat(scale_prefix + "centers", scale_centers);
+
+		centers[scale].resize(scale_centers.rows);
+		visibilities[scale].resize(scale_centers.rows);
+		for (int view = 0; view < scale_centers.rows; ++view)
+		{
+			centers[scale][view] = cv::Vec3d(scale_centers(view, 0), scale_centers(view, 1), scale_centers(view, 2));
+			bundle.GetMat(scale_prefix + "visibility_" + std::to_string(view), visibilities[scale][view]);
+		}
+	}
+
+	// Reading in the experts themselves, laid out type/scale/view/landmark
+	int num_svr = bundle.GetInt(prefix + "svr/num_scales");
+	svr_expert_intensity.resize(num_svr);
+	for (int scale = 0; scale < num_svr; ++scale)
+	{
+		svr_expert_intensity[scale].resize(centers[scale].size());
+		for (size_t view = 0; view < centers[scale].size(); ++view)
+		{
+			int n = visibilities[scale][view].rows;
+			svr_expert_intensity[scale][view].resize(n);
+			for (int lmark = 0; lmark < n; ++lmark)
+			{
+				svr_expert_intensity[scale][view][lmark].Read(bundle, prefix + "svr/" + std::to_string(scale) + "/" + std::to_string(view) + "/" + std::to_string(lmark) + "/");
+			}
+		}
+	}
+
+	int num_ccnf = bundle.GetInt(prefix + "ccnf/num_scales");
+	ccnf_expert_intensity.resize(num_ccnf);
+	for (int scale = 0; scale < num_ccnf; ++scale)
+	{
+		ccnf_expert_intensity[scale].resize(centers[scale].size());
+		for (size_t view = 0; view < centers[scale].size(); ++view)
+		{
+			int n = visibilities[scale][view].rows;
+			ccnf_expert_intensity[scale][view].resize(n);
+			for (int lmark = 0; lmark < n; ++lmark)
+			{
+				ccnf_expert_intensity[scale][view][lmark].Read(bundle, prefix + "ccnf/" + std::to_string(scale) + "/" + std::to_string(view) + "/" + std::to_string(lmark) + "/");
+			}
+		}
+	}
+
+	// The node connectivity of CCNF experts, for each window size
+	int num_win_sizes = bundle.GetInt(prefix + "sigma_components/num_windows");
+	sigma_components.resize(num_win_sizes);
+	for (int w = 0; w < num_win_sizes; ++w)
+	{
+		std::string window_prefix = prefix + "sigma_components/" + std::to_string(w) + "/";
+		int num_sigma_comp = bundle.GetInt(window_prefix + "num_components");
+		sigma_components[w].resize(num_sigma_comp);
+		for (int s = 0; s < num_sigma_comp; ++s)
+		{
+			bundle.GetMat(window_prefix + std::to_string(s), sigma_components[w][s]);
+		}
+	}
+
+	int num_cen = bundle.GetInt(prefix + "cen/num_scales");
+	cen_expert_intensity.resize(num_cen);
+	for (int scale = 0; scale < num_cen; ++scale)
+	{
+		cen_expert_intensity[scale].resize(centers[scale].size());
+		for (size_t view = 0; view < centers[scale].size(); ++view)
+		{
+			int n = visibilities[scale][view].rows;
+			cen_expert_intensity[scale][view].resize(n);
+			for (int lmark = 0; lmark < n; ++lmark)
+			{
+				cen_expert_intensity[scale][view][lmark].Read(bundle, prefix + "cen/" + std::to_string(scale) + "/" + std::to_string(view) + "/" + std::to_string(lmark) + "/");
+			}
+		}
+	}
+
+	bundle.GetMat(prefix + "mirror_inds", mirror_inds);
+	bundle.GetMat(prefix + "mirror_views", mirror_views);
+
+	early_term_weights = bundle.GetDoubles(prefix + "early_term_weights");
+	early_term_biases = bundle.GetDoubles(prefix + "early_term_biases");
+	early_term_cutoffs = bundle.GetDoubles(prefix + "early_term_cutoffs");
+
+	return true;
+}
+
+void Patch_experts::Quantise_CEN()
+{
+	for (size_t scale = 0; scale < cen_expert_intensity.size(); ++scale)
+	{
+		for (size_t view = 0; view < cen_expert_intensity[scale].size(); ++view)
+		{
+			for (size_t lmk = 0; lmk < cen_expert_intensity[scale][view].size(); ++lmk)
+			{
+				cen_expert_intensity[scale][view][lmk].Quantise();
+			}
+		}
+	}
+}
+
+void Patch_experts::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	bundle.AddDoubles(prefix + "patch_scaling", patch_scaling);
+
+	for (size_t scale = 0; scale < centers.size(); ++scale)
+	{
+		std::string scale_prefix = prefix + std::to_string(scale) + "/";
+
+		cv::Mat_<double> scale_centers((int)centers[scale].size(), 3);
+		for (size_t view = 0; view < centers[scale].size(); ++view)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				scale_centers((int)view, i) = centers[scale][view][i];
+			}
+			bundle.AddMat(scale_prefix + "visibility_" + std::to_string(view), visibilities[scale][view]);
+		}
+		bundle.AddMat(scale_prefix + "centers", scale_centers);
+	}
+
+	bundle.AddInt(prefix + "svr/num_scales", (int)svr_expert_intensity.size());
+	for (size_t scale = 0; scale < svr_expert_intensity.size(); ++scale)
+	{
+		for (size_t view = 0; view < svr_expert_intensity[scale].size(); ++view)
+		{
+			for (size_t lmark = 0; lmark < svr_expert_intensity[scale][view].size(); ++lmark)
+			{
+				svr_expert_intensity[scale][view][lmark].Write(bundle, prefix + "svr/" + std::to_string(scale) + "/" + std::to_string(view) + "/" + std::to_string(lmark) + "/");
+			}
+		}
+	}
+
+	bundle.AddInt(prefix + "ccnf/num_scales", (int)ccnf_expert_intensity.size());
+	for (size_t scale = 0; scale < ccnf_expert_intensity.size(); ++scale)
+	{
+		for (size_t view = 0; view < ccnf_expert_intensity[scale].size(); ++view)
+		{
+			for (size_t lmark = 0; lmark < ccnf_expert_intensity[scale][view].size(); ++lmark)
+			{
+				ccnf_expert_intensity[scale][view][lmark].Write(bundle, prefix + "ccnf/" + std::to_string(scale) + "/" + std::to_string(view) + "/" + std::to_string(lmark) + "/");
+			}
+		}
+	}
+
+	bundle.AddInt(prefix + "sigma_components/num_windows", (int)sigma_components.size());
+	for (size_t w = 0; w < sigma_components.size(); ++w)
+	{
+		std::string window_prefix = prefix + "sigma_components/" + std::to_string(w) + "/";
+		bundle.AddInt(window_prefix + "num_components", (int)sigma_components[w].size());
+		for (size_t s = 0; s < sigma_components[w].size(); ++s)
+		{
+			bundle.AddMat(window_prefix + std::to_string(s), sigma_components[w][s]);
+		}
+	}
+
+	bundle.AddInt(prefix + "cen/num_scales", (int)cen_expert_intensity.size());
+	for (size_t scale = 0; scale < cen_expert_intensity.size(); ++scale)
+	{
+		for (size_t view = 0; view < cen_expert_intensity[scale].size(); ++view)
+		{
+			for (size_t lmark = 0; lmark < cen_expert_intensity[scale][view].size(); ++lmark)
+			{
+				cen_expert_intensity[scale][view][lmark].Write(bundle, prefix + "cen/" + std::to_string(scale) + "/" + std::to_string(view) + "/" + std::to_string(lmark) + "/");
+			}
+		}
+	}
+
+	bundle.AddMat(prefix + "mirror_inds", mirror_inds);
+	bundle.AddMat(prefix + "mirror_views", mirror_views);
+
+	bundle.AddDoubles(prefix + "early_term_weights", early_term_weights);
+	bundle.AddDoubles(prefix + "early_term_biases", early_term_biases);
+	bundle.AddDoubles(prefix + "early_term_cutoffs", early_term_cutoffs);
+}
+
 //======================= Reading the SVR patch experts =========================================//
 bool Patch_experts::Read_SVR_patch_experts(std::string expert_location, std::vector<cv::Vec3d>& centers,
 	std::vector<cv::Mat_<int> >& visibility, std::vector<std::vector<Multi_SVR_patch_expert> >& patches, double& scale)
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "PoseMotionModel.h"
+
+using namespace LandmarkDetector;
+
+// How much a prediction error changes the velocity estimate
+static const float velocity_gain = 0.5f;
+
+// How quickly the prediction error estimate follows the recent errors
+static const float error_rate = 0.3f;
+
+PoseMotionModel::PoseMotionModel()
+{
+	Reset();
+}
+
+void PoseMotionModel::Reset()
+{
+	state = cv::Vec6f(0, 0, 0, 0, 0, 0);
+	velocity = cv::Vec6f(0, 0, 0, 0, 0, 0);
+	error_variance = cv::Vec6f(0, 0, 0, 0, 0, 0);
+	updates = 0;
+}
+
+void PoseMotionModel::Update(const cv::Vec6f& params_global)
+{
+	if (updates == 0)
+	{
+		state = params_global;
+	}
+	else if (updates == 1)
+	{
+		velocity = params_global - state;
+		state = params_global;
+	}
+	else
+	{
+		cv::Vec6f innovation = params_global - Predict();
+
+		for (int i = 0; i < 6; ++i)
+		{
+			float squared_error = innovation[i] * innovation[i];
+
+			// The first error is taken as is, after that a running mean
+			error_variance[i] = updates == 2 ? squared_error : (1 - error_rate) * error_variance[i] + error_rate * squared_error;
+		}
+
+		// The fitted parameters are accurate enough to be taken directly, only the velocity is filtered
+		velocity = velocity + velocity_gain * innovation;
+		state = params_global;
+	}
+	updates++;
+}
+
+cv::Vec6f PoseMotionModel::Predict() const
+{
+	return state + velocity;
+}
+
+float PoseMotionModel::PredictionUncertainty(float face_radius) const
+{
+	// Translation errors move all of the landmarks directly
+	float translation_error = sqrt(error_variance[4] + error_variance[5]);
+
+	// Rotation and scale errors move the landmarks in proportion to their distance from the centre of the face
+	float rotation_error = face_radius * sqrt(error_variance[1] + error_variance[2] + error_variance[3]);
+	float scale_error = state[0] > 0 ? face_radius * sqrt(error_variance[0]) / state[0] : 0;
+
+	return translation_error + rotation_error + scale_error;
+}
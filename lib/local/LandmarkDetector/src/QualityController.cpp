@@ -0,0 +1,299 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "QualityController.h"
+
+// System includes
+#include <algorithm>
+#include <sstream>
+
+using namespace LandmarkDetector;
+
+// How many recent frames the latency percentile is measured over, and how many are needed before changing the quality
+static const size_t latency_history = 30;
+static const size_t min_latency_frames = 10;
+
+// The quality is only stepped back up if the latencies stay below this fraction of the target for a whole history
+static const double headroom_fraction = 0.7;
+
+// How quickly the mean stage latencies follow the recent ones
+static const double stage_latency_rate = 0.1;
+
+QualityController::QualityController(double target_latency, double percentile) : base_params(FaceModelParameters::CECLM_DETECTOR)
+{
+	Init(target_latency, percentile);
+}
+
+QualityController::QualityController(std::vector<std::string>& arguments) : base_params(FaceModelParameters::CECLM_DETECTOR)
+{
+	double target_latency = -1;
+	double percentile = 0.9;
+
+	bool* valid = new bool[arguments.size()];
+
+	for (size_t i = 0; i < arguments.size(); ++i)
+	{
+		valid[i] = true;
+
+		if (arguments[i].compare("-deadline") == 0 && i + 1 < arguments.size())
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> target_latency;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-deadline_percentile") == 0 && i + 1 < arguments.size())
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> percentile;
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+	}
+
+	for (int i = (int)arguments.size() - 1; i >= 0; --i)
+	{
+		if (!valid[i])
+		{
+			arguments.erase(arguments.begin() + i);
+		}
+	}
+
+	delete[] valid;
+
+	Init(target_latency, percentile);
+}
+
+void QualityController::Init(double target_latency, double percentile)
+{
+	this->target_latency = target_latency;
+	this->percentile = std::min(1.0, std::max(0.0, percentile));
+
+	quality_level = FULL_QUALITY;
+	base_set = false;
+	applied_face_detector = base_params.curr_face_detector;
+
+	frame_start = 0;
+	stage_start = 0;
+}
+
+void QualityController::BeginFrame(FaceModelParameters& params)
+{
+	if (!Enabled())
+	{
+		return;
+	}
+
+	if (!base_set)
+	{
+		base_params = params;
+		base_set = true;
+	}
+	else if (params.curr_face_detector != applied_face_detector)
+	{
+		// The face detector fell back to another one, which becomes the full quality one
+		base_params.curr_face_detector = params.curr_face_detector;
+	}
+
+	ApplyLevel(params);
+	applied_face_detector = params.curr_face_detector;
+
+	frame_start = cv::getTickCount();
+	stage_start = frame_start;
+}
+
+void QualityController::StageDone(const std::string& stage)
+{
+	if (!Enabled())
+	{
+		return;
+	}
+
+	int64 now = cv::getTickCount();
+	double latency = 1000.0 * (now - stage_start) / cv::getTickFrequency();
+	stage_start = now;
+
+	auto stage_latency = stage_latencies.find(stage);
+	if (stage_latency == stage_latencies.end())
+	{
+		stage_latencies[stage] = latency;
+	}
+	else
+	{
+		stage_latency->second = (1 - stage_latency_rate) * stage_latency->second + stage_latency_rate * latency;
+	}
+}
+
+void QualityController::EndFrame()
+{
+	if (!Enabled())
+	{
+		return;
+	}
+
+	double latency = 1000.0 * (cv::getTickCount() - frame_start) / cv::getTickFrequency();
+
+	frame_latencies.push_back(latency);
+	if (frame_latencies.size() > latency_history)
+	{
+		frame_latencies.pop_front();
+	}
+
+	if (frame_latencies.size() < min_latency_frames)
+	{
+		return;
+	}
+
+	double latency_percentile = GetLatencyPercentile();
+
+	// Stepping down as soon as the deadline is missed too often, but only back up after a whole history of headroom
+	// The latencies are measured anew after every change, so that each decision is based on the current level
+	if (latency_percentile > target_latency && quality_level < NO_VALIDATION)
+	{
+		quality_level = (QualityLevel)(quality_level + 1);
+		frame_latencies.clear();
+	}
+	else if (latency_percentile < headroom_fraction * target_latency && quality_level > FULL_QUALITY && frame_latencies.size() == latency_history)
+	{
+		quality_level = (QualityLevel)(quality_level - 1);
+		frame_latencies.clear();
+	}
+}
+
+double QualityController::GetLatencyPercentile() const
+{
+	if (frame_latencies.empty())
+	{
+		return 0;
+	}
+
+	std::vector<double> latencies(frame_latencies.begin(), frame_latencies.end());
+	size_t index = std::min(latencies.size() - 1, (size_t)(percentile * latencies.size()));
+	std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+
+	return latencies[index];
+}
+
+std::string QualityController::GetQualityDescription() const
+{
+	if (quality_level == FULL_QUALITY)
+	{
+		return "full quality";
+	}
+
+	std::string description;
+	if (quality_level >= FAST_FACE_DETECTOR)
+		description += "fast face detector";
+	if (quality_level >= NO_HIERARCHICAL_REFINEMENT)
+		description += ", no hierarchical refinement";
+	if (quality_level >= FEWER_ITERATIONS)
+		description += ", fewer iterations";
+	if (quality_level >= SMALLER_WINDOWS)
+		description += ", smaller windows";
+	if (quality_level >= NO_VALIDATION)
+		description += ", no validation";
+
+	return description;
+}
+
+void QualityController::ApplyLevel(FaceModelParameters& params) const
+{
+	// Start from full quality and add the levers of every level up to the current one
+	params.curr_face_detector = base_params.curr_face_detector;
+	params.refine_hierarchical = base_params.refine_hierarchical;
+	params.num_optimisation_iteration = base_params.num_optimisation_iteration;
+	params.window_sizes_init = base_params.window_sizes_init;
+	params.window_sizes_small = base_params.window_sizes_small;
+	params.validate_detections = base_params.validate_detections;
+
+	// HOG SVM is quicker than MTCNN for reinitialisation (it does not need a model to be read)
+	if (quality_level >= FAST_FACE_DETECTOR && params.curr_face_detector == FaceModelParameters::MTCNN_DETECTOR)
+	{
+		params.curr_face_detector = FaceModelParameters::HOG_SVM_DETECTOR;
+	}
+
+	if (quality_level >= NO_HIERARCHICAL_REFINEMENT)
+	{
+		params.refine_hierarchical = false;
+	}
+
+	if (quality_level >= FEWER_ITERATIONS)
+	{
+		params.num_optimisation_iteration = std::max(2, base_params.num_optimisation_iteration / 2);
+	}
+
+	if (quality_level >= SMALLER_WINDOWS)
+	{
+		// Only the window sizes the parameters already use are known to be supported by the patch experts
+		std::vector<int> window_sizes(base_params.window_sizes_init);
+		window_sizes.insert(window_sizes.end(), base_params.window_sizes_small.begin(), base_params.window_sizes_small.end());
+
+		// The next smaller initialisation windows
+		for (size_t scale = 0; scale < params.window_sizes_init.size(); ++scale)
+		{
+			int smaller_size = 0;
+			for (int window_size : window_sizes)
+			{
+				if (window_size < params.window_sizes_init[scale] && window_size > smaller_size)
+				{
+					smaller_size = window_size;
+				}
+			}
+			if (smaller_size > 0)
+			{
+				params.window_sizes_init[scale] = smaller_size;
+			}
+		}
+
+		// Tracking at one scale fewer (the coarsest one)
+		int tracking_scales = (int)std::count_if(params.window_sizes_small.begin(), params.window_sizes_small.end(), [](int window_size) { return window_size > 0; });
+		for (size_t scale = 0; scale < params.window_sizes_small.size() && tracking_scales > 1; ++scale)
+		{
+			if (params.window_sizes_small[scale] > 0)
+			{
+				params.window_sizes_small[scale] = 0;
+				break;
+			}
+		}
+	}
+
+	if (quality_level >= NO_VALIDATION)
+	{
+		params.validate_detections = false;
+	}
+}
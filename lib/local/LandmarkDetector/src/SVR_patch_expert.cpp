@@ -130,6 +130,29 @@ void SVR_patch_expert::Read(std::ifstream &stream)
 
 }
 
+//===========================================================================
+void SVR_patch_expert::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	// The scalar parameters are stored together as type, confidence, scaling, bias
+	cv::Mat_<double> params;
+	bundle.GetMat(prefix + "params", params);
+
+	type = (int)params(0);
+	confidence = params(1);
+	scaling = params(2);
+	bias = params(3);
+
+	// The weights are stored already transposed
+	bundle.GetMat(prefix + "weights", weights);
+}
+
+void SVR_patch_expert::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	cv::Mat_<double> params = (cv::Mat_<double>(1, 4) << type, confidence, scaling, bias);
+	bundle.AddMat(prefix + "params", params);
+	bundle.AddMat(prefix + "weights", weights);
+}
+
 //===========================================================================
 void SVR_patch_expert::Response(const cv::Mat_<float>& area_of_interest, cv::Mat_<float>& response)
 {
@@ -286,6 +309,31 @@ void Multi_SVR_patch_expert::Read(std::ifstream &stream)
 		svr_patch_experts[i].Read(stream);
 
 }
+
+//===========================================================================
+void Multi_SVR_patch_expert::Read(const ModelBundle& bundle, const std::string& prefix)
+{
+	// Stored as width, height, number of modalities
+	cv::Mat_<int> size;
+	bundle.GetMat(prefix + "size", size);
+
+	width = size(0);
+	height = size(1);
+	int number_modalities = size(2);
+
+	svr_patch_experts.resize(number_modalities);
+	for (int i = 0; i < number_modalities; i++)
+		svr_patch_experts[i].Read(bundle, prefix + std::to_string(i) + "/");
+}
+
+void Multi_SVR_patch_expert::Write(ModelBundleWriter& bundle, const std::string& prefix) const
+{
+	cv::Mat_<int> size = (cv::Mat_<int>(1, 3) << width, height, (int)svr_patch_experts.size());
+	bundle.AddMat(prefix + "size", size);
+
+	for (size_t i = 0; i < svr_patch_experts.size(); i++)
+		svr_patch_experts[i].Write(bundle, prefix + std::to_string(i) + "/");
+}
 //===========================================================================
 void Multi_SVR_patch_expert::Response(const cv::Mat_<float> &area_of_interest, cv::Mat_<float> &response)
 {
@@ -0,0 +1,338 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "SimdDispatch.h"
+
+// System includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+using namespace LandmarkDetector;
+
+//===========================================================================
+// Scalar versions of the kernels, used when no SIMD instruction set is available
+
+static void contrast_normalize_scalar(float* data, int length)
+{
+	float sum = 0;
+	for (int i = 0; i < length; ++i)
+	{
+		sum += data[i];
+	}
+	float mean = sum / (float)length;
+
+	float sum_sq = 0;
+	for (int i = 0; i < length; ++i)
+	{
+		float in = data[i] - mean;
+		data[i] = in;
+		sum_sq += in * in;
+	}
+
+	float norm = std::sqrt(sum_sq);
+
+	// Avoiding division by 0
+	if (norm == 0)
+	{
+		norm = 1;
+	}
+
+	norm = 1.0f / norm;
+	for (int i = 0; i < length; ++i)
+	{
+		data[i] *= norm;
+	}
+}
+
+static void relu_scalar(float* data, size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		data[i] = std::max(data[i], 0.0f);
+	}
+}
+
+static void prelu_scalar(float* data, size_t length, float slope)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		data[i] = data[i] >= 0 ? data[i] : data[i] * slope;
+	}
+}
+
+static void max_accumulate_scalar(float* acc, const float* row, size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		acc[i] = std::max(acc[i], row[i]);
+	}
+}
+
+static inline void weighted_mean_shift_scalar(const float* response, const float* kde, const float* cols, const float* rows, int length, float* sum, float* mx, float* my)
+{
+	float s = 0, x = 0, y = 0;
+	for (int i = 0; i < length; ++i)
+	{
+		float v = response[i] * kde[i];
+		s += v;
+		x += v * cols[i];
+		y += v * rows[i];
+	}
+	*sum = s;
+	*mx = x;
+	*my = y;
+}
+
+static void mean_shifts_scalar(const float* const* responses, const float* const* kde_rows, const float* cols, const float* rows, int length,
+	const float* xs, const float* ys, int count, float* ms_x, float* ms_y)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		float sum, mx, my;
+		weighted_mean_shift_scalar(responses[i], kde_rows[i], cols, rows, length, &sum, &mx, &my);
+		ms_x[i] = mx / sum - xs[i];
+		ms_y[i] = my / sum - ys[i];
+	}
+}
+
+static void sigmoid_scalar(float* data, size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		data[i] = 1.0f / (1.0f + std::exp(-data[i]));
+	}
+}
+
+static void tanh_scalar(float* data, size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		data[i] = std::tanh(data[i]);
+	}
+}
+
+static void gemm_int8_scalar(const signed char* a, int num_a, const signed char* b, int num_b, int length, int* c)
+{
+	for (int i = 0; i < num_a; ++i)
+	{
+		const signed char* a_row = a + (size_t)i * length;
+		for (int j = 0; j < num_b; ++j)
+		{
+			const signed char* b_row = b + (size_t)j * length;
+			int sum = 0;
+			for (int k = 0; k < length; ++k)
+			{
+				sum += (int)a_row[k] * (int)b_row[k];
+			}
+			c[(size_t)i * num_b + j] = sum;
+		}
+	}
+}
+
+static void softmax_scalar(float* data, size_t length)
+{
+	if (length == 0)
+	{
+		return;
+	}
+
+	float max_val = *std::max_element(data, data + length);
+
+	float sum = 0;
+	for (size_t i = 0; i < length; ++i)
+	{
+		data[i] = std::exp(data[i] - max_val);
+		sum += data[i];
+	}
+
+	for (size_t i = 0; i < length; ++i)
+	{
+		data[i] /= sum;
+	}
+}
+
+//===========================================================================
+
+SimdLevel LandmarkDetector::DetectSimdLevel()
+{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SIMD_SSE2;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+
+	// The OS has to save the wider registers as well
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool ymm_enabled = (xcr0 & 0x6) == 0x6;
+	bool zmm_enabled = (xcr0 & 0xe6) == 0xe6;
+
+	bool avx2 = false;
+	bool avx512f = false;
+	if (max_leaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+		avx512f = (info[1] & (1 << 16)) != 0;
+	}
+
+	if (avx512f && zmm_enabled)
+		return SIMD_AVX512;
+	if (avx2 && fma && ymm_enabled)
+		return SIMD_AVX2;
+	if (sse2)
+		return SIMD_SSE2;
+#endif
+	return SIMD_SCALAR;
+}
+
+const char* LandmarkDetector::SimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_SSE2: return "sse2";
+	case SIMD_AVX2: return "avx2";
+	case SIMD_AVX512: return "avx512";
+	default: return "scalar";
+	}
+}
+
+// Picking the kernels on first use
+struct SimdSelection
+{
+	SimdLevel detected;
+	SimdLevel requested;
+	SimdLevel used;
+	SimdKernels kernels;
+
+	SimdSelection()
+	{
+		detected = DetectSimdLevel();
+		requested = detected;
+
+		const char* env = std::getenv("OPENFACE_SIMD");
+		if (env != nullptr && env[0] != '\0')
+		{
+			std::string value(env);
+			std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+			bool known = false;
+			for (int level = SIMD_SCALAR; level <= SIMD_AVX512; ++level)
+			{
+				if (value == SimdLevelName((SimdLevel)level))
+				{
+					requested = (SimdLevel)level;
+					known = true;
+				}
+			}
+
+			if (!known)
+			{
+				std::cout << "Unknown OPENFACE_SIMD value " << value << ", expected scalar, sse2, avx2 or avx512" << std::endl;
+			}
+			else if (requested > detected)
+			{
+				std::cout << "OPENFACE_SIMD requests " << value << " but the CPU only supports " << SimdLevelName(detected) << std::endl;
+				requested = detected;
+			}
+		}
+
+		kernels.contrast_normalize = contrast_normalize_scalar;
+		kernels.relu = relu_scalar;
+		kernels.prelu = prelu_scalar;
+		kernels.max_accumulate = max_accumulate_scalar;
+		kernels.mean_shifts = mean_shifts_scalar;
+		kernels.sigmoid = sigmoid_scalar;
+		kernels.tanh = tanh_scalar;
+		kernels.softmax = softmax_scalar;
+		kernels.gemm_int8 = gemm_int8_scalar;
+		used = SIMD_SCALAR;
+
+		// Use the widest compiled in instruction set not above the requested one
+		if (requested >= SIMD_AVX512 && GetSimdKernelsAVX512(kernels))
+			used = SIMD_AVX512;
+		else if (requested >= SIMD_AVX2 && GetSimdKernelsAVX2(kernels))
+			used = SIMD_AVX2;
+		else if (requested >= SIMD_SSE2 && GetSimdKernelsSSE2(kernels))
+			used = SIMD_SSE2;
+	}
+};
+
+static const SimdSelection& GetSimdSelection()
+{
+	static const SimdSelection selection;
+	return selection;
+}
+
+const SimdKernels& LandmarkDetector::GetSimdKernels()
+{
+	return GetSimdSelection().kernels;
+}
+
+SimdLevel LandmarkDetector::GetSimdLevel()
+{
+	return GetSimdSelection().used;
+}
+
+std::string LandmarkDetector::SimdDiagnostics()
+{
+	const SimdSelection& selection = GetSimdSelection();
+	std::string diagnostics = std::string("SIMD kernels: ") + SimdLevelName(selection.used) + " (CPU supports " + SimdLevelName(selection.detected);
+	if (selection.requested != selection.detected)
+	{
+		diagnostics += std::string(", OPENFACE_SIMD selected ") + SimdLevelName(selection.requested);
+	}
+	diagnostics += ")";
+	return diagnostics;
+}
@@ -0,0 +1,406 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// The AVX2 (with FMA) versions of the dispatched kernels, this file is compiled with AVX2 enabled and only called on CPUs supporting it
+
+#include "SimdDispatch.h"
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+
+#include <immintrin.h>
+
+// System includes
+#include <algorithm>
+#include <cmath>
+
+using namespace LandmarkDetector;
+
+static inline float horizontal_sum(__m256 v)
+{
+	__m128 sums = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	__m128 shuf = _mm_movehdup_ps(sums);
+	sums = _mm_add_ps(sums, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	sums = _mm_add_ss(sums, shuf);
+	return _mm_cvtss_f32(sums);
+}
+
+static void contrast_normalize_avx2(float* data, int length)
+{
+	int i = 0;
+	__m256 sum8 = _mm256_setzero_ps();
+	for (; i + 8 <= length; i += 8)
+	{
+		sum8 = _mm256_add_ps(sum8, _mm256_loadu_ps(data + i));
+	}
+	float sum = horizontal_sum(sum8);
+	for (; i < length; ++i)
+	{
+		sum += data[i];
+	}
+	const float mean = sum / (float)length;
+
+	const __m256 mean8 = _mm256_set1_ps(mean);
+	__m256 sum_sq8 = _mm256_setzero_ps();
+	for (i = 0; i + 8 <= length; i += 8)
+	{
+		__m256 in = _mm256_sub_ps(_mm256_loadu_ps(data + i), mean8);
+		_mm256_storeu_ps(data + i, in);
+		sum_sq8 = _mm256_fmadd_ps(in, in, sum_sq8);
+	}
+	float sum_sq = horizontal_sum(sum_sq8);
+	for (; i < length; ++i)
+	{
+		float in = data[i] - mean;
+		data[i] = in;
+		sum_sq += in * in;
+	}
+
+	float norm = std::sqrt(sum_sq);
+
+	// Avoiding division by 0
+	if (norm == 0)
+	{
+		norm = 1;
+	}
+
+	const __m256 norm8 = _mm256_set1_ps(1.0f / norm);
+	for (i = 0; i + 8 <= length; i += 8)
+	{
+		_mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), norm8));
+	}
+	for (; i < length; ++i)
+	{
+		data[i] *= 1.0f / norm;
+	}
+}
+
+static void relu_avx2(float* data, size_t length)
+{
+	size_t i = 0;
+	const __m256 zero = _mm256_setzero_ps();
+	for (; i + 8 <= length; i += 8)
+	{
+		_mm256_storeu_ps(data + i, _mm256_max_ps(_mm256_loadu_ps(data + i), zero));
+	}
+	for (; i < length; ++i)
+	{
+		data[i] = std::max(data[i], 0.0f);
+	}
+}
+
+static void prelu_avx2(float* data, size_t length, float slope)
+{
+	size_t i = 0;
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 slope8 = _mm256_set1_ps(slope);
+	for (; i + 8 <= length; i += 8)
+	{
+		__m256 in = _mm256_loadu_ps(data + i);
+		__m256 pos = _mm256_max_ps(in, zero);
+		__m256 neg = _mm256_min_ps(in, zero);
+		_mm256_storeu_ps(data + i, _mm256_fmadd_ps(neg, slope8, pos));
+	}
+	for (; i < length; ++i)
+	{
+		data[i] = data[i] >= 0 ? data[i] : data[i] * slope;
+	}
+}
+
+static void max_accumulate_avx2(float* acc, const float* row, size_t length)
+{
+	size_t i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		_mm256_storeu_ps(acc + i, _mm256_max_ps(_mm256_loadu_ps(acc + i), _mm256_loadu_ps(row + i)));
+	}
+	for (; i < length; ++i)
+	{
+		acc[i] = std::max(acc[i], row[i]);
+	}
+}
+
+static inline void weighted_mean_shift_avx2(const float* response, const float* kde, const float* cols, const float* rows, int length, float* sum, float* mx, float* my)
+{
+	int i = 0;
+	__m256 s8 = _mm256_setzero_ps();
+	__m256 x8 = _mm256_setzero_ps();
+	__m256 y8 = _mm256_setzero_ps();
+	for (; i + 8 <= length; i += 8)
+	{
+		__m256 v = _mm256_mul_ps(_mm256_loadu_ps(response + i), _mm256_loadu_ps(kde + i));
+		s8 = _mm256_add_ps(s8, v);
+		x8 = _mm256_fmadd_ps(v, _mm256_loadu_ps(cols + i), x8);
+		y8 = _mm256_fmadd_ps(v, _mm256_loadu_ps(rows + i), y8);
+	}
+	float s = horizontal_sum(s8);
+	float x = horizontal_sum(x8);
+	float y = horizontal_sum(y8);
+	for (; i < length; ++i)
+	{
+		float v = response[i] * kde[i];
+		s += v;
+		x += v * cols[i];
+		y += v * rows[i];
+	}
+	*sum = s;
+	*mx = x;
+	*my = y;
+}
+
+static void mean_shifts_avx2(const float* const* responses, const float* const* kde_rows, const float* cols, const float* rows, int length,
+	const float* xs, const float* ys, int count, float* ms_x, float* ms_y)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		float sum, mx, my;
+		weighted_mean_shift_avx2(responses[i], kde_rows[i], cols, rows, length, &sum, &mx, &my);
+		ms_x[i] = mx / sum - xs[i];
+		ms_y[i] = my / sum - ys[i];
+	}
+}
+
+//===========================================================================
+// Activations, exp is evaluated with the Cephes expf polynomial
+
+static inline __m256 exp_avx2(__m256 x)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	// Clamp to the range where the result is a normal float
+	x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3365f)), _mm256_set1_ps(88.0f));
+
+	// exp(x) = 2^n * exp(r), with n = floor(x / ln(2) + 0.5)
+	__m256 fx = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _mm256_set1_ps(0.5f));
+	fx = _mm256_floor_ps(fx);
+
+	// r = x - n * ln(2), with ln(2) split in two for accuracy
+	x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(0.693359375f)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(-2.12194440e-4f)));
+
+	__m256 y = _mm256_set1_ps(1.9875691500e-4f);
+	y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+	y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+	y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+	y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+	y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+	y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, one));
+
+	// Build 2^n directly in the exponent bits
+	return _mm256_mul_ps(y, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127)), 23)));
+}
+
+static inline __m256 sigmoid_avx2(__m256 x)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	return _mm256_div_ps(one, _mm256_add_ps(one, exp_avx2(_mm256_sub_ps(_mm256_set1_ps(0.0f), x))));
+}
+
+// Applies an activation over a buffer, the remainder going through a padded vector so all elements use the same approximation
+template<typename Activation>
+static inline void apply_avx2(float* data, size_t length, Activation activation)
+{
+	size_t i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		_mm256_storeu_ps(data + i, activation(_mm256_loadu_ps(data + i)));
+	}
+	if (i < length)
+	{
+		float tail[8] = { 0 };
+		std::copy(data + i, data + length, tail);
+		_mm256_storeu_ps(tail, activation(_mm256_loadu_ps(tail)));
+		std::copy(tail, tail + (length - i), data + i);
+	}
+}
+
+static void sigmoid_avx2(float* data, size_t length)
+{
+	apply_avx2(data, length, [](const __m256& x) { return sigmoid_avx2(x); });
+}
+
+static void tanh_avx2(float* data, size_t length)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	apply_avx2(data, length, [&](const __m256& x) { return _mm256_sub_ps(_mm256_mul_ps(two, sigmoid_avx2(_mm256_mul_ps(two, x))), one); });
+}
+
+static void softmax_avx2(float* data, size_t length)
+{
+	if (length == 0)
+	{
+		return;
+	}
+
+	float max_val = *std::max_element(data, data + length);
+	const __m256 max_v = _mm256_set1_ps(max_val);
+
+	apply_avx2(data, length, [&](const __m256& x) { return exp_avx2(_mm256_sub_ps(x, max_v)); });
+
+	float sum = 0;
+	for (size_t i = 0; i < length; ++i)
+	{
+		sum += data[i];
+	}
+
+	const __m256 scale = _mm256_set1_ps(1.0f / sum);
+	apply_avx2(data, length, [&](const __m256& x) { return _mm256_mul_ps(x, scale); });
+}
+
+// The next (up to) 16 values of a row sign extended to 16 bits, the values past the end of the row are zeros
+static inline __m256i load_int8_avx2(const signed char* row, int count)
+{
+	if (count >= 16)
+	{
+		return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)row));
+	}
+	signed char tail[16] = {};
+	std::copy(row, row + count, tail);
+	return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)tail));
+}
+
+static inline int horizontal_sum_epi32_avx2(__m256i acc)
+{
+	__m128i acc_128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	acc_128 = _mm_add_epi32(acc_128, _mm_shuffle_epi32(acc_128, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc_128 = _mm_add_epi32(acc_128, _mm_shuffle_epi32(acc_128, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(acc_128);
+}
+
+static int dot_int8_avx2(const signed char* a, const signed char* b, int length)
+{
+	__m256i acc = _mm256_setzero_si256();
+	for (int k = 0; k < length; k += 16)
+	{
+		acc = _mm256_add_epi32(acc, _mm256_madd_epi16(load_int8_avx2(a + k, length - k), load_int8_avx2(b + k, length - k)));
+	}
+	return horizontal_sum_epi32_avx2(acc);
+}
+
+// Blocks of 4 rows of a by 2 rows of b, so that every row loaded is used for several products (the accumulators stay in registers)
+static void gemm_int8_avx2(const signed char* a, int num_a, const signed char* b, int num_b, int length, int* c)
+{
+	int i = 0;
+	for (; i + 4 <= num_a; i += 4)
+	{
+		const signed char* a0 = a + (size_t)i * length;
+		const signed char* a1 = a0 + length;
+		const signed char* a2 = a1 + length;
+		const signed char* a3 = a2 + length;
+
+		int j = 0;
+		for (; j + 2 <= num_b; j += 2)
+		{
+			const signed char* b0 = b + (size_t)j * length;
+			const signed char* b1 = b0 + length;
+
+			__m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+			__m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+			__m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+			__m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+
+			for (int k = 0; k < length; k += 16)
+			{
+				const int count = length - k;
+				__m256i vb0 = load_int8_avx2(b0 + k, count);
+				__m256i vb1 = load_int8_avx2(b1 + k, count);
+
+				__m256i va = load_int8_avx2(a0 + k, count);
+				c00 = _mm256_add_epi32(c00, _mm256_madd_epi16(va, vb0));
+				c01 = _mm256_add_epi32(c01, _mm256_madd_epi16(va, vb1));
+				va = load_int8_avx2(a1 + k, count);
+				c10 = _mm256_add_epi32(c10, _mm256_madd_epi16(va, vb0));
+				c11 = _mm256_add_epi32(c11, _mm256_madd_epi16(va, vb1));
+				va = load_int8_avx2(a2 + k, count);
+				c20 = _mm256_add_epi32(c20, _mm256_madd_epi16(va, vb0));
+				c21 = _mm256_add_epi32(c21, _mm256_madd_epi16(va, vb1));
+				va = load_int8_avx2(a3 + k, count);
+				c30 = _mm256_add_epi32(c30, _mm256_madd_epi16(va, vb0));
+				c31 = _mm256_add_epi32(c31, _mm256_madd_epi16(va, vb1));
+			}
+
+			int* c_row = c + (size_t)i * num_b + j;
+			c_row[0] = horizontal_sum_epi32_avx2(c00);
+			c_row[1] = horizontal_sum_epi32_avx2(c01);
+			c_row += num_b;
+			c_row[0] = horizontal_sum_epi32_avx2(c10);
+			c_row[1] = horizontal_sum_epi32_avx2(c11);
+			c_row += num_b;
+			c_row[0] = horizontal_sum_epi32_avx2(c20);
+			c_row[1] = horizontal_sum_epi32_avx2(c21);
+			c_row += num_b;
+			c_row[0] = horizontal_sum_epi32_avx2(c30);
+			c_row[1] = horizontal_sum_epi32_avx2(c31);
+		}
+		for (; j < num_b; ++j)
+		{
+			const signed char* b_row = b + (size_t)j * length;
+			c[(size_t)i * num_b + j] = dot_int8_avx2(a0, b_row, length);
+			c[(size_t)(i + 1) * num_b + j] = dot_int8_avx2(a1, b_row, length);
+			c[(size_t)(i + 2) * num_b + j] = dot_int8_avx2(a2, b_row, length);
+			c[(size_t)(i + 3) * num_b + j] = dot_int8_avx2(a3, b_row, length);
+		}
+	}
+	for (; i < num_a; ++i)
+	{
+		for (int j = 0; j < num_b; ++j)
+		{
+			c[(size_t)i * num_b + j] = dot_int8_avx2(a + (size_t)i * length, b + (size_t)j * length, length);
+		}
+	}
+}
+
+bool LandmarkDetector::GetSimdKernelsAVX2(SimdKernels& kernels)
+{
+	kernels.contrast_normalize = contrast_normalize_avx2;
+	kernels.relu = relu_avx2;
+	kernels.prelu = prelu_avx2;
+	kernels.max_accumulate = max_accumulate_avx2;
+	kernels.mean_shifts = mean_shifts_avx2;
+	kernels.sigmoid = sigmoid_avx2;
+	kernels.tanh = tanh_avx2;
+	kernels.softmax = softmax_avx2;
+	kernels.gemm_int8 = gemm_int8_avx2;
+	return true;
+}
+
+#else
+
+bool LandmarkDetector::GetSimdKernelsAVX2(LandmarkDetector::SimdKernels&)
+{
+	return false;
+}
+
+#endif
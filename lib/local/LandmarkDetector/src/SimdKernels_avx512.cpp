@@ -0,0 +1,369 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// The AVX-512 versions of the dispatched kernels, this file is compiled with AVX-512 enabled and only called on CPUs supporting it
+// The remainders are handled through masked loads and stores
+
+#include "SimdDispatch.h"
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+// System includes
+#include <algorithm>
+#include <cmath>
+
+using namespace LandmarkDetector;
+
+static inline __mmask16 tail_mask(size_t remaining)
+{
+	return remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+}
+
+static void contrast_normalize_avx512(float* data, int length)
+{
+	__m512 sum16 = _mm512_setzero_ps();
+	for (int i = 0; i < length; i += 16)
+	{
+		__mmask16 mask = tail_mask(length - i);
+		sum16 = _mm512_add_ps(sum16, _mm512_maskz_loadu_ps(mask, data + i));
+	}
+	const float mean = _mm512_reduce_add_ps(sum16) / (float)length;
+
+	const __m512 mean16 = _mm512_set1_ps(mean);
+	__m512 sum_sq16 = _mm512_setzero_ps();
+	for (int i = 0; i < length; i += 16)
+	{
+		__mmask16 mask = tail_mask(length - i);
+		__m512 in = _mm512_maskz_sub_ps(mask, _mm512_maskz_loadu_ps(mask, data + i), mean16);
+		_mm512_mask_storeu_ps(data + i, mask, in);
+		sum_sq16 = _mm512_fmadd_ps(in, in, sum_sq16);
+	}
+
+	float norm = std::sqrt(_mm512_reduce_add_ps(sum_sq16));
+
+	// Avoiding division by 0
+	if (norm == 0)
+	{
+		norm = 1;
+	}
+
+	const __m512 norm16 = _mm512_set1_ps(1.0f / norm);
+	for (int i = 0; i < length; i += 16)
+	{
+		__mmask16 mask = tail_mask(length - i);
+		_mm512_mask_storeu_ps(data + i, mask, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, data + i), norm16));
+	}
+}
+
+static void relu_avx512(float* data, size_t length)
+{
+	const __m512 zero = _mm512_setzero_ps();
+	for (size_t i = 0; i < length; i += 16)
+	{
+		__mmask16 mask = tail_mask(length - i);
+		_mm512_mask_storeu_ps(data + i, mask, _mm512_max_ps(_mm512_maskz_loadu_ps(mask, data + i), zero));
+	}
+}
+
+static void prelu_avx512(float* data, size_t length, float slope)
+{
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 slope16 = _mm512_set1_ps(slope);
+	for (size_t i = 0; i < length; i += 16)
+	{
+		__mmask16 mask = tail_mask(length - i);
+		__m512 in = _mm512_maskz_loadu_ps(mask, data + i);
+		__m512 pos = _mm512_max_ps(in, zero);
+		__m512 neg = _mm512_min_ps(in, zero);
+		_mm512_mask_storeu_ps(data + i, mask, _mm512_fmadd_ps(neg, slope16, pos));
+	}
+}
+
+static void max_accumulate_avx512(float* acc, const float* row, size_t length)
+{
+	for (size_t i = 0; i < length; i += 16)
+	{
+		__mmask16 mask = tail_mask(length - i);
+		__m512 out = _mm512_max_ps(_mm512_maskz_loadu_ps(mask, acc + i), _mm512_maskz_loadu_ps(mask, row + i));
+		_mm512_mask_storeu_ps(acc + i, mask, out);
+	}
+}
+
+static inline void weighted_mean_shift_avx512(const float* response, const float* kde, const float* cols, const float* rows, int length, float* sum, float* mx, float* my)
+{
+	__m512 s16 = _mm512_setzero_ps();
+	__m512 x16 = _mm512_setzero_ps();
+	__m512 y16 = _mm512_setzero_ps();
+	for (int i = 0; i < length; i += 16)
+	{
+		__mmask16 mask = tail_mask(length - i);
+		__m512 v = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, response + i), _mm512_maskz_loadu_ps(mask, kde + i));
+		s16 = _mm512_add_ps(s16, v);
+		x16 = _mm512_fmadd_ps(v, _mm512_maskz_loadu_ps(mask, cols + i), x16);
+		y16 = _mm512_fmadd_ps(v, _mm512_maskz_loadu_ps(mask, rows + i), y16);
+	}
+	*sum = _mm512_reduce_add_ps(s16);
+	*mx = _mm512_reduce_add_ps(x16);
+	*my = _mm512_reduce_add_ps(y16);
+}
+
+static void mean_shifts_avx512(const float* const* responses, const float* const* kde_rows, const float* cols, const float* rows, int length,
+	const float* xs, const float* ys, int count, float* ms_x, float* ms_y)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		float sum, mx, my;
+		weighted_mean_shift_avx512(responses[i], kde_rows[i], cols, rows, length, &sum, &mx, &my);
+		ms_x[i] = mx / sum - xs[i];
+		ms_y[i] = my / sum - ys[i];
+	}
+}
+
+//===========================================================================
+// Activations, exp is evaluated with the Cephes expf polynomial
+
+static inline __m512 exp_avx512(__m512 x)
+{
+	const __m512 one = _mm512_set1_ps(1.0f);
+
+	// Clamp to the range where the result is a normal float
+	x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-87.3365f)), _mm512_set1_ps(88.0f));
+
+	// exp(x) = 2^n * exp(r), with n = floor(x / ln(2) + 0.5)
+	__m512 fx = _mm512_add_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f)), _mm512_set1_ps(0.5f));
+	fx = _mm512_roundscale_ps(fx, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+
+	// r = x - n * ln(2), with ln(2) split in two for accuracy
+	x = _mm512_sub_ps(x, _mm512_mul_ps(fx, _mm512_set1_ps(0.693359375f)));
+	x = _mm512_sub_ps(x, _mm512_mul_ps(fx, _mm512_set1_ps(-2.12194440e-4f)));
+
+	__m512 y = _mm512_set1_ps(1.9875691500e-4f);
+	y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.3981999507e-3f));
+	y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(8.3334519073e-3f));
+	y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(4.1665795894e-2f));
+	y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.6666665459e-1f));
+	y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(5.0000001201e-1f));
+	y = _mm512_fmadd_ps(y, _mm512_mul_ps(x, x), _mm512_add_ps(x, one));
+
+	// Build 2^n directly in the exponent bits
+	return _mm512_mul_ps(y, _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvttps_epi32(fx), _mm512_set1_epi32(127)), 23)));
+}
+
+static inline __m512 sigmoid_avx512(__m512 x)
+{
+	const __m512 one = _mm512_set1_ps(1.0f);
+	return _mm512_div_ps(one, _mm512_add_ps(one, exp_avx512(_mm512_sub_ps(_mm512_set1_ps(0.0f), x))));
+}
+
+// Applies an activation over a buffer, the remainder going through a padded vector so all elements use the same approximation
+template<typename Activation>
+static inline void apply_avx512(float* data, size_t length, Activation activation)
+{
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		_mm512_storeu_ps(data + i, activation(_mm512_loadu_ps(data + i)));
+	}
+	if (i < length)
+	{
+		float tail[16] = { 0 };
+		std::copy(data + i, data + length, tail);
+		_mm512_storeu_ps(tail, activation(_mm512_loadu_ps(tail)));
+		std::copy(tail, tail + (length - i), data + i);
+	}
+}
+
+static void sigmoid_avx512(float* data, size_t length)
+{
+	apply_avx512(data, length, [](const __m512& x) { return sigmoid_avx512(x); });
+}
+
+static void tanh_avx512(float* data, size_t length)
+{
+	const __m512 one = _mm512_set1_ps(1.0f);
+	const __m512 two = _mm512_set1_ps(2.0f);
+	apply_avx512(data, length, [&](const __m512& x) { return _mm512_sub_ps(_mm512_mul_ps(two, sigmoid_avx512(_mm512_mul_ps(two, x))), one); });
+}
+
+static void softmax_avx512(float* data, size_t length)
+{
+	if (length == 0)
+	{
+		return;
+	}
+
+	float max_val = *std::max_element(data, data + length);
+	const __m512 max_v = _mm512_set1_ps(max_val);
+
+	apply_avx512(data, length, [&](const __m512& x) { return exp_avx512(_mm512_sub_ps(x, max_v)); });
+
+	float sum = 0;
+	for (size_t i = 0; i < length; ++i)
+	{
+		sum += data[i];
+	}
+
+	const __m512 scale = _mm512_set1_ps(1.0f / sum);
+	apply_avx512(data, length, [&](const __m512& x) { return _mm512_mul_ps(x, scale); });
+}
+
+// AVX-512F has no 8 and 16 bit integer arithmetic (that needs AVX-512BW), so the INT8 products below use 256 bit vectors
+
+// The next (up to) 16 values of a row sign extended to 16 bits, the values past the end of the row are zeros
+static inline __m256i load_int8_avx512(const signed char* row, int count)
+{
+	if (count >= 16)
+	{
+		return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)row));
+	}
+	signed char tail[16] = {};
+	std::copy(row, row + count, tail);
+	return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)tail));
+}
+
+static inline int horizontal_sum_epi32_avx512(__m256i acc)
+{
+	__m128i acc_128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	acc_128 = _mm_add_epi32(acc_128, _mm_shuffle_epi32(acc_128, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc_128 = _mm_add_epi32(acc_128, _mm_shuffle_epi32(acc_128, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(acc_128);
+}
+
+static int dot_int8_avx512(const signed char* a, const signed char* b, int length)
+{
+	__m256i acc = _mm256_setzero_si256();
+	for (int k = 0; k < length; k += 16)
+	{
+		acc = _mm256_add_epi32(acc, _mm256_madd_epi16(load_int8_avx512(a + k, length - k), load_int8_avx512(b + k, length - k)));
+	}
+	return horizontal_sum_epi32_avx512(acc);
+}
+
+// Blocks of 4 rows of a by 2 rows of b, so that every row loaded is used for several products (the accumulators stay in registers)
+static void gemm_int8_avx512(const signed char* a, int num_a, const signed char* b, int num_b, int length, int* c)
+{
+	int i = 0;
+	for (; i + 4 <= num_a; i += 4)
+	{
+		const signed char* a0 = a + (size_t)i * length;
+		const signed char* a1 = a0 + length;
+		const signed char* a2 = a1 + length;
+		const signed char* a3 = a2 + length;
+
+		int j = 0;
+		for (; j + 2 <= num_b; j += 2)
+		{
+			const signed char* b0 = b + (size_t)j * length;
+			const signed char* b1 = b0 + length;
+
+			__m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+			__m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+			__m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+			__m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+
+			for (int k = 0; k < length; k += 16)
+			{
+				const int count = length - k;
+				__m256i vb0 = load_int8_avx512(b0 + k, count);
+				__m256i vb1 = load_int8_avx512(b1 + k, count);
+
+				__m256i va = load_int8_avx512(a0 + k, count);
+				c00 = _mm256_add_epi32(c00, _mm256_madd_epi16(va, vb0));
+				c01 = _mm256_add_epi32(c01, _mm256_madd_epi16(va, vb1));
+				va = load_int8_avx512(a1 + k, count);
+				c10 = _mm256_add_epi32(c10, _mm256_madd_epi16(va, vb0));
+				c11 = _mm256_add_epi32(c11, _mm256_madd_epi16(va, vb1));
+				va = load_int8_avx512(a2 + k, count);
+				c20 = _mm256_add_epi32(c20, _mm256_madd_epi16(va, vb0));
+				c21 = _mm256_add_epi32(c21, _mm256_madd_epi16(va, vb1));
+				va = load_int8_avx512(a3 + k, count);
+				c30 = _mm256_add_epi32(c30, _mm256_madd_epi16(va, vb0));
+				c31 = _mm256_add_epi32(c31, _mm256_madd_epi16(va, vb1));
+			}
+
+			int* c_row = c + (size_t)i * num_b + j;
+			c_row[0] = horizontal_sum_epi32_avx512(c00);
+			c_row[1] = horizontal_sum_epi32_avx512(c01);
+			c_row += num_b;
+			c_row[0] = horizontal_sum_epi32_avx512(c10);
+			c_row[1] = horizontal_sum_epi32_avx512(c11);
+			c_row += num_b;
+			c_row[0] = horizontal_sum_epi32_avx512(c20);
+			c_row[1] = horizontal_sum_epi32_avx512(c21);
+			c_row += num_b;
+			c_row[0] = horizontal_sum_epi32_avx512(c30);
+			c_row[1] = horizontal_sum_epi32_avx512(c31);
+		}
+		for (; j < num_b; ++j)
+		{
+			const signed char* b_row = b + (size_t)j * length;
+			c[(size_t)i * num_b + j] = dot_int8_avx512(a0, b_row, length);
+			c[(size_t)(i + 1) * num_b + j] = dot_int8_avx512(a1, b_row, length);
+			c[(size_t)(i + 2) * num_b + j] = dot_int8_avx512(a2, b_row, length);
+			c[(size_t)(i + 3) * num_b + j] = dot_int8_avx512(a3, b_row, length);
+		}
+	}
+	for (; i < num_a; ++i)
+	{
+		for (int j = 0; j < num_b; ++j)
+		{
+			c[(size_t)i * num_b + j] = dot_int8_avx512(a + (size_t)i * length, b + (size_t)j * length, length);
+		}
+	}
+}
+
+bool LandmarkDetector::GetSimdKernelsAVX512(SimdKernels& kernels)
+{
+	kernels.contrast_normalize = contrast_normalize_avx512;
+	kernels.relu = relu_avx512;
+	kernels.prelu = prelu_avx512;
+	kernels.max_accumulate = max_accumulate_avx512;
+	kernels.mean_shifts = mean_shifts_avx512;
+	kernels.sigmoid = sigmoid_avx512;
+	kernels.tanh = tanh_avx512;
+	kernels.softmax = softmax_avx512;
+	kernels.gemm_int8 = gemm_int8_avx512;
+	return true;
+}
+
+#else
+
+bool LandmarkDetector::GetSimdKernelsAVX512(LandmarkDetector::SimdKernels&)
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,406 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// The SSE2 versions of the dispatched kernels (no precompiled header, as this file may be compiled with different instruction set flags)
+
+#include "SimdDispatch.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+// System includes
+#include <algorithm>
+#include <cmath>
+
+using namespace LandmarkDetector;
+
+static inline float horizontal_sum(__m128 v)
+{
+	__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	sums = _mm_add_ss(sums, shuf);
+	return _mm_cvtss_f32(sums);
+}
+
+static void contrast_normalize_sse2(float* data, int length)
+{
+	int i = 0;
+	__m128 sum4 = _mm_setzero_ps();
+	for (; i + 4 <= length; i += 4)
+	{
+		sum4 = _mm_add_ps(sum4, _mm_loadu_ps(data + i));
+	}
+	float sum = horizontal_sum(sum4);
+	for (; i < length; ++i)
+	{
+		sum += data[i];
+	}
+	const float mean = sum / (float)length;
+
+	const __m128 mean4 = _mm_set1_ps(mean);
+	__m128 sum_sq4 = _mm_setzero_ps();
+	for (i = 0; i + 4 <= length; i += 4)
+	{
+		__m128 in = _mm_sub_ps(_mm_loadu_ps(data + i), mean4);
+		_mm_storeu_ps(data + i, in);
+		sum_sq4 = _mm_add_ps(sum_sq4, _mm_mul_ps(in, in));
+	}
+	float sum_sq = horizontal_sum(sum_sq4);
+	for (; i < length; ++i)
+	{
+		float in = data[i] - mean;
+		data[i] = in;
+		sum_sq += in * in;
+	}
+
+	float norm = std::sqrt(sum_sq);
+
+	// Avoiding division by 0
+	if (norm == 0)
+	{
+		norm = 1;
+	}
+
+	const __m128 norm4 = _mm_set1_ps(1.0f / norm);
+	for (i = 0; i + 4 <= length; i += 4)
+	{
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), norm4));
+	}
+	for (; i < length; ++i)
+	{
+		data[i] *= 1.0f / norm;
+	}
+}
+
+static void relu_sse2(float* data, size_t length)
+{
+	size_t i = 0;
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= length; i += 4)
+	{
+		_mm_storeu_ps(data + i, _mm_max_ps(_mm_loadu_ps(data + i), zero));
+	}
+	for (; i < length; ++i)
+	{
+		data[i] = std::max(data[i], 0.0f);
+	}
+}
+
+static void prelu_sse2(float* data, size_t length, float slope)
+{
+	size_t i = 0;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 slope4 = _mm_set1_ps(slope);
+	for (; i + 4 <= length; i += 4)
+	{
+		__m128 in = _mm_loadu_ps(data + i);
+		__m128 pos = _mm_max_ps(in, zero);
+		__m128 neg = _mm_min_ps(in, zero);
+		_mm_storeu_ps(data + i, _mm_add_ps(pos, _mm_mul_ps(neg, slope4)));
+	}
+	for (; i < length; ++i)
+	{
+		data[i] = data[i] >= 0 ? data[i] : data[i] * slope;
+	}
+}
+
+static void max_accumulate_sse2(float* acc, const float* row, size_t length)
+{
+	size_t i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		_mm_storeu_ps(acc + i, _mm_max_ps(_mm_loadu_ps(acc + i), _mm_loadu_ps(row + i)));
+	}
+	for (; i < length; ++i)
+	{
+		acc[i] = std::max(acc[i], row[i]);
+	}
+}
+
+static inline void weighted_mean_shift_sse2(const float* response, const float* kde, const float* cols, const float* rows, int length, float* sum, float* mx, float* my)
+{
+	int i = 0;
+	__m128 s4 = _mm_setzero_ps();
+	__m128 x4 = _mm_setzero_ps();
+	__m128 y4 = _mm_setzero_ps();
+	for (; i + 4 <= length; i += 4)
+	{
+		__m128 v = _mm_mul_ps(_mm_loadu_ps(response + i), _mm_loadu_ps(kde + i));
+		s4 = _mm_add_ps(s4, v);
+		x4 = _mm_add_ps(x4, _mm_mul_ps(v, _mm_loadu_ps(cols + i)));
+		y4 = _mm_add_ps(y4, _mm_mul_ps(v, _mm_loadu_ps(rows + i)));
+	}
+	float s = horizontal_sum(s4);
+	float x = horizontal_sum(x4);
+	float y = horizontal_sum(y4);
+	for (; i < length; ++i)
+	{
+		float v = response[i] * kde[i];
+		s += v;
+		x += v * cols[i];
+		y += v * rows[i];
+	}
+	*sum = s;
+	*mx = x;
+	*my = y;
+}
+
+static void mean_shifts_sse2(const float* const* responses, const float* const* kde_rows, const float* cols, const float* rows, int length,
+	const float* xs, const float* ys, int count, float* ms_x, float* ms_y)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		float sum, mx, my;
+		weighted_mean_shift_sse2(responses[i], kde_rows[i], cols, rows, length, &sum, &mx, &my);
+		ms_x[i] = mx / sum - xs[i];
+		ms_y[i] = my / sum - ys[i];
+	}
+}
+
+//===========================================================================
+// Activations, exp is evaluated with the Cephes expf polynomial
+
+static inline __m128 exp_sse2(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	// Clamp to the range where the result is a normal float
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-87.3365f)), _mm_set1_ps(88.0f));
+
+	// exp(x) = 2^n * exp(r), with n = floor(x / ln(2) + 0.5)
+	__m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+	// Floor without SSE4.1: truncate and correct the negative values
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+	fx = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, fx), one));
+
+	// r = x - n * ln(2), with ln(2) split in two for accuracy
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+
+	__m128 y = _mm_set1_ps(1.9875691500e-4f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), _mm_add_ps(x, one));
+
+	// Build 2^n directly in the exponent bits
+	return _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127)), 23)));
+}
+
+static inline __m128 sigmoid_sse2(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	return _mm_div_ps(one, _mm_add_ps(one, exp_sse2(_mm_sub_ps(_mm_set1_ps(0.0f), x))));
+}
+
+// Applies an activation over a buffer, the remainder going through a padded vector so all elements use the same approximation
+template<typename Activation>
+static inline void apply_sse2(float* data, size_t length, Activation activation)
+{
+	size_t i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		_mm_storeu_ps(data + i, activation(_mm_loadu_ps(data + i)));
+	}
+	if (i < length)
+	{
+		float tail[4] = { 0 };
+		std::copy(data + i, data + length, tail);
+		_mm_storeu_ps(tail, activation(_mm_loadu_ps(tail)));
+		std::copy(tail, tail + (length - i), data + i);
+	}
+}
+
+static void sigmoid_sse2(float* data, size_t length)
+{
+	apply_sse2(data, length, [](const __m128& x) { return sigmoid_sse2(x); });
+}
+
+static void tanh_sse2(float* data, size_t length)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	apply_sse2(data, length, [&](const __m128& x) { return _mm_sub_ps(_mm_mul_ps(two, sigmoid_sse2(_mm_mul_ps(two, x))), one); });
+}
+
+static void softmax_sse2(float* data, size_t length)
+{
+	if (length == 0)
+	{
+		return;
+	}
+
+	float max_val = *std::max_element(data, data + length);
+	const __m128 max_v = _mm_set1_ps(max_val);
+
+	apply_sse2(data, length, [&](const __m128& x) { return exp_sse2(_mm_sub_ps(x, max_v)); });
+
+	float sum = 0;
+	for (size_t i = 0; i < length; ++i)
+	{
+		sum += data[i];
+	}
+
+	const __m128 scale = _mm_set1_ps(1.0f / sum);
+	apply_sse2(data, length, [&](const __m128& x) { return _mm_mul_ps(x, scale); });
+}
+
+// The next (up to) 16 values of a row sign extended to 16 bits (interleaving with their sign mask) as two vectors,
+// the values past the end of the row are zeros
+static inline void load_int8_sse2(const signed char* row, int count, __m128i& lo, __m128i& hi)
+{
+	__m128i v;
+	if (count >= 16)
+	{
+		v = _mm_loadu_si128((const __m128i*)row);
+	}
+	else
+	{
+		signed char tail[16] = {};
+		std::copy(row, row + count, tail);
+		v = _mm_loadu_si128((const __m128i*)tail);
+	}
+	__m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), v);
+	lo = _mm_unpacklo_epi8(v, sign);
+	hi = _mm_unpackhi_epi8(v, sign);
+}
+
+static inline __m128i madd_int8_sse2(__m128i acc, __m128i a_lo, __m128i a_hi, __m128i b_lo, __m128i b_hi)
+{
+	return _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(a_lo, b_lo), _mm_madd_epi16(a_hi, b_hi)));
+}
+
+static inline int horizontal_sum_epi32_sse2(__m128i acc)
+{
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(acc);
+}
+
+static int dot_int8_sse2(const signed char* a, const signed char* b, int length)
+{
+	__m128i acc = _mm_setzero_si128();
+	for (int k = 0; k < length; k += 16)
+	{
+		__m128i a_lo, a_hi, b_lo, b_hi;
+		load_int8_sse2(a + k, length - k, a_lo, a_hi);
+		load_int8_sse2(b + k, length - k, b_lo, b_hi);
+		acc = madd_int8_sse2(acc, a_lo, a_hi, b_lo, b_hi);
+	}
+	return horizontal_sum_epi32_sse2(acc);
+}
+
+// Blocks of 2 rows of a by 2 rows of b, so that every row loaded is used for several products (larger blocks would not fit the
+// accumulators and the unpacked rows in the 16 SSE registers)
+static void gemm_int8_sse2(const signed char* a, int num_a, const signed char* b, int num_b, int length, int* c)
+{
+	int i = 0;
+	for (; i + 2 <= num_a; i += 2)
+	{
+		const signed char* a0 = a + (size_t)i * length;
+		const signed char* a1 = a0 + length;
+
+		int j = 0;
+		for (; j + 2 <= num_b; j += 2)
+		{
+			const signed char* b0 = b + (size_t)j * length;
+			const signed char* b1 = b0 + length;
+
+			__m128i c00 = _mm_setzero_si128(), c01 = _mm_setzero_si128();
+			__m128i c10 = _mm_setzero_si128(), c11 = _mm_setzero_si128();
+
+			for (int k = 0; k < length; k += 16)
+			{
+				const int count = length - k;
+				__m128i b0_lo, b0_hi, b1_lo, b1_hi, a_lo, a_hi;
+				load_int8_sse2(b0 + k, count, b0_lo, b0_hi);
+				load_int8_sse2(b1 + k, count, b1_lo, b1_hi);
+
+				load_int8_sse2(a0 + k, count, a_lo, a_hi);
+				c00 = madd_int8_sse2(c00, a_lo, a_hi, b0_lo, b0_hi);
+				c01 = madd_int8_sse2(c01, a_lo, a_hi, b1_lo, b1_hi);
+				load_int8_sse2(a1 + k, count, a_lo, a_hi);
+				c10 = madd_int8_sse2(c10, a_lo, a_hi, b0_lo, b0_hi);
+				c11 = madd_int8_sse2(c11, a_lo, a_hi, b1_lo, b1_hi);
+			}
+
+			int* c_row = c + (size_t)i * num_b + j;
+			c_row[0] = horizontal_sum_epi32_sse2(c00);
+			c_row[1] = horizontal_sum_epi32_sse2(c01);
+			c_row += num_b;
+			c_row[0] = horizontal_sum_epi32_sse2(c10);
+			c_row[1] = horizontal_sum_epi32_sse2(c11);
+		}
+		for (; j < num_b; ++j)
+		{
+			const signed char* b_row = b + (size_t)j * length;
+			c[(size_t)i * num_b + j] = dot_int8_sse2(a0, b_row, length);
+			c[(size_t)(i + 1) * num_b + j] = dot_int8_sse2(a1, b_row, length);
+		}
+	}
+	for (; i < num_a; ++i)
+	{
+		for (int j = 0; j < num_b; ++j)
+		{
+			c[(size_t)i * num_b + j] = dot_int8_sse2(a + (size_t)i * length, b + (size_t)j * length, length);
+		}
+	}
+}
+
+bool LandmarkDetector::GetSimdKernelsSSE2(SimdKernels& kernels)
+{
+	kernels.contrast_normalize = contrast_normalize_sse2;
+	kernels.relu = relu_sse2;
+	kernels.prelu = prelu_sse2;
+	kernels.max_accumulate = max_accumulate_sse2;
+	kernels.mean_shifts = mean_shifts_sse2;
+	kernels.sigmoid = sigmoid_sse2;
+	kernels.tanh = tanh_sse2;
+	kernels.softmax = softmax_sse2;
+	kernels.gemm_int8 = gemm_int8_sse2;
+	return true;
+}
+
+#else
+
+bool LandmarkDetector::GetSimdKernelsSSE2(LandmarkDetector::SimdKernels&)
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,404 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include "ThreadingPolicy.h"
+
+// System includes
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace LandmarkDetector;
+
+namespace
+{
+	// A parallel loop, its range is handed out in chunks to whichever thread asks for work next
+	struct ParallelJob
+	{
+		const std::function<void(const cv::Range&)>* body;
+
+		int end;
+		int chunk;
+
+		// The start of the next chunk to hand out, and the number of iterations not done yet
+		std::atomic<int> next;
+		std::atomic<int> unfinished;
+
+		// The first exception thrown by the body, rethrown on the thread that started the loop
+		std::exception_ptr error;
+	};
+
+	class WorkerPool
+	{
+	public:
+
+		explicit WorkerPool(int num_workers);
+
+		~WorkerPool();
+
+		void Run(const cv::Range& range, const std::function<void(const cv::Range&)>& body, bool nested);
+
+	private:
+
+		void WorkerLoop(int index);
+
+		// Finding a loop with chunks left, the newest one in the thread's own queue first and then the oldest one in the others (should hold the lock)
+		std::shared_ptr<ParallelJob> FindJob(int queue);
+
+		// Doing chunks of a loop until none are left
+		void Work(ParallelJob& job);
+
+		std::mutex mutex;
+		std::condition_variable wake;
+
+		// One queue per worker, and a last one shared by the threads outside of the pool
+		std::vector<std::deque<std::shared_ptr<ParallelJob> > > queues;
+		std::vector<std::thread> workers;
+		bool stopping;
+	};
+
+	// The pool a thread belongs to and its queue in it, and how many parallel loops the thread is currently inside of
+	thread_local WorkerPool* thread_pool = nullptr;
+	thread_local int thread_queue = -1;
+	thread_local int loop_depth = 0;
+
+	WorkerPool::WorkerPool(int num_workers) : queues(num_workers + 1), stopping(false)
+	{
+		for (int i = 0; i < num_workers; ++i)
+		{
+			workers.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+		}
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+
+		for (size_t i = 0; i < workers.size(); ++i)
+		{
+			workers[i].join();
+		}
+	}
+
+	void WorkerPool::WorkerLoop(int index)
+	{
+		thread_pool = this;
+		thread_queue = index;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!stopping)
+		{
+			std::shared_ptr<ParallelJob> job = FindJob(index);
+			if (job)
+			{
+				lock.unlock();
+				Work(*job);
+				lock.lock();
+			}
+			else
+			{
+				wake.wait(lock);
+			}
+		}
+	}
+
+	std::shared_ptr<ParallelJob> WorkerPool::FindJob(int queue)
+	{
+		for (size_t i = 0; i < queues.size(); ++i)
+		{
+			std::deque<std::shared_ptr<ParallelJob> >& candidates = queues[(queue + i) % queues.size()];
+
+			// The loops that have all of their chunks handed out are dropped from the queues
+			while (!candidates.empty() && candidates.back()->next >= candidates.back()->end)
+			{
+				candidates.pop_back();
+			}
+			while (!candidates.empty() && candidates.front()->next >= candidates.front()->end)
+			{
+				candidates.pop_front();
+			}
+
+			if (!candidates.empty())
+			{
+				return i == 0 ? candidates.back() : candidates.front();
+			}
+		}
+		return std::shared_ptr<ParallelJob>();
+	}
+
+	void WorkerPool::Work(ParallelJob& job)
+	{
+		loop_depth++;
+		while (true)
+		{
+			int start = job.next.fetch_add(job.chunk);
+			if (start >= job.end)
+			{
+				break;
+			}
+			int stop = std::min(start + job.chunk, job.end);
+
+			try
+			{
+				(*job.body)(cv::Range(start, stop));
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!job.error)
+				{
+					job.error = std::current_exception();
+				}
+			}
+
+			// The thread that started the loop is woken up once the last chunk is done
+			if (job.unfinished.fetch_sub(stop - start) == stop - start)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				wake.notify_all();
+			}
+		}
+		loop_depth--;
+	}
+
+	void WorkerPool::Run(const cv::Range& range, const std::function<void(const cv::Range&)>& body, bool nested)
+	{
+		int num_iterations = range.size();
+		if (num_iterations <= 0)
+		{
+			return;
+		}
+
+		if (workers.empty() || num_iterations == 1 || (loop_depth > 0 && !nested))
+		{
+			loop_depth++;
+			body(range);
+			loop_depth--;
+			return;
+		}
+
+		std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>();
+		job->body = &body;
+		job->end = range.end;
+		// A few chunks per thread, so that the threads finishing early can take over from the slower ones
+		job->chunk = std::max(1, num_iterations / (4 * (int)queues.size()));
+		job->next = range.start;
+		job->unfinished = num_iterations;
+
+		int queue = thread_pool == this ? thread_queue : (int)workers.size();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queues[queue].push_back(job);
+		}
+		wake.notify_all();
+
+		Work(*job);
+
+		// Helping with the other loops while the last chunks of this one are being done elsewhere, this keeps a nested loop
+		// from blocking the worker that started it
+		std::unique_lock<std::mutex> lock(mutex);
+		while (job->unfinished > 0)
+		{
+			std::shared_ptr<ParallelJob> other = FindJob(queue);
+			if (other)
+			{
+				lock.unlock();
+				Work(*other);
+				lock.lock();
+			}
+			else
+			{
+				wake.wait(lock);
+			}
+		}
+
+		if (job->error)
+		{
+			std::rethrow_exception(job->error);
+		}
+	}
+
+	// Stopping a pool once its last user is done with it. When the policy is changed during a nested loop that can be one of the pool's own workers,
+	// which can not join itself, so the pool is then stopped on a thread of its own
+	void DeletePool(WorkerPool* pool)
+	{
+		if (thread_pool == pool)
+		{
+			std::thread([pool]() { delete pool; }).detach();
+		}
+		else
+		{
+			delete pool;
+		}
+	}
+
+	// The policy in use and its worker pool (created on first use)
+	std::mutex policy_mutex;
+	ThreadingPolicy current_policy;
+	std::shared_ptr<WorkerPool> current_pool;
+
+	std::shared_ptr<WorkerPool> GetPool(bool& nested)
+	{
+		std::lock_guard<std::mutex> lock(policy_mutex);
+		if (!current_pool)
+		{
+			current_pool = std::shared_ptr<WorkerPool>(new WorkerPool(current_policy.NumThreads() - 1), DeletePool);
+		}
+		nested = current_policy.nested_parallelism;
+		return current_pool;
+	}
+}
+
+ThreadingPolicy::ThreadingPolicy()
+{
+	num_threads = 0;
+	blas_threads = 1;
+	opencv_threads = -1;
+	nested_parallelism = true;
+}
+
+ThreadingPolicy::ThreadingPolicy(std::vector<std::string>& arguments) : ThreadingPolicy()
+{
+	bool* valid = new bool[arguments.size()];
+
+	for (size_t i = 0; i < arguments.size(); ++i)
+	{
+		valid[i] = true;
+
+		if (i + 1 >= arguments.size())
+		{
+			continue;
+		}
+
+		if (arguments[i].compare("-threads") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> num_threads;
+		}
+		else if (arguments[i].compare("-blas_threads") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> blas_threads;
+		}
+		else if (arguments[i].compare("-cv_threads") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			data >> opencv_threads;
+		}
+		else if (arguments[i].compare("-nested_parallel") == 0)
+		{
+			std::stringstream data(arguments[i + 1]);
+			int nested;
+			data >> nested;
+			nested_parallelism = nested != 0;
+		}
+		else
+		{
+			continue;
+		}
+
+		valid[i] = false;
+		valid[i + 1] = false;
+		i++;
+	}
+
+	for (int i = (int)arguments.size() - 1; i >= 0; --i)
+	{
+		if (!valid[i])
+		{
+			arguments.erase(arguments.begin() + i);
+		}
+	}
+
+	delete[] valid;
+}
+
+int ThreadingPolicy::NumThreads() const
+{
+	if (num_threads > 0)
+	{
+		return num_threads;
+	}
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+void ThreadingPolicy::Apply(const ThreadingPolicy& policy)
+{
+	std::shared_ptr<WorkerPool> old_pool;
+	{
+		std::lock_guard<std::mutex> lock(policy_mutex);
+		current_policy = policy;
+
+		// The old workers are stopped once the loops still using them are done (by whichever thread finishes the last of them)
+		old_pool = current_pool;
+		current_pool.reset();
+	}
+	old_pool.reset();
+
+	openblas_set_num_threads(std::max(1, policy.blas_threads));
+
+	if (policy.opencv_threads >= 0)
+	{
+		cv::setNumThreads(policy.opencv_threads);
+	}
+}
+
+ThreadingPolicy ThreadingPolicy::Current()
+{
+	std::lock_guard<std::mutex> lock(policy_mutex);
+	return current_policy;
+}
+
+void ThreadingPolicy::ApplyBlasThreads()
+{
+	openblas_set_num_threads(std::max(1, Current().blas_threads));
+}
+
+void LandmarkDetector::ParallelFor(const cv::Range& range, const std::function<void(const cv::Range&)>& body)
+{
+	bool nested;
+	std::shared_ptr<WorkerPool> pool = GetPool(nested);
+	pool->Run(range, body, nested);
+}
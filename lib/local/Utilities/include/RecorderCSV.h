@@ -58,14 +58,14 @@ namespace Utilities
 
 		// Opening the file and preparing the header for it
 		bool Open(std::string output_file_name, bool is_sequence, bool output_2D_landmarks, bool output_3D_landmarks, bool output_model_params, bool output_pose, bool output_AUs, bool output_gaze,
-			int num_face_landmarks, int num_model_modes, int num_eye_landmarks, const std::vector<std::string>& au_names_class, const std::vector<std::string>& au_names_reg);
+			bool output_propagated, bool output_quality_level, int num_face_landmarks, int num_model_modes, int num_eye_landmarks, const std::vector<std::string>& au_names_class, const std::vector<std::string>& au_names_reg);
 
 		bool isOpen() const { return output_file.is_open(); }
 
 		// Closing the file and cleaning up
 		void Close();
 
-		void WriteLine(int face_id, int frame_num, double time_stamp, bool landmark_detection_success, double landmark_confidence,
+		void WriteLine(int face_id, int frame_num, double time_stamp, bool landmark_detection_success, double landmark_confidence, bool landmarks_propagated, int quality_level,
 			const cv::Mat_<float>& landmarks_2D, const cv::Mat_<float>& landmarks_3D, const cv::Mat_<float>& pdm_model_params, const cv::Vec6f& rigid_shape_params, cv::Vec6f& pose_estimate,
 			const cv::Point3f& gazeDirection0, const cv::Point3f& gazeDirection1, const cv::Vec2f& gaze_angle, const std::vector<cv::Point2f>& eye_landmarks2d, const std::vector<cv::Point3f>& eye_landmarks3d,
 			const std::vector<std::pair<std::string, double> >& au_intensities, const std::vector<std::pair<std::string, double> >& au_occurences);
@@ -91,6 +91,8 @@ namespace Utilities
 		bool output_pose;
 		bool output_AUs;
 		bool output_gaze;
+		bool output_propagated;
+		bool output_quality_level;
 
 		std::vector<std::string> au_names_class;
 		std::vector<std::string> au_names_reg;
@@ -80,9 +80,12 @@ namespace Utilities
 		// If in multiple face mode, identifying which face was tracked
 		void SetObservationFaceID(int face_id);
 
-		// All observations relevant to facial landmarks
+		// All observations relevant to facial landmarks (propagated indicates that the landmarks were propagated from a previous frame rather than detected)
 		void SetObservationLandmarks(const cv::Mat_<float>& landmarks_2D, const cv::Mat_<float>& landmarks_3D,
-			const cv::Vec6f& params_global, const cv::Mat_<float>& params_local, double confidence, bool success);
+			const cv::Vec6f& params_global, const cv::Mat_<float>& params_local, double confidence, bool success, bool propagated = false);
+
+		// The quality level the frame was processed at (when adapting the processing to a deadline)
+		void SetObservationQualityLevel(int quality_level);
 
 		// Pose related observations
 		void SetObservationPose(const cv::Vec6f& pose);
@@ -153,6 +156,8 @@ namespace Utilities
 		cv::Mat_<float> pdm_params_local;
 		double landmark_detection_confidence;
 		bool landmark_detection_success;
+		bool landmarks_propagated;
+		int quality_level;
 
 		// Head pose related observations
 		cv::Vec6f head_pose;
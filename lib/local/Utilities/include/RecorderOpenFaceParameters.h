@@ -63,6 +63,8 @@ namespace Utilities
 		bool outputHOG() const { return output_hog; }
 		bool outputTracked() const { return output_tracked; }
 		bool outputAlignedFaces() const { return output_aligned_faces; }
+		bool outputPropagated() const { return output_propagated; }
+		bool outputQualityLevel() const { return output_quality_level; }
 		std::string outputCodec() const { return output_codec; }
 		std::string imageFormatAligned() const { return image_format_aligned; }
 		std::string imageFormatVisualization() const { return image_format_visualization; }
@@ -77,6 +79,8 @@ namespace Utilities
 
 		void setOutputAUs(bool output_AUs) { this->output_AUs = output_AUs; }
 		void setOutputGaze(bool output_gaze) { this->output_gaze = output_gaze; }
+		void setOutputPropagated(bool output_propagated) { this->output_propagated = output_propagated; }
+		void setOutputQualityLevel(bool output_quality_level) { this->output_quality_level = output_quality_level; }
 
 	private:
 		
@@ -95,6 +99,12 @@ namespace Utilities
 		bool output_hog;
 		bool output_tracked;
 		bool output_aligned_faces;
+
+		// If the landmarks of some frames are propagated rather than detected (keyframe tracking), flag those frames
+		bool output_propagated;
+
+		// If the quality of processing is adapted to a deadline, the quality level used for every frame
+		bool output_quality_level;
 		
 		// Should the algined faces be recorded even if the detection failed (blank images)
 		bool record_aligned_bad;
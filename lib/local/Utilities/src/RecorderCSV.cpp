@@ -46,7 +46,7 @@ struct fullstop : std::numpunct<char> {
 
 // Opening the file and preparing the header for it
 bool RecorderCSV::Open(std::string output_file_name, bool is_sequence, bool output_2D_landmarks, bool output_3D_landmarks, bool output_model_params, bool output_pose, bool output_AUs, bool output_gaze,
-	int num_face_landmarks, int num_model_modes, int num_eye_landmarks, const std::vector<std::string>& au_names_class, const std::vector<std::string>& au_names_reg)
+	bool output_propagated, bool output_quality_level, int num_face_landmarks, int num_model_modes, int num_eye_landmarks, const std::vector<std::string>& au_names_class, const std::vector<std::string>& au_names_reg)
 {
 
 	output_file.open(output_file_name, std::ios_base::out);
@@ -64,6 +64,8 @@ bool RecorderCSV::Open(std::string output_file_name, bool is_sequence, bool outp
 	this->output_gaze = output_gaze;
 	this->output_model_params = output_model_params;
 	this->output_pose = output_pose;
+	this->output_propagated = output_propagated && is_sequence;
+	this->output_quality_level = output_quality_level && is_sequence;
 
 	this->au_names_class = au_names_class;
 	this->au_names_reg = au_names_reg;
@@ -72,6 +74,18 @@ bool RecorderCSV::Open(std::string output_file_name, bool is_sequence, bool outp
 	if(this->is_sequence)
 	{
 		output_file << "frame,face_id,timestamp,confidence,success";
+
+		// Frames whose landmarks were propagated with optical flow instead of being detected
+		if (output_propagated)
+		{
+			output_file << ",propagated";
+		}
+
+		// The quality level the frame was processed at, when adapting to a deadline
+		if (output_quality_level)
+		{
+			output_file << ",quality_level";
+		}
 	}
 	else
 	{
@@ -169,7 +183,7 @@ bool RecorderCSV::Open(std::string output_file_name, bool is_sequence, bool outp
 
 }
 
-void RecorderCSV::WriteLine(int face_id, int frame_num, double time_stamp, bool landmark_detection_success, double landmark_confidence,
+void RecorderCSV::WriteLine(int face_id, int frame_num, double time_stamp, bool landmark_detection_success, double landmark_confidence, bool landmarks_propagated, int quality_level,
 	const cv::Mat_<float>& landmarks_2D, const cv::Mat_<float>& landmarks_3D, const cv::Mat_<float>& pdm_model_params, const cv::Vec6f& rigid_shape_params, cv::Vec6f& pose_estimate,
 	const cv::Point3f& gazeDirection0, const cv::Point3f& gazeDirection1, const cv::Vec2f& gaze_angle, const std::vector<cv::Point2f>& eye_landmarks2d, const std::vector<cv::Point3f>& eye_landmarks3d,
 	const std::vector<std::pair<std::string, double> >& au_intensities, const std::vector<std::pair<std::string, double> >& au_occurences)
@@ -193,6 +207,14 @@ void RecorderCSV::WriteLine(int face_id, int frame_num, double time_stamp, bool
 		output_file << "," << landmark_confidence;
 		output_file << std::setprecision(0);
 		output_file << "," << landmark_detection_success;
+		if (output_propagated)
+		{
+			output_file << "," << landmarks_propagated;
+		}
+		if (output_quality_level)
+		{
+			output_file << "," << quality_level;
+		}
 	}
 	else
 	{
@@ -195,6 +195,8 @@ void RecorderOpenFace::PrepareRecording(const std::string& in_filename)
 	}
 
 	this->frame_number = 0;
+	this->landmarks_propagated = false;
+	this->quality_level = 0;
 	this->tracked_writing_thread_started = false;
 	this->aligned_writing_thread_started = false;
 }
@@ -332,11 +334,11 @@ void RecorderOpenFace::WriteObservation()
 
 		csv_filename = (fs::path(record_root) / csv_filename).string();
 		csv_recorder.Open(csv_filename, params.isSequence(), params.output2DLandmarks(), params.output3DLandmarks(), params.outputPDMParams(), params.outputPose(),
-			params.outputAUs(), params.outputGaze(), num_face_landmarks, num_model_modes, num_eye_landmarks, au_names_class, au_names_reg);
+			params.outputAUs(), params.outputGaze(), params.outputPropagated(), params.outputQualityLevel(), num_face_landmarks, num_model_modes, num_eye_landmarks, au_names_class, au_names_reg);
 	}
 
 	this->csv_recorder.WriteLine(face_id, frame_number, timestamp, landmark_detection_success, 
-		landmark_detection_confidence, landmarks_2D, landmarks_3D, pdm_params_local, pdm_params_global, head_pose,
+		landmark_detection_confidence, landmarks_propagated, quality_level, landmarks_2D, landmarks_3D, pdm_params_local, pdm_params_global, head_pose,
 		gaze_direction0, gaze_direction1, gaze_angle, eye_landmarks2D, eye_landmarks3D, au_intensities, au_occurences);
 
 	if(params.outputHOG())
@@ -461,7 +463,7 @@ void RecorderOpenFace::SetObservationFaceID(int face_id)
 
 
 void RecorderOpenFace::SetObservationLandmarks(const cv::Mat_<float>& landmarks_2D, const cv::Mat_<float>& landmarks_3D,
-	const cv::Vec6f& pdm_params_global, const cv::Mat_<float>& pdm_params_local, double confidence, bool success)
+	const cv::Vec6f& pdm_params_global, const cv::Mat_<float>& pdm_params_local, double confidence, bool success, bool propagated)
 {
 	this->landmarks_2D = landmarks_2D;
 	this->landmarks_3D = landmarks_3D;
@@ -469,9 +471,15 @@ void RecorderOpenFace::SetObservationLandmarks(const cv::Mat_<float>& landmarks_
 	this->pdm_params_local = pdm_params_local;
 	this->landmark_detection_confidence = confidence;
 	this->landmark_detection_success = success;
+	this->landmarks_propagated = propagated;
 
 }
 
+void RecorderOpenFace::SetObservationQualityLevel(int quality_level)
+{
+	this->quality_level = quality_level;
+}
+
 void RecorderOpenFace::SetObservationPose(const cv::Vec6f& pose)
 {
 	this->head_pose = pose;
@@ -71,6 +71,8 @@ RecorderOpenFaceParameters::RecorderOpenFaceParameters(std::vector<std::string>
 	this->output_hog = false;
 	this->output_tracked = false;
 	this->output_aligned_faces = false;
+	this->output_propagated = false;
+	this->output_quality_level = false;
 
 	this->record_aligned_bad = true;
 
@@ -188,4 +190,6 @@ RecorderOpenFaceParameters::RecorderOpenFaceParameters(bool sequence, bool is_fr
 	this->output_hog = output_hog;
 	this->output_tracked = output_tracked;
 	this->output_aligned_faces = output_aligned_faces;
+	this->output_propagated = false;
+	this->output_quality_level = false;
 }
\ No newline at end of file
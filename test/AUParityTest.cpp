@@ -0,0 +1,155 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+// AUParityTest.cpp : Compares the AUs of the stacked float model with those of the original double precision regressors and classifiers
+//
+// Landmarks are fitted on every image (-f, can be repeated), and the HOG and geometry descriptors of the face are computed by a static
+// analyser (static models only) and by a dynamic one the images are added to as a sequence (so the running median is in use). On the same
+// stored descriptors both the stacked model and the reference models are applied, the intensities have to agree to within a tolerance
+// and none of the presences may differ
+
+#include "TestUtils.h"
+
+#include <FaceAnalyser.h>
+#include <FaceAnalyserParameters.h>
+
+// System includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The largest absolute difference allowed between the float and the double AU intensities (before clipping them to 0-5)
+static const double INTENSITY_TOLERANCE = 1e-3;
+
+// Comparing the outputs of both paths of an analyser on its currently stored descriptors, false if they do not correspond
+static bool CompareAUPaths(FaceAnalysis::FaceAnalyser& face_analyser, double& max_difference, int& num_flips, int& num_compared)
+{
+	std::vector<std::pair<std::string, double>> float_reg, float_class;
+	std::vector<std::pair<std::string, double>> double_reg, double_class;
+	face_analyser.PredictCurrentAUs(float_reg, float_class);
+	face_analyser.PredictCurrentAUsReference(double_reg, double_class);
+
+	if (float_reg.size() != double_reg.size() || float_class.size() != double_class.size())
+	{
+		std::cout << "ERROR: " << float_reg.size() << " and " << float_class.size() << " float AUs against " << double_reg.size() << " and "
+			<< double_class.size() << " double ones" << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < float_reg.size(); ++i)
+	{
+		if (float_reg[i].first != double_reg[i].first)
+		{
+			std::cout << "ERROR: AU intensity " << float_reg[i].first << " in place of " << double_reg[i].first << std::endl;
+			return false;
+		}
+		max_difference = std::max(max_difference, std::abs(float_reg[i].second - double_reg[i].second));
+	}
+
+	for (size_t i = 0; i < float_class.size(); ++i)
+	{
+		if (float_class[i].first != double_class[i].first)
+		{
+			std::cout << "ERROR: AU presence " << float_class[i].first << " in place of " << double_class[i].first << std::endl;
+			return false;
+		}
+		if (float_class[i].second != double_class[i].second)
+		{
+			std::cout << "AU presence " << float_class[i].first << " differs: float " << float_class[i].second << ", double " << double_class[i].second << std::endl;
+			num_flips++;
+		}
+	}
+
+	num_compared += (int)(float_reg.size() + float_class.size());
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> arguments = TestUtils::GetArguments(argc, argv);
+	std::vector<std::string> image_files = TestUtils::GetImageFiles(arguments);
+	TestUtils::SetDefaultModel(arguments, "model/main_clnf_general.txt");
+
+	// The AU models, the static analyser as used for images and the dynamic one as used for videos
+	FaceAnalysis::FaceAnalyserParameters static_parameters(arguments);
+	static_parameters.OptimizeForImages();
+	FaceAnalysis::FaceAnalyser static_analyser(static_parameters);
+
+	FaceAnalysis::FaceAnalyserParameters dynamic_parameters(arguments);
+	FaceAnalysis::FaceAnalyser dynamic_analyser(dynamic_parameters);
+
+	if (static_analyser.GetAURegNames().empty() || dynamic_analyser.GetAURegNames().empty())
+	{
+		std::cout << "No Action Unit models found, skipping" << std::endl;
+		return TestUtils::SKIP_CODE;
+	}
+
+	LandmarkDetector::FaceModelParameters det_parameters(arguments);
+	LandmarkDetector::CLNF face_model(det_parameters.model_location);
+	if (!face_model.loaded_successfully)
+	{
+		std::cout << "ERROR: Could not load the landmark detector" << std::endl;
+		return 1;
+	}
+
+	double max_difference = 0;
+	int num_flips = 0;
+	int num_compared = 0;
+	int frame_number = 0;
+
+	int num_faces = TestUtils::ForEachFace(image_files, [&](const std::string&, LandmarkDetector::FrameContext& frame, const cv::Rect_<float>& face_box)
+	{
+		bool success = LandmarkDetector::DetectLandmarksInImage(frame, face_box, face_model, det_parameters);
+
+		static_analyser.PredictStaticAUsAndComputeFeatures(frame, face_model.detected_landmarks);
+		dynamic_analyser.AddNextFrame(frame, face_model.detected_landmarks, success, (double)frame_number++, false);
+
+		return CompareAUPaths(static_analyser, max_difference, num_flips, num_compared) && CompareAUPaths(dynamic_analyser, max_difference, num_flips, num_compared);
+	});
+
+	if (num_faces < 0)
+	{
+		return TestUtils::Report(false);
+	}
+	if (num_faces == 0 || num_compared == 0)
+	{
+		std::cout << "ERROR: No faces to compare on" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Over " << num_faces << " faces (" << num_compared << " AU outputs): largest intensity difference " << max_difference
+		<< " (tolerance " << INTENSITY_TOLERANCE << "), differing presences " << num_flips << std::endl;
+	return TestUtils::Report(max_difference <= INTENSITY_TOLERANCE && num_flips == 0);
+}
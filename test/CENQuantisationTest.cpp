@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+// CENQuantisationTest.cpp : Compares the landmarks of the INT8 quantised CEN patch experts with the float ones
+//
+// Every image (-f, can be repeated, or -flist with one image per line) is fitted by the float model and by a quantised copy of it,
+// both started from the same face detection. The difference is reported normalised by the inter-ocular distance (outer eye corners),
+// and if a 300-W style .pts file sits next to an image the errors of both models against that ground truth are reported as well
+
+#include "TestUtils.h"
+
+// System includes
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The mean landmark difference between the quantised and the float fit, and the mean increase in the error against
+// the ground truth, allowed as a fraction of the inter-ocular distance
+static const double DIFFERENCE_TOLERANCE = 0.02;
+static const double ERROR_INCREASE_TOLERANCE = 0.005;
+
+// Reading the landmarks of a 300-W style .pts file into the detected_landmarks layout (all x followed by all y)
+static bool ReadPts(const std::string& location, cv::Mat_<float>& landmarks)
+{
+	std::ifstream pts_file(location);
+	if (!pts_file.is_open())
+	{
+		return false;
+	}
+
+	std::vector<float> xs, ys;
+	std::string line;
+	bool in_points = false;
+	while (std::getline(pts_file, line))
+	{
+		if (line.find('{') != std::string::npos)
+		{
+			in_points = true;
+		}
+		else if (line.find('}') != std::string::npos)
+		{
+			break;
+		}
+		else if (in_points)
+		{
+			std::stringstream data(line);
+			float x, y;
+			if (data >> x >> y)
+			{
+				// The .pts files are 1 based
+				xs.push_back(x - 1.0f);
+				ys.push_back(y - 1.0f);
+			}
+		}
+	}
+
+	landmarks.create((int)xs.size() * 2, 1);
+	for (size_t i = 0; i < xs.size(); ++i)
+	{
+		landmarks((int)i) = xs[i];
+		landmarks((int)(i + xs.size())) = ys[i];
+	}
+	return !xs.empty();
+}
+
+// The normalising distance of a shape, the inter-ocular one for 68 landmarks and the size of the bounding box otherwise
+static double NormalisingDistance(const cv::Mat_<float>& landmarks)
+{
+	int n = landmarks.rows / 2;
+	if (n == 68)
+	{
+		return std::sqrt(std::pow(landmarks(36) - landmarks(45), 2) + std::pow(landmarks(36 + n) - landmarks(45 + n), 2));
+	}
+
+	double min_x, max_x, min_y, max_y;
+	cv::minMaxLoc(landmarks(cv::Rect(0, 0, 1, n)), &min_x, &max_x);
+	cv::minMaxLoc(landmarks(cv::Rect(0, n, 1, n)), &min_y, &max_y);
+	return std::sqrt((max_x - min_x) * (max_y - min_y));
+}
+
+// The mean distance between the corresponding landmarks of two shapes
+static double MeanLandmarkDistance(const cv::Mat_<float>& landmarks_a, const cv::Mat_<float>& landmarks_b)
+{
+	int n = landmarks_a.rows / 2;
+	double sum = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		sum += std::sqrt(std::pow(landmarks_a(i) - landmarks_b(i), 2) + std::pow(landmarks_a(i + n) - landmarks_b(i + n), 2));
+	}
+	return sum / n;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> arguments = TestUtils::GetArguments(argc, argv);
+	std::vector<std::string> image_files = TestUtils::GetImageFiles(arguments);
+	TestUtils::SetDefaultModel(arguments, "model/main_ceclm_general.txt");
+
+	LandmarkDetector::FaceModelParameters det_parameters(arguments);
+
+	// Two separately loaded copies of the model, one of which is quantised
+	LandmarkDetector::CLNF float_model(det_parameters.model_location);
+	LandmarkDetector::CLNF quantised_model(det_parameters.model_location);
+	if (!float_model.loaded_successfully || !quantised_model.loaded_successfully || float_model.model->patch_experts.cen_expert_intensity.empty())
+	{
+		std::cout << "No CEN landmark detection model found at " << det_parameters.model_location << " (see download_models), skipping" << std::endl;
+		return TestUtils::SKIP_CODE;
+	}
+	quantised_model.model->QuantisePatchExperts();
+
+	int num_ground_truth = 0;
+	double difference_sum = 0;
+	double float_error_sum = 0;
+	double quantised_error_sum = 0;
+
+	int num_compared = TestUtils::ForEachFace(image_files, [&](const std::string& image_file, LandmarkDetector::FrameContext& frame, const cv::Rect_<float>& face_box)
+	{
+		cv::Mat_<float> ground_truth;
+		bool has_ground_truth = ReadPts(image_file.substr(0, image_file.find_last_of('.')) + ".pts", ground_truth);
+
+		LandmarkDetector::DetectLandmarksInImage(frame, face_box, float_model, det_parameters);
+		LandmarkDetector::DetectLandmarksInImage(frame, face_box, quantised_model, det_parameters);
+
+		const cv::Mat_<float>& reference = has_ground_truth ? ground_truth : float_model.detected_landmarks;
+		double normalisation = NormalisingDistance(reference);
+
+		double difference = MeanLandmarkDistance(float_model.detected_landmarks, quantised_model.detected_landmarks) / normalisation;
+		difference_sum += difference;
+
+		std::cout << image_file << ": quantised vs float " << difference;
+
+		if (has_ground_truth && ground_truth.rows == float_model.detected_landmarks.rows)
+		{
+			double float_error = MeanLandmarkDistance(float_model.detected_landmarks, ground_truth) / normalisation;
+			double quantised_error = MeanLandmarkDistance(quantised_model.detected_landmarks, ground_truth) / normalisation;
+			float_error_sum += float_error;
+			quantised_error_sum += quantised_error;
+			num_ground_truth++;
+
+			std::cout << ", error float " << float_error << " quantised " << quantised_error;
+		}
+		std::cout << std::endl;
+		return true;
+	});
+
+	if (num_compared < 0)
+	{
+		return TestUtils::Report(false);
+	}
+	if (num_compared == 0)
+	{
+		std::cout << "ERROR: No faces to compare on" << std::endl;
+		return 1;
+	}
+
+	bool passed = true;
+
+	double mean_difference = difference_sum / num_compared;
+	std::cout << "Mean normalised difference of the quantised landmarks over " << num_compared << " faces: " << mean_difference
+		<< " (tolerance " << DIFFERENCE_TOLERANCE << ")" << std::endl;
+	passed &= mean_difference <= DIFFERENCE_TOLERANCE;
+
+	if (num_ground_truth > 0)
+	{
+		double mean_float_error = float_error_sum / num_ground_truth;
+		double mean_quantised_error = quantised_error_sum / num_ground_truth;
+		std::cout << "Mean normalised error over " << num_ground_truth << " annotated faces: float " << mean_float_error
+			<< ", quantised " << mean_quantised_error << " (tolerance on the increase " << ERROR_INCREASE_TOLERANCE << ")" << std::endl;
+		passed &= mean_quantised_error - mean_float_error <= ERROR_INCREASE_TOLERANCE;
+	}
+
+	return TestUtils::Report(passed);
+}
@@ -0,0 +1,241 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+// ConvolutionTest.cpp : Checks the direct (im2col + BLAS), fused PReLU, Winograd and FFT convolutions against a naive reference
+
+#include "CNN_utils.h"
+#include "TestUtils.h"
+
+// System includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace LandmarkDetector;
+
+// The maximum absolute error allowed, the inputs and weights are in [-1, 1] and the sums have at most a few hundred terms
+static const double CONVOLUTION_TOLERANCE = 1e-4;
+
+static float RandomWeight()
+{
+	return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+// A randomly filled layer, the kernels are indexed kernel -> input map as in the loaded models
+struct TestLayer
+{
+	std::vector<std::vector<cv::Mat_<float> > > kernels;
+	std::vector<float> biases;
+	cv::Mat_<float> prelu_weights;
+};
+
+static TestLayer RandomLayer(int num_in_maps, int num_kernels, int height_k, int width_k)
+{
+	TestLayer layer;
+	layer.kernels.resize(num_kernels);
+	layer.prelu_weights.create(num_kernels, 1);
+	for (int k = 0; k < num_kernels; ++k)
+	{
+		for (int in = 0; in < num_in_maps; ++in)
+		{
+			cv::Mat_<float> kernel(height_k, width_k);
+			for (float& weight : kernel)
+			{
+				weight = RandomWeight();
+			}
+			layer.kernels[k].push_back(kernel);
+		}
+		layer.biases.push_back(RandomWeight());
+		layer.prelu_weights(k) = 0.5f * (RandomWeight() + 1.0f);
+	}
+	return layer;
+}
+
+// The weight matrix of the direct convolution, built the same way as when reading the MTCNN models (flattened kernels and a bias row)
+static cv::Mat_<float> DirectWeights(const TestLayer& layer)
+{
+	int num_kernels = (int)layer.kernels.size();
+	int num_in_maps = (int)layer.kernels[0].size();
+	int kernel_size = layer.kernels[0][0].rows * layer.kernels[0][0].cols;
+
+	cv::Mat_<float> W(num_in_maps * kernel_size + 1, num_kernels);
+	for (int k = 0; k < num_kernels; ++k)
+	{
+		for (int in = 0; in < num_in_maps; ++in)
+		{
+			cv::Mat_<float> k_flat = layer.kernels[k][in].t();
+			k_flat.reshape(0, kernel_size).copyTo(W(cv::Rect(k, in * kernel_size, 1, kernel_size)));
+		}
+		W(num_in_maps * kernel_size, k) = layer.biases[k];
+	}
+	return W;
+}
+
+// The valid cross-correlation of every image with the kernels summed over the input maps, plus the bias and optionally the PReLU, in double precision
+static std::vector<double> NaiveConvolution(const CNN_tensor& input, const TestLayer& layer, bool prelu)
+{
+	int num_kernels = (int)layer.kernels.size();
+	int height_k = layer.kernels[0][0].rows;
+	int width_k = layer.kernels[0][0].cols;
+	int out_h = input.h - height_k + 1;
+	int out_w = input.w - width_k + 1;
+
+	std::vector<double> output((size_t)input.n * num_kernels * out_h * out_w);
+	size_t idx = 0;
+	for (int b = 0; b < input.n; ++b)
+	{
+		for (int k = 0; k < num_kernels; ++k)
+		{
+			for (int y = 0; y < out_h; ++y)
+			{
+				for (int x = 0; x < out_w; ++x)
+				{
+					double sum = layer.biases[k];
+					for (int in = 0; in < input.c; ++in)
+					{
+						const float* in_map = input.Plane(b, in);
+						const cv::Mat_<float>& kernel = layer.kernels[k][in];
+						for (int yy = 0; yy < height_k; ++yy)
+						{
+							for (int xx = 0; xx < width_k; ++xx)
+							{
+								sum += (double)kernel(yy, xx) * in_map[(y + yy) * input.w + x + xx];
+							}
+						}
+					}
+					if (prelu && sum < 0)
+					{
+						sum *= layer.prelu_weights(k);
+					}
+					output[idx++] = sum;
+				}
+			}
+		}
+	}
+	return output;
+}
+
+static double MaxError(const CNN_tensor& output, const std::vector<double>& reference, int out_h, int out_w)
+{
+	if (output.h != out_h || output.w != out_w || output.Size() != reference.size())
+	{
+		return HUGE_VAL;
+	}
+
+	double max_error = 0;
+	for (size_t i = 0; i < reference.size(); ++i)
+	{
+		max_error = std::max(max_error, std::abs((double)output.data[i] - reference[i]));
+	}
+	return max_error;
+}
+
+// Runs every convolution applicable to the kernel size on a random input, the layers share an arena as during inference
+static bool CheckShape(int n, int c, int h, int w, int num_kernels, int height_k, int width_k, CNN_arena& arena, CNN_dft_cache& dft_cache)
+{
+	std::cout << "Input " << n << "x" << c << "x" << h << "x" << w << ", " << num_kernels << " kernels of " << height_k << "x" << width_k << std::endl;
+
+	TestLayer layer = RandomLayer(c, num_kernels, height_k, width_k);
+	cv::Mat_<float> weights = DirectWeights(layer);
+
+	// The input is kept outside the arena, as the arena buffers are reused by every convolution
+	std::vector<float> input_data((size_t)n * c * h * w);
+	for (float& value : input_data)
+	{
+		value = RandomWeight();
+	}
+	CNN_tensor input(n, c, h, w, input_data.data());
+
+	int out_h = h - height_k + 1;
+	int out_w = w - width_k + 1;
+	std::vector<double> reference = NaiveConvolution(input, layer, false);
+	std::vector<double> reference_prelu = NaiveConvolution(input, layer, true);
+
+	bool passed = true;
+	CNN_tensor output;
+
+	convolution_direct_blas(output, input, weights, height_k, width_k, arena);
+	passed &= TestUtils::CheckTolerance("direct", MaxError(output, reference, out_h, out_w), CONVOLUTION_TOLERANCE);
+
+	convolution_direct_blas(output, input, weights, height_k, width_k, arena, layer.prelu_weights);
+	passed &= TestUtils::CheckTolerance("direct with fused PReLU", MaxError(output, reference_prelu, out_h, out_w), CONVOLUTION_TOLERANCE);
+
+	convolution_direct_blas(output, input, weights, height_k, width_k, arena);
+	PReLU(output, layer.prelu_weights);
+	passed &= TestUtils::CheckTolerance("direct followed by PReLU", MaxError(output, reference_prelu, out_h, out_w), CONVOLUTION_TOLERANCE);
+
+	convolution_fft2(output, input, layer.kernels, layer.biases, dft_cache, 0, arena);
+	passed &= TestUtils::CheckTolerance("FFT", MaxError(output, reference, out_h, out_w), CONVOLUTION_TOLERANCE);
+
+	if (height_k == 3 && width_k == 3)
+	{
+		cv::Mat_<float> kernels_winograd;
+		winograd_kernels(kernels_winograd, layer.kernels);
+
+		convolution_winograd(output, input, kernels_winograd, layer.biases, arena);
+		passed &= TestUtils::CheckTolerance("Winograd", MaxError(output, reference, out_h, out_w), CONVOLUTION_TOLERANCE);
+
+		convolution_winograd(output, input, kernels_winograd, layer.biases, arena, layer.prelu_weights);
+		passed &= TestUtils::CheckTolerance("Winograd with fused PReLU", MaxError(output, reference_prelu, out_h, out_w), CONVOLUTION_TOLERANCE);
+	}
+
+	// The FFT kernels are cached by layer and size, a new layer must not pick up the ones of the previous shape
+	dft_cache.Clear();
+
+	return passed;
+}
+
+int main()
+{
+	srand(42);
+
+	CNN_arena arena;
+	CNN_dft_cache dft_cache;
+
+	bool passed = true;
+
+	// Winograd on even and odd output sizes (the latter with partial tiles), a batch, and the minimal input of a single output
+	passed &= CheckShape(1, 3, 12, 12, 10, 3, 3, arena, dft_cache);
+	passed &= CheckShape(3, 10, 11, 9, 16, 3, 3, arena, dft_cache);
+	passed &= CheckShape(2, 4, 3, 3, 5, 3, 3, arena, dft_cache);
+	passed &= CheckShape(1, 1, 4, 7, 1, 3, 3, arena, dft_cache);
+
+	// Kernel sizes of the other MTCNN layers, including non square ones
+	passed &= CheckShape(2, 32, 5, 5, 8, 2, 2, arena, dft_cache);
+	passed &= CheckShape(4, 16, 9, 7, 12, 4, 3, arena, dft_cache);
+	passed &= CheckShape(2, 8, 6, 6, 4, 1, 1, arena, dft_cache);
+
+	return TestUtils::Report(passed);
+}
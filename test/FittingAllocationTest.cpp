@@ -0,0 +1,268 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+// FittingAllocationTest.cpp : Checks that the landmark fitting reuses its workspace instead of allocating memory in every iteration
+//
+// The allocations are counted by replacing malloc and its relatives (operator new goes through malloc), which needs glibc.
+// OpenCV allocates internally when warping the areas of interest, so the fitting can not be entirely allocation free.
+// Instead the test checks that the optimisation iterations do not allocate (a fit with more iterations allocates exactly
+// as much as one with fewer) and that the patch expert responses are computed into the memory of the previous call.
+
+#include "TestUtils.h"
+#include "ThreadingPolicy.h"
+
+// System includes
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+
+#include <malloc.h>
+
+extern "C"
+{
+	void* __libc_malloc(size_t size);
+	void* __libc_calloc(size_t count, size_t size);
+	void* __libc_realloc(void* ptr, size_t size);
+	void* __libc_memalign(size_t alignment, size_t size);
+}
+
+static std::atomic<bool> counting(false);
+static std::atomic<long> allocation_count(0);
+
+static inline void CountAllocation()
+{
+	if (counting.load(std::memory_order_relaxed))
+	{
+		allocation_count.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+extern "C"
+{
+	void* malloc(size_t size)
+	{
+		CountAllocation();
+		return __libc_malloc(size);
+	}
+
+	void* calloc(size_t count, size_t size)
+	{
+		CountAllocation();
+		return __libc_calloc(count, size);
+	}
+
+	void* realloc(void* ptr, size_t size)
+	{
+		CountAllocation();
+		return __libc_realloc(ptr, size);
+	}
+
+	void* memalign(size_t alignment, size_t size)
+	{
+		CountAllocation();
+		return __libc_memalign(alignment, size);
+	}
+
+	void* aligned_alloc(size_t alignment, size_t size)
+	{
+		CountAllocation();
+		return __libc_memalign(alignment, size);
+	}
+
+	int posix_memalign(void** ptr, size_t alignment, size_t size)
+	{
+		CountAllocation();
+		void* memory = __libc_memalign(alignment, size);
+		if (memory == nullptr)
+		{
+			return ENOMEM;
+		}
+		*ptr = memory;
+		return 0;
+	}
+}
+
+// The number of allocations made by a fit from the given starting point
+static long CountFittingAllocations(LandmarkDetector::CLNF& face_model, LandmarkDetector::FrameContext& frame, LandmarkDetector::FaceModelParameters& det_parameters,
+	const cv::Vec6f& start_global, const cv::Mat_<float>& start_local, int num_iterations, int& iterations_used)
+{
+	det_parameters.num_optimisation_iteration = num_iterations;
+	face_model.params_global = start_global;
+	start_local.copyTo(face_model.params_local);
+
+	allocation_count = 0;
+	counting = true;
+	face_model.DetectLandmarks(frame, det_parameters);
+	counting = false;
+
+	iterations_used = face_model.iterations_used;
+	return allocation_count;
+}
+
+// Whether the optimisation iterations and the patch expert responses of a fit reuse their memory, starting from the fit on a face
+// (the parameters are a copy, as they are changed to run every iteration)
+static bool CheckFittingAllocations(LandmarkDetector::CLNF& face_model, LandmarkDetector::FrameContext& frame, LandmarkDetector::FaceModelParameters det_parameters)
+{
+	// Every iteration and scale is run, and only the fitting itself is measured
+	det_parameters.validate_detections = false;
+	det_parameters.refine_hierarchical = false;
+	det_parameters.convergence_landmark_threshold = 0;
+	det_parameters.scale_convergence_threshold = 0;
+	det_parameters.window_sizes_current = det_parameters.window_sizes_init;
+
+	cv::Vec6f start_global = face_model.params_global;
+	cv::Mat_<float> start_local = face_model.params_local.clone();
+
+	const int few_iterations = 2;
+	const int many_iterations = 6;
+	int iterations_few = 0;
+	int iterations_many = 0;
+
+	// The first fits size the workspace and any caches
+	CountFittingAllocations(face_model, frame, det_parameters, start_global, start_local, few_iterations, iterations_few);
+	CountFittingAllocations(face_model, frame, det_parameters, start_global, start_local, many_iterations, iterations_many);
+
+	long allocations_few = CountFittingAllocations(face_model, frame, det_parameters, start_global, start_local, few_iterations, iterations_few);
+	long allocations_many = CountFittingAllocations(face_model, frame, det_parameters, start_global, start_local, many_iterations, iterations_many);
+	long allocations_repeat = CountFittingAllocations(face_model, frame, det_parameters, start_global, start_local, many_iterations, iterations_many);
+
+	std::cout << "Fit with " << iterations_few << " iterations: " << allocations_few << " allocations" << std::endl;
+	std::cout << "Fit with " << iterations_many << " iterations: " << allocations_many << " allocations (" << allocations_repeat << " when repeated)" << std::endl;
+
+	bool passed = true;
+	if (iterations_many <= iterations_few)
+	{
+		std::cout << "FAILED: the longer fit did not run more iterations" << std::endl;
+		passed = false;
+	}
+	if (allocations_many != allocations_few || allocations_repeat != allocations_many)
+	{
+		std::cout << "FAILED: the optimisation iterations allocate memory" << std::endl;
+		passed = false;
+	}
+
+	// The response maps of a second call should be computed into the memory of the first one
+	int n = face_model.model->pdm.NumberOfPoints();
+	int window_size = det_parameters.window_sizes_init[0];
+	std::vector<cv::Mat_<float> > responses(n);
+	std::vector<std::map<int, cv::Mat_<float> > > preallocated_im2col;
+	cv::Matx22f sim_ref_to_img, sim_img_to_ref;
+
+	face_model.model->patch_experts.Response(responses, sim_ref_to_img, sim_img_to_ref, frame.GrayscaleFloat(), face_model.model->pdm, face_model.params_global,
+		face_model.params_local, window_size, 0, preallocated_im2col);
+
+	std::vector<const float*> response_memory;
+	for (int i = 0; i < n; ++i)
+	{
+		response_memory.push_back(responses[i].empty() ? nullptr : responses[i].ptr<float>());
+	}
+
+	face_model.model->patch_experts.Response(responses, sim_ref_to_img, sim_img_to_ref, frame.GrayscaleFloat(), face_model.model->pdm, face_model.params_global,
+		face_model.params_local, window_size, 0, preallocated_im2col);
+
+	int reused = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		if (response_memory[i] != nullptr)
+		{
+			if (responses[i].ptr<float>() != response_memory[i])
+			{
+				std::cout << "FAILED: the response map of landmark " << i << " was reallocated" << std::endl;
+				passed = false;
+			}
+			reused++;
+		}
+	}
+	std::cout << "Response maps checked for reuse: " << reused << std::endl;
+	if (reused == 0)
+	{
+		std::cout << "FAILED: no response maps were computed" << std::endl;
+		passed = false;
+	}
+
+	return passed;
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+#if !defined(__GLIBC__)
+	std::cout << "Counting the allocations needs glibc, skipping" << std::endl;
+	return TestUtils::SKIP_CODE;
+#else
+	// The image to fit on (-f) and the landmark detection model (-mloc), the CLNF model by default as it is distributed with the code
+	std::vector<std::string> arguments = TestUtils::GetArguments(argc, argv);
+	std::vector<std::string> image_files = TestUtils::GetImageFiles(arguments);
+	TestUtils::SetDefaultModel(arguments, "model/main_clnf_general.txt");
+
+	// Serial loops, so that the allocations do not depend on how the work is scheduled
+	LandmarkDetector::ThreadingPolicy threading;
+	threading.num_threads = 1;
+	threading.opencv_threads = 1;
+	LandmarkDetector::ThreadingPolicy::Apply(threading);
+
+	LandmarkDetector::FaceModelParameters det_parameters(arguments);
+
+	LandmarkDetector::CLNF face_model(det_parameters.model_location);
+	if (!face_model.loaded_successfully)
+	{
+		std::cout << "ERROR: Could not load the landmark detector" << std::endl;
+		return 1;
+	}
+
+	bool passed = true;
+	int num_faces = TestUtils::ForEachFace(image_files, [&](const std::string&, LandmarkDetector::FrameContext& frame, const cv::Rect_<float>& face_box)
+	{
+		if (!LandmarkDetector::DetectLandmarksInImage(frame, face_box, face_model, det_parameters))
+		{
+			std::cout << "ERROR: The landmark detection failed" << std::endl;
+			return false;
+		}
+		passed &= CheckFittingAllocations(face_model, frame, det_parameters);
+		return true;
+	});
+
+	if (num_faces == 0)
+	{
+		std::cout << "ERROR: No face to fit on" << std::endl;
+	}
+	return TestUtils::Report(passed && num_faces > 0);
+#endif
+}
@@ -0,0 +1,222 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+// SimdActivationsTest.cpp : Checks the activation kernels of the instruction set selected through OPENFACE_SIMD against std::exp references,
+// and its INT8 matrix multiplication against exact integer products
+
+#include "SimdDispatch.h"
+#include "TestUtils.h"
+
+// System includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace LandmarkDetector;
+
+// The maximum absolute errors allowed, as documented in SimdDispatch.h
+static const double SIGMOID_TOLERANCE = 1e-6;
+static const double TANH_TOLERANCE = 1e-6;
+static const double SOFTMAX_TOLERANCE = 1e-6;
+
+// Inputs covering the saturated ends, zero and everything in between, with a length that is not a multiple of any vector width
+static std::vector<float> TestInputs(float range)
+{
+	std::vector<float> inputs;
+	const int steps = 4001;
+	for (int i = 0; i < steps; ++i)
+	{
+		inputs.push_back(-range + 2.0f * range * i / (steps - 1));
+	}
+	inputs.push_back(0.0f);
+	inputs.push_back(1e-8f);
+	inputs.push_back(-1e-8f);
+	inputs.push_back(200.0f);
+	inputs.push_back(-200.0f);
+	return inputs;
+}
+
+static double SigmoidReference(double x)
+{
+	return 1.0 / (1.0 + std::exp(-x));
+}
+
+static double TanhReference(double x)
+{
+	return 2.0 / (1.0 + std::exp(-2.0 * x)) - 1.0;
+}
+
+// Runs a kernel over all the lengths up to 67 and all the offsets within a cache line, so every head and tail path is exercised,
+// returning the maximum absolute error against the reference
+template<typename Kernel, typename Reference>
+static double MaxElementwiseError(const std::vector<float>& inputs, Kernel kernel, Reference reference)
+{
+	double max_error = 0;
+	std::vector<float> buffer(inputs.size() + 16);
+	for (size_t offset = 0; offset < 16; ++offset)
+	{
+		size_t lengths[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 67, inputs.size() };
+		for (size_t length : lengths)
+		{
+			float* data = buffer.data() + offset;
+			std::copy(inputs.begin(), inputs.begin() + length, data);
+			kernel(data, length);
+			for (size_t i = 0; i < length; ++i)
+			{
+				max_error = std::max(max_error, std::abs((double)data[i] - reference((double)inputs[i])));
+			}
+		}
+	}
+	return max_error;
+}
+
+static double MaxSoftmaxError(const SimdKernels& kernels)
+{
+	double max_error = 0;
+	srand(42);
+	std::vector<float> buffer(300);
+	std::vector<double> reference(buffer.size());
+	for (size_t offset = 0; offset < 16; ++offset)
+	{
+		size_t lengths[] = { 1, 2, 3, 7, 8, 9, 15, 16, 17, 33, 67, 284 };
+		for (size_t length : lengths)
+		{
+			// Both a moderate and a wide spread of the logits, the latter having most of the outputs underflow
+			for (float spread : { 4.0f, 60.0f })
+			{
+				float* data = buffer.data() + offset;
+				for (size_t i = 0; i < length; ++i)
+				{
+					data[i] = spread * (2.0f * rand() / RAND_MAX - 1.0f);
+				}
+
+				double max_val = *std::max_element(data, data + length);
+				double sum = 0;
+				for (size_t i = 0; i < length; ++i)
+				{
+					reference[i] = std::exp(data[i] - max_val);
+					sum += reference[i];
+				}
+
+				kernels.softmax(data, length);
+				for (size_t i = 0; i < length; ++i)
+				{
+					max_error = std::max(max_error, std::abs((double)data[i] - reference[i] / sum));
+				}
+			}
+		}
+	}
+	return max_error;
+}
+
+// The integer products are exact, so they have to match a plain loop on every block size and remainder (including the -128 extreme)
+static double MaxGemmInt8Error(const SimdKernels& kernels)
+{
+	double max_error = 0;
+	srand(7);
+	int shapes[][3] = { { 1, 1, 1 }, { 4, 2, 16 }, { 5, 3, 17 }, { 9, 7, 121 }, { 64, 200, 121 }, { 64, 1, 100 }, { 3, 5, 15 } };
+	for (const auto& shape : shapes)
+	{
+		int num_a = shape[0], num_b = shape[1], length = shape[2];
+		std::vector<signed char> a((size_t)num_a * length), b((size_t)num_b * length);
+		for (signed char& value : a)
+		{
+			value = (signed char)(rand() % 256 - 128);
+		}
+		for (signed char& value : b)
+		{
+			value = (signed char)(rand() % 256 - 128);
+		}
+
+		std::vector<int> c((size_t)num_a * num_b);
+		kernels.gemm_int8(a.data(), num_a, b.data(), num_b, length, c.data());
+
+		for (int i = 0; i < num_a; ++i)
+		{
+			for (int j = 0; j < num_b; ++j)
+			{
+				int reference = 0;
+				for (int k = 0; k < length; ++k)
+				{
+					reference += (int)a[(size_t)i * length + k] * (int)b[(size_t)j * length + k];
+				}
+				max_error = std::max(max_error, std::abs((double)c[(size_t)i * num_b + j] - reference));
+			}
+		}
+	}
+	return max_error;
+}
+
+int main(int argc, char** argv)
+{
+	// The level asked for, the kernels fall back to the detected one if it is not supported
+	SimdLevel requested = GetSimdLevel();
+	const char* env = getenv("OPENFACE_SIMD");
+	if (env != nullptr)
+	{
+		for (int level = SIMD_SCALAR; level <= SIMD_AVX512; ++level)
+		{
+			if (strcmp(env, SimdLevelName((SimdLevel)level)) == 0)
+			{
+				requested = (SimdLevel)level;
+			}
+		}
+	}
+
+	std::cout << SimdDiagnostics() << std::endl;
+
+	if (requested > DetectSimdLevel())
+	{
+		std::cout << "The CPU does not support " << SimdLevelName(requested) << ", skipping" << std::endl;
+		return TestUtils::SKIP_CODE;
+	}
+
+	if (GetSimdLevel() != requested)
+	{
+		std::cout << "Asked for " << SimdLevelName(requested) << " but got " << SimdLevelName(GetSimdLevel()) << std::endl;
+		return 1;
+	}
+
+	const SimdKernels& kernels = GetSimdKernels();
+
+	bool passed = true;
+	passed &= TestUtils::CheckTolerance("sigmoid", MaxElementwiseError(TestInputs(100.0f), kernels.sigmoid, SigmoidReference), SIGMOID_TOLERANCE);
+	passed &= TestUtils::CheckTolerance("tanh", MaxElementwiseError(TestInputs(50.0f), kernels.tanh, TanhReference), TANH_TOLERANCE);
+	passed &= TestUtils::CheckTolerance("softmax", MaxSoftmaxError(kernels), SOFTMAX_TOLERANCE);
+	passed &= TestUtils::CheckTolerance("gemm_int8", MaxGemmInt8Error(kernels), 0);
+
+	return TestUtils::Report(passed);
+}
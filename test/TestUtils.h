@@ -0,0 +1,160 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+// TestUtils.h : The setup shared by the tests, reading the arguments and the face images and reporting the result
+//
+// The tests return 0 when passed, 1 when failed and SKIP_CODE when what they need is not available
+
+#ifndef TEST_UTILS_H
+#define TEST_UTILS_H
+
+#include "LandmarkCoreIncludes.h"
+
+// OpenCV includes
+#include <opencv2/imgcodecs.hpp>
+
+// System includes
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace TestUtils
+{
+	// The ctest code for a skipped test (SKIP_RETURN_CODE in CMakeLists.txt)
+	static const int SKIP_CODE = 77;
+
+	inline std::vector<std::string> GetArguments(int argc, char** argv)
+	{
+		std::vector<std::string> arguments;
+		for (int i = 0; i < argc; ++i)
+		{
+			arguments.push_back(std::string(argv[i]));
+		}
+		return arguments;
+	}
+
+	// The images given with -f (can be repeated) and -flist (a file with one image per line)
+	inline std::vector<std::string> GetImageFiles(const std::vector<std::string>& arguments)
+	{
+		std::vector<std::string> image_files;
+		for (size_t i = 1; i + 1 < arguments.size(); ++i)
+		{
+			if (arguments[i].compare("-f") == 0)
+			{
+				image_files.push_back(arguments[i + 1]);
+			}
+			else if (arguments[i].compare("-flist") == 0)
+			{
+				std::ifstream list(arguments[i + 1]);
+				std::string image_file;
+				while (std::getline(list, image_file))
+				{
+					if (!image_file.empty())
+					{
+						image_files.push_back(image_file);
+					}
+				}
+			}
+		}
+		return image_files;
+	}
+
+	// The landmark detection model to use when none is given with -mloc
+	inline void SetDefaultModel(std::vector<std::string>& arguments, const std::string& model_location)
+	{
+		for (size_t i = 1; i < arguments.size(); ++i)
+		{
+			if (arguments[i].compare("-mloc") == 0)
+			{
+				return;
+			}
+		}
+		arguments.push_back("-mloc");
+		arguments.push_back(model_location);
+	}
+
+	// Reads every image and finds a face in it with the HOG detector, then calls process(image_file, frame, face_box) on it.
+	// The images without a face are reported and left out. Returns the number of faces processed, or -1 if an image could
+	// not be read or process returned false
+	template<typename Process>
+	int ForEachFace(const std::vector<std::string>& image_files, Process process)
+	{
+		dlib::frontal_face_detector face_detector_hog = dlib::get_frontal_face_detector();
+
+		int num_faces = 0;
+		for (const std::string& image_file : image_files)
+		{
+			cv::Mat image = cv::imread(image_file);
+			if (image.empty())
+			{
+				std::cout << "ERROR: Could not read the image " << image_file << std::endl;
+				return -1;
+			}
+
+			LandmarkDetector::FrameContext frame(image);
+
+			cv::Rect_<float> face_box;
+			float confidence;
+			if (!LandmarkDetector::DetectSingleFaceHOG(face_box, frame.Grayscale(), face_detector_hog, confidence))
+			{
+				std::cout << image_file << ": no face found, skipped" << std::endl;
+				continue;
+			}
+
+			if (!process(image_file, frame, face_box))
+			{
+				return -1;
+			}
+			num_faces++;
+		}
+		return num_faces;
+	}
+
+	// Reports an error against its tolerance
+	inline bool CheckTolerance(const std::string& name, double error, double tolerance)
+	{
+		bool passed = error <= tolerance;
+		std::cout << name << ": maximum absolute error " << error << " (tolerance " << tolerance << ") " << (passed ? "passed" : "FAILED") << std::endl;
+		return passed;
+	}
+
+	// Reports the result of a test, returning its exit code
+	inline int Report(bool passed)
+	{
+		std::cout << (passed ? "passed" : "FAILED") << std::endl;
+		return passed ? 0 : 1;
+	}
+}
+
+#endif // TEST_UTILS_H
@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2017, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// ACADEMIC OR NON-PROFIT ORGANIZATION NONCOMMERCIAL RESEARCH USE ONLY
+//
+// BY USING OR DOWNLOADING THE SOFTWARE, YOU ARE AGREEING TO THE TERMS OF THIS LICENSE AGREEMENT.  
+// IF YOU DO NOT AGREE WITH THESE TERMS, YOU MAY NOT USE OR DOWNLOAD THE SOFTWARE.
+//
+// License can be found in OpenFace-license.txt
+//
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace 2.0: Facial Behavior Analysis Toolkit
+//       Tadas Baltruaitis, Amir Zadeh, Yao Chong Lim, and Louis-Philippe Morency
+//       in IEEE International Conference on Automatic Face and Gesture Recognition, 2018  
+//
+//       Convolutional experts constrained local model for facial landmark detection.
+//       A. Zadeh, T. Baltruaitis, and Louis-Philippe Morency,
+//       in Computer Vision and Pattern Recognition Workshops, 2017.    
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-specific normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+///////////////////////////////////////////////////////////////////////////////
+// ThreadingPolicyTest.cpp : Checks that the parallel loops cover their ranges exactly once, also while the policy is changed from inside nested loops
+
+#include "TestUtils.h"
+#include "ThreadingPolicy.h"
+
+// System includes
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+	const int outer_size = 16;
+	const int inner_size = 16;
+	const int rounds = 200;
+
+	// The policy is available under the OpenFace namespace as well
+	OpenFace::ThreadingPolicy policy;
+	policy.num_threads = 4;
+	OpenFace::ThreadingPolicy::Apply(policy);
+
+	bool passed = true;
+	for (int round = 0; round < rounds; ++round)
+	{
+		std::vector<std::atomic<int> > visits(outer_size * inner_size);
+		for (size_t i = 0; i < visits.size(); ++i)
+		{
+			visits[i] = 0;
+		}
+
+		OpenFace::ParallelFor(cv::Range(0, outer_size), [&](const cv::Range& outer_range) {
+			for (int i = outer_range.start; i < outer_range.end; ++i)
+			{
+				OpenFace::ParallelFor(cv::Range(0, inner_size), [&](const cv::Range& inner_range) {
+					for (int j = inner_range.start; j < inner_range.end; ++j)
+					{
+						visits[i * inner_size + j]++;
+
+						// Replacing the worker pool while loops are still running on it, from whichever thread gets there
+						if (i == round % outer_size && j == 0)
+						{
+							OpenFace::ThreadingPolicy changed = OpenFace::ThreadingPolicy::Current();
+							changed.num_threads = 2 + round % 3;
+							OpenFace::ThreadingPolicy::Apply(changed);
+						}
+					}
+				});
+			}
+		});
+
+		for (size_t i = 0; i < visits.size(); ++i)
+		{
+			if (visits[i] != 1)
+			{
+				std::cout << "FAILED: iteration " << i << " of round " << round << " was run " << visits[i] << " times" << std::endl;
+				passed = false;
+			}
+		}
+	}
+
+	return TestUtils::Report(passed);
+}